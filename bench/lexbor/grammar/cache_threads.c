@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+/*
+ * Matching against one frozen grammar from 1 to N threads, each thread
+ * with its own VM: without a cache and with the shared cache.
+ *
+ * One line of JSON per run.
+ *
+ * Usage: cache_threads [max threads] [values per thread]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <lexbor/grammar/tokenizer.h>
+#include <lexbor/grammar/parser.h>
+#include <lexbor/grammar/tree.h>
+#include <lexbor/grammar/bytecode.h>
+#include <lexbor/grammar/frozen.h>
+#include <lexbor/grammar/vm.h>
+#include <lexbor/grammar/cache_shared.h>
+
+
+#define BENCH_SEED 0x2545F4914F6CDD1DULL
+
+
+typedef struct {
+    const char *declaration;
+    const char *value;
+}
+bench_value_t;
+
+typedef struct {
+    lxb_grammar_frozen_t       *frozen;
+    lxb_grammar_cache_shared_t *shared;
+    size_t                     *decls;
+    size_t                     count;
+    size_t                     index;
+    lxb_status_t               status;
+    size_t                     accepted;
+    pthread_t                  thread;
+}
+bench_thread_t;
+
+
+static const char bench_grammar[] =
+    "<margin> = [ <length-percentage> | auto ]{1,4}\n"
+    "<display> = [ block | inline | run-in ] || [ flow | flow-root | flex"
+    " | grid | table ] | none | contents\n"
+    "<color> = <hex-color> | red | green | blue | transparent"
+    " | currentcolor\n"
+    "<font-weight> = normal | bold | bolder | lighter | <number>\n"
+    "<transition> = [ <custom-ident> || <time> || <time> ]#\n";
+
+static const bench_value_t bench_values[] = {
+    {"display", "block"}, {"display", "inline flex"}, {"display", "none"},
+    {"display", "flow-root"}, {"display", "grid"}, {"display", "table"},
+    {"margin", "0"}, {"margin", "auto"}, {"margin", "0 auto"},
+    {"margin", "1px 2px 3px 4px"}, {"margin", "10%"}, {"margin", "1em 0"},
+    {"color", "#fff"}, {"color", "#000000"}, {"color", "red"},
+    {"color", "transparent"}, {"color", "#336699"}, {"color", "blue"},
+    {"font-weight", "bold"}, {"font-weight", "400"}, {"font-weight", "700"},
+    {"transition", "opacity 1s"}, {"transition", "all 0.3s 1s, color 2s"},
+    {"display", "blocks"}, {"margin", "1px 2px 3px 4px 5px"},
+    {"color", "#ffff0"}, {"font-weight", "heavy"}
+};
+
+#define BENCH_VALUES (sizeof(bench_values) / sizeof(bench_value_t))
+
+static size_t bench_decls[BENCH_VALUES];
+
+
+static lxb_grammar_frozen_t *
+bench_compile(void);
+
+static double
+bench_run(lxb_grammar_frozen_t *frozen, lxb_grammar_cache_shared_t *shared,
+          size_t threads, size_t count, size_t *accepted);
+
+static void *
+bench_thread(void *arg);
+
+static double
+bench_now(void);
+
+
+int
+main(int argc, const char *argv[])
+{
+    double time, base;
+    size_t max, count, accepted, threads;
+    lxb_status_t status;
+    lxb_grammar_frozen_t *frozen;
+    lxb_grammar_cache_shared_t *shared;
+
+    max = (argc > 1) ? strtoul(argv[1], NULL, 10) : 8;
+    count = (argc > 2) ? strtoul(argv[2], NULL, 10) : 200000;
+
+    if (max == 0 || count == 0) {
+        printf("Usage:\n\tcache_threads [max threads] [values per thread]\n");
+        return EXIT_FAILURE;
+    }
+
+    frozen = bench_compile();
+    if (frozen == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < BENCH_VALUES; i++) {
+        bench_decls[i] = (size_t) lxb_grammar_bytecode_declaration(
+                             lxb_grammar_frozen_bytecode(frozen),
+                             (const lxb_char_t *) bench_values[i].declaration,
+                             strlen(bench_values[i].declaration));
+    }
+
+    shared = lxb_grammar_cache_shared_create();
+    status = lxb_grammar_cache_shared_init(shared, 0, 0, 0);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    for (size_t mode = 0; mode < 2; mode++) {
+        base = 0;
+        threads = 1;
+
+        for (;;) {
+            lxb_grammar_cache_shared_clean(shared);
+
+            time = bench_run(frozen, (mode == 1) ? shared : NULL,
+                             threads, count, &accepted);
+            if (time < 0) {
+                return EXIT_FAILURE;
+            }
+
+            if (threads == 1) {
+                base = time;
+            }
+
+            printf("{\"bench\": \"cache_threads\", \"mode\": \"%s\", "
+                   "\"threads\": %zu, \"ops\": %zu, \"accepted\": %zu, "
+                   "\"seconds\": %.6f, \"ns_per_op\": %.1f, "
+                   "\"ops_per_sec\": %.0f, \"speedup\": %.2f}\n",
+                   (mode == 1) ? "shared" : "none", threads,
+                   threads * count, accepted, time,
+                   time * 1e9 / (double) count,
+                   (double) (threads * count) / time,
+                   base * (double) threads / time);
+
+            if (threads == max) {
+                break;
+            }
+
+            threads = (threads * 2 < max) ? threads * 2 : max;
+        }
+    }
+
+    lxb_grammar_cache_shared_destroy(shared, true);
+    lxb_grammar_frozen_destroy(frozen, true);
+
+    return EXIT_SUCCESS;
+}
+
+static lxb_grammar_frozen_t *
+bench_compile(void)
+{
+    lxb_status_t status;
+    lxb_grammar_frozen_t *frozen;
+    lxb_grammar_node_t *root;
+    lxb_grammar_tree_t *tree;
+    lxb_grammar_parser_t *parser;
+    lxb_grammar_document_t *document;
+    lxb_grammar_bytecode_t *bc;
+    lxb_grammar_tokenizer_t *tkz;
+
+    tkz = lxb_grammar_tokenizer_create();
+    status = lxb_grammar_tokenizer_init(tkz);
+    if (status != LXB_STATUS_OK) {
+        return NULL;
+    }
+
+    document = lxb_grammar_tokenizer_process(tkz,
+                                             (const lxb_char_t *) bench_grammar,
+                                             sizeof(bench_grammar) - 1);
+    if (document == NULL) {
+        return NULL;
+    }
+
+    parser = lxb_grammar_parser_create();
+    status = lxb_grammar_parser_init(parser);
+    if (status != LXB_STATUS_OK) {
+        return NULL;
+    }
+
+    root = lxb_grammar_parser_process(parser, document);
+    if (root == NULL) {
+        lxb_grammar_parser_print_last_error(parser);
+        return NULL;
+    }
+
+    tree = lxb_grammar_tree_create();
+    status = lxb_grammar_tree_init(tree, document);
+    if (status != LXB_STATUS_OK) {
+        return NULL;
+    }
+
+    status = lxb_grammar_tree_make(tree, root);
+    if (status != LXB_STATUS_OK) {
+        return NULL;
+    }
+
+    bc = lxb_grammar_bytecode_create();
+    status = lxb_grammar_bytecode_init(bc);
+    if (status != LXB_STATUS_OK) {
+        return NULL;
+    }
+
+    status = lxb_grammar_bytecode_make(bc, tree);
+    if (status != LXB_STATUS_OK) {
+        return NULL;
+    }
+
+    frozen = lxb_grammar_frozen_create();
+    status = lxb_grammar_frozen_init(frozen, bc);
+    if (status != LXB_STATUS_OK) {
+        return NULL;
+    }
+
+    /* The frozen grammar does not need the source anymore. */
+    lxb_grammar_bytecode_destroy(bc, true);
+    lxb_grammar_tree_destroy(tree, true);
+    lxb_grammar_document_destroy(document);
+    lxb_grammar_parser_destroy(parser, true);
+    lxb_grammar_tokenizer_destroy(tkz, true);
+
+    return frozen;
+}
+
+static double
+bench_run(lxb_grammar_frozen_t *frozen, lxb_grammar_cache_shared_t *shared,
+          size_t threads, size_t count, size_t *accepted)
+{
+    double begin;
+    bench_thread_t *list;
+
+    list = lexbor_calloc(threads, sizeof(bench_thread_t));
+    if (list == NULL) {
+        return -1;
+    }
+
+    begin = bench_now();
+
+    for (size_t i = 0; i < threads; i++) {
+        list[i].frozen = frozen;
+        list[i].shared = shared;
+        list[i].decls = bench_decls;
+        list[i].count = count;
+        list[i].index = i;
+
+        if (pthread_create(&list[i].thread, NULL, bench_thread, &list[i])) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    *accepted = 0;
+
+    for (size_t i = 0; i < threads; i++) {
+        pthread_join(list[i].thread, NULL);
+
+        if (list[i].status != LXB_STATUS_OK) {
+            exit(EXIT_FAILURE);
+        }
+
+        *accepted += list[i].accepted;
+    }
+
+    begin = bench_now() - begin;
+
+    lexbor_free(list);
+
+    return begin;
+}
+
+static void *
+bench_thread(void *arg)
+{
+    size_t idx;
+    uint64_t state;
+    lxb_grammar_vm_t *vm;
+    const bench_value_t *value;
+    bench_thread_t *ctx = arg;
+    lxb_grammar_match_result_t result;
+
+    vm = lxb_grammar_vm_create();
+    ctx->status = lxb_grammar_vm_init(vm,
+                                      lxb_grammar_frozen_bytecode(ctx->frozen));
+    if (ctx->status != LXB_STATUS_OK) {
+        return NULL;
+    }
+
+    vm->shared = ctx->shared;
+
+    /* Same sequence for every run, skewed to the first values. */
+    state = BENCH_SEED + ctx->index;
+
+    for (size_t i = 0; i < ctx->count; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        idx = (size_t) ((state % BENCH_VALUES) * (state % BENCH_VALUES)
+                        / BENCH_VALUES);
+        value = &bench_values[idx];
+
+        ctx->status = lxb_grammar_vm_match_declaration(vm, ctx->decls[idx],
+                                       (const lxb_char_t *) value->value,
+                                       strlen(value->value), &result);
+        if (ctx->status != LXB_STATUS_OK) {
+            break;
+        }
+
+        ctx->accepted += result.accepted;
+    }
+
+    lxb_grammar_vm_destroy(vm, true);
+
+    return NULL;
+}
+
+static double
+bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,778 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+/*
+ * Each stage of a grammar alone: tokenizer, parser, serialization of
+ * the AST, compilation to the bytecode and matching by the tree and by
+ * the VM.  Inputs from one declaration to a whole grammar file, and
+ * a generated grammar of default shape, see lexbor/grammar/synth.h.
+ *
+ * One line of JSON per stage and input.  Bytes, allocations and frees per
+ * operation are counted by the allocator of lexbor defined below: calls of
+ * lexbor_malloc(), lexbor_calloc() and lexbor_realloc() with the bytes
+ * asked, and calls of lexbor_free().  Only the stage itself is counted,
+ * not the preparation of its input nor the release of its result.
+ *
+ * Usage: stages [operations] [grammar file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <lexbor/core/fs.h>
+
+#include <lexbor/grammar/tokenizer.h>
+#include <lexbor/grammar/parser.h>
+#include <lexbor/grammar/tree.h>
+#include <lexbor/grammar/bytecode.h>
+#include <lexbor/grammar/match.h>
+#include <lexbor/grammar/vm.h>
+#include <lexbor/grammar/synth.h>
+
+
+/* Matching is fast, more operations for the same time. */
+#define BENCH_MATCH_FACTOR 100
+
+
+typedef struct {
+    const char *declaration;
+    const char *value;
+}
+bench_value_t;
+
+typedef struct {
+    const char          *name;
+    const lxb_char_t    *grammar;
+    size_t              length;
+
+    const bench_value_t *values;
+    size_t              count;
+}
+bench_input_t;
+
+typedef struct {
+    lxb_grammar_tokenizer_t *tkz;
+    lxb_grammar_parser_t    *parser;
+    lxb_grammar_document_t  *document;
+    lxb_grammar_node_t      *root;
+    lxb_grammar_tree_t      *tree;
+    lxb_grammar_bytecode_t  *bc;
+}
+bench_ctx_t;
+
+typedef struct {
+    size_t allocs;
+    size_t bytes;
+    size_t frees;
+}
+bench_heap_t;
+
+typedef struct {
+    double       seconds;
+    bench_heap_t heap;
+}
+bench_result_t;
+
+typedef struct {
+    lxb_char_t *data;
+    size_t     length;
+    size_t     size;
+}
+bench_buffer_t;
+
+typedef lxb_status_t
+(*bench_stage_f)(bench_ctx_t *ctx, const bench_input_t *input, size_t ops,
+                 bench_result_t *result);
+
+
+static const char bench_one[] =
+    "<color> = <hex-color> | red | green | blue | transparent"
+    " | currentcolor\n";
+
+static const bench_value_t bench_one_values[] = {
+    {"color", "#fff"}, {"color", "red"}, {"color", "currentcolor"},
+    {"color", "#ffff0"}, {"color", "none"}
+};
+
+static const char bench_small[] =
+    "<margin> = [ <length-percentage> | auto ]{1,4}\n"
+    "<display> = [ block | inline | run-in ] || [ flow | flow-root | flex"
+    " | grid | table ] | none | contents\n"
+    "<color> = <hex-color> | red | green | blue | transparent"
+    " | currentcolor\n"
+    "<font-weight> = normal | bold | bolder | lighter | <number>\n"
+    "<transition> = [ <custom-ident> || <time> || <time> ]#\n";
+
+static const bench_value_t bench_small_values[] = {
+    {"display", "block"}, {"display", "inline flex"}, {"display", "none"},
+    {"margin", "0 auto"}, {"margin", "1px 2px 3px 4px"},
+    {"color", "#336699"}, {"font-weight", "700"},
+    {"transition", "all 0.3s 1s, color 2s"},
+    {"display", "blocks"}, {"margin", "1px 2px 3px 4px 5px"}
+};
+
+static const char bench_css[] =
+    "<length-or-auto> = <length-percentage> | auto\n"
+    "<margin> = <length-or-auto>{1,4}\n"
+    "<padding> = <length-percentage>{1,4}\n"
+    "<width> = auto | <length-percentage> | min-content | max-content"
+    " | fit-content\n"
+    "<height> = <width>\n"
+    "<min-width> = <width>\n"
+    "<max-width> = none | <length-percentage> | min-content | max-content\n"
+    "<display> = [ block | inline | run-in ] || [ flow | flow-root | flex"
+    " | grid | table | ruby ] | none | contents | list-item\n"
+    "<position> = static | relative | absolute | sticky | fixed\n"
+    "<inset> = <length-or-auto>{1,4}\n"
+    "<float> = left | right | none | inline-start | inline-end\n"
+    "<clear> = none | left | right | both | inline-start | inline-end\n"
+    "<visibility> = visible | hidden | collapse\n"
+    "<overflow> = [ visible | hidden | clip | scroll | auto ]{1,2}\n"
+    "<z-index> = auto | <integer>\n"
+    "<opacity> = <number> | <percentage>\n"
+    "<color> = <hex-color> | red | green | blue | black | white | gray"
+    " | transparent | currentcolor\n"
+    "<line-style> = none | hidden | dotted | dashed | solid | double"
+    " | groove | ridge | inset | outset\n"
+    "<line-width> = <length> | thin | medium | thick\n"
+    "<border> = <line-width> || <line-style> || <color>\n"
+    "<border-radius> = <length-percentage>{1,4} [ / <length-percentage>{1,4}"
+    " ]?\n"
+    "<box-sizing> = content-box | border-box\n"
+    "<font-style> = normal | italic | oblique <angle>?\n"
+    "<font-weight> = normal | bold | bolder | lighter | <number>\n"
+    "<font-size> = xx-small | x-small | small | medium | large | x-large"
+    " | xx-large | larger | smaller | <length-percentage>\n"
+    "<font-family> = [ <string> | <custom-ident>+ ]#\n"
+    "<line-height> = normal | <number> | <length-percentage>\n"
+    "<font> = [ <font-style> || <font-weight> ]? <font-size>"
+    " [ / <line-height> ]? <font-family>\n"
+    "<text-align> = start | end | left | right | center | justify"
+    " | match-parent\n"
+    "<text-decoration> = [ underline || overline || line-through ]"
+    " || <line-style> || <color>\n"
+    "<white-space> = normal | pre | nowrap | pre-wrap | break-spaces"
+    " | pre-line\n"
+    "<flex-direction> = row | row-reverse | column | column-reverse\n"
+    "<flex-wrap> = nowrap | wrap | wrap-reverse\n"
+    "<flex-flow> = <flex-direction> || <flex-wrap>\n"
+    "<flex> = none | [ <number> <number>? || <width> ]\n"
+    "<justify-content> = normal | flex-start | flex-end | center"
+    " | space-between | space-around | space-evenly | stretch\n"
+    "<align-items> = normal | stretch | center | start | end | flex-start"
+    " | flex-end | baseline\n"
+    "<gap> = [ normal | <length-percentage> ]{1,2}\n"
+    "<grid-line> = auto | <custom-ident> | [ <integer> && <custom-ident>? ]"
+    " | [ span && [ <integer> || <custom-ident> ] ]\n"
+    "<grid-area> = <grid-line> [ / <grid-line> ]{0,3}\n"
+    "<track-size> = <length-percentage> | <flex> | min-content"
+    " | max-content | auto\n"
+    "<grid-template-columns> = none | <track-size>+\n"
+    "<transition> = [ none | <custom-ident> ] || <time> || <time>\n"
+    "<transitions> = <transition>#\n"
+    "<cursor> = [ <url> [ <number> <number> ]? , ]* [ auto | default"
+    " | pointer | text | move | wait | help | not-allowed ]\n"
+    "<content> = normal | none | [ <string> | <url> | open-quote"
+    " | close-quote ]+\n";
+
+static const bench_value_t bench_css_values[] = {
+    {"margin", "0 auto"}, {"padding", "1px 2px 3px 4px"},
+    {"display", "inline flex"}, {"display", "list-item"},
+    {"overflow", "hidden scroll"}, {"color", "#336699"},
+    {"border", "1px solid red"}, {"border", "dashed thick"},
+    {"border-radius", "1px 2px / 3px"}, {"font-weight", "700"},
+    {"font", "italic bold 12px / 1.5 serif"},
+    {"font-family", "\"Helvetica Neue\", Arial, sans-serif"},
+    {"text-decoration", "underline dotted red"},
+    {"flex", "1 1 auto"}, {"flex-flow", "column wrap"},
+    {"gap", "1em 2em"}, {"grid-area", "1 / span 2 / auto"},
+    {"transitions", "opacity 1s, transform 0.3s 1s"},
+    {"content", "open-quote \"x\" close-quote"},
+    {"display", "blocks"}, {"margin", "1px 2px 3px 4px 5px"},
+    {"font", "bold"}
+};
+
+#define BENCH_VALUES_COUNT(values) (sizeof(values) / sizeof(bench_value_t))
+
+
+/* Everything taken from the heap by lexbor and the grammar, see below. */
+static bench_heap_t bench_heap;
+
+
+static lxb_status_t
+bench_tokenizer_process(bench_ctx_t *ctx, const bench_input_t *input,
+                        size_t ops, bench_result_t *result);
+
+static lxb_status_t
+bench_parser_process(bench_ctx_t *ctx, const bench_input_t *input,
+                     size_t ops, bench_result_t *result);
+
+static lxb_status_t
+bench_node_serialize_deep(bench_ctx_t *ctx, const bench_input_t *input,
+                          size_t ops, bench_result_t *result);
+
+static lxb_status_t
+bench_compile(bench_ctx_t *ctx, const bench_input_t *input,
+              size_t ops, bench_result_t *result);
+
+static lxb_status_t
+bench_match(bench_ctx_t *ctx, const bench_input_t *input,
+            size_t ops, bench_result_t *result);
+
+static lxb_status_t
+bench_vm_match(bench_ctx_t *ctx, const bench_input_t *input,
+               size_t ops, bench_result_t *result);
+
+static lxb_status_t
+bench_prepare(bench_ctx_t *ctx, const bench_input_t *input, bool compile);
+
+static lxb_status_t
+bench_buffer_callback(const lxb_char_t *data, size_t len, void *ctx);
+
+static void
+bench_release(bench_ctx_t *ctx);
+
+static void
+bench_heap_add(bench_result_t *result, const bench_heap_t *begin);
+
+static void
+bench_print(const char *stage, const bench_input_t *input, size_t ops,
+            const bench_result_t *result);
+
+static double
+bench_now(void);
+
+
+static const struct {
+    const char    *name;
+    bench_stage_f func;
+    bool          match;
+}
+bench_stages[] = {
+    {"tokenizer_process", bench_tokenizer_process, false},
+    {"parser_process", bench_parser_process, false},
+    {"node_serialize_deep", bench_node_serialize_deep, false},
+    {"compile", bench_compile, false},
+    {"match", bench_match, true},
+    {"vm_match", bench_vm_match, true}
+};
+
+
+int
+main(int argc, const char *argv[])
+{
+    size_t ops, count, length, inputs_count;
+    lxb_status_t status;
+    bench_ctx_t ctx;
+    bench_result_t result;
+    lxb_char_t *file;
+    bench_buffer_t synth_text;
+    lxb_grammar_synth_t synth;
+    bench_input_t inputs[5];
+
+    ops = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000;
+
+    if (ops == 0) {
+        printf("Usage:\n\tstages [operations] [grammar file]\n");
+        return EXIT_FAILURE;
+    }
+
+    inputs[0] = (bench_input_t) {"one", (const lxb_char_t *) bench_one,
+                                 sizeof(bench_one) - 1, bench_one_values,
+                                 BENCH_VALUES_COUNT(bench_one_values)};
+
+    inputs[1] = (bench_input_t) {"small", (const lxb_char_t *) bench_small,
+                                 sizeof(bench_small) - 1, bench_small_values,
+                                 BENCH_VALUES_COUNT(bench_small_values)};
+
+    inputs[2] = (bench_input_t) {"css", (const lxb_char_t *) bench_css,
+                                 sizeof(bench_css) - 1, bench_css_values,
+                                 BENCH_VALUES_COUNT(bench_css_values)};
+
+    memset(&synth_text, 0, sizeof(bench_buffer_t));
+
+    lxb_grammar_synth_init(&synth);
+
+    status = lxb_grammar_synth_serialize(&synth, bench_buffer_callback,
+                                         &synth_text);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    inputs[3] = (bench_input_t) {"synth", synth_text.data, synth_text.length,
+                                 NULL, 0};
+
+    inputs_count = 4;
+    file = NULL;
+
+    if (argc > 2) {
+        file = lexbor_fs_file_easy_read((const lxb_char_t *) argv[2],
+                                        &length);
+        if (file == NULL) {
+            printf("Failed to read file: %s\n", argv[2]);
+            return EXIT_FAILURE;
+        }
+
+        inputs[4] = (bench_input_t) {"file", file, length, NULL, 0};
+        inputs_count = 5;
+    }
+
+    memset(&ctx, 0, sizeof(bench_ctx_t));
+
+    ctx.tkz = lxb_grammar_tokenizer_create();
+    status = lxb_grammar_tokenizer_init(ctx.tkz);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    ctx.parser = lxb_grammar_parser_create();
+    status = lxb_grammar_parser_init(ctx.parser);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < inputs_count; i++) {
+        for (size_t s = 0; s < sizeof(bench_stages) / sizeof(bench_stages[0]);
+             s++)
+        {
+            if (bench_stages[s].match && inputs[i].count == 0) {
+                continue;
+            }
+
+            count = (bench_stages[s].match) ? ops * BENCH_MATCH_FACTOR : ops;
+
+            memset(&result, 0, sizeof(bench_result_t));
+
+            status = bench_stages[s].func(&ctx, &inputs[i], count, &result);
+            if (status != LXB_STATUS_OK) {
+                printf("Failed: %s, %s\n", bench_stages[s].name,
+                       inputs[i].name);
+                return EXIT_FAILURE;
+            }
+
+            bench_print(bench_stages[s].name, &inputs[i], count, &result);
+        }
+    }
+
+    lxb_grammar_parser_destroy(ctx.parser, true);
+    lxb_grammar_tokenizer_destroy(ctx.tkz, true);
+
+    lexbor_free(synth_text.data);
+
+    if (file != NULL) {
+        lexbor_free(file);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static lxb_status_t
+bench_tokenizer_process(bench_ctx_t *ctx, const bench_input_t *input,
+                        size_t ops, bench_result_t *result)
+{
+    double begin;
+    bench_heap_t heap;
+
+    for (size_t i = 0; i < ops; i++) {
+        heap = bench_heap;
+        begin = bench_now();
+
+        ctx->document = lxb_grammar_tokenizer_process(ctx->tkz, input->grammar,
+                                                      input->length);
+
+        result->seconds += bench_now() - begin;
+        bench_heap_add(result, &heap);
+
+        if (ctx->document == NULL) {
+            return LXB_STATUS_ERROR;
+        }
+
+        bench_release(ctx);
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+bench_parser_process(bench_ctx_t *ctx, const bench_input_t *input,
+                     size_t ops, bench_result_t *result)
+{
+    double begin;
+    bench_heap_t heap;
+
+    for (size_t i = 0; i < ops; i++) {
+        ctx->document = lxb_grammar_tokenizer_process(ctx->tkz, input->grammar,
+                                                      input->length);
+        if (ctx->document == NULL) {
+            return LXB_STATUS_ERROR;
+        }
+
+        heap = bench_heap;
+        begin = bench_now();
+
+        ctx->root = lxb_grammar_parser_process(ctx->parser, ctx->document);
+
+        result->seconds += bench_now() - begin;
+        bench_heap_add(result, &heap);
+
+        if (ctx->root == NULL) {
+            lxb_grammar_parser_print_last_error(ctx->parser);
+            bench_release(ctx);
+
+            return LXB_STATUS_ERROR;
+        }
+
+        bench_release(ctx);
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+bench_serialize_callback(const lxb_char_t *data, size_t len, void *ctx)
+{
+    *(size_t *) ctx += len;
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+bench_node_serialize_deep(bench_ctx_t *ctx, const bench_input_t *input,
+                          size_t ops, bench_result_t *result)
+{
+    double begin;
+    size_t length;
+    lxb_status_t status;
+    bench_heap_t heap;
+
+    status = bench_prepare(ctx, input, false);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    length = 0;
+
+    heap = bench_heap;
+    begin = bench_now();
+
+    for (size_t i = 0; i < ops; i++) {
+        status = lxb_grammar_node_serialize_deep(ctx->root,
+                                                 bench_serialize_callback,
+                                                 &length);
+        if (status != LXB_STATUS_OK) {
+            break;
+        }
+    }
+
+    result->seconds = bench_now() - begin;
+    bench_heap_add(result, &heap);
+
+    bench_release(ctx);
+
+    return status;
+}
+
+static lxb_status_t
+bench_compile(bench_ctx_t *ctx, const bench_input_t *input,
+              size_t ops, bench_result_t *result)
+{
+    double begin;
+    lxb_status_t status;
+    bench_heap_t heap;
+
+    for (size_t i = 0; i < ops; i++) {
+        status = bench_prepare(ctx, input, false);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        heap = bench_heap;
+        begin = bench_now();
+
+        ctx->tree = lxb_grammar_tree_create();
+        status = lxb_grammar_tree_init(ctx->tree, ctx->document);
+        if (status == LXB_STATUS_OK) {
+            status = lxb_grammar_tree_make(ctx->tree, ctx->root);
+        }
+
+        if (status == LXB_STATUS_OK) {
+            ctx->bc = lxb_grammar_bytecode_create();
+            status = lxb_grammar_bytecode_init(ctx->bc);
+        }
+
+        if (status == LXB_STATUS_OK) {
+            status = lxb_grammar_bytecode_make(ctx->bc, ctx->tree);
+        }
+
+        result->seconds += bench_now() - begin;
+        bench_heap_add(result, &heap);
+
+        if (status != LXB_STATUS_OK) {
+            bench_release(ctx);
+            return status;
+        }
+
+        bench_release(ctx);
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+bench_match(bench_ctx_t *ctx, const bench_input_t *input,
+            size_t ops, bench_result_t *result)
+{
+    double begin;
+    lxb_status_t status;
+    lxb_grammar_match_t *match;
+    const bench_value_t *value;
+    lxb_grammar_match_result_t res;
+    bench_heap_t heap;
+
+    status = bench_prepare(ctx, input, true);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    match = lxb_grammar_match_create();
+    status = lxb_grammar_match_init(match, ctx->tree);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    heap = bench_heap;
+    begin = bench_now();
+
+    for (size_t i = 0; i < ops; i++) {
+        value = &input->values[i % input->count];
+
+        status = lxb_grammar_match(match,
+                                   (const lxb_char_t *) value->declaration,
+                                   strlen(value->declaration),
+                                   (const lxb_char_t *) value->value,
+                                   strlen(value->value), &res);
+        if (status != LXB_STATUS_OK) {
+            break;
+        }
+    }
+
+    result->seconds = bench_now() - begin;
+    bench_heap_add(result, &heap);
+
+done:
+
+    lxb_grammar_match_destroy(match, true);
+    bench_release(ctx);
+
+    return status;
+}
+
+static lxb_status_t
+bench_vm_match(bench_ctx_t *ctx, const bench_input_t *input,
+               size_t ops, bench_result_t *result)
+{
+    double begin;
+    lxb_status_t status;
+    lxb_grammar_vm_t *vm;
+    const bench_value_t *value;
+    lxb_grammar_match_result_t res;
+    bench_heap_t heap;
+
+    status = bench_prepare(ctx, input, true);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    vm = lxb_grammar_vm_create();
+    status = lxb_grammar_vm_init(vm, ctx->bc);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    heap = bench_heap;
+    begin = bench_now();
+
+    for (size_t i = 0; i < ops; i++) {
+        value = &input->values[i % input->count];
+
+        status = lxb_grammar_vm_match(vm,
+                                      (const lxb_char_t *) value->declaration,
+                                      strlen(value->declaration),
+                                      (const lxb_char_t *) value->value,
+                                      strlen(value->value), &res);
+        if (status != LXB_STATUS_OK) {
+            break;
+        }
+    }
+
+    result->seconds = bench_now() - begin;
+    bench_heap_add(result, &heap);
+
+done:
+
+    lxb_grammar_vm_destroy(vm, true);
+    bench_release(ctx);
+
+    return status;
+}
+
+/* The document and the AST, with the tree and the bytecode if compile. */
+static lxb_status_t
+bench_prepare(bench_ctx_t *ctx, const bench_input_t *input, bool compile)
+{
+    lxb_status_t status;
+
+    ctx->document = lxb_grammar_tokenizer_process(ctx->tkz, input->grammar,
+                                                  input->length);
+    if (ctx->document == NULL) {
+        return LXB_STATUS_ERROR;
+    }
+
+    ctx->root = lxb_grammar_parser_process(ctx->parser, ctx->document);
+    if (ctx->root == NULL) {
+        lxb_grammar_parser_print_last_error(ctx->parser);
+        bench_release(ctx);
+
+        return LXB_STATUS_ERROR;
+    }
+
+    if (!compile) {
+        return LXB_STATUS_OK;
+    }
+
+    ctx->tree = lxb_grammar_tree_create();
+    status = lxb_grammar_tree_init(ctx->tree, ctx->document);
+    if (status == LXB_STATUS_OK) {
+        status = lxb_grammar_tree_make(ctx->tree, ctx->root);
+    }
+
+    if (status == LXB_STATUS_OK) {
+        ctx->bc = lxb_grammar_bytecode_create();
+        status = lxb_grammar_bytecode_init(ctx->bc);
+    }
+
+    if (status == LXB_STATUS_OK) {
+        status = lxb_grammar_bytecode_make(ctx->bc, ctx->tree);
+    }
+
+    if (status != LXB_STATUS_OK) {
+        bench_release(ctx);
+    }
+
+    return status;
+}
+
+static lxb_status_t
+bench_buffer_callback(const lxb_char_t *data, size_t len, void *ctx)
+{
+    lxb_char_t *tmp;
+    bench_buffer_t *buf = ctx;
+
+    if (buf->length + len > buf->size) {
+        buf->size = (buf->length + len) * 2;
+
+        tmp = lexbor_realloc(buf->data, buf->size);
+        if (tmp == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        buf->data = tmp;
+    }
+
+    memcpy(buf->data + buf->length, data, len);
+    buf->length += len;
+
+    return LXB_STATUS_OK;
+}
+
+static void
+bench_heap_add(bench_result_t *result, const bench_heap_t *begin)
+{
+    result->heap.allocs += bench_heap.allocs - begin->allocs;
+    result->heap.bytes += bench_heap.bytes - begin->bytes;
+    result->heap.frees += bench_heap.frees - begin->frees;
+}
+
+static void
+bench_release(bench_ctx_t *ctx)
+{
+    ctx->bc = lxb_grammar_bytecode_destroy(ctx->bc, true);
+    ctx->tree = lxb_grammar_tree_destroy(ctx->tree, true);
+    ctx->document = lxb_grammar_document_destroy(ctx->document);
+    ctx->root = NULL;
+}
+
+static void
+bench_print(const char *stage, const bench_input_t *input, size_t ops,
+            const bench_result_t *result)
+{
+    printf("{\"bench\": \"stages\", \"stage\": \"%s\", \"input\": \"%s\", "
+           "\"input_bytes\": %zu, \"ops\": %zu, \"seconds\": %.6f, "
+           "\"ns_per_op\": %.1f, ",
+           stage, input->name, input->length, ops, result->seconds,
+           result->seconds * 1e9 / (double) ops);
+
+    printf("\"bytes_per_op\": %.1f, \"allocs_per_op\": %.1f, "
+           "\"frees_per_op\": %.1f}\n",
+           (double) result->heap.bytes / (double) ops,
+           (double) result->heap.allocs / (double) ops,
+           (double) result->heap.frees / (double) ops);
+}
+
+static double
+bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/*
+ * The allocator of lexbor for this binary.  Calls of the shared libraries
+ * are bound to these definitions by the dynamic linker, the port of lexbor
+ * is malloc() and free() too, so a block is freed by either.
+ */
+void *
+lexbor_malloc(size_t size)
+{
+    bench_heap.allocs++;
+    bench_heap.bytes += size;
+
+    return malloc(size);
+}
+
+void *
+lexbor_calloc(size_t num, size_t size)
+{
+    bench_heap.allocs++;
+    bench_heap.bytes += num * size;
+
+    return calloc(num, size);
+}
+
+void *
+lexbor_realloc(void *dst, size_t size)
+{
+    bench_heap.allocs++;
+    bench_heap.bytes += size;
+
+    return realloc(dst, size);
+}
+
+void *
+lexbor_free(void *dst)
+{
+    if (dst != NULL) {
+        bench_heap.frees++;
+    }
+
+    free(dst);
+
+    return NULL;
+}
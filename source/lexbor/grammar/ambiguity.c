@@ -0,0 +1,919 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/ambiguity.h"
+#include "lexbor/grammar/tokenizer.h"
+#include "lexbor/grammar/token.h"
+#include "lexbor/grammar/memory.h"
+
+#include "lexbor/core/conv.h"
+
+
+#define lxb_grammar_ambiguity_send(data, len)                                  \
+    do {                                                                       \
+        status = func((const lxb_char_t *) (data), (len), ctx);                \
+        if (status != LXB_STATUS_OK) {                                         \
+            return status;                                                     \
+        }                                                                      \
+    }                                                                          \
+    while (0)
+
+
+static bool
+lxb_grammar_ambiguity_follow(lxb_grammar_ambiguity_t *amb,
+                             lxb_grammar_node_t *node);
+
+static lxb_status_t
+lxb_grammar_ambiguity_check(lxb_grammar_ambiguity_t *amb,
+                            lxb_grammar_node_t *decl, lxb_grammar_node_t *node);
+
+static lxb_status_t
+lxb_grammar_ambiguity_recursion(lxb_grammar_ambiguity_t *amb,
+                                lxb_grammar_node_t *decl, bool *visited);
+
+static void
+lxb_grammar_ambiguity_determine(lxb_grammar_ambiguity_t *amb,
+                                lxb_grammar_node_t *root);
+
+
+lxb_grammar_ambiguity_t *
+lxb_grammar_ambiguity_create(void)
+{
+    return lexbor_calloc(1, sizeof(lxb_grammar_ambiguity_t));
+}
+
+lxb_status_t
+lxb_grammar_ambiguity_init(lxb_grammar_ambiguity_t *amb,
+                           lxb_grammar_tree_t *tree)
+{
+    bool changed, *visited;
+    size_t words;
+    lxb_status_t status;
+    lxb_grammar_node_t *root, *node;
+
+    if (amb == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    status = lxb_grammar_first_init(&amb->first, tree);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    amb->tree = tree;
+    words = amb->first.words;
+
+    amb->follow = lexbor_calloc(amb->first.length * words * 2,
+                                sizeof(uint64_t));
+    if (amb->follow == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    amb->inner = amb->follow + amb->first.length * words;
+
+    amb->deterministic = lexbor_calloc(amb->first.length * 2, sizeof(bool));
+    if (amb->deterministic == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    amb->backtracking = amb->deterministic + amb->first.length;
+
+    status = lexbor_array_obj_init(&amb->conflicts, 16,
+                                   sizeof(lxb_grammar_ambiguity_conflict_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    root = tree->nodes->list[0];
+
+    /* Any declaration can be matched alone, up to the end of the value. */
+    for (node = root->first_child; node != NULL; node = node->next) {
+        amb->follow[node->id * words] |= (uint64_t) 1 << LXB_GRAMMAR_FIRST_END;
+    }
+
+    do {
+        changed = false;
+
+        for (node = root->first_child; node != NULL; node = node->next) {
+            changed |= lxb_grammar_ambiguity_follow(amb, node);
+        }
+    }
+    while (changed);
+
+    visited = lexbor_malloc(amb->first.length * sizeof(bool));
+    if (visited == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    for (node = root->first_child; node != NULL; node = node->next) {
+        status = lxb_grammar_ambiguity_check(amb, node, node);
+        if (status != LXB_STATUS_OK) {
+            goto done;
+        }
+
+        status = lxb_grammar_ambiguity_recursion(amb, node, visited);
+        if (status != LXB_STATUS_OK) {
+            goto done;
+        }
+    }
+
+    lxb_grammar_ambiguity_determine(amb, root);
+
+done:
+
+    lexbor_free(visited);
+
+    return status;
+}
+
+lxb_grammar_ambiguity_t *
+lxb_grammar_ambiguity_destroy(lxb_grammar_ambiguity_t *amb,
+                              bool self_destroy)
+{
+    if (amb == NULL) {
+        return NULL;
+    }
+
+    lxb_grammar_first_destroy(&amb->first, false);
+    lexbor_array_obj_destroy(&amb->conflicts, false);
+
+    if (amb->follow != NULL) {
+        amb->follow = lexbor_free(amb->follow);
+        amb->inner = NULL;
+    }
+
+    if (amb->deterministic != NULL) {
+        amb->deterministic = lexbor_free(amb->deterministic);
+        amb->backtracking = NULL;
+    }
+
+    if (self_destroy) {
+        return lexbor_free(amb);
+    }
+
+    return amb;
+}
+
+lxb_inline uint64_t *
+lxb_grammar_ambiguity_set(lxb_grammar_ambiguity_t *amb, uint64_t *sets,
+                          const lxb_grammar_node_t *node)
+{
+    return sets + node->id * amb->first.words;
+}
+
+static bool
+lxb_grammar_ambiguity_union(lxb_grammar_ambiguity_t *amb, uint64_t *dst,
+                            const uint64_t *src)
+{
+    uint64_t word;
+    bool changed = false;
+
+    for (size_t i = 0; i < amb->first.words; i++) {
+        word = dst[i] | src[i];
+
+        if (word != dst[i]) {
+            dst[i] = word;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+/* Any identifier overlaps every keyword. */
+static bool
+lxb_grammar_ambiguity_overlap(lxb_grammar_ambiguity_t *amb,
+                              const uint64_t *first, const uint64_t *second)
+{
+    uint64_t mask, kw_first, kw_second;
+
+    kw_first = 0;
+    kw_second = 0;
+
+    mask = ~(((uint64_t) 1 << LXB_GRAMMAR_FIRST_KEYWORD) - 1);
+
+    for (size_t i = 0; i < amb->first.words; i++) {
+        if ((first[i] & second[i]) != 0) {
+            return true;
+        }
+
+        kw_first |= first[i] & mask;
+        kw_second |= second[i] & mask;
+
+        mask = UINT64_MAX;
+    }
+
+    return (kw_second != 0
+            && lxb_grammar_first_has(first, LXB_GRAMMAR_VALUE_IDENT))
+        || (kw_first != 0
+            && lxb_grammar_first_has(second, LXB_GRAMMAR_VALUE_IDENT));
+}
+
+/*
+ * FOLLOW sets: tokens which can come after the node.  "inner" is what
+ * comes after one repetition: the next one or FOLLOW of the node.
+ */
+static bool
+lxb_grammar_ambiguity_follow(lxb_grammar_ambiguity_t *amb,
+                             lxb_grammar_node_t *node)
+{
+    bool changed;
+    uint64_t *follow, *inner, *set, bit;
+    lxb_grammar_node_t *child, *sibling;
+
+    follow = lxb_grammar_ambiguity_set(amb, amb->follow, node);
+    inner = lxb_grammar_ambiguity_set(amb, amb->inner, node);
+
+    changed = lxb_grammar_ambiguity_union(amb, inner, follow);
+
+    if (lxb_grammar_node_repeat_max(node) != 1) {
+        if (node->is_comma_separated) {
+            bit = (uint64_t) 1 << LXB_GRAMMAR_VALUE_DELIM;
+
+            changed |= (inner[0] & bit) == 0;
+            inner[0] |= bit;
+        }
+        else {
+            changed |= lxb_grammar_ambiguity_union(amb, inner,
+                                  lxb_grammar_first_set(&amb->first, node));
+        }
+    }
+
+    switch (node->type) {
+        case LXB_GRAMMAR_NODE_GROUP:
+        case LXB_GRAMMAR_NODE_DECLARATION:
+            switch (node->combinator) {
+                case LXB_GRAMMAR_COMBINATOR_ONE_OF:
+                    for (child = node->first_child; child != NULL;
+                         child = child->next)
+                    {
+                        set = lxb_grammar_ambiguity_set(amb, amb->follow, child);
+                        changed |= lxb_grammar_ambiguity_union(amb, set, inner);
+                    }
+
+                    break;
+
+                /* Any other child can come next, in any order. */
+                case LXB_GRAMMAR_COMBINATOR_AND:
+                case LXB_GRAMMAR_COMBINATOR_OR:
+                    for (child = node->first_child; child != NULL;
+                         child = child->next)
+                    {
+                        set = lxb_grammar_ambiguity_set(amb, amb->follow, child);
+                        changed |= lxb_grammar_ambiguity_union(amb, set, inner);
+
+                        for (sibling = node->first_child; sibling != NULL;
+                             sibling = sibling->next)
+                        {
+                            if (sibling != child) {
+                                changed |= lxb_grammar_ambiguity_union(amb, set,
+                                      lxb_grammar_first_set(&amb->first, sibling));
+                            }
+                        }
+                    }
+
+                    break;
+
+                /* From the end, FOLLOW of the next child is ready. */
+                default:
+                    for (child = node->last_child; child != NULL;
+                         child = child->prev)
+                    {
+                        set = lxb_grammar_ambiguity_set(amb, amb->follow, child);
+
+                        if (child->next == NULL) {
+                            changed |= lxb_grammar_ambiguity_union(amb, set,
+                                                                   inner);
+                            continue;
+                        }
+
+                        changed |= lxb_grammar_ambiguity_union(amb, set,
+                                   lxb_grammar_first_set(&amb->first,
+                                                         child->next));
+
+                        if (lxb_grammar_first_is_nullable(&amb->first,
+                                                          child->next))
+                        {
+                            changed |= lxb_grammar_ambiguity_union(amb, set,
+                                       lxb_grammar_ambiguity_set(amb,
+                                                   amb->follow, child->next));
+                        }
+                    }
+
+                    break;
+            }
+
+            for (child = node->first_child; child != NULL; child = child->next) {
+                changed |= lxb_grammar_ambiguity_follow(amb, child);
+            }
+
+            break;
+
+        case LXB_GRAMMAR_NODE_ELEMENT:
+            if (node->bst_declaration != NULL) {
+                set = lxb_grammar_ambiguity_set(amb, amb->follow,
+                                                node->bst_declaration->value);
+                changed |= lxb_grammar_ambiguity_union(amb, set, inner);
+            }
+
+            break;
+
+        default:
+            break;
+    }
+
+    return changed;
+}
+
+static lxb_status_t
+lxb_grammar_ambiguity_append(lxb_grammar_ambiguity_t *amb,
+                             lxb_grammar_ambiguity_type_t type,
+                             lxb_grammar_node_t *decl, lxb_grammar_node_t *node,
+                             lxb_grammar_node_t *first,
+                             lxb_grammar_node_t *second)
+{
+    lxb_grammar_ambiguity_conflict_t *conflict;
+
+    conflict = lexbor_array_obj_push(&amb->conflicts);
+    if (conflict == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    conflict->type = type;
+    conflict->decl = decl;
+    conflict->node = node;
+    conflict->first = first;
+    conflict->second = second;
+
+    return LXB_STATUS_OK;
+}
+
+/* Nullability without the own multiplier of the node. */
+static bool
+lxb_grammar_ambiguity_content_nullable(lxb_grammar_ambiguity_t *amb,
+                                       lxb_grammar_node_t *node)
+{
+    bool nullable;
+    lxb_grammar_node_t *child;
+
+    switch (node->type) {
+        case LXB_GRAMMAR_NODE_GROUP:
+        case LXB_GRAMMAR_NODE_DECLARATION:
+            if (node->combinator == LXB_GRAMMAR_COMBINATOR_ONE_OF
+                || node->combinator == LXB_GRAMMAR_COMBINATOR_OR)
+            {
+                nullable = (node->first_child == NULL);
+
+                for (child = node->first_child; child != NULL;
+                     child = child->next)
+                {
+                    nullable |= lxb_grammar_first_is_nullable(&amb->first,
+                                                              child);
+                }
+
+                return nullable;
+            }
+
+            for (child = node->first_child; child != NULL; child = child->next) {
+                if (!lxb_grammar_first_is_nullable(&amb->first, child)) {
+                    return false;
+                }
+            }
+
+            return true;
+
+        case LXB_GRAMMAR_NODE_ELEMENT:
+            return node->bst_declaration != NULL
+                   && lxb_grammar_first_is_nullable(&amb->first,
+                                                 node->bst_declaration->value);
+
+        default:
+            return false;
+    }
+}
+
+/* Choice between one more repetition of the node and what follows it. */
+static lxb_status_t
+lxb_grammar_ambiguity_check_repeat(lxb_grammar_ambiguity_t *amb,
+                                   lxb_grammar_node_t *decl,
+                                   lxb_grammar_node_t *node)
+{
+    long min, max;
+    const uint64_t *first, *follow;
+    lxb_grammar_ambiguity_type_t type;
+
+    min = lxb_grammar_node_repeat_min(node);
+    max = lxb_grammar_node_repeat_max(node);
+
+    if (min == max || lxb_grammar_node_is_required(node)) {
+        return LXB_STATUS_OK;
+    }
+
+    if (lxb_grammar_ambiguity_content_nullable(amb, node)) {
+        return lxb_grammar_ambiguity_append(amb, LXB_GRAMMAR_AMBIGUITY_EMPTY,
+                                            decl, node, node, NULL);
+    }
+
+    first = lxb_grammar_first_set(&amb->first, node);
+    follow = lxb_grammar_ambiguity_set(amb, amb->follow, node);
+    type = (max == 1) ? LXB_GRAMMAR_AMBIGUITY_FOLLOW
+                      : LXB_GRAMMAR_AMBIGUITY_REPEAT;
+
+    if (min == 0 && lxb_grammar_ambiguity_overlap(amb, first, follow)) {
+        return lxb_grammar_ambiguity_append(amb, type, decl, node, node, NULL);
+    }
+
+    if (max == 1) {
+        return LXB_STATUS_OK;
+    }
+
+    if (node->is_comma_separated) {
+        if (!lxb_grammar_first_has(follow, LXB_GRAMMAR_VALUE_DELIM)) {
+            return LXB_STATUS_OK;
+        }
+    }
+    else if (!lxb_grammar_ambiguity_overlap(amb, first, follow)) {
+        return LXB_STATUS_OK;
+    }
+
+    return lxb_grammar_ambiguity_append(amb, type, decl, node, node, NULL);
+}
+
+static lxb_status_t
+lxb_grammar_ambiguity_check_choice(lxb_grammar_ambiguity_t *amb,
+                                   lxb_grammar_node_t *decl,
+                                   lxb_grammar_node_t *node)
+{
+    bool any_order;
+    lxb_status_t status;
+    const uint64_t *first, *second;
+    lxb_grammar_node_t *child, *other;
+    lxb_grammar_first_t *fst = &amb->first;
+
+    any_order = (node->combinator != LXB_GRAMMAR_COMBINATOR_ONE_OF);
+
+    for (child = node->first_child; child != NULL; child = child->next) {
+        first = lxb_grammar_first_set(fst, child);
+
+        /* An empty child of && and || matches before or after any other. */
+        if (any_order && lxb_grammar_first_is_nullable(fst, child)
+            && node->first_child != node->last_child)
+        {
+            status = lxb_grammar_ambiguity_append(amb,
+                                                  LXB_GRAMMAR_AMBIGUITY_EMPTY,
+                                                  decl, node, child, NULL);
+            if (status != LXB_STATUS_OK) {
+                return status;
+            }
+        }
+
+        /* The || group can stop before any child. */
+        if (node->combinator == LXB_GRAMMAR_COMBINATOR_OR
+            && lxb_grammar_ambiguity_overlap(amb, first,
+                                             lxb_grammar_ambiguity_set(amb,
+                                                           amb->inner, node)))
+        {
+            status = lxb_grammar_ambiguity_append(amb,
+                                                  LXB_GRAMMAR_AMBIGUITY_FOLLOW,
+                                                  decl, node, child, NULL);
+            if (status != LXB_STATUS_OK) {
+                return status;
+            }
+        }
+
+        for (other = child->next; other != NULL; other = other->next) {
+            second = lxb_grammar_first_set(fst, other);
+
+            if (lxb_grammar_ambiguity_overlap(amb, first, second)) {
+                status = lxb_grammar_ambiguity_append(amb,
+                                             LXB_GRAMMAR_AMBIGUITY_ALTERNATIVES,
+                                             decl, node, child, other);
+            }
+            else if (any_order) {
+                continue;
+            }
+            else if (lxb_grammar_first_is_nullable(fst, child)
+                     && lxb_grammar_first_is_nullable(fst, other))
+            {
+                status = lxb_grammar_ambiguity_append(amb,
+                                                  LXB_GRAMMAR_AMBIGUITY_EMPTY,
+                                                  decl, node, child, other);
+            }
+            else if (lxb_grammar_first_is_nullable(fst, child)
+                     && lxb_grammar_ambiguity_overlap(amb, second,
+                              lxb_grammar_ambiguity_set(amb, amb->follow, child)))
+            {
+                status = lxb_grammar_ambiguity_append(amb,
+                                                  LXB_GRAMMAR_AMBIGUITY_FOLLOW,
+                                                  decl, node, child, other);
+            }
+            else if (lxb_grammar_first_is_nullable(fst, other)
+                     && lxb_grammar_ambiguity_overlap(amb, first,
+                              lxb_grammar_ambiguity_set(amb, amb->follow, other)))
+            {
+                status = lxb_grammar_ambiguity_append(amb,
+                                                  LXB_GRAMMAR_AMBIGUITY_FOLLOW,
+                                                  decl, node, other, child);
+            }
+            else {
+                continue;
+            }
+
+            if (status != LXB_STATUS_OK) {
+                return status;
+            }
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_ambiguity_check(lxb_grammar_ambiguity_t *amb,
+                            lxb_grammar_node_t *decl, lxb_grammar_node_t *node)
+{
+    lxb_status_t status;
+    lxb_grammar_node_t *child;
+
+    status = lxb_grammar_ambiguity_check_repeat(amb, decl, node);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    if (node->type != LXB_GRAMMAR_NODE_GROUP
+        && node->type != LXB_GRAMMAR_NODE_DECLARATION)
+    {
+        return LXB_STATUS_OK;
+    }
+
+    if (node->combinator != LXB_GRAMMAR_COMBINATOR_NORMAL) {
+        status = lxb_grammar_ambiguity_check_choice(amb, decl, node);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+    }
+
+    for (child = node->first_child; child != NULL; child = child->next) {
+        status = lxb_grammar_ambiguity_check(amb, decl, child);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+/*
+ * Returns the reference in the first declaration through which the target
+ * is reached at the beginning of the node, or NULL.
+ */
+static lxb_grammar_node_t *
+lxb_grammar_ambiguity_leftmost(lxb_grammar_ambiguity_t *amb,
+                               lxb_grammar_node_t *node,
+                               lxb_grammar_node_t *target,
+                               lxb_grammar_node_t *via, bool *visited)
+{
+    lxb_grammar_node_t *child, *decl, *found;
+
+    switch (node->type) {
+        case LXB_GRAMMAR_NODE_GROUP:
+        case LXB_GRAMMAR_NODE_DECLARATION:
+            for (child = node->first_child; child != NULL; child = child->next) {
+                found = lxb_grammar_ambiguity_leftmost(amb, child, target,
+                                                       via, visited);
+                if (found != NULL) {
+                    return found;
+                }
+
+                if (node->combinator == LXB_GRAMMAR_COMBINATOR_NORMAL
+                    && !lxb_grammar_first_is_nullable(&amb->first, child))
+                {
+                    break;
+                }
+            }
+
+            return NULL;
+
+        case LXB_GRAMMAR_NODE_ELEMENT:
+            if (node->bst_declaration == NULL) {
+                return NULL;
+            }
+
+            decl = node->bst_declaration->value;
+
+            if (via == NULL) {
+                via = node;
+            }
+
+            if (decl == target) {
+                return via;
+            }
+
+            if (visited[decl->id]) {
+                return NULL;
+            }
+
+            visited[decl->id] = true;
+
+            return lxb_grammar_ambiguity_leftmost(amb, decl, target,
+                                                  via, visited);
+
+        default:
+            return NULL;
+    }
+}
+
+static lxb_status_t
+lxb_grammar_ambiguity_recursion(lxb_grammar_ambiguity_t *amb,
+                                lxb_grammar_node_t *decl, bool *visited)
+{
+    lxb_grammar_node_t *via;
+
+    memset(visited, 0, amb->first.length * sizeof(bool));
+
+    via = lxb_grammar_ambiguity_leftmost(amb, decl, decl, NULL, visited);
+    if (via == NULL) {
+        return LXB_STATUS_OK;
+    }
+
+    return lxb_grammar_ambiguity_append(amb,
+                                        LXB_GRAMMAR_AMBIGUITY_LEFT_RECURSION,
+                                        decl, decl, via, NULL);
+}
+
+static bool
+lxb_grammar_ambiguity_depends(lxb_grammar_ambiguity_t *amb,
+                              lxb_grammar_node_t *node)
+{
+    lxb_grammar_node_t *child, *decl;
+
+    if (node->type == LXB_GRAMMAR_NODE_ELEMENT) {
+        if (node->bst_declaration == NULL) {
+            return false;
+        }
+
+        decl = node->bst_declaration->value;
+
+        return !amb->deterministic[decl->id];
+    }
+
+    for (child = node->first_child; child != NULL; child = child->next) {
+        if (lxb_grammar_ambiguity_depends(amb, child)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+lxb_grammar_ambiguity_references(lxb_grammar_ambiguity_t *amb,
+                                 lxb_grammar_node_t *node)
+{
+    lxb_grammar_node_t *child;
+
+    if (node->type == LXB_GRAMMAR_NODE_ELEMENT) {
+        if (node->bst_declaration != NULL) {
+            child = node->bst_declaration->value;
+            amb->backtracking[child->id] = true;
+        }
+
+        return;
+    }
+
+    for (child = node->first_child; child != NULL; child = child->next) {
+        lxb_grammar_ambiguity_references(amb, child);
+    }
+}
+
+static void
+lxb_grammar_ambiguity_determine(lxb_grammar_ambiguity_t *amb,
+                                lxb_grammar_node_t *root)
+{
+    bool changed;
+    lxb_grammar_node_t *node;
+    lxb_grammar_ambiguity_conflict_t *conflict;
+
+    for (node = root->first_child; node != NULL; node = node->next) {
+        amb->deterministic[node->id] = true;
+    }
+
+    for (size_t i = 0; i < amb->conflicts.length; i++) {
+        conflict = lexbor_array_obj_get(&amb->conflicts, i);
+
+        amb->deterministic[conflict->decl->id] = false;
+    }
+
+    do {
+        changed = false;
+
+        for (node = root->first_child; node != NULL; node = node->next) {
+            if (amb->deterministic[node->id]
+                && lxb_grammar_ambiguity_depends(amb, node))
+            {
+                amb->deterministic[node->id] = false;
+                changed = true;
+            }
+        }
+    }
+    while (changed);
+
+    for (node = root->first_child; node != NULL; node = node->next) {
+        if (!amb->deterministic[node->id]) {
+            amb->backtracking[node->id] = true;
+
+            lxb_grammar_ambiguity_references(amb, node);
+        }
+    }
+}
+
+size_t
+lxb_grammar_ambiguity_line(lxb_grammar_ambiguity_t *amb,
+                           lxb_grammar_node_t *node)
+{
+    size_t line;
+    lexbor_array_t *tokens;
+    lxb_grammar_token_t *token;
+
+    while (node != NULL && node->token == NULL) {
+        node = node->first_child;
+    }
+
+    if (node == NULL || amb->tree->document == NULL) {
+        return 0;
+    }
+
+    tokens = lxb_grammar_tokenizer_tokens(amb->tree->document);
+    if (tokens == NULL) {
+        return 0;
+    }
+
+    line = 1;
+
+    for (size_t i = 0; i < tokens->length; i++) {
+        token = tokens->list[i];
+
+        if (token == node->token) {
+            return line;
+        }
+
+        if (token->type != LXB_GRAMMAR_TOKEN_WHITESPACE
+            || (token->flags & LXB_GRAMMAR_TOKEN_FLAGS_NEWLINE) == 0)
+        {
+            continue;
+        }
+
+        for (size_t n = 0; n < token->u.str.length; n++) {
+            if (token->u.str.data[n] == '\n') {
+                line++;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Sets, flags and conflicts, with the visited flags of the init. */
+static size_t
+lxb_grammar_ambiguity_memory(const lxb_grammar_ambiguity_t *amb)
+{
+    size_t length = amb->first.length;
+
+    return length * amb->first.words * 3 * sizeof(uint64_t)
+           + length * 4 * sizeof(bool)
+           + amb->conflicts.size * amb->conflicts.struct_size;
+}
+
+lxb_status_t
+lxb_grammar_ambiguity_verify(lxb_grammar_tree_t *tree,
+                             lxb_grammar_node_t **node)
+{
+    size_t held;
+    lxb_status_t status;
+    lxb_grammar_ambiguity_t amb = {0};
+    lxb_grammar_ambiguity_conflict_t *conflict;
+
+    *node = NULL;
+
+    status = lxb_grammar_ambiguity_init(&amb, tree);
+
+    held = lxb_grammar_ambiguity_memory(&amb);
+    lxb_grammar_memory_hold(tree->document, held);
+
+    if (status == LXB_STATUS_OK && amb.conflicts.length != 0) {
+        conflict = lexbor_array_obj_get(&amb.conflicts, 0);
+
+        *node = conflict->first;
+        status = LXB_STATUS_ERROR;
+    }
+
+    lxb_grammar_memory_release(tree->document, tree, NULL, held);
+
+    (void) lxb_grammar_ambiguity_destroy(&amb, false);
+
+    return status;
+}
+
+const lxb_char_t *
+lxb_grammar_ambiguity_type_name(lxb_grammar_ambiguity_type_t type,
+                                size_t *len)
+{
+#define lxb_grammar_ambiguity_type_name_str(name)                              \
+    do {                                                                       \
+        if (len != NULL) {                                                     \
+            *len = sizeof(name) - 1;                                           \
+        }                                                                      \
+                                                                               \
+        return (const lxb_char_t *) name;                                      \
+    }                                                                          \
+    while (0)
+
+    switch (type) {
+        case LXB_GRAMMAR_AMBIGUITY_ALTERNATIVES:
+            lxb_grammar_ambiguity_type_name_str("same first token");
+
+        case LXB_GRAMMAR_AMBIGUITY_EMPTY:
+            lxb_grammar_ambiguity_type_name_str("empty in more than one way");
+
+        case LXB_GRAMMAR_AMBIGUITY_FOLLOW:
+            lxb_grammar_ambiguity_type_name_str("optional overlaps follow");
+
+        case LXB_GRAMMAR_AMBIGUITY_REPEAT:
+            lxb_grammar_ambiguity_type_name_str("repetition overlaps follow");
+
+        case LXB_GRAMMAR_AMBIGUITY_LEFT_RECURSION:
+            lxb_grammar_ambiguity_type_name_str("left recursion");
+
+        default:
+            lxb_grammar_ambiguity_type_name_str("UNDEFINED");
+    }
+
+#undef lxb_grammar_ambiguity_type_name_str
+}
+
+static lxb_status_t
+lxb_grammar_ambiguity_serialize_node(lxb_grammar_ambiguity_t *amb,
+                                     lxb_grammar_node_t *node,
+                                     lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    size_t len;
+    lxb_char_t buf[32];
+    lxb_status_t status;
+
+    len = lexbor_conv_long_to_data((long) lxb_grammar_ambiguity_line(amb, node),
+                                   buf, sizeof(buf));
+
+    lxb_grammar_ambiguity_send("line ", 5);
+    lxb_grammar_ambiguity_send(buf, len);
+    lxb_grammar_ambiguity_send(": ", 2);
+
+    return lxb_grammar_node_serialize_branch(node, func, ctx);
+}
+
+lxb_status_t
+lxb_grammar_ambiguity_serialize(lxb_grammar_ambiguity_t *amb,
+                                lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    size_t len;
+    lxb_status_t status;
+    const lxb_char_t *name;
+    lxb_grammar_ambiguity_conflict_t *conflict;
+
+    for (size_t i = 0; i < amb->conflicts.length; i++) {
+        conflict = lexbor_array_obj_get(&amb->conflicts, i);
+
+        status = lxb_grammar_node_serialize(conflict->decl, func, ctx);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        name = lxb_grammar_ambiguity_type_name(conflict->type, &len);
+
+        lxb_grammar_ambiguity_send(": ", 2);
+        lxb_grammar_ambiguity_send(name, len);
+        lxb_grammar_ambiguity_send(": ", 2);
+
+        status = lxb_grammar_ambiguity_serialize_node(amb, conflict->first,
+                                                      func, ctx);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        if (conflict->second != NULL) {
+            lxb_grammar_ambiguity_send(" ; ", 3);
+
+            status = lxb_grammar_ambiguity_serialize_node(amb, conflict->second,
+                                                          func, ctx);
+            if (status != LXB_STATUS_OK) {
+                return status;
+            }
+        }
+
+        lxb_grammar_ambiguity_send("\n", 1);
+    }
+
+    return LXB_STATUS_OK;
+}
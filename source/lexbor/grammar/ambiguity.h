@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_AMBIGUITY_H
+#define LEXBOR_GRAMMAR_AMBIGUITY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/node.h"
+#include "lexbor/grammar/tree.h"
+#include "lexbor/grammar/first.h"
+
+#include "lexbor/core/array_obj.h"
+
+
+typedef enum {
+    /* Alternatives can begin with the same token. */
+    LXB_GRAMMAR_AMBIGUITY_ALTERNATIVES = 0x00,
+    /* Nothing can be matched in more than one way. */
+    LXB_GRAMMAR_AMBIGUITY_EMPTY,
+    /* Optional part can begin with a token which can follow it. */
+    LXB_GRAMMAR_AMBIGUITY_FOLLOW,
+    /* Repetition can stop or continue at the same token. */
+    LXB_GRAMMAR_AMBIGUITY_REPEAT,
+    /* Declaration can begin with itself. */
+    LXB_GRAMMAR_AMBIGUITY_LEFT_RECURSION
+}
+lxb_grammar_ambiguity_type_t;
+
+typedef struct {
+    lxb_grammar_ambiguity_type_t type;
+
+    lxb_grammar_node_t           *decl;
+    lxb_grammar_node_t           *node;   /* Where the choice is made. */
+    lxb_grammar_node_t           *first;
+    lxb_grammar_node_t           *second; /* Can be NULL. */
+}
+lxb_grammar_ambiguity_conflict_t;
+
+/*
+ * LL(1) check: at every choice the next token must decide what to match.
+ * Declarations without conflicts are matched without backtracking.
+ */
+struct lxb_grammar_ambiguity {
+    lxb_grammar_tree_t  *tree;
+    lxb_grammar_first_t first;
+
+    /* By node->id, see lxb_grammar_first_t, with LXB_GRAMMAR_FIRST_END. */
+    uint64_t            *follow;
+    /* What follows one repetition of the node. */
+    uint64_t            *inner;
+
+    /* By node->id of declarations. */
+    bool                *deterministic;
+    bool                *backtracking;
+
+    lexbor_array_obj_t  conflicts;   /* lxb_grammar_ambiguity_conflict_t */
+};
+
+
+LXB_API lxb_grammar_ambiguity_t *
+lxb_grammar_ambiguity_create(void);
+
+/* The tree must be made by lxb_grammar_tree_make(). */
+LXB_API lxb_status_t
+lxb_grammar_ambiguity_init(lxb_grammar_ambiguity_t *amb,
+                           lxb_grammar_tree_t *tree);
+
+LXB_API lxb_grammar_ambiguity_t *
+lxb_grammar_ambiguity_destroy(lxb_grammar_ambiguity_t *amb,
+                              bool self_destroy);
+
+/* Line of the node in the source of the grammar, from 1.  0 if unknown. */
+LXB_API size_t
+lxb_grammar_ambiguity_line(lxb_grammar_ambiguity_t *amb,
+                           lxb_grammar_node_t *node);
+
+/*
+ * For the deterministic mode of compilers.  LXB_STATUS_ERROR if the tree
+ * has conflicts, the node is set to the first conflicting one.
+ */
+LXB_API lxb_status_t
+lxb_grammar_ambiguity_verify(lxb_grammar_tree_t *tree,
+                             lxb_grammar_node_t **node);
+
+LXB_API const lxb_char_t *
+lxb_grammar_ambiguity_type_name(lxb_grammar_ambiguity_type_t type,
+                                size_t *len);
+
+/*
+ * One conflict per line:
+ * "<decl>: <type>: line N: <first> ; line M: <second>".
+ */
+LXB_API lxb_status_t
+lxb_grammar_ambiguity_serialize(lxb_grammar_ambiguity_t *amb,
+                                lxb_grammar_serialize_cb_f func, void *ctx);
+
+
+/*
+ * Inline functions
+ */
+lxb_inline size_t
+lxb_grammar_ambiguity_length(const lxb_grammar_ambiguity_t *amb)
+{
+    return amb->conflicts.length;
+}
+
+lxb_inline lxb_grammar_ambiguity_conflict_t *
+lxb_grammar_ambiguity_get(lxb_grammar_ambiguity_t *amb, size_t idx)
+{
+    return lexbor_array_obj_get(&amb->conflicts, idx);
+}
+
+/*
+ * The declaration and all declarations referenced by it have no conflicts.
+ */
+lxb_inline bool
+lxb_grammar_ambiguity_is_deterministic(const lxb_grammar_ambiguity_t *amb,
+                                       const lxb_grammar_node_t *decl)
+{
+    return amb->deterministic[decl->id];
+}
+
+/*
+ * The declaration is not deterministic or is referenced from such one:
+ * it can be matched again at the same position on backtracking.
+ */
+lxb_inline bool
+lxb_grammar_ambiguity_is_backtracking(const lxb_grammar_ambiguity_t *amb,
+                                      const lxb_grammar_node_t *decl)
+{
+    return amb->backtracking[decl->id];
+}
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_AMBIGUITY_H */
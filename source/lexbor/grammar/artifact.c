@@ -0,0 +1,650 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/artifact.h"
+
+#include "lexbor/core/fs.h"
+
+#include <stdio.h>
+#include <stddef.h>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+
+#define LXB_GRAMMAR_ARTIFACT_FNV_BASIS 2166136261U
+#define LXB_GRAMMAR_ARTIFACT_FNV_PRIME 16777619U
+
+#define lxb_grammar_artifact_align(size)                                       \
+    (((size) + (LXB_GRAMMAR_ARTIFACT_ALIGN - 1))                               \
+     & ~((uint64_t) LXB_GRAMMAR_ARTIFACT_ALIGN - 1))
+
+/* Checksum covers everything after this offset. */
+#define LXB_GRAMMAR_ARTIFACT_CHECKSUM_END                                      \
+    (offsetof(lxb_grammar_artifact_header_t, checksum) + sizeof(uint32_t))
+
+/* Registers are addressed by 16 bits, see lxb_grammar_bytecode_instr_t. */
+#define LXB_GRAMMAR_ARTIFACT_REGISTERS_MAX (UINT16_MAX + 1)
+
+
+static const lxb_char_t lxb_grammar_artifact_zero[LXB_GRAMMAR_ARTIFACT_ALIGN];
+
+static const size_t
+lxb_grammar_artifact_entry_size[LXB_GRAMMAR_ARTIFACT_SECTION__LAST_ENTRY] = {
+    sizeof(lxb_grammar_bytecode_instr_t),
+    sizeof(lxb_grammar_bytecode_term_t),
+    sizeof(lxb_grammar_bytecode_decl_t),
+    sizeof(uint32_t),
+    sizeof(lxb_grammar_bytecode_keyword_t),
+    sizeof(uint32_t),
+    sizeof(lxb_char_t)
+};
+
+
+static lxb_status_t
+lxb_grammar_artifact_validate(lxb_grammar_bytecode_t *bc);
+
+
+lxb_inline uint32_t
+lxb_grammar_artifact_fnv(uint32_t hash, const lxb_char_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= LXB_GRAMMAR_ARTIFACT_FNV_PRIME;
+    }
+
+    return hash;
+}
+
+static lxb_status_t
+lxb_grammar_artifact_fnv_cb(const lxb_char_t *data, size_t len, void *ctx)
+{
+    uint32_t *hash = ctx;
+
+    *hash = lxb_grammar_artifact_fnv(*hash, data, len);
+
+    return LXB_STATUS_OK;
+}
+
+static const lxb_char_t *
+lxb_grammar_artifact_section_data(lxb_grammar_bytecode_t *bc,
+                                  lxb_grammar_artifact_section_id_t id,
+                                  size_t *count)
+{
+    const lexbor_array_obj_t *array;
+
+    switch (id) {
+        case LXB_GRAMMAR_ARTIFACT_SECTION_CODE:
+            array = &bc->code;
+            break;
+
+        case LXB_GRAMMAR_ARTIFACT_SECTION_TERMS:
+            array = &bc->terms;
+            break;
+
+        case LXB_GRAMMAR_ARTIFACT_SECTION_DECLS:
+            array = &bc->decls;
+            break;
+
+        case LXB_GRAMMAR_ARTIFACT_SECTION_INDEX:
+            array = &bc->index;
+            break;
+
+        case LXB_GRAMMAR_ARTIFACT_SECTION_KEYWORDS:
+            array = &bc->keywords;
+            break;
+
+        case LXB_GRAMMAR_ARTIFACT_SECTION_HASH:
+            array = &bc->hash;
+            break;
+
+        default:
+            *count = bc->strings.length;
+            return bc->strings.data;
+    }
+
+    *count = array->length;
+
+    return array->list;
+}
+
+static void
+lxb_grammar_artifact_header(lxb_grammar_bytecode_t *bc,
+                            lxb_grammar_artifact_header_t *hdr)
+{
+    size_t count;
+    uint64_t offset;
+    lxb_grammar_artifact_section_t *section;
+
+    memset(hdr, 0, sizeof(lxb_grammar_artifact_header_t));
+
+    memcpy(hdr->magic, LXB_GRAMMAR_ARTIFACT_MAGIC, sizeof(hdr->magic));
+
+    hdr->version = LXB_GRAMMAR_ARTIFACT_VERSION;
+    hdr->byte_order = LXB_GRAMMAR_ARTIFACT_BYTE_ORDER;
+    hdr->header_size = sizeof(lxb_grammar_artifact_header_t);
+    hdr->keyword_max_len = bc->keyword_max_len;
+
+    offset = lxb_grammar_artifact_align(sizeof(lxb_grammar_artifact_header_t));
+
+    for (size_t i = 0; i < LXB_GRAMMAR_ARTIFACT_SECTION__LAST_ENTRY; i++) {
+        section = &hdr->sections[i];
+
+        (void) lxb_grammar_artifact_section_data(bc, i, &count);
+
+        section->offset = offset;
+        section->count = count;
+        section->entry_size = lxb_grammar_artifact_entry_size[i];
+
+        offset = lxb_grammar_artifact_align(offset
+                                            + count * section->entry_size);
+    }
+
+    hdr->size = offset;
+}
+
+/* Everything after the header: alignment and sections. */
+static lxb_status_t
+lxb_grammar_artifact_body(lxb_grammar_bytecode_t *bc,
+                          const lxb_grammar_artifact_header_t *hdr,
+                          lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    size_t count, len;
+    uint64_t offset;
+    lxb_status_t status;
+    const lxb_char_t *data;
+    const lxb_grammar_artifact_section_t *section;
+
+    offset = sizeof(lxb_grammar_artifact_header_t);
+
+    for (size_t i = 0; i < LXB_GRAMMAR_ARTIFACT_SECTION__LAST_ENTRY; i++) {
+        section = &hdr->sections[i];
+
+        if (section->offset > offset) {
+            status = func(lxb_grammar_artifact_zero,
+                          (size_t) (section->offset - offset), ctx);
+            if (status != LXB_STATUS_OK) {
+                return status;
+            }
+        }
+
+        data = lxb_grammar_artifact_section_data(bc, i, &count);
+        len = count * section->entry_size;
+
+        if (len != 0) {
+            status = func(data, len, ctx);
+            if (status != LXB_STATUS_OK) {
+                return status;
+            }
+        }
+
+        offset = section->offset + len;
+    }
+
+    if (hdr->size > offset) {
+        return func(lxb_grammar_artifact_zero,
+                    (size_t) (hdr->size - offset), ctx);
+    }
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_artifact_serialize(lxb_grammar_bytecode_t *bc,
+                               lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    uint32_t hash;
+    lxb_status_t status;
+    lxb_grammar_artifact_header_t hdr;
+
+    lxb_grammar_artifact_header(bc, &hdr);
+
+    hash = lxb_grammar_artifact_fnv(LXB_GRAMMAR_ARTIFACT_FNV_BASIS,
+                         (const lxb_char_t *) &hdr + LXB_GRAMMAR_ARTIFACT_CHECKSUM_END,
+                         sizeof(hdr) - LXB_GRAMMAR_ARTIFACT_CHECKSUM_END);
+
+    status = lxb_grammar_artifact_body(bc, &hdr, lxb_grammar_artifact_fnv_cb,
+                                       &hash);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    hdr.checksum = hash;
+
+    status = func((const lxb_char_t *) &hdr, sizeof(hdr), ctx);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    return lxb_grammar_artifact_body(bc, &hdr, func, ctx);
+}
+
+static lxb_status_t
+lxb_grammar_artifact_file_cb(const lxb_char_t *data, size_t len, void *ctx)
+{
+    if (fwrite(data, 1, len, ctx) != len) {
+        return LXB_STATUS_ERROR;
+    }
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_artifact_save(lxb_grammar_bytecode_t *bc, const lxb_char_t *path)
+{
+    FILE *fh;
+    lxb_status_t status;
+
+    fh = fopen((const char *) path, "wb");
+    if (fh == NULL) {
+        return LXB_STATUS_ERROR;
+    }
+
+    status = lxb_grammar_artifact_serialize(bc, lxb_grammar_artifact_file_cb,
+                                            fh);
+
+    if (fclose(fh) != 0 && status == LXB_STATUS_OK) {
+        status = LXB_STATUS_ERROR;
+    }
+
+    return status;
+}
+
+static void
+lxb_grammar_artifact_bind(lexbor_array_obj_t *array, const lxb_char_t *data,
+                          const lxb_grammar_artifact_section_t *section)
+{
+    array->list = (uint8_t *) data + section->offset;
+    array->size = (size_t) section->count;
+    array->length = (size_t) section->count;
+    array->struct_size = (size_t) section->entry_size;
+}
+
+lxb_status_t
+lxb_grammar_artifact_load(lxb_grammar_bytecode_t *bc,
+                          const lxb_char_t *data, size_t size, int opt)
+{
+    uint32_t hash;
+    const lxb_grammar_artifact_header_t *hdr;
+    const lxb_grammar_artifact_section_t *section;
+
+    if (bc == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    if (data == NULL
+        || ((uintptr_t) data % LXB_GRAMMAR_ARTIFACT_ALIGN) != 0)
+    {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    if (size < sizeof(lxb_grammar_artifact_header_t)) {
+        return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+    }
+
+    hdr = (const lxb_grammar_artifact_header_t *) data;
+
+    if (memcmp(hdr->magic, LXB_GRAMMAR_ARTIFACT_MAGIC, sizeof(hdr->magic)) != 0
+        || hdr->version != LXB_GRAMMAR_ARTIFACT_VERSION
+        || hdr->byte_order != LXB_GRAMMAR_ARTIFACT_BYTE_ORDER
+        || hdr->header_size != sizeof(lxb_grammar_artifact_header_t)
+        || hdr->size > size)
+    {
+        return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+    }
+
+    if ((opt & LXB_GRAMMAR_ARTIFACT_OPT_NO_CHECKSUM) == 0) {
+        hash = lxb_grammar_artifact_fnv(LXB_GRAMMAR_ARTIFACT_FNV_BASIS,
+                                        data + LXB_GRAMMAR_ARTIFACT_CHECKSUM_END,
+                                        (size_t) hdr->size
+                                        - LXB_GRAMMAR_ARTIFACT_CHECKSUM_END);
+        if (hash != hdr->checksum) {
+            return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+        }
+    }
+
+    for (size_t i = 0; i < LXB_GRAMMAR_ARTIFACT_SECTION__LAST_ENTRY; i++) {
+        section = &hdr->sections[i];
+
+        if (section->entry_size != lxb_grammar_artifact_entry_size[i]
+            || (section->offset % LXB_GRAMMAR_ARTIFACT_ALIGN) != 0
+            || section->offset < hdr->header_size
+            || section->offset > hdr->size
+            || section->count > (hdr->size - section->offset)
+                                / section->entry_size
+            || section->count >= UINT32_MAX)
+        {
+            return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+        }
+    }
+
+    memset(bc, 0, sizeof(lxb_grammar_bytecode_t));
+
+    lxb_grammar_artifact_bind(&bc->code, data,
+                              &hdr->sections[LXB_GRAMMAR_ARTIFACT_SECTION_CODE]);
+    lxb_grammar_artifact_bind(&bc->terms, data,
+                              &hdr->sections[LXB_GRAMMAR_ARTIFACT_SECTION_TERMS]);
+    lxb_grammar_artifact_bind(&bc->decls, data,
+                              &hdr->sections[LXB_GRAMMAR_ARTIFACT_SECTION_DECLS]);
+    lxb_grammar_artifact_bind(&bc->index, data,
+                              &hdr->sections[LXB_GRAMMAR_ARTIFACT_SECTION_INDEX]);
+    lxb_grammar_artifact_bind(&bc->keywords, data,
+                          &hdr->sections[LXB_GRAMMAR_ARTIFACT_SECTION_KEYWORDS]);
+    lxb_grammar_artifact_bind(&bc->hash, data,
+                              &hdr->sections[LXB_GRAMMAR_ARTIFACT_SECTION_HASH]);
+
+    section = &hdr->sections[LXB_GRAMMAR_ARTIFACT_SECTION_STRINGS];
+
+    bc->strings.data = (lxb_char_t *) data + section->offset;
+    bc->strings.length = (size_t) section->count;
+
+    bc->keyword_max_len = (size_t) hdr->keyword_max_len;
+    bc->external = true;
+
+    if (opt & LXB_GRAMMAR_ARTIFACT_OPT_NO_VALIDATE) {
+        return LXB_STATUS_OK;
+    }
+
+    return lxb_grammar_artifact_validate(bc);
+}
+
+lxb_inline bool
+lxb_grammar_artifact_str_valid(lxb_grammar_bytecode_t *bc,
+                               uint32_t offset, uint32_t length)
+{
+    return offset <= bc->strings.length
+           && length <= bc->strings.length - offset;
+}
+
+/*
+ * The VM trusts the bytecode: all indexes, addresses and registers
+ * must be in range.  Code of a declaration: entry, then body.
+ */
+static bool
+lxb_grammar_artifact_validate_code(lxb_grammar_bytecode_t *bc,
+                                   uint32_t begin, uint32_t end,
+                                   uint32_t registers,
+                                   lxb_grammar_bytecode_op_t last)
+{
+    const lxb_grammar_bytecode_instr_t *instr;
+
+    if (begin >= end) {
+        return false;
+    }
+
+    instr = lexbor_array_obj_get(&bc->code, end - 1);
+
+    if (instr->opcode != last) {
+        return false;
+    }
+
+    for (uint32_t pc = begin; pc < end; pc++) {
+        instr = lexbor_array_obj_get(&bc->code, pc);
+
+        switch (instr->opcode) {
+            case LXB_GRAMMAR_BYTECODE_OP_TERM:
+                if (instr->a >= bc->terms.length) {
+                    return false;
+                }
+
+                break;
+
+            case LXB_GRAMMAR_BYTECODE_OP_SPLIT:
+                if (instr->b < begin || instr->b >= end) {
+                    return false;
+                }
+
+                /* Fall through. */
+
+            case LXB_GRAMMAR_BYTECODE_OP_JUMP:
+                if (instr->a < begin || instr->a >= end) {
+                    return false;
+                }
+
+                break;
+
+            case LXB_GRAMMAR_BYTECODE_OP_CALL:
+                if (instr->a >= bc->decls.length) {
+                    return false;
+                }
+
+                break;
+
+            case LXB_GRAMMAR_BYTECODE_OP_COUNTER_LOOP:
+            case LXB_GRAMMAR_BYTECODE_OP_COUNTER_NEXT:
+                if (instr->a < begin || instr->a >= end) {
+                    return false;
+                }
+
+                /* Fall through. */
+
+            case LXB_GRAMMAR_BYTECODE_OP_COUNTER_ENTER:
+            case LXB_GRAMMAR_BYTECODE_OP_COUNTER_EXIT:
+            case LXB_GRAMMAR_BYTECODE_OP_MASK_ENTER:
+                if (instr->reg >= registers) {
+                    return false;
+                }
+
+                break;
+
+            case LXB_GRAMMAR_BYTECODE_OP_MASK_TEST:
+            case LXB_GRAMMAR_BYTECODE_OP_MASK_SET:
+                if (instr->reg >= registers || instr->a >= 64) {
+                    return false;
+                }
+
+                break;
+
+            case LXB_GRAMMAR_BYTECODE_OP_MASK_EXIT:
+                if (instr->reg >= registers || instr->a > 64) {
+                    return false;
+                }
+
+                break;
+
+            case LXB_GRAMMAR_BYTECODE_OP_RET:
+            case LXB_GRAMMAR_BYTECODE_OP_FAIL:
+            case LXB_GRAMMAR_BYTECODE_OP_ACCEPT:
+                break;
+
+            default:
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static lxb_status_t
+lxb_grammar_artifact_validate(lxb_grammar_bytecode_t *bc)
+{
+    uint32_t end;
+    const uint32_t *index;
+    const lxb_grammar_bytecode_term_t *term;
+    const lxb_grammar_bytecode_decl_t *decl, *next;
+    const lxb_grammar_bytecode_keyword_t *keyword;
+
+    for (size_t i = 0; i < bc->terms.length; i++) {
+        term = lexbor_array_obj_get(&bc->terms, i);
+
+        switch (term->type) {
+            case LXB_GRAMMAR_BYTECODE_TERM_LITERAL:
+                if (!lxb_grammar_artifact_str_valid(bc, term->value,
+                                                    term->length))
+                {
+                    return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+                }
+
+                break;
+
+            case LXB_GRAMMAR_BYTECODE_TERM_TYPE:
+                if (term->value >= LXB_GRAMMAR_TYPE__LAST_ENTRY) {
+                    return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+                }
+
+                break;
+
+            case LXB_GRAMMAR_BYTECODE_TERM_NONE:
+            case LXB_GRAMMAR_BYTECODE_TERM_KEYWORD:
+            case LXB_GRAMMAR_BYTECODE_TERM_NUMBER:
+                break;
+
+            default:
+                return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+        }
+    }
+
+    if (bc->index.length != bc->decls.length) {
+        return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+    }
+
+    index = (const uint32_t *) bc->index.list;
+    end = 0;
+
+    /* Declarations are contiguous and in order: entry, body, next entry. */
+    for (size_t i = 0; i < bc->decls.length; i++) {
+        decl = lexbor_array_obj_get(&bc->decls, i);
+        next = lexbor_array_obj_get(&bc->decls, i + 1);
+
+        if (decl->entry != end) {
+            return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+        }
+
+        end = (next != NULL) ? next->entry : (uint32_t) bc->code.length;
+
+        if (index[i] >= bc->decls.length
+            || !lxb_grammar_artifact_str_valid(bc, decl->name, decl->name_len)
+            || decl->body <= decl->entry || decl->body >= end
+            || end > bc->code.length
+            || decl->entry_registers > LXB_GRAMMAR_ARTIFACT_REGISTERS_MAX
+            || decl->registers > LXB_GRAMMAR_ARTIFACT_REGISTERS_MAX
+            || !lxb_grammar_artifact_validate_code(bc, decl->entry, decl->body,
+                                                   decl->entry_registers,
+                                                   LXB_GRAMMAR_BYTECODE_OP_ACCEPT)
+            || !lxb_grammar_artifact_validate_code(bc, decl->body, end,
+                                                   decl->registers,
+                                                   LXB_GRAMMAR_BYTECODE_OP_RET))
+        {
+            return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+        }
+    }
+
+    if (bc->hash.length != lxb_grammar_phash_size(bc->keywords.length)) {
+        return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+    }
+
+    /* The hash must lead to each keyword. */
+    for (size_t i = 0; i < bc->keywords.length; i++) {
+        keyword = lexbor_array_obj_get(&bc->keywords, i);
+
+        if (!lxb_grammar_artifact_str_valid(bc, keyword->str,
+                                            keyword->length)
+            || keyword->length > bc->keyword_max_len
+            || keyword->id == 0
+            || lxb_grammar_bytecode_keyword(bc,
+                             lxb_grammar_bytecode_string(bc, keyword->str),
+                             keyword->length) != keyword->id)
+        {
+            return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+lxb_grammar_artifact_t *
+lxb_grammar_artifact_create(void)
+{
+    return lexbor_calloc(1, sizeof(lxb_grammar_artifact_t));
+}
+
+lxb_status_t
+lxb_grammar_artifact_init(lxb_grammar_artifact_t *artifact,
+                          const lxb_char_t *path)
+{
+#ifndef _WIN32
+    int fd;
+    void *data;
+    struct stat st;
+#endif
+
+    if (artifact == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    if (path == NULL) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+#ifndef _WIN32
+    fd = open((const char *) path, O_RDONLY);
+    if (fd == -1) {
+        return LXB_STATUS_ERROR;
+    }
+
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return LXB_STATUS_ERROR;
+    }
+
+    data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return LXB_STATUS_ERROR;
+    }
+
+    artifact->data = data;
+    artifact->size = (size_t) st.st_size;
+    artifact->is_mapped = true;
+#else
+    /* Without mmap the image is read, the heap is aligned enough. */
+    artifact->data = lexbor_fs_file_easy_read(path, &artifact->size);
+    if (artifact->data == NULL) {
+        return LXB_STATUS_ERROR;
+    }
+
+    artifact->is_mapped = false;
+#endif
+
+    return LXB_STATUS_OK;
+}
+
+lxb_grammar_artifact_t *
+lxb_grammar_artifact_destroy(lxb_grammar_artifact_t *artifact,
+                             bool self_destroy)
+{
+    if (artifact == NULL) {
+        return NULL;
+    }
+
+    if (artifact->data != NULL) {
+#ifndef _WIN32
+        if (artifact->is_mapped) {
+            munmap(artifact->data, artifact->size);
+        }
+        else {
+            lexbor_free(artifact->data);
+        }
+#else
+        lexbor_free(artifact->data);
+#endif
+
+        artifact->data = NULL;
+        artifact->size = 0;
+    }
+
+    if (self_destroy) {
+        return lexbor_free(artifact);
+    }
+
+    return artifact;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_ARTIFACT_H
+#define LEXBOR_GRAMMAR_ARTIFACT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/bytecode.h"
+
+
+#define LXB_GRAMMAR_ARTIFACT_MAGIC "LXBGRAMR"
+#define LXB_GRAMMAR_ARTIFACT_VERSION 3
+
+/* Marker of the byte order, written as native uint32_t. */
+#define LXB_GRAMMAR_ARTIFACT_BYTE_ORDER 0x01020304
+
+/* Sections begin at this alignment, relative to the start of the file. */
+#define LXB_GRAMMAR_ARTIFACT_ALIGN 8
+
+
+typedef enum {
+    LXB_GRAMMAR_ARTIFACT_SECTION_CODE = 0x00,
+    LXB_GRAMMAR_ARTIFACT_SECTION_TERMS,
+    LXB_GRAMMAR_ARTIFACT_SECTION_DECLS,
+    LXB_GRAMMAR_ARTIFACT_SECTION_INDEX,
+    LXB_GRAMMAR_ARTIFACT_SECTION_KEYWORDS,
+    LXB_GRAMMAR_ARTIFACT_SECTION_HASH,
+    LXB_GRAMMAR_ARTIFACT_SECTION_STRINGS,
+    LXB_GRAMMAR_ARTIFACT_SECTION__LAST_ENTRY
+}
+lxb_grammar_artifact_section_id_t;
+
+typedef struct {
+    uint64_t offset;     /* From the start of the file. */
+    uint64_t count;
+    uint64_t entry_size;
+}
+lxb_grammar_artifact_section_t;
+
+/*
+ * File layout: header, then sections in order of
+ * lxb_grammar_artifact_section_id_t, each aligned.
+ *
+ * The checksum (FNV-1a) covers all bytes after the checksum field.
+ */
+typedef struct {
+    char                           magic[8];
+    uint32_t                       version;
+    uint32_t                       checksum;
+
+    uint32_t                       byte_order;
+    uint32_t                       header_size;
+    uint64_t                       size;
+    uint64_t                       keyword_max_len;
+
+    lxb_grammar_artifact_section_t sections[LXB_GRAMMAR_ARTIFACT_SECTION__LAST_ENTRY];
+}
+lxb_grammar_artifact_header_t;
+
+typedef enum {
+    LXB_GRAMMAR_ARTIFACT_OPT_UNDEF       = 0x00,
+    LXB_GRAMMAR_ARTIFACT_OPT_NO_CHECKSUM = 0x01,
+    LXB_GRAMMAR_ARTIFACT_OPT_NO_VALIDATE = 0x02  /* Trust instructions. */
+}
+lxb_grammar_artifact_opt_t;
+
+/* File image: mapped or read into memory. */
+typedef struct {
+    lxb_char_t *data;
+    size_t     size;
+    bool       is_mapped;
+}
+lxb_grammar_artifact_t;
+
+
+/*
+ * Writes binary image of the bytecode.  Position independent, all
+ * references inside the image are offsets and indexes.
+ */
+LXB_API lxb_status_t
+lxb_grammar_artifact_serialize(lxb_grammar_bytecode_t *bc,
+                               lxb_grammar_serialize_cb_f func, void *ctx);
+
+LXB_API lxb_status_t
+lxb_grammar_artifact_save(lxb_grammar_bytecode_t *bc, const lxb_char_t *path);
+
+/*
+ * Binds bytecode to the image, nothing is copied.  The data must be aligned
+ * to LXB_GRAMMAR_ARTIFACT_ALIGN and live while the bytecode is used.
+ *
+ * The bytecode must be created by lxb_grammar_bytecode_create() and
+ * not initialized.  Release it by lxb_grammar_bytecode_destroy().
+ */
+LXB_API lxb_status_t
+lxb_grammar_artifact_load(lxb_grammar_bytecode_t *bc,
+                          const lxb_char_t *data, size_t size, int opt);
+
+LXB_API lxb_grammar_artifact_t *
+lxb_grammar_artifact_create(void);
+
+/* Maps the file read-only, pages are shared between processes. */
+LXB_API lxb_status_t
+lxb_grammar_artifact_init(lxb_grammar_artifact_t *artifact,
+                          const lxb_char_t *path);
+
+LXB_API lxb_grammar_artifact_t *
+lxb_grammar_artifact_destroy(lxb_grammar_artifact_t *artifact,
+                             bool self_destroy);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_ARTIFACT_H */
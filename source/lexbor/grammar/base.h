@@ -31,9 +31,22 @@ typedef lxb_status_t
 typedef struct lxb_grammar_parser lxb_grammar_parser_t;
 typedef struct lxb_grammar_tokenizer lxb_grammar_tokenizer_t;
 typedef struct lxb_grammar_node lxb_grammar_node_t;
+typedef struct lxb_grammar_element lxb_grammar_element_t;
 typedef struct lxb_grammar_tree lxb_grammar_tree_t;
 typedef struct lxb_grammar_tree_group lxb_grammar_tree_group_t;
 typedef struct lxb_grammar_tree_entry lxb_grammar_tree_entry_t;
+typedef struct lxb_grammar_match lxb_grammar_match_t;
+typedef struct lxb_grammar_bytecode lxb_grammar_bytecode_t;
+typedef struct lxb_grammar_vm lxb_grammar_vm_t;
+typedef struct lxb_grammar_codegen lxb_grammar_codegen_t;
+typedef struct lxb_grammar_codegen_rt lxb_grammar_codegen_rt_t;
+typedef struct lxb_grammar_first lxb_grammar_first_t;
+typedef struct lxb_grammar_bounds lxb_grammar_bounds_t;
+typedef struct lxb_grammar_ambiguity lxb_grammar_ambiguity_t;
+typedef struct lxb_grammar_frozen lxb_grammar_frozen_t;
+typedef struct lxb_grammar_cache lxb_grammar_cache_t;
+typedef struct lxb_grammar_cache_shared lxb_grammar_cache_shared_t;
+typedef struct lxb_grammar_stats lxb_grammar_stats_t;
 
 typedef struct lxb_grammar_period {
     long start;
@@ -0,0 +1,301 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/bounds.h"
+
+#include "lexbor/core/conv.h"
+
+
+#define lxb_grammar_bounds_send(data, len)                                     \
+    do {                                                                       \
+        status = func((const lxb_char_t *) (data), (len), ctx);                \
+        if (status != LXB_STATUS_OK) {                                         \
+            return status;                                                     \
+        }                                                                      \
+    }                                                                          \
+    while (0)
+
+
+static bool
+lxb_grammar_bounds_node(lxb_grammar_bounds_t *bounds, lxb_grammar_node_t *node,
+                        bool grow);
+
+
+lxb_grammar_bounds_t *
+lxb_grammar_bounds_create(void)
+{
+    return lexbor_calloc(1, sizeof(lxb_grammar_bounds_t));
+}
+
+lxb_status_t
+lxb_grammar_bounds_init(lxb_grammar_bounds_t *bounds, lxb_grammar_tree_t *tree)
+{
+    bool changed, grow;
+    size_t count, pass;
+    lxb_grammar_node_t *root, *node;
+
+    if (bounds == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    if (tree == NULL || tree->nodes->length == 0) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    root = tree->nodes->list[0];
+
+    if (root->type != LXB_GRAMMAR_NODE_ROOT) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    bounds->tree = tree;
+    bounds->length = tree->nodes->length;
+
+    bounds->min = lexbor_malloc(bounds->length * sizeof(size_t));
+    if (bounds->min == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    bounds->max = lexbor_calloc(bounds->length, sizeof(size_t));
+    if (bounds->max == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    count = 0;
+
+    for (size_t i = 0; i < bounds->length; i++) {
+        bounds->min[i] = LXB_GRAMMAR_BOUNDS_INFINITY;
+    }
+
+    for (node = root->first_child; node != NULL; node = node->next) {
+        count++;
+    }
+
+    /*
+     * Minimums only go down, maximums only up.  A pass for each declaration
+     * settles all references without recursion, a maximum growing after
+     * that is in a recursion which takes tokens.
+     */
+    pass = 0;
+
+    do {
+        changed = false;
+        grow = (pass++ > count);
+
+        for (node = root->first_child; node != NULL; node = node->next) {
+            changed |= lxb_grammar_bounds_node(bounds, node, grow);
+        }
+    }
+    while (changed);
+
+    return LXB_STATUS_OK;
+}
+
+lxb_grammar_bounds_t *
+lxb_grammar_bounds_destroy(lxb_grammar_bounds_t *bounds, bool self_destroy)
+{
+    if (bounds == NULL) {
+        return NULL;
+    }
+
+    if (bounds->min != NULL) {
+        bounds->min = lexbor_free(bounds->min);
+    }
+
+    if (bounds->max != NULL) {
+        bounds->max = lexbor_free(bounds->max);
+    }
+
+    if (self_destroy) {
+        return lexbor_free(bounds);
+    }
+
+    return bounds;
+}
+
+lxb_inline size_t
+lxb_grammar_bounds_add(size_t a, size_t b)
+{
+    return (a > LXB_GRAMMAR_BOUNDS_INFINITY - b) ? LXB_GRAMMAR_BOUNDS_INFINITY
+                                                 : a + b;
+}
+
+lxb_inline size_t
+lxb_grammar_bounds_mul(size_t a, size_t n)
+{
+    if (a == 0 || n == 0) {
+        return 0;
+    }
+
+    return (a > LXB_GRAMMAR_BOUNDS_INFINITY / n) ? LXB_GRAMMAR_BOUNDS_INFINITY
+                                                 : a * n;
+}
+
+/* Returns true if the bounds of the node are changed. */
+static bool
+lxb_grammar_bounds_node(lxb_grammar_bounds_t *bounds, lxb_grammar_node_t *node,
+                        bool grow)
+{
+    bool changed;
+    long rmin, rmax;
+    size_t min, max, seps;
+    lxb_grammar_node_t *child, *decl;
+
+    changed = false;
+
+    switch (node->type) {
+        case LXB_GRAMMAR_NODE_GROUP:
+        case LXB_GRAMMAR_NODE_DECLARATION:
+            for (child = node->first_child; child != NULL;
+                 child = child->next)
+            {
+                changed |= lxb_grammar_bounds_node(bounds, child, grow);
+            }
+
+            if (node->first_child == NULL) {
+                min = 0;
+                max = 0;
+                break;
+            }
+
+            switch (node->combinator) {
+                case LXB_GRAMMAR_COMBINATOR_ONE_OF:
+                    min = LXB_GRAMMAR_BOUNDS_INFINITY;
+                    max = 0;
+
+                    for (child = node->first_child; child != NULL;
+                         child = child->next)
+                    {
+                        min = lexbor_min(min, bounds->min[child->id]);
+                        max = lexbor_max(max, bounds->max[child->id]);
+                    }
+
+                    break;
+
+                /* One or more of the children. */
+                case LXB_GRAMMAR_COMBINATOR_OR:
+                    min = LXB_GRAMMAR_BOUNDS_INFINITY;
+                    max = 0;
+
+                    for (child = node->first_child; child != NULL;
+                         child = child->next)
+                    {
+                        min = lexbor_min(min, bounds->min[child->id]);
+                        max = lxb_grammar_bounds_add(max,
+                                                     bounds->max[child->id]);
+                    }
+
+                    break;
+
+                /* Sequence and &&: all children. */
+                default:
+                    min = 0;
+                    max = 0;
+
+                    for (child = node->first_child; child != NULL;
+                         child = child->next)
+                    {
+                        min = lxb_grammar_bounds_add(min,
+                                                     bounds->min[child->id]);
+                        max = lxb_grammar_bounds_add(max,
+                                                     bounds->max[child->id]);
+                    }
+
+                    break;
+            }
+
+            break;
+
+        case LXB_GRAMMAR_NODE_ELEMENT:
+            if (node->bst_declaration != NULL) {
+                decl = node->bst_declaration->value;
+
+                min = bounds->min[decl->id];
+                max = bounds->max[decl->id];
+                break;
+            }
+
+            /* Fall through. */
+
+        /* Terms: one token. */
+        default:
+            min = 1;
+            max = 1;
+            break;
+    }
+
+    /* Own multiplier of the node, "," between repetitions for #. */
+    if (lxb_grammar_node_is_required(node) && min == 0) {
+        min = 1;
+    }
+
+    rmin = lxb_grammar_node_repeat_min(node);
+    rmax = lxb_grammar_node_repeat_max(node);
+
+    seps = (node->is_comma_separated && rmin > 1) ? (size_t) rmin - 1 : 0;
+    min = lxb_grammar_bounds_add(lxb_grammar_bounds_mul(min, (size_t) rmin),
+                                 seps);
+
+    if (rmax < 0) {
+        if (max != 0 || node->is_comma_separated) {
+            max = LXB_GRAMMAR_BOUNDS_INFINITY;
+        }
+    }
+    else {
+        seps = (node->is_comma_separated && rmax > 1) ? (size_t) rmax - 1 : 0;
+        max = lxb_grammar_bounds_add(lxb_grammar_bounds_mul(max, (size_t) rmax),
+                                     seps);
+    }
+
+    if (min < bounds->min[node->id]) {
+        bounds->min[node->id] = min;
+        changed = true;
+    }
+
+    if (max > bounds->max[node->id]) {
+        bounds->max[node->id] = (grow) ? LXB_GRAMMAR_BOUNDS_INFINITY : max;
+        changed = true;
+    }
+
+    return changed;
+}
+
+lxb_status_t
+lxb_grammar_bounds_serialize(lxb_grammar_bounds_t *bounds,
+                             lxb_grammar_node_t *node,
+                             lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    size_t len;
+    lxb_status_t status;
+    lxb_char_t buf[128];
+
+    lxb_grammar_bounds_send("tokens: ", 8);
+
+    if (bounds->min[node->id] == LXB_GRAMMAR_BOUNDS_INFINITY) {
+        lxb_grammar_bounds_send("none", 4);
+
+        return LXB_STATUS_OK;
+    }
+
+    len = lexbor_conv_long_to_data((long) bounds->min[node->id],
+                                   buf, sizeof(buf));
+
+    lxb_grammar_bounds_send(buf, len);
+    lxb_grammar_bounds_send("..", 2);
+
+    if (bounds->max[node->id] == LXB_GRAMMAR_BOUNDS_INFINITY) {
+        lxb_grammar_bounds_send("inf", 3);
+
+        return LXB_STATUS_OK;
+    }
+
+    len = lexbor_conv_long_to_data((long) bounds->max[node->id],
+                                   buf, sizeof(buf));
+
+    lxb_grammar_bounds_send(buf, len);
+
+    return LXB_STATUS_OK;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_BOUNDS_H
+#define LEXBOR_GRAMMAR_BOUNDS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/node.h"
+#include "lexbor/grammar/tree.h"
+
+
+/* No maximum: *, +, #, {n,} or a recursive declaration. */
+#define LXB_GRAMMAR_BOUNDS_INFINITY SIZE_MAX
+
+
+/*
+ * Minimum and maximum count of value tokens a match of the node takes,
+ * with the multiplier of the node.  Bounds are wider than exact, never
+ * narrower: a value with the count of tokens out of the bounds of the
+ * declaration is rejected without matching.
+ *
+ * Minimum is LXB_GRAMMAR_BOUNDS_INFINITY if the node never matches.
+ */
+struct lxb_grammar_bounds {
+    lxb_grammar_tree_t *tree;
+
+    /* By node->id. */
+    size_t             *min;
+    size_t             *max;
+    size_t             length;
+};
+
+
+LXB_API lxb_grammar_bounds_t *
+lxb_grammar_bounds_create(void);
+
+/* Computes bounds of all nodes of the tree, see lxb_grammar_tree_make(). */
+LXB_API lxb_status_t
+lxb_grammar_bounds_init(lxb_grammar_bounds_t *bounds, lxb_grammar_tree_t *tree);
+
+LXB_API lxb_grammar_bounds_t *
+lxb_grammar_bounds_destroy(lxb_grammar_bounds_t *bounds, bool self_destroy);
+
+LXB_API lxb_status_t
+lxb_grammar_bounds_serialize(lxb_grammar_bounds_t *bounds,
+                             lxb_grammar_node_t *node,
+                             lxb_grammar_serialize_cb_f func, void *ctx);
+
+
+/*
+ * Inline functions
+ */
+lxb_inline size_t
+lxb_grammar_bounds_min(const lxb_grammar_bounds_t *bounds,
+                       const lxb_grammar_node_t *node)
+{
+    return bounds->min[node->id];
+}
+
+lxb_inline size_t
+lxb_grammar_bounds_max(const lxb_grammar_bounds_t *bounds,
+                       const lxb_grammar_node_t *node)
+{
+    return bounds->max[node->id];
+}
+
+/* If false, the node can not match the count of tokens. */
+lxb_inline bool
+lxb_grammar_bounds_fit(const lxb_grammar_bounds_t *bounds,
+                       const lxb_grammar_node_t *node, size_t count)
+{
+    return count >= bounds->min[node->id] && count <= bounds->max[node->id];
+}
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_BOUNDS_H */
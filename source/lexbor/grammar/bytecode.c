@@ -0,0 +1,1302 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/bytecode.h"
+#include "lexbor/grammar/ambiguity.h"
+#include "lexbor/grammar/bounds.h"
+#include "lexbor/grammar/memory.h"
+
+#include "lexbor/core/conv.h"
+
+
+#define LXB_GRAMMAR_BYTECODE_NONE UINT32_MAX
+
+#define lxb_grammar_bytecode_serialize_send(data, len, cb, ctx)                \
+    do {                                                                       \
+        status = cb((const lxb_char_t *) data, len, ctx);                      \
+        if (status != LXB_STATUS_OK) {                                         \
+            return status;                                                     \
+        }                                                                      \
+    }                                                                          \
+    while (0)
+
+
+typedef struct {
+    const char *name;
+    size_t     length;
+}
+lxb_grammar_bytecode_op_name_t;
+
+#define lxb_grammar_bytecode_op_name_entry(name)                               \
+    {name, (sizeof(name) - 1)}
+
+static const lxb_grammar_bytecode_op_name_t
+lxb_grammar_bytecode_op_names[LXB_GRAMMAR_BYTECODE_OP__LAST_ENTRY] = {
+    lxb_grammar_bytecode_op_name_entry("TERM"),
+    lxb_grammar_bytecode_op_name_entry("SPLIT"),
+    lxb_grammar_bytecode_op_name_entry("JUMP"),
+    lxb_grammar_bytecode_op_name_entry("CALL"),
+    lxb_grammar_bytecode_op_name_entry("RET"),
+    lxb_grammar_bytecode_op_name_entry("COUNTER_ENTER"),
+    lxb_grammar_bytecode_op_name_entry("COUNTER_LOOP"),
+    lxb_grammar_bytecode_op_name_entry("COUNTER_NEXT"),
+    lxb_grammar_bytecode_op_name_entry("COUNTER_EXIT"),
+    lxb_grammar_bytecode_op_name_entry("MASK_ENTER"),
+    lxb_grammar_bytecode_op_name_entry("MASK_TEST"),
+    lxb_grammar_bytecode_op_name_entry("MASK_SET"),
+    lxb_grammar_bytecode_op_name_entry("MASK_EXIT"),
+    lxb_grammar_bytecode_op_name_entry("FAIL"),
+    lxb_grammar_bytecode_op_name_entry("ACCEPT")
+};
+
+
+typedef struct {
+    lxb_grammar_bytecode_t *bc;
+
+    /* Declaration index by node id. */
+    uint32_t               *decl_idx;
+
+    /* Registers of the current frame. */
+    uint32_t               registers;
+
+    lxb_grammar_bounds_t   bounds;
+}
+lxb_grammar_bytecode_ctx_t;
+
+
+static lxb_status_t
+lxb_grammar_bytecode_decl_reg(lxb_grammar_bytecode_ctx_t *ctx,
+                              lxb_grammar_node_t *decl);
+
+static lxb_status_t
+lxb_grammar_bytecode_keywords(lxb_grammar_bytecode_t *bc,
+                              lxb_grammar_tree_t *tree);
+
+static lxb_status_t
+lxb_grammar_bytecode_hash(lxb_grammar_bytecode_t *bc);
+
+static lxb_status_t
+lxb_grammar_bytecode_compile_decl(lxb_grammar_bytecode_ctx_t *ctx,
+                                  lxb_grammar_bytecode_decl_t *decl,
+                                  lxb_grammar_node_t *node);
+
+static lxb_status_t
+lxb_grammar_bytecode_compile_node(lxb_grammar_bytecode_ctx_t *ctx,
+                                  lxb_grammar_node_t *node);
+
+static lxb_status_t
+lxb_grammar_bytecode_compile_once(lxb_grammar_bytecode_ctx_t *ctx,
+                                  lxb_grammar_node_t *node);
+
+static lxb_status_t
+lxb_grammar_bytecode_compile_group(lxb_grammar_bytecode_ctx_t *ctx,
+                                   lxb_grammar_node_t *group);
+
+static lxb_status_t
+lxb_grammar_bytecode_compile_set(lxb_grammar_bytecode_ctx_t *ctx,
+                                 lxb_grammar_node_t *group);
+
+static lxb_status_t
+lxb_grammar_bytecode_compile_term(lxb_grammar_bytecode_ctx_t *ctx,
+                                  lxb_grammar_node_t *node);
+
+static int
+lxb_grammar_bytecode_cmp(const lxb_char_t *first, size_t first_len,
+                         const lxb_char_t *second, size_t second_len);
+
+static lxb_status_t
+lxb_grammar_bytecode_index_insert(lxb_grammar_bytecode_t *bc, uint32_t idx);
+
+static lxb_status_t
+lxb_grammar_bytecode_keyword_insert(lxb_grammar_bytecode_t *bc,
+                                    const lexbor_str_t *str, uint32_t id);
+
+
+lxb_grammar_bytecode_t *
+lxb_grammar_bytecode_create(void)
+{
+    return lexbor_calloc(1, sizeof(lxb_grammar_bytecode_t));
+}
+
+lxb_status_t
+lxb_grammar_bytecode_init(lxb_grammar_bytecode_t *bc)
+{
+    lxb_status_t status;
+
+    if (bc == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    status = lexbor_array_obj_init(&bc->code, 1024,
+                                   sizeof(lxb_grammar_bytecode_instr_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lexbor_array_obj_init(&bc->terms, 256,
+                                   sizeof(lxb_grammar_bytecode_term_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lexbor_array_obj_init(&bc->decls, 128,
+                                   sizeof(lxb_grammar_bytecode_decl_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lexbor_array_obj_init(&bc->index, 128, sizeof(uint32_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lexbor_array_obj_init(&bc->keywords, 256,
+                                   sizeof(lxb_grammar_bytecode_keyword_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lexbor_array_obj_init(&bc->hash, 256, sizeof(uint32_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    bc->mraw = lexbor_mraw_create();
+    status = lexbor_mraw_init(bc->mraw, 4096);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    if (lexbor_str_init(&bc->strings, bc->mraw, 1024) == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    bc->keyword_max_len = 0;
+    bc->deterministic = false;
+    bc->tree = NULL;
+    bc->external = false;
+    bc->last_node = NULL;
+    bc->last_error = NULL;
+
+    return LXB_STATUS_OK;
+}
+
+void
+lxb_grammar_bytecode_clean(lxb_grammar_bytecode_t *bc)
+{
+    if (bc->external) {
+        return;
+    }
+
+    lexbor_array_obj_clean(&bc->code);
+    lexbor_array_obj_clean(&bc->terms);
+    lexbor_array_obj_clean(&bc->decls);
+    lexbor_array_obj_clean(&bc->index);
+    lexbor_array_obj_clean(&bc->keywords);
+    lexbor_array_obj_clean(&bc->hash);
+
+    bc->strings.length = 0;
+
+    bc->keyword_max_len = 0;
+    bc->tree = NULL;
+    bc->last_node = NULL;
+    bc->last_error = NULL;
+}
+
+lxb_grammar_bytecode_t *
+lxb_grammar_bytecode_destroy(lxb_grammar_bytecode_t *bc, bool self_destroy)
+{
+    if (bc == NULL) {
+        return NULL;
+    }
+
+    if (bc->external) {
+        goto done;
+    }
+
+    lexbor_array_obj_destroy(&bc->code, false);
+    lexbor_array_obj_destroy(&bc->terms, false);
+    lexbor_array_obj_destroy(&bc->decls, false);
+    lexbor_array_obj_destroy(&bc->index, false);
+    lexbor_array_obj_destroy(&bc->keywords, false);
+    lexbor_array_obj_destroy(&bc->hash, false);
+
+    bc->mraw = lexbor_mraw_destroy(bc->mraw, true);
+
+done:
+
+    if (self_destroy) {
+        return lexbor_free(bc);
+    }
+
+    return bc;
+}
+
+lxb_status_t
+lxb_grammar_bytecode_make(lxb_grammar_bytecode_t *bc, lxb_grammar_tree_t *tree)
+{
+    size_t held;
+    lxb_status_t status;
+    lxb_grammar_node_t *root, *node;
+    lxb_grammar_bytecode_ctx_t ctx;
+
+    if (bc->external || tree->nodes->length == 0) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    root = tree->nodes->list[0];
+
+    if (root->type != LXB_GRAMMAR_NODE_ROOT) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    lxb_grammar_bytecode_clean(bc);
+
+    if (bc->deterministic) {
+        status = lxb_grammar_ambiguity_verify(tree, &bc->last_node);
+        if (status != LXB_STATUS_OK) {
+            if (bc->last_node != NULL) {
+                bc->last_error = "Ambiguous grammar in deterministic mode.";
+            }
+
+            return status;
+        }
+    }
+
+    bc->tree = tree;
+
+    memset(&ctx, 0, sizeof(lxb_grammar_bytecode_ctx_t));
+
+    ctx.bc = bc;
+
+    /* The index of declarations and the bounds, freed when compiled. */
+    held = tree->nodes->length * (sizeof(uint32_t) + sizeof(size_t) * 2);
+    lxb_grammar_memory_hold(tree->document, held);
+
+    ctx.decl_idx = lexbor_calloc(tree->nodes->length, sizeof(uint32_t));
+    if (ctx.decl_idx == NULL) {
+        status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        goto done;
+    }
+
+    status = lxb_grammar_bounds_init(&ctx.bounds, tree);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    /* All declarations first, CALL may point forward. */
+    for (node = root->first_child; node != NULL; node = node->next) {
+        status = lxb_grammar_bytecode_decl_reg(&ctx, node);
+        if (status != LXB_STATUS_OK) {
+            goto done;
+        }
+    }
+
+    for (node = root->first_child; node != NULL; node = node->next) {
+        status = lxb_grammar_bytecode_compile_decl(&ctx,
+                       lexbor_array_obj_get(&bc->decls, ctx.decl_idx[node->id]),
+                       node);
+        if (status != LXB_STATUS_OK) {
+            goto done;
+        }
+    }
+
+    status = lxb_grammar_bytecode_keywords(bc, tree);
+
+done:
+
+    lxb_grammar_memory_release(tree->document, tree, bc, held);
+
+    lexbor_free(ctx.decl_idx);
+    (void) lxb_grammar_bounds_destroy(&ctx.bounds, false);
+
+    if (status == LXB_STATUS_OK) {
+        lxb_grammar_memory_peak(tree->document, tree, bc);
+    }
+
+    return status;
+}
+
+static lxb_status_t
+lxb_grammar_bytecode_string_append(lxb_grammar_bytecode_t *bc,
+                                   const lxb_char_t *data, size_t len,
+                                   uint32_t *offset)
+{
+    *offset = (uint32_t) bc->strings.length;
+
+    if (len == 0) {
+        return LXB_STATUS_OK;
+    }
+
+    if (bc->strings.length + len >= UINT32_MAX) {
+        return LXB_STATUS_ERROR_OVERFLOW;
+    }
+
+    if (lexbor_str_append(&bc->strings, bc->mraw, data, len) == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_bytecode_decl_reg(lxb_grammar_bytecode_ctx_t *ctx,
+                              lxb_grammar_node_t *node)
+{
+    size_t len;
+    lxb_status_t status;
+    const lxb_char_t *name;
+    lxb_grammar_bytecode_decl_t *decl;
+    lxb_grammar_bytecode_t *bc = ctx->bc;
+
+    if (node->type != LXB_GRAMMAR_NODE_DECLARATION) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    decl = lexbor_array_obj_push(&bc->decls);
+    if (decl == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    memset(decl, 0, sizeof(lxb_grammar_bytecode_decl_t));
+
+    name = lxb_grammar_tree_node_name(node, &len);
+
+    status = lxb_grammar_bytecode_string_append(bc, name, len, &decl->name);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    decl->name_len = (uint32_t) len;
+    decl->node_id = (uint32_t) node->id;
+
+    decl->min_tokens = (uint32_t) lexbor_min(lxb_grammar_bounds_min(&ctx->bounds,
+                                                                    node),
+                                             UINT32_MAX);
+    decl->max_tokens = (uint32_t) lexbor_min(lxb_grammar_bounds_max(&ctx->bounds,
+                                                                    node),
+                                             UINT32_MAX);
+
+    ctx->decl_idx[node->id] = (uint32_t) (bc->decls.length - 1);
+
+    return lxb_grammar_bytecode_index_insert(bc, ctx->decl_idx[node->id]);
+}
+
+static lxb_status_t
+lxb_grammar_bytecode_keywords(lxb_grammar_bytecode_t *bc,
+                              lxb_grammar_tree_t *tree)
+{
+    lxb_status_t status;
+    lexbor_bst_map_entry_t *entry;
+
+    for (size_t i = 0; i < tree->keyword_list->length; i++) {
+        entry = tree->keyword_list->list[i];
+
+        status = lxb_grammar_bytecode_keyword_insert(bc, &entry->str,
+                                                     (uint32_t) (i + 1));
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+    }
+
+    bc->keyword_max_len = tree->keyword_max_len;
+
+    return lxb_grammar_bytecode_hash(bc);
+}
+
+static lxb_status_t
+lxb_grammar_bytecode_hash(lxb_grammar_bytecode_t *bc)
+{
+    size_t size, held;
+    lexbor_str_t *keys;
+    lxb_status_t status;
+    const lxb_grammar_bytecode_keyword_t *keyword;
+
+    size = lxb_grammar_phash_size(bc->keywords.length);
+
+    lexbor_array_obj_clean(&bc->hash);
+
+    if (lexbor_array_obj_expand(&bc->hash, size) == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    held = sizeof(lexbor_str_t) * (bc->keywords.length + 1);
+
+    keys = lexbor_malloc(held);
+    if (keys == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    lxb_grammar_memory_hold(bc->tree->document, held);
+
+    for (size_t i = 0; i < bc->keywords.length; i++) {
+        keyword = lexbor_array_obj_get(&bc->keywords, i);
+
+        keys[i].data = (lxb_char_t *) lxb_grammar_bytecode_string(bc,
+                                                                  keyword->str);
+        keys[i].length = keyword->length;
+    }
+
+    status = lxb_grammar_phash_make(keys, bc->keywords.length,
+                                    (uint32_t *) bc->hash.list);
+
+    lxb_grammar_memory_release(bc->tree->document, bc->tree, bc, held);
+
+    lexbor_free(keys);
+
+    if (status != LXB_STATUS_OK) {
+        bc->last_error = "Failed to make hash of keywords.";
+        return status;
+    }
+
+    bc->hash.length = size;
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_grammar_bytecode_instr_t *
+lxb_grammar_bytecode_emit(lxb_grammar_bytecode_t *bc,
+                          lxb_grammar_bytecode_op_t op, unsigned reg)
+{
+    lxb_grammar_bytecode_instr_t *instr;
+
+    if (bc->code.length >= LXB_GRAMMAR_BYTECODE_NONE) {
+        return NULL;
+    }
+
+    instr = lexbor_array_obj_push(&bc->code);
+    if (instr == NULL) {
+        return NULL;
+    }
+
+    memset(instr, 0, sizeof(lxb_grammar_bytecode_instr_t));
+
+    instr->opcode = (uint8_t) op;
+    instr->reg = (uint16_t) reg;
+
+    return instr;
+}
+
+lxb_inline uint32_t
+lxb_grammar_bytecode_pc(lxb_grammar_bytecode_t *bc)
+{
+    return (uint32_t) bc->code.length;
+}
+
+lxb_inline lxb_grammar_bytecode_instr_t *
+lxb_grammar_bytecode_instr(lxb_grammar_bytecode_t *bc, uint32_t pc)
+{
+    return lexbor_array_obj_get(&bc->code, pc);
+}
+
+static lxb_status_t
+lxb_grammar_bytecode_reg(lxb_grammar_bytecode_ctx_t *ctx,
+                         lxb_grammar_node_t *node, unsigned *reg)
+{
+    if (ctx->registers > UINT16_MAX) {
+        ctx->bc->last_node = node;
+        ctx->bc->last_error = "Too many registers in the declaration.";
+
+        return LXB_STATUS_ERROR_OVERFLOW;
+    }
+
+    *reg = ctx->registers++;
+
+    return LXB_STATUS_OK;
+}
+
+/*
+ * entry: COUNTER_ENTER r0, CALL decl, COUNTER_EXIT r0, ACCEPT
+ * body:  <group>, RET
+ */
+static lxb_status_t
+lxb_grammar_bytecode_compile_decl(lxb_grammar_bytecode_ctx_t *ctx,
+                                  lxb_grammar_bytecode_decl_t *decl,
+                                  lxb_grammar_node_t *node)
+{
+    uint32_t entry, body, entry_regs;
+    lxb_status_t status;
+    lxb_grammar_bytecode_t *bc = ctx->bc;
+
+    entry = lxb_grammar_bytecode_pc(bc);
+    ctx->registers = 0;
+
+    status = lxb_grammar_bytecode_compile_node(ctx, node);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    if (lxb_grammar_bytecode_emit(bc, LXB_GRAMMAR_BYTECODE_OP_ACCEPT,
+                                  0) == NULL)
+    {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    entry_regs = ctx->registers;
+
+    body = lxb_grammar_bytecode_pc(bc);
+    ctx->registers = 0;
+
+    status = lxb_grammar_bytecode_compile_group(ctx, node);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    if (lxb_grammar_bytecode_emit(bc, LXB_GRAMMAR_BYTECODE_OP_RET, 0) == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    /* The array could be reallocated. */
+    decl = lexbor_array_obj_get(&bc->decls, ctx->decl_idx[node->id]);
+
+    decl->entry = entry;
+    decl->entry_registers = entry_regs;
+    decl->body = body;
+    decl->registers = ctx->registers;
+
+    return LXB_STATUS_OK;
+}
+
+/*
+ * Straight, min == max == 1:
+ *     COUNTER_ENTER r, <once>, COUNTER_EXIT r
+ *
+ * Loop, greedy:
+ *     COUNTER_ENTER r
+ *     loop: COUNTER_LOOP r, exit, min, max
+ *     <once>
+ *     COUNTER_NEXT r, loop, min
+ *     exit: COUNTER_EXIT r
+ */
+static lxb_status_t
+lxb_grammar_bytecode_compile_node(lxb_grammar_bytecode_ctx_t *ctx,
+                                  lxb_grammar_node_t *node)
+{
+    long min, max;
+    unsigned reg;
+    uint32_t loop;
+    lxb_status_t status;
+    lxb_grammar_bytecode_instr_t *instr;
+    lxb_grammar_bytecode_t *bc = ctx->bc;
+
+    status = lxb_grammar_bytecode_reg(ctx, node, &reg);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    min = lxb_grammar_node_repeat_min(node);
+    max = lxb_grammar_node_repeat_max(node);
+
+    if (lxb_grammar_bytecode_emit(bc, LXB_GRAMMAR_BYTECODE_OP_COUNTER_ENTER,
+                                  reg) == NULL)
+    {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    if (min == 1 && max == 1) {
+        status = lxb_grammar_bytecode_compile_once(ctx, node);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        instr = lxb_grammar_bytecode_emit(bc,
+                                          LXB_GRAMMAR_BYTECODE_OP_COUNTER_EXIT,
+                                          reg);
+        if (instr == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        instr->a = (uint32_t) node->id;
+
+        if (lxb_grammar_node_is_required(node)) {
+            instr->flags |= LXB_GRAMMAR_BYTECODE_FLAGS_REQUIRED;
+        }
+
+        return LXB_STATUS_OK;
+    }
+
+    loop = lxb_grammar_bytecode_pc(bc);
+
+    instr = lxb_grammar_bytecode_emit(bc, LXB_GRAMMAR_BYTECODE_OP_COUNTER_LOOP,
+                                      reg);
+    if (instr == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    instr->b = (uint32_t) min;
+    instr->c = (max < 0) ? LXB_GRAMMAR_BYTECODE_INFINITY : (uint32_t) max;
+
+    if (node->is_comma_separated) {
+        instr->flags |= LXB_GRAMMAR_BYTECODE_FLAGS_COMMA;
+    }
+
+    status = lxb_grammar_bytecode_compile_once(ctx, node);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    instr = lxb_grammar_bytecode_emit(bc, LXB_GRAMMAR_BYTECODE_OP_COUNTER_NEXT,
+                                      reg);
+    if (instr == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    instr->a = loop;
+    instr->b = (uint32_t) min;
+
+    lxb_grammar_bytecode_instr(bc, loop)->a = lxb_grammar_bytecode_pc(bc);
+
+    instr = lxb_grammar_bytecode_emit(bc, LXB_GRAMMAR_BYTECODE_OP_COUNTER_EXIT,
+                                      reg);
+    if (instr == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    instr->a = (uint32_t) node->id;
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_bytecode_compile_once(lxb_grammar_bytecode_ctx_t *ctx,
+                                  lxb_grammar_node_t *node)
+{
+    lxb_grammar_node_t *decl;
+    lxb_grammar_bytecode_instr_t *instr;
+
+    switch (node->type) {
+        case LXB_GRAMMAR_NODE_GROUP:
+            return lxb_grammar_bytecode_compile_group(ctx, node);
+
+        case LXB_GRAMMAR_NODE_DECLARATION:
+            decl = node;
+            break;
+
+        case LXB_GRAMMAR_NODE_ELEMENT:
+            if (node->bst_declaration == NULL) {
+                return lxb_grammar_bytecode_compile_term(ctx, node);
+            }
+
+            decl = node->bst_declaration->value;
+            break;
+
+        default:
+            return lxb_grammar_bytecode_compile_term(ctx, node);
+    }
+
+    instr = lxb_grammar_bytecode_emit(ctx->bc, LXB_GRAMMAR_BYTECODE_OP_CALL, 0);
+    if (instr == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    instr->a = ctx->decl_idx[decl->id];
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_bytecode_compile_group(lxb_grammar_bytecode_ctx_t *ctx,
+                                   lxb_grammar_node_t *group)
+{
+    uint32_t split, jumps, next;
+    lxb_status_t status;
+    lxb_grammar_node_t *node;
+    lxb_grammar_bytecode_instr_t *instr;
+    lxb_grammar_bytecode_t *bc = ctx->bc;
+
+    switch (group->combinator) {
+        case LXB_GRAMMAR_COMBINATOR_ONE_OF:
+            if (group->first_child == NULL) {
+                if (lxb_grammar_bytecode_emit(bc, LXB_GRAMMAR_BYTECODE_OP_FAIL,
+                                              0) == NULL)
+                {
+                    return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+                }
+
+                return LXB_STATUS_OK;
+            }
+
+            /* Jumps to the end are chained by the "a" field. */
+            jumps = LXB_GRAMMAR_BYTECODE_NONE;
+
+            for (node = group->first_child; node->next != NULL;
+                 node = node->next)
+            {
+                split = lxb_grammar_bytecode_pc(bc);
+
+                instr = lxb_grammar_bytecode_emit(bc,
+                                                  LXB_GRAMMAR_BYTECODE_OP_SPLIT,
+                                                  0);
+                if (instr == NULL) {
+                    return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+                }
+
+                instr->a = split + 1;
+
+                status = lxb_grammar_bytecode_compile_node(ctx, node);
+                if (status != LXB_STATUS_OK) {
+                    return status;
+                }
+
+                next = lxb_grammar_bytecode_pc(bc);
+
+                instr = lxb_grammar_bytecode_emit(bc,
+                                                  LXB_GRAMMAR_BYTECODE_OP_JUMP,
+                                                  0);
+                if (instr == NULL) {
+                    return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+                }
+
+                instr->a = jumps;
+                jumps = next;
+
+                lxb_grammar_bytecode_instr(bc, split)->b =
+                                                  lxb_grammar_bytecode_pc(bc);
+            }
+
+            status = lxb_grammar_bytecode_compile_node(ctx, node);
+            if (status != LXB_STATUS_OK) {
+                return status;
+            }
+
+            next = lxb_grammar_bytecode_pc(bc);
+
+            while (jumps != LXB_GRAMMAR_BYTECODE_NONE) {
+                instr = lxb_grammar_bytecode_instr(bc, jumps);
+
+                jumps = instr->a;
+                instr->a = next;
+            }
+
+            return LXB_STATUS_OK;
+
+        case LXB_GRAMMAR_COMBINATOR_AND:
+        case LXB_GRAMMAR_COMBINATOR_OR:
+            return lxb_grammar_bytecode_compile_set(ctx, group);
+
+        default:
+            for (node = group->first_child; node != NULL; node = node->next) {
+                status = lxb_grammar_bytecode_compile_node(ctx, node);
+                if (status != LXB_STATUS_OK) {
+                    return status;
+                }
+            }
+
+            return LXB_STATUS_OK;
+    }
+}
+
+/*
+ *     MASK_ENTER r
+ *     top: SPLIT c0, t1
+ *     c0: MASK_TEST r, 0; <child 0>; MASK_SET r, 0; JUMP top
+ *     t1: SPLIT c1, t2
+ *     ...
+ *     tn: MASK_EXIT r, n
+ */
+static lxb_status_t
+lxb_grammar_bytecode_compile_set(lxb_grammar_bytecode_ctx_t *ctx,
+                                 lxb_grammar_node_t *group)
+{
+    unsigned reg;
+    uint32_t top, split, bit;
+    lxb_status_t status;
+    lxb_grammar_node_t *node;
+    lxb_grammar_bytecode_instr_t *instr;
+    lxb_grammar_bytecode_t *bc = ctx->bc;
+
+    status = lxb_grammar_bytecode_reg(ctx, group, &reg);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    if (lxb_grammar_bytecode_emit(bc, LXB_GRAMMAR_BYTECODE_OP_MASK_ENTER,
+                                  reg) == NULL)
+    {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    top = lxb_grammar_bytecode_pc(bc);
+    bit = 0;
+
+    for (node = group->first_child; node != NULL; node = node->next, bit++) {
+        split = lxb_grammar_bytecode_pc(bc);
+
+        instr = lxb_grammar_bytecode_emit(bc, LXB_GRAMMAR_BYTECODE_OP_SPLIT, 0);
+        if (instr == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        instr->a = split + 1;
+
+        instr = lxb_grammar_bytecode_emit(bc, LXB_GRAMMAR_BYTECODE_OP_MASK_TEST,
+                                          reg);
+        if (instr == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        instr->a = bit;
+
+        status = lxb_grammar_bytecode_compile_node(ctx, node);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        instr = lxb_grammar_bytecode_emit(bc, LXB_GRAMMAR_BYTECODE_OP_MASK_SET,
+                                          reg);
+        if (instr == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        instr->a = bit;
+
+        instr = lxb_grammar_bytecode_emit(bc, LXB_GRAMMAR_BYTECODE_OP_JUMP, 0);
+        if (instr == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        instr->a = top;
+
+        lxb_grammar_bytecode_instr(bc, split)->b = lxb_grammar_bytecode_pc(bc);
+    }
+
+    instr = lxb_grammar_bytecode_emit(bc, LXB_GRAMMAR_BYTECODE_OP_MASK_EXIT,
+                                      reg);
+    if (instr == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    instr->a = bit;
+
+    if (group->combinator == LXB_GRAMMAR_COMBINATOR_OR) {
+        instr->flags |= LXB_GRAMMAR_BYTECODE_FLAGS_ANY;
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_bytecode_compile_term(lxb_grammar_bytecode_ctx_t *ctx,
+                                  lxb_grammar_node_t *node)
+{
+    lxb_status_t status;
+    lxb_grammar_bytecode_term_t *term;
+    lxb_grammar_bytecode_instr_t *instr;
+    lxb_grammar_bytecode_t *bc = ctx->bc;
+
+    if (bc->terms.length >= LXB_GRAMMAR_BYTECODE_NONE) {
+        return LXB_STATUS_ERROR_OVERFLOW;
+    }
+
+    term = lexbor_array_obj_push(&bc->terms);
+    if (term == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    memset(term, 0, sizeof(lxb_grammar_bytecode_term_t));
+
+    switch (node->type) {
+        case LXB_GRAMMAR_NODE_UNQUOTED:
+            term->type = LXB_GRAMMAR_BYTECODE_TERM_KEYWORD;
+            term->value = (uint32_t) node->keyword_id;
+            break;
+
+        case LXB_GRAMMAR_NODE_STRING:
+        case LXB_GRAMMAR_NODE_DELIM:
+            term->type = LXB_GRAMMAR_BYTECODE_TERM_LITERAL;
+            term->length = (uint32_t) node->u.str.length;
+
+            status = lxb_grammar_bytecode_string_append(bc, node->u.str.data,
+                                                        node->u.str.length,
+                                                        &term->value);
+            if (status != LXB_STATUS_OK) {
+                return status;
+            }
+
+            break;
+
+        case LXB_GRAMMAR_NODE_NUMBER:
+            term->type = LXB_GRAMMAR_BYTECODE_TERM_NUMBER;
+            term->num = node->u.num;
+            break;
+
+        case LXB_GRAMMAR_NODE_ELEMENT:
+            term->type = LXB_GRAMMAR_BYTECODE_TERM_TYPE;
+            term->value = node->type_id;
+            break;
+
+        default:
+            term->type = LXB_GRAMMAR_BYTECODE_TERM_NONE;
+            break;
+    }
+
+    instr = lxb_grammar_bytecode_emit(bc, LXB_GRAMMAR_BYTECODE_OP_TERM, 0);
+    if (instr == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    instr->a = (uint32_t) (bc->terms.length - 1);
+
+    return LXB_STATUS_OK;
+}
+
+static int
+lxb_grammar_bytecode_cmp(const lxb_char_t *first, size_t first_len,
+                         const lxb_char_t *second, size_t second_len)
+{
+    int res;
+
+    res = memcmp(first, second, (first_len < second_len) ? first_len
+                                                          : second_len);
+    if (res != 0) {
+        return res;
+    }
+
+    if (first_len == second_len) {
+        return 0;
+    }
+
+    return (first_len < second_len) ? -1 : 1;
+}
+
+/*
+ * The sorted arrays are filled once by lxb_grammar_bytecode_make(),
+ * insertion keeps them sorted without a global context for qsort().
+ */
+static size_t
+lxb_grammar_bytecode_index_find(lxb_grammar_bytecode_t *bc,
+                                const lxb_char_t *name, size_t len,
+                                bool *found)
+{
+    int res;
+    size_t left, right, mid;
+    const uint32_t *index;
+    const lxb_grammar_bytecode_decl_t *decl;
+
+    index = (const uint32_t *) bc->index.list;
+    left = 0;
+    right = bc->index.length;
+
+    *found = false;
+
+    while (left < right) {
+        mid = left + (right - left) / 2;
+        decl = lxb_grammar_bytecode_decl(bc, index[mid]);
+
+        res = lxb_grammar_bytecode_cmp(lxb_grammar_bytecode_string(bc,
+                                                                   decl->name),
+                                       decl->name_len, name, len);
+        if (res == 0) {
+            *found = true;
+            return mid;
+        }
+
+        if (res < 0) {
+            left = mid + 1;
+        }
+        else {
+            right = mid;
+        }
+    }
+
+    return left;
+}
+
+static size_t
+lxb_grammar_bytecode_keyword_find(lxb_grammar_bytecode_t *bc,
+                                  const lxb_char_t *data, size_t len,
+                                  bool *found)
+{
+    int res;
+    size_t left, right, mid;
+    const lxb_grammar_bytecode_keyword_t *keywords, *keyword;
+
+    keywords = (const lxb_grammar_bytecode_keyword_t *) bc->keywords.list;
+    left = 0;
+    right = bc->keywords.length;
+
+    *found = false;
+
+    while (left < right) {
+        mid = left + (right - left) / 2;
+        keyword = &keywords[mid];
+
+        res = lxb_grammar_bytecode_cmp(lxb_grammar_bytecode_string(bc,
+                                                                  keyword->str),
+                                       keyword->length, data, len);
+        if (res == 0) {
+            *found = true;
+            return mid;
+        }
+
+        if (res < 0) {
+            left = mid + 1;
+        }
+        else {
+            right = mid;
+        }
+    }
+
+    return left;
+}
+
+static void *
+lxb_grammar_bytecode_array_insert(lexbor_array_obj_t *array, size_t idx)
+{
+    uint8_t *entry;
+
+    if (lexbor_array_obj_push(array) == NULL) {
+        return NULL;
+    }
+
+    entry = array->list + (idx * array->struct_size);
+
+    memmove(entry + array->struct_size, entry,
+            (array->length - idx - 1) * array->struct_size);
+
+    return entry;
+}
+
+static lxb_status_t
+lxb_grammar_bytecode_index_insert(lxb_grammar_bytecode_t *bc, uint32_t idx)
+{
+    bool found;
+    size_t pos;
+    uint32_t *entry;
+    const lxb_grammar_bytecode_decl_t *decl;
+
+    decl = lxb_grammar_bytecode_decl(bc, idx);
+
+    pos = lxb_grammar_bytecode_index_find(bc,
+                                lxb_grammar_bytecode_string(bc, decl->name),
+                                decl->name_len, &found);
+
+    entry = lxb_grammar_bytecode_array_insert(&bc->index, pos);
+    if (entry == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    *entry = idx;
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_bytecode_keyword_insert(lxb_grammar_bytecode_t *bc,
+                                    const lexbor_str_t *str, uint32_t id)
+{
+    bool found;
+    size_t pos;
+    uint32_t offset;
+    lxb_status_t status;
+    lxb_grammar_bytecode_keyword_t *keyword;
+
+    status = lxb_grammar_bytecode_string_append(bc, str->data, str->length,
+                                                &offset);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    pos = lxb_grammar_bytecode_keyword_find(bc, str->data, str->length,
+                                            &found);
+
+    keyword = lxb_grammar_bytecode_array_insert(&bc->keywords, pos);
+    if (keyword == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    keyword->str = offset;
+    keyword->length = (uint32_t) str->length;
+    keyword->id = id;
+
+    return LXB_STATUS_OK;
+}
+
+long
+lxb_grammar_bytecode_declaration(lxb_grammar_bytecode_t *bc,
+                                 const lxb_char_t *name, size_t len)
+{
+    bool found;
+    size_t pos;
+
+    if (len >= 2 && name[0] == '<' && name[len - 1] == '>') {
+        name++;
+        len -= 2;
+    }
+
+    pos = lxb_grammar_bytecode_index_find(bc, name, len, &found);
+    if (!found) {
+        return -1;
+    }
+
+    return (long) ((const uint32_t *) bc->index.list)[pos];
+}
+
+size_t
+lxb_grammar_bytecode_keyword(lxb_grammar_bytecode_t *bc,
+                             const lxb_char_t *data, size_t len)
+{
+    size_t idx;
+    const lxb_grammar_bytecode_keyword_t *keyword;
+
+    idx = lxb_grammar_phash_find((const uint32_t *) bc->hash.list,
+                                 bc->keywords.length, data, len);
+    if (idx >= bc->keywords.length) {
+        return 0;
+    }
+
+    keyword = &((const lxb_grammar_bytecode_keyword_t *) bc->keywords.list)[idx];
+
+    if (keyword->length != len
+        || memcmp(lxb_grammar_bytecode_string(bc, keyword->str), data, len) != 0)
+    {
+        return 0;
+    }
+
+    return keyword->id;
+}
+
+const lxb_char_t *
+lxb_grammar_bytecode_op_name(lxb_grammar_bytecode_op_t op, size_t *len)
+{
+    if (op >= LXB_GRAMMAR_BYTECODE_OP__LAST_ENTRY) {
+        if (len != NULL) {
+            *len = 0;
+        }
+
+        return NULL;
+    }
+
+    if (len != NULL) {
+        *len = lxb_grammar_bytecode_op_names[op].length;
+    }
+
+    return (const lxb_char_t *) lxb_grammar_bytecode_op_names[op].name;
+}
+
+static lxb_status_t
+lxb_grammar_bytecode_serialize_num(const char *prefix, size_t value,
+                                   lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    size_t len;
+    lxb_status_t status;
+    lxb_char_t buf[128];
+
+    lxb_grammar_bytecode_serialize_send(prefix, strlen(prefix), func, ctx);
+
+    len = lexbor_conv_long_to_data((long) value, buf, sizeof(buf));
+
+    lxb_grammar_bytecode_serialize_send(buf, len, func, ctx);
+
+    return LXB_STATUS_OK;
+}
+
+/*
+ * One instruction per line:
+ *     <address> <opcode> [r<reg>] [<a> [<b> [<c>]]]
+ */
+lxb_status_t
+lxb_grammar_bytecode_serialize(lxb_grammar_bytecode_t *bc,
+                               lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    size_t len, args;
+    lxb_status_t status;
+    const lxb_char_t *name;
+    const lxb_grammar_bytecode_instr_t *instr;
+
+    for (size_t i = 0; i < bc->code.length; i++) {
+        instr = lexbor_array_obj_get(&bc->code, i);
+
+        status = lxb_grammar_bytecode_serialize_num("", i, func, ctx);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        name = lxb_grammar_bytecode_op_name(instr->opcode, &len);
+
+        lxb_grammar_bytecode_serialize_send(" ", 1, func, ctx);
+        lxb_grammar_bytecode_serialize_send(name, len, func, ctx);
+
+        switch (instr->opcode) {
+            case LXB_GRAMMAR_BYTECODE_OP_COUNTER_ENTER:
+            case LXB_GRAMMAR_BYTECODE_OP_COUNTER_LOOP:
+            case LXB_GRAMMAR_BYTECODE_OP_COUNTER_NEXT:
+            case LXB_GRAMMAR_BYTECODE_OP_COUNTER_EXIT:
+            case LXB_GRAMMAR_BYTECODE_OP_MASK_ENTER:
+            case LXB_GRAMMAR_BYTECODE_OP_MASK_TEST:
+            case LXB_GRAMMAR_BYTECODE_OP_MASK_SET:
+            case LXB_GRAMMAR_BYTECODE_OP_MASK_EXIT:
+                status = lxb_grammar_bytecode_serialize_num(" r", instr->reg,
+                                                            func, ctx);
+                if (status != LXB_STATUS_OK) {
+                    return status;
+                }
+
+                break;
+
+            default:
+                break;
+        }
+
+        switch (instr->opcode) {
+            case LXB_GRAMMAR_BYTECODE_OP_COUNTER_LOOP:
+                args = 3;
+                break;
+
+            case LXB_GRAMMAR_BYTECODE_OP_SPLIT:
+            case LXB_GRAMMAR_BYTECODE_OP_COUNTER_NEXT:
+                args = 2;
+                break;
+
+            case LXB_GRAMMAR_BYTECODE_OP_TERM:
+            case LXB_GRAMMAR_BYTECODE_OP_JUMP:
+            case LXB_GRAMMAR_BYTECODE_OP_CALL:
+            case LXB_GRAMMAR_BYTECODE_OP_COUNTER_EXIT:
+            case LXB_GRAMMAR_BYTECODE_OP_MASK_TEST:
+            case LXB_GRAMMAR_BYTECODE_OP_MASK_SET:
+            case LXB_GRAMMAR_BYTECODE_OP_MASK_EXIT:
+                args = 1;
+                break;
+
+            default:
+                args = 0;
+                break;
+        }
+
+        if (args > 0) {
+            status = lxb_grammar_bytecode_serialize_num(" ", instr->a,
+                                                        func, ctx);
+            if (status != LXB_STATUS_OK) {
+                return status;
+            }
+        }
+
+        if (args > 1) {
+            status = lxb_grammar_bytecode_serialize_num(" ", instr->b,
+                                                        func, ctx);
+            if (status != LXB_STATUS_OK) {
+                return status;
+            }
+        }
+
+        if (args > 2) {
+            if (instr->c == LXB_GRAMMAR_BYTECODE_INFINITY) {
+                lxb_grammar_bytecode_serialize_send(" inf", 4, func, ctx);
+            }
+            else {
+                status = lxb_grammar_bytecode_serialize_num(" ", instr->c,
+                                                            func, ctx);
+                if (status != LXB_STATUS_OK) {
+                    return status;
+                }
+            }
+        }
+
+        lxb_grammar_bytecode_serialize_send("\n", 1, func, ctx);
+    }
+
+    return LXB_STATUS_OK;
+}
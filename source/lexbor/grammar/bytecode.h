@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_BYTECODE_H
+#define LEXBOR_GRAMMAR_BYTECODE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/node.h"
+#include "lexbor/grammar/tree.h"
+#include "lexbor/grammar/phash.h"
+
+#include "lexbor/core/array_obj.h"
+#include "lexbor/core/mraw.h"
+#include "lexbor/core/str.h"
+
+
+#define LXB_GRAMMAR_BYTECODE_INFINITY UINT32_MAX
+
+
+/*
+ * Opcodes of the matcher VM.
+ *
+ * Registers (counters and masks) are local for a declaration call,
+ * every CALL gets a new frame of registers.
+ */
+typedef enum {
+    LXB_GRAMMAR_BYTECODE_OP_TERM = 0x00,  /* a: term; token or fail */
+    LXB_GRAMMAR_BYTECODE_OP_SPLIT,        /* a: first, b: on backtracking */
+    LXB_GRAMMAR_BYTECODE_OP_JUMP,         /* a: address */
+    LXB_GRAMMAR_BYTECODE_OP_CALL,         /* a: declaration */
+    LXB_GRAMMAR_BYTECODE_OP_RET,
+    LXB_GRAMMAR_BYTECODE_OP_COUNTER_ENTER,/* reg */
+    LXB_GRAMMAR_BYTECODE_OP_COUNTER_LOOP, /* reg, a: exit, b: min, c: max */
+    LXB_GRAMMAR_BYTECODE_OP_COUNTER_NEXT, /* reg, a: loop, b: min */
+    LXB_GRAMMAR_BYTECODE_OP_COUNTER_EXIT, /* reg, a: node id */
+    LXB_GRAMMAR_BYTECODE_OP_MASK_ENTER,   /* reg */
+    LXB_GRAMMAR_BYTECODE_OP_MASK_TEST,    /* reg, a: bit; fail if set */
+    LXB_GRAMMAR_BYTECODE_OP_MASK_SET,     /* reg, a: bit */
+    LXB_GRAMMAR_BYTECODE_OP_MASK_EXIT,    /* reg, a: children count */
+    LXB_GRAMMAR_BYTECODE_OP_FAIL,
+    LXB_GRAMMAR_BYTECODE_OP_ACCEPT,       /* if all tokens consumed */
+    LXB_GRAMMAR_BYTECODE_OP__LAST_ENTRY
+}
+lxb_grammar_bytecode_op_t;
+
+typedef enum {
+    LXB_GRAMMAR_BYTECODE_FLAGS_UNDEF    = 0x00,
+    LXB_GRAMMAR_BYTECODE_FLAGS_COMMA    = 0x01, /* COUNTER_LOOP: # */
+    LXB_GRAMMAR_BYTECODE_FLAGS_REQUIRED = 0x02, /* COUNTER_*: ! */
+    LXB_GRAMMAR_BYTECODE_FLAGS_ANY      = 0x04  /* MASK_EXIT: || */
+}
+lxb_grammar_bytecode_flags_t;
+
+typedef enum {
+    LXB_GRAMMAR_BYTECODE_TERM_NONE = 0x00,
+    LXB_GRAMMAR_BYTECODE_TERM_KEYWORD,    /* value: keyword id */
+    LXB_GRAMMAR_BYTECODE_TERM_LITERAL,    /* value, length: string */
+    LXB_GRAMMAR_BYTECODE_TERM_NUMBER,     /* num */
+    LXB_GRAMMAR_BYTECODE_TERM_TYPE        /* value: lxb_grammar_type_id_t */
+}
+lxb_grammar_bytecode_term_type_t;
+
+/*
+ * All references are indexes or offsets, there are no pointers.
+ */
+typedef struct {
+    uint8_t  opcode;
+    uint8_t  flags;
+    uint16_t reg;
+
+    uint32_t a;
+    uint32_t b;
+    uint32_t c;
+}
+lxb_grammar_bytecode_instr_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t value;
+    uint32_t length;
+    uint32_t reserved;
+
+    double   num;
+}
+lxb_grammar_bytecode_term_t;
+
+typedef struct {
+    uint32_t name;       /* Offset in the string table. */
+    uint32_t name_len;
+
+    uint32_t entry;      /* Top-level match: span and end of value. */
+    uint32_t entry_registers;
+    uint32_t body;       /* Target of CALL. */
+    uint32_t registers;
+
+    uint32_t node_id;
+
+    /* Count of value tokens, see lexbor/grammar/bounds.h. */
+    uint32_t min_tokens;  /* UINT32_MAX: never matches. */
+    uint32_t max_tokens;  /* UINT32_MAX: no maximum. */
+}
+lxb_grammar_bytecode_decl_t;
+
+typedef struct {
+    uint32_t str;        /* Offset in the string table, lowercase. */
+    uint32_t length;
+    uint32_t id;
+}
+lxb_grammar_bytecode_keyword_t;
+
+struct lxb_grammar_bytecode {
+    lexbor_array_obj_t code;      /* lxb_grammar_bytecode_instr_t */
+    lexbor_array_obj_t terms;     /* lxb_grammar_bytecode_term_t */
+    lexbor_array_obj_t decls;     /* lxb_grammar_bytecode_decl_t */
+    lexbor_array_obj_t index;     /* uint32_t, declarations sorted by name */
+    lexbor_array_obj_t keywords;  /* lxb_grammar_bytecode_keyword_t, sorted */
+    lexbor_array_obj_t hash;      /* uint32_t, see lexbor/grammar/phash.h */
+
+    lexbor_str_t       strings;
+    lexbor_mraw_t      *mraw;
+
+    size_t             keyword_max_len;
+
+    /* Settings, may be changed after init. */
+    bool               deterministic;  /* See lexbor/grammar/ambiguity.h. */
+
+    /* Source of the bytecode, for span nodes.  Can be NULL. */
+    lxb_grammar_tree_t *tree;
+
+    /* Tables refer to read-only memory, see lxb_grammar_artifact_load(). */
+    bool               external;
+
+    lxb_grammar_node_t *last_node;
+    const char         *last_error;
+};
+
+
+LXB_API lxb_grammar_bytecode_t *
+lxb_grammar_bytecode_create(void);
+
+LXB_API lxb_status_t
+lxb_grammar_bytecode_init(lxb_grammar_bytecode_t *bc);
+
+LXB_API void
+lxb_grammar_bytecode_clean(lxb_grammar_bytecode_t *bc);
+
+LXB_API lxb_grammar_bytecode_t *
+lxb_grammar_bytecode_destroy(lxb_grammar_bytecode_t *bc, bool self_destroy);
+
+/*
+ * Compiles all declarations of the tree (see lxb_grammar_tree_make()).
+ * The tree must live while the bytecode is used.
+ *
+ * In deterministic mode a grammar with LL(1) conflicts is refused.
+ *
+ * Not allowed for loaded bytecode.
+ */
+LXB_API lxb_status_t
+lxb_grammar_bytecode_make(lxb_grammar_bytecode_t *bc, lxb_grammar_tree_t *tree);
+
+/*
+ * Returns index of declaration or -1 if not found.
+ * Name without angle brackets, "<name>" is accepted too.
+ */
+LXB_API long
+lxb_grammar_bytecode_declaration(lxb_grammar_bytecode_t *bc,
+                                 const lxb_char_t *name, size_t len);
+
+/* Returns keyword id or 0.  Data must be lowercase. */
+LXB_API size_t
+lxb_grammar_bytecode_keyword(lxb_grammar_bytecode_t *bc,
+                             const lxb_char_t *data, size_t len);
+
+LXB_API const lxb_char_t *
+lxb_grammar_bytecode_op_name(lxb_grammar_bytecode_op_t op, size_t *len);
+
+LXB_API lxb_status_t
+lxb_grammar_bytecode_serialize(lxb_grammar_bytecode_t *bc,
+                               lxb_grammar_serialize_cb_f func, void *ctx);
+
+
+/*
+ * Inline functions
+ */
+lxb_inline const lxb_grammar_bytecode_decl_t *
+lxb_grammar_bytecode_decl(lxb_grammar_bytecode_t *bc, size_t idx)
+{
+    return lexbor_array_obj_get(&bc->decls, idx);
+}
+
+/* If false, the declaration can not match the count of tokens. */
+lxb_inline bool
+lxb_grammar_bytecode_decl_fit(const lxb_grammar_bytecode_decl_t *decl,
+                              size_t count)
+{
+    return count >= decl->min_tokens
+           && (decl->max_tokens == UINT32_MAX || count <= decl->max_tokens);
+}
+
+lxb_inline const lxb_char_t *
+lxb_grammar_bytecode_string(lxb_grammar_bytecode_t *bc, uint32_t offset)
+{
+    return bc->strings.data + offset;
+}
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_BYTECODE_H */
@@ -0,0 +1,348 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/cache.h"
+
+
+#define LXB_GRAMMAR_CACHE_MUL 0x9E3779B97F4A7C15ULL
+
+
+static size_t
+lxb_grammar_cache_clock(lxb_grammar_cache_t *cache);
+
+static size_t
+lxb_grammar_cache_slot(lxb_grammar_cache_t *cache);
+
+static void
+lxb_grammar_cache_evict(lxb_grammar_cache_t *cache, size_t idx);
+
+
+lxb_grammar_cache_t *
+lxb_grammar_cache_create(void)
+{
+    return lexbor_calloc(1, sizeof(lxb_grammar_cache_t));
+}
+
+lxb_status_t
+lxb_grammar_cache_init(lxb_grammar_cache_t *cache, size_t entries,
+                       size_t memory)
+{
+    size_t buckets;
+
+    if (cache == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    if (entries == 0) {
+        entries = LXB_GRAMMAR_CACHE_ENTRIES;
+    }
+
+    if (entries >= UINT32_MAX) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    buckets = 1;
+
+    while (buckets < entries) {
+        buckets <<= 1;
+    }
+
+    cache->entries = lexbor_calloc(entries, sizeof(lxb_grammar_cache_entry_t));
+    if (cache->entries == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    cache->buckets = lexbor_calloc(buckets, sizeof(uint32_t));
+    if (cache->buckets == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    cache->size = entries;
+    cache->mask = buckets - 1;
+    cache->memory_max = memory;
+
+    return LXB_STATUS_OK;
+}
+
+void
+lxb_grammar_cache_clean(lxb_grammar_cache_t *cache)
+{
+    for (size_t i = 0; i < cache->top; i++) {
+        cache->entries[i].spans = lexbor_free(cache->entries[i].spans);
+        cache->entries[i].used = false;
+    }
+
+    memset(cache->buckets, 0, (cache->mask + 1) * sizeof(uint32_t));
+
+    cache->length = 0;
+    cache->top = 0;
+    cache->free = 0;
+    cache->hand = 0;
+    cache->memory = 0;
+
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->evictions = 0;
+}
+
+lxb_grammar_cache_t *
+lxb_grammar_cache_destroy(lxb_grammar_cache_t *cache, bool self_destroy)
+{
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    if (cache->entries != NULL) {
+        for (size_t i = 0; i < cache->top; i++) {
+            lexbor_free(cache->entries[i].spans);
+        }
+
+        cache->entries = lexbor_free(cache->entries);
+    }
+
+    cache->buckets = lexbor_free(cache->buckets);
+
+    if (self_destroy) {
+        return lexbor_free(cache);
+    }
+
+    return cache;
+}
+
+const lxb_grammar_cache_entry_t *
+lxb_grammar_cache_find(lxb_grammar_cache_t *cache, size_t decl,
+                       const lxb_char_t *data, size_t size)
+{
+    uint32_t idx;
+    uint64_t hash;
+    lxb_grammar_cache_entry_t *entry;
+
+    hash = lxb_grammar_cache_hash(data, size);
+    idx = cache->buckets[(hash ^ decl) & cache->mask];
+
+    while (idx != 0) {
+        entry = &cache->entries[idx - 1];
+
+        if (entry->hash == hash && entry->decl == decl
+            && entry->length == size
+            && memcmp(entry->spans + entry->count, data, size) == 0)
+        {
+            entry->referenced = true;
+            cache->hits++;
+
+            return entry;
+        }
+
+        idx = entry->next;
+    }
+
+    cache->misses++;
+
+    return NULL;
+}
+
+lxb_status_t
+lxb_grammar_cache_insert(lxb_grammar_cache_t *cache, size_t decl,
+                         const lxb_char_t *data, size_t size,
+                         const lxb_grammar_match_result_t *result)
+{
+    size_t idx, block, count;
+    uint32_t *bucket;
+    lxb_grammar_cache_span_t *spans;
+    lxb_grammar_cache_entry_t *entry;
+    const lxb_grammar_match_span_t *span;
+
+    count = (result->accepted) ? result->length : 0;
+
+    if (size > LXB_GRAMMAR_CACHE_VALUE_MAX || decl >= UINT32_MAX) {
+        return LXB_STATUS_OK;
+    }
+
+    block = count * sizeof(lxb_grammar_cache_span_t) + size;
+
+    if (cache->memory_max != 0) {
+        if (block > cache->memory_max) {
+            return LXB_STATUS_OK;
+        }
+
+        while (cache->memory + block > cache->memory_max) {
+            lxb_grammar_cache_evict(cache, lxb_grammar_cache_clock(cache));
+        }
+    }
+
+    spans = lexbor_malloc((block != 0) ? block : 1);
+    if (spans == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    idx = lxb_grammar_cache_slot(cache);
+    entry = &cache->entries[idx];
+
+    for (size_t i = 0; i < count; i++) {
+        span = &result->spans[i];
+
+        spans[i].node = span->node;
+        spans[i].id = (uint32_t) span->id;
+        spans[i].first = (uint32_t) span->first;
+        spans[i].last = (uint32_t) span->last;
+        spans[i].begin = (uint32_t) (span->begin - data);
+        spans[i].end = (uint32_t) (span->end - data);
+    }
+
+    memcpy(spans + count, data, size);
+
+    entry->hash = lxb_grammar_cache_hash(data, size);
+    entry->decl = (uint32_t) decl;
+    entry->length = (uint32_t) size;
+    entry->count = (uint32_t) count;
+    entry->accepted = result->accepted;
+    entry->referenced = false;
+    entry->spans = spans;
+    entry->size = block;
+    entry->used = true;
+
+    bucket = &cache->buckets[(entry->hash ^ decl) & cache->mask];
+
+    entry->next = *bucket;
+    *bucket = (uint32_t) idx + 1;
+
+    cache->memory += block;
+    cache->length++;
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_cache_spans(const lxb_grammar_cache_entry_t *entry,
+                        const lxb_char_t *data, lexbor_array_obj_t *spans)
+{
+    lxb_grammar_match_span_t *span;
+    const lxb_grammar_cache_span_t *cached;
+
+    for (size_t i = 0; i < entry->count; i++) {
+        span = lexbor_array_obj_push(spans);
+        if (span == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        cached = &entry->spans[i];
+
+        span->node = cached->node;
+        span->id = cached->id;
+        span->first = cached->first;
+        span->last = cached->last;
+        span->begin = data + cached->begin;
+        span->end = data + cached->end;
+    }
+
+    return LXB_STATUS_OK;
+}
+
+/* Multiplicative hash, eight bytes at a step. */
+uint64_t
+lxb_grammar_cache_hash(const lxb_char_t *data, size_t size)
+{
+    uint64_t hash, word;
+
+    hash = size * LXB_GRAMMAR_CACHE_MUL;
+
+    while (size >= 8) {
+        memcpy(&word, data, 8);
+
+        hash = (hash ^ word) * LXB_GRAMMAR_CACHE_MUL;
+        hash ^= hash >> 32;
+
+        data += 8;
+        size -= 8;
+    }
+
+    if (size != 0) {
+        word = 0;
+        memcpy(&word, data, size);
+
+        hash = (hash ^ word) * LXB_GRAMMAR_CACHE_MUL;
+        hash ^= hash >> 32;
+    }
+
+    return hash;
+}
+
+/* Entry to evict: used since the last pass gets the second chance. */
+static size_t
+lxb_grammar_cache_clock(lxb_grammar_cache_t *cache)
+{
+    size_t idx;
+    lxb_grammar_cache_entry_t *entry;
+
+    for (;;) {
+        idx = cache->hand;
+        entry = &cache->entries[idx];
+
+        cache->hand = (idx + 1 < cache->top) ? idx + 1 : 0;
+
+        if (entry->used) {
+            if (!entry->referenced) {
+                return idx;
+            }
+
+            entry->referenced = false;
+        }
+    }
+}
+
+static size_t
+lxb_grammar_cache_slot(lxb_grammar_cache_t *cache)
+{
+    size_t idx;
+
+    if (cache->free != 0) {
+        idx = cache->free - 1;
+        cache->free = cache->entries[idx].next;
+
+        return idx;
+    }
+
+    if (cache->top < cache->size) {
+        return cache->top++;
+    }
+
+    idx = lxb_grammar_cache_clock(cache);
+
+    lxb_grammar_cache_evict(cache, idx);
+
+    /* Taken back from the free list. */
+    cache->free = cache->entries[idx].next;
+
+    return idx;
+}
+
+/* The entry goes to the free list. */
+static void
+lxb_grammar_cache_evict(lxb_grammar_cache_t *cache, size_t idx)
+{
+    uint32_t *link;
+    lxb_grammar_cache_entry_t *entry;
+
+    entry = &cache->entries[idx];
+
+    link = &cache->buckets[(entry->hash ^ entry->decl) & cache->mask];
+
+    while (*link != idx + 1) {
+        link = &cache->entries[*link - 1].next;
+    }
+
+    *link = entry->next;
+
+    entry->spans = lexbor_free(entry->spans);
+    entry->used = false;
+    entry->next = cache->free;
+
+    cache->free = (uint32_t) idx + 1;
+
+    cache->memory -= entry->size;
+    cache->length--;
+    cache->evictions++;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_CACHE_H
+#define LEXBOR_GRAMMAR_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/match.h"
+
+
+/* Entries by default, see lxb_grammar_cache_init(). */
+#define LXB_GRAMMAR_CACHE_ENTRIES 4096
+
+/* Values longer than this are not cached. */
+#ifndef LXB_GRAMMAR_CACHE_VALUE_MAX
+#define LXB_GRAMMAR_CACHE_VALUE_MAX 1024
+#endif
+
+
+/* Span without pointers to the value: offsets from its beginning. */
+typedef struct {
+    lxb_grammar_node_t *node;
+    uint32_t           id;
+    uint32_t           first;
+    uint32_t           last;
+    uint32_t           begin;
+    uint32_t           end;
+}
+lxb_grammar_cache_span_t;
+
+/*
+ * Block of an entry: spans, then bytes of the value.
+ */
+typedef struct {
+    uint64_t                 hash;
+    uint32_t                 decl;     /* node->id of the declaration. */
+    uint32_t                 length;   /* Of the value. */
+    uint32_t                 count;    /* Of the spans. */
+    uint32_t                 next;     /* In the bucket or free, index + 1. */
+
+    bool                     used;
+    bool                     accepted;
+    bool                     referenced;
+
+    lxb_grammar_cache_span_t *spans;
+    size_t                   size;     /* Of the block. */
+}
+lxb_grammar_cache_entry_t;
+
+/*
+ * Results of values by declaration and bytes of the value.
+ * Eviction by CLOCK: an entry used since the last pass of the hand
+ * gets the second chance.
+ *
+ * Not thread-safe, one cache for each lxb_grammar_match_t or
+ * lxb_grammar_vm_t.  All users of the cache must match the same grammar.
+ */
+struct lxb_grammar_cache {
+    lxb_grammar_cache_entry_t *entries;
+    size_t                    size;
+    size_t                    length;
+    size_t                    top;       /* Entries taken at least once. */
+    uint32_t                  free;      /* Evicted entries, index + 1. */
+    size_t                    hand;
+
+    uint32_t                  *buckets;  /* Index of entry + 1. */
+    size_t                    mask;
+
+    /* Blocks of entries, limited by memory_max if not 0. */
+    size_t                    memory;
+    size_t                    memory_max;
+
+    /* Counters, reset by lxb_grammar_cache_clean(). */
+    size_t                    hits;
+    size_t                    misses;
+    size_t                    evictions;
+};
+
+
+LXB_API lxb_grammar_cache_t *
+lxb_grammar_cache_create(void);
+
+/*
+ * Entries: maximum count of values, 0 for LXB_GRAMMAR_CACHE_ENTRIES.
+ * Memory: maximum bytes of spans and values, 0 for no limit.
+ * The table itself takes about entries * 56 bytes.
+ */
+LXB_API lxb_status_t
+lxb_grammar_cache_init(lxb_grammar_cache_t *cache, size_t entries,
+                       size_t memory);
+
+LXB_API void
+lxb_grammar_cache_clean(lxb_grammar_cache_t *cache);
+
+LXB_API lxb_grammar_cache_t *
+lxb_grammar_cache_destroy(lxb_grammar_cache_t *cache, bool self_destroy);
+
+/* Entry of the value or NULL.  Counts a hit or a miss. */
+LXB_API const lxb_grammar_cache_entry_t *
+lxb_grammar_cache_find(lxb_grammar_cache_t *cache, size_t decl,
+                       const lxb_char_t *data, size_t size);
+
+/*
+ * Stores result of the value, old entries are evicted if needed.
+ * Too long values are skipped.
+ */
+LXB_API lxb_status_t
+lxb_grammar_cache_insert(lxb_grammar_cache_t *cache, size_t decl,
+                         const lxb_char_t *data, size_t size,
+                         const lxb_grammar_match_result_t *result);
+
+/*
+ * Appends spans of the entry to the array of lxb_grammar_match_span_t,
+ * pointers are set to the data of the value.
+ */
+LXB_API lxb_status_t
+lxb_grammar_cache_spans(const lxb_grammar_cache_entry_t *entry,
+                        const lxb_char_t *data, lexbor_array_obj_t *spans);
+
+LXB_API uint64_t
+lxb_grammar_cache_hash(const lxb_char_t *data, size_t size);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_CACHE_H */
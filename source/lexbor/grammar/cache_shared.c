@@ -0,0 +1,397 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/cache_shared.h"
+
+
+#define LXB_GRAMMAR_CACHE_SHARED_HEADER 4
+#define LXB_GRAMMAR_CACHE_SHARED_ACCEPTED ((uint64_t) 1 << 32)
+#define LXB_GRAMMAR_CACHE_SHARED_USED ((uint64_t) 1 << 33)
+
+#define LXB_GRAMMAR_CACHE_SHARED_MUL 0x9E3779B97F4A7C15ULL
+
+#define lxb_grammar_cache_shared_words(bytes) (((bytes) + 7) / 8)
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define lxb_grammar_cache_shared_load(ptr)                                 \
+        __atomic_load_n((ptr), __ATOMIC_RELAXED)
+    #define lxb_grammar_cache_shared_load_acquire(ptr)                         \
+        __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+    #define lxb_grammar_cache_shared_store(ptr, value)                         \
+        __atomic_store_n((ptr), (value), __ATOMIC_RELAXED)
+    #define lxb_grammar_cache_shared_store_release(ptr, value)                 \
+        __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+    #define lxb_grammar_cache_shared_fence_acquire()                           \
+        __atomic_thread_fence(__ATOMIC_ACQUIRE)
+    #define lxb_grammar_cache_shared_fence_release()                           \
+        __atomic_thread_fence(__ATOMIC_RELEASE)
+    #define lxb_grammar_cache_shared_trylock(ptr)                              \
+        (__atomic_exchange_n((ptr), 1, __ATOMIC_ACQUIRE) == 0)
+    #define lxb_grammar_cache_shared_unlock(ptr)                               \
+        __atomic_store_n((ptr), 0, __ATOMIC_RELEASE)
+#elif defined(_MSC_VER)
+    #include <intrin.h>
+
+    /* Volatile accesses of MSVC have acquire and release semantics. */
+    #define lxb_grammar_cache_shared_load(ptr) (*(volatile uint64_t *) (ptr))
+    #define lxb_grammar_cache_shared_load_acquire(ptr)                         \
+        (*(volatile uint64_t *) (ptr))
+    #define lxb_grammar_cache_shared_store(ptr, value)                         \
+        (*(volatile uint64_t *) (ptr) = (value))
+    #define lxb_grammar_cache_shared_store_release(ptr, value)                 \
+        (*(volatile uint64_t *) (ptr) = (value))
+    #define lxb_grammar_cache_shared_fence_acquire() _ReadWriteBarrier()
+    #define lxb_grammar_cache_shared_fence_release() _ReadWriteBarrier()
+    #define lxb_grammar_cache_shared_trylock(ptr)                              \
+        (_InterlockedExchange((volatile long *) (ptr), 1) == 0)
+    #define lxb_grammar_cache_shared_unlock(ptr)                               \
+        (*(volatile long *) (ptr) = 0)
+#else
+    /* Without atomics the cache is for one thread only. */
+    #define lxb_grammar_cache_shared_load(ptr) (*(ptr))
+    #define lxb_grammar_cache_shared_load_acquire(ptr) (*(ptr))
+    #define lxb_grammar_cache_shared_store(ptr, value) (*(ptr) = (value))
+    #define lxb_grammar_cache_shared_store_release(ptr, value)                 \
+        (*(ptr) = (value))
+    #define lxb_grammar_cache_shared_fence_acquire()
+    #define lxb_grammar_cache_shared_fence_release()
+    #define lxb_grammar_cache_shared_trylock(ptr)                              \
+        ((*(ptr) == 0) ? (*(ptr) = 1) : 0)
+    #define lxb_grammar_cache_shared_unlock(ptr) (*(ptr) = 0)
+#endif
+
+
+static size_t
+lxb_grammar_cache_shared_pow2(size_t value);
+
+
+lxb_grammar_cache_shared_t *
+lxb_grammar_cache_shared_create(void)
+{
+    return lexbor_calloc(1, sizeof(lxb_grammar_cache_shared_t));
+}
+
+lxb_status_t
+lxb_grammar_cache_shared_init(lxb_grammar_cache_shared_t *cache,
+                              size_t shards, size_t slots, size_t slot_size)
+{
+    uintptr_t addr;
+    uint64_t *words;
+    size_t shards_size, slots_size;
+
+    if (cache == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    shards = lxb_grammar_cache_shared_pow2((shards != 0) ? shards
+                                           : LXB_GRAMMAR_CACHE_SHARED_SHARDS);
+    slots = lxb_grammar_cache_shared_pow2((slots != 0) ? slots
+                                          : LXB_GRAMMAR_CACHE_SHARED_SLOTS);
+
+    if (slot_size == 0) {
+        slot_size = LXB_GRAMMAR_CACHE_SHARED_SLOT;
+    }
+
+    slot_size = (slot_size + LXB_GRAMMAR_CACHE_SHARED_LINE - 1)
+                & ~((size_t) LXB_GRAMMAR_CACHE_SHARED_LINE - 1);
+
+    if (slot_size > LXB_GRAMMAR_CACHE_SHARED_SLOT_MAX
+        || slots < LXB_GRAMMAR_CACHE_SHARED_WAYS
+        || shards > SIZE_MAX / slots / slot_size)
+    {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    shards_size = shards * sizeof(lxb_grammar_cache_shared_shard_t);
+    slots_size = shards * slots * slot_size;
+
+    cache->memory = lexbor_calloc(1, shards_size + slots_size
+                                     + LXB_GRAMMAR_CACHE_SHARED_LINE);
+    if (cache->memory == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    addr = ((uintptr_t) cache->memory + LXB_GRAMMAR_CACHE_SHARED_LINE - 1)
+           & ~((uintptr_t) LXB_GRAMMAR_CACHE_SHARED_LINE - 1);
+
+    cache->shards = (lxb_grammar_cache_shared_shard_t *) addr;
+    words = (uint64_t *) (addr + shards_size);
+
+    for (size_t i = 0; i < shards; i++) {
+        cache->shards[i].slots = words + i * slots * (slot_size / 8);
+    }
+
+    cache->shard_mask = shards - 1;
+    cache->slot_mask = slots - 1;
+    cache->slot_words = slot_size / 8;
+
+    return LXB_STATUS_OK;
+}
+
+void
+lxb_grammar_cache_shared_clean(lxb_grammar_cache_shared_t *cache)
+{
+    size_t count;
+
+    count = (cache->slot_mask + 1) * cache->slot_words;
+
+    for (size_t i = 0; i <= cache->shard_mask; i++) {
+        memset(cache->shards[i].slots, 0, count * sizeof(uint64_t));
+
+        cache->shards[i].lock = 0;
+        cache->shards[i].hand = 0;
+    }
+}
+
+lxb_grammar_cache_shared_t *
+lxb_grammar_cache_shared_destroy(lxb_grammar_cache_shared_t *cache,
+                                 bool self_destroy)
+{
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    cache->memory = lexbor_free(cache->memory);
+    cache->shards = NULL;
+
+    if (self_destroy) {
+        return lexbor_free(cache);
+    }
+
+    return cache;
+}
+
+lxb_inline uint64_t
+lxb_grammar_cache_shared_key(size_t decl, const lxb_char_t *data, size_t size)
+{
+    return lxb_grammar_cache_hash(data, size)
+           ^ ((uint64_t) decl * LXB_GRAMMAR_CACHE_SHARED_MUL);
+}
+
+lxb_inline lxb_grammar_cache_shared_shard_t *
+lxb_grammar_cache_shared_shard(lxb_grammar_cache_shared_t *cache,
+                               uint64_t hash)
+{
+    return &cache->shards[(hash >> 32) & cache->shard_mask];
+}
+
+lxb_inline uint64_t *
+lxb_grammar_cache_shared_slot(lxb_grammar_cache_shared_t *cache,
+                              lxb_grammar_cache_shared_shard_t *shard,
+                              uint64_t hash, size_t way)
+{
+    return shard->slots
+           + ((hash + way) & cache->slot_mask) * cache->slot_words;
+}
+
+bool
+lxb_grammar_cache_shared_find(lxb_grammar_cache_shared_t *cache,
+                              size_t decl,
+                              const lxb_char_t *data, size_t size,
+                              lexbor_array_obj_t *spans, bool *accepted)
+{
+    size_t count, words, begin;
+    uint64_t hash, seq, info, *slot;
+    uint64_t copy[LXB_GRAMMAR_CACHE_SHARED_SLOT_MAX / 8];
+    lxb_grammar_match_span_t *span;
+    lxb_grammar_cache_span_t cached;
+    lxb_grammar_cache_shared_shard_t *shard;
+    const lxb_char_t *bytes;
+
+    hash = lxb_grammar_cache_shared_key(decl, data, size);
+    shard = lxb_grammar_cache_shared_shard(cache, hash);
+
+    for (size_t way = 0; way < LXB_GRAMMAR_CACHE_SHARED_WAYS; way++) {
+        slot = lxb_grammar_cache_shared_slot(cache, shard, hash, way);
+
+        seq = lxb_grammar_cache_shared_load_acquire(&slot[0]);
+        if (seq & 1) {
+            continue;
+        }
+
+        info = lxb_grammar_cache_shared_load(&slot[3]);
+
+        if (lxb_grammar_cache_shared_load(&slot[1]) != hash
+            || lxb_grammar_cache_shared_load(&slot[2])
+               != ((uint64_t) size << 32 | (uint32_t) decl)
+            || (info & LXB_GRAMMAR_CACHE_SHARED_USED) == 0)
+        {
+            continue;
+        }
+
+        count = (uint32_t) info;
+        words = LXB_GRAMMAR_CACHE_SHARED_HEADER
+                + count * (sizeof(lxb_grammar_cache_span_t) / 8)
+                + lxb_grammar_cache_shared_words(size);
+
+        if (words > cache->slot_words) {
+            continue;
+        }
+
+        for (size_t i = LXB_GRAMMAR_CACHE_SHARED_HEADER; i < words; i++) {
+            copy[i] = lxb_grammar_cache_shared_load(&slot[i]);
+        }
+
+        lxb_grammar_cache_shared_fence_acquire();
+
+        /* Changed while read. */
+        if (lxb_grammar_cache_shared_load(&slot[0]) != seq) {
+            return false;
+        }
+
+        bytes = (const lxb_char_t *) &copy[LXB_GRAMMAR_CACHE_SHARED_HEADER]
+                + count * sizeof(lxb_grammar_cache_span_t);
+
+        if (memcmp(bytes, data, size) != 0) {
+            continue;
+        }
+
+        begin = spans->length;
+
+        for (size_t i = 0; i < count; i++) {
+            span = lexbor_array_obj_push(spans);
+            if (span == NULL) {
+                spans->length = begin;
+                return false;
+            }
+
+            memcpy(&cached, &copy[LXB_GRAMMAR_CACHE_SHARED_HEADER]
+                            + i * (sizeof(lxb_grammar_cache_span_t) / 8),
+                   sizeof(lxb_grammar_cache_span_t));
+
+            span->node = cached.node;
+            span->id = cached.id;
+            span->first = cached.first;
+            span->last = cached.last;
+            span->begin = data + cached.begin;
+            span->end = data + cached.end;
+        }
+
+        *accepted = (info & LXB_GRAMMAR_CACHE_SHARED_ACCEPTED) != 0;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool
+lxb_grammar_cache_shared_insert(lxb_grammar_cache_shared_t *cache,
+                                size_t decl,
+                                const lxb_char_t *data, size_t size,
+                                const lxb_grammar_match_result_t *result)
+{
+    size_t count, words, way;
+    uint64_t hash, seq, info, *slot;
+    uint64_t copy[LXB_GRAMMAR_CACHE_SHARED_SLOT_MAX / 8];
+    lxb_grammar_cache_span_t cached;
+    lxb_grammar_cache_shared_shard_t *shard;
+    const lxb_grammar_match_span_t *span;
+
+    count = (result->accepted) ? result->length : 0;
+
+    if (decl >= UINT32_MAX || size >= UINT32_MAX
+        || count > cache->slot_words)
+    {
+        return false;
+    }
+
+    words = LXB_GRAMMAR_CACHE_SHARED_HEADER
+            + count * (sizeof(lxb_grammar_cache_span_t) / 8)
+            + lxb_grammar_cache_shared_words(size);
+
+    if (words > cache->slot_words) {
+        return false;
+    }
+
+    /* Image of the slot. */
+    hash = lxb_grammar_cache_shared_key(decl, data, size);
+    info = count | LXB_GRAMMAR_CACHE_SHARED_USED;
+
+    if (result->accepted) {
+        info |= LXB_GRAMMAR_CACHE_SHARED_ACCEPTED;
+    }
+
+    copy[words - 1] = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        span = &result->spans[i];
+
+        memset(&cached, 0, sizeof(lxb_grammar_cache_span_t));
+
+        cached.node = span->node;
+        cached.id = (uint32_t) span->id;
+        cached.first = (uint32_t) span->first;
+        cached.last = (uint32_t) span->last;
+        cached.begin = (uint32_t) (span->begin - data);
+        cached.end = (uint32_t) (span->end - data);
+
+        memcpy(&copy[LXB_GRAMMAR_CACHE_SHARED_HEADER]
+               + i * (sizeof(lxb_grammar_cache_span_t) / 8),
+               &cached, sizeof(lxb_grammar_cache_span_t));
+    }
+
+    memcpy((lxb_char_t *) &copy[LXB_GRAMMAR_CACHE_SHARED_HEADER]
+           + count * sizeof(lxb_grammar_cache_span_t), data, size);
+
+    shard = lxb_grammar_cache_shared_shard(cache, hash);
+
+    if (!lxb_grammar_cache_shared_trylock(&shard->lock)) {
+        return false;
+    }
+
+    /* Only the writer changes slots, plain reads are enough here. */
+    for (way = 0; way < LXB_GRAMMAR_CACHE_SHARED_WAYS; way++) {
+        slot = lxb_grammar_cache_shared_slot(cache, shard, hash, way);
+
+        if ((slot[3] & LXB_GRAMMAR_CACHE_SHARED_USED) == 0) {
+            break;
+        }
+
+        if (slot[1] == hash
+            && slot[2] == ((uint64_t) size << 32 | (uint32_t) decl))
+        {
+            lxb_grammar_cache_shared_unlock(&shard->lock);
+            return true;
+        }
+    }
+
+    if (way == LXB_GRAMMAR_CACHE_SHARED_WAYS) {
+        way = shard->hand++ % LXB_GRAMMAR_CACHE_SHARED_WAYS;
+        slot = lxb_grammar_cache_shared_slot(cache, shard, hash, way);
+    }
+
+    seq = slot[0];
+
+    lxb_grammar_cache_shared_store(&slot[0], seq + 1);
+    lxb_grammar_cache_shared_fence_release();
+
+    lxb_grammar_cache_shared_store(&slot[1], hash);
+    lxb_grammar_cache_shared_store(&slot[2],
+                                   (uint64_t) size << 32 | (uint32_t) decl);
+    lxb_grammar_cache_shared_store(&slot[3], info);
+
+    for (size_t i = LXB_GRAMMAR_CACHE_SHARED_HEADER; i < words; i++) {
+        lxb_grammar_cache_shared_store(&slot[i], copy[i]);
+    }
+
+    lxb_grammar_cache_shared_store_release(&slot[0], seq + 2);
+    lxb_grammar_cache_shared_unlock(&shard->lock);
+
+    return true;
+}
+
+static size_t
+lxb_grammar_cache_shared_pow2(size_t value)
+{
+    size_t pow = 1;
+
+    while (pow < value) {
+        pow <<= 1;
+    }
+
+    return pow;
+}
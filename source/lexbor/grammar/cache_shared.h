@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_CACHE_SHARED_H
+#define LEXBOR_GRAMMAR_CACHE_SHARED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/cache.h"
+
+
+#define LXB_GRAMMAR_CACHE_SHARED_SHARDS 64
+#define LXB_GRAMMAR_CACHE_SHARED_SLOTS  256
+
+/* Bytes of a slot: header, spans and the value, see below. */
+#define LXB_GRAMMAR_CACHE_SHARED_SLOT     256
+#define LXB_GRAMMAR_CACHE_SHARED_SLOT_MAX 1024
+
+/* Slots probed for a value, from its hash. */
+#define LXB_GRAMMAR_CACHE_SHARED_WAYS 4
+
+#define LXB_GRAMMAR_CACHE_SHARED_LINE 64
+
+
+/*
+ * Slot, in 64-bit words:
+ *     0: sequence, odd while the slot is written;
+ *     1: hash of the declaration and the value;
+ *     2: declaration node->id | length of the value << 32;
+ *     3: count of spans | accepted << 32 | used << 33;
+ *     4: lxb_grammar_cache_span_t spans, then bytes of the value.
+ */
+typedef struct {
+    uint32_t lock;   /* Writer of the shard. */
+    uint32_t hand;   /* Next way to replace. */
+    uint64_t *slots;
+
+    /* Shards do not share cache lines. */
+    lxb_char_t pad[LXB_GRAMMAR_CACHE_SHARED_LINE - sizeof(uint32_t) * 2
+                   - sizeof(uint64_t *)];
+}
+lxb_grammar_cache_shared_shard_t;
+
+/*
+ * Same as lxb_grammar_cache_t, but for many threads at the same time,
+ * for example VMs of one lxb_grammar_frozen_t.
+ *
+ * Memory is fixed at init: shards * slots * slot size.  A lookup never
+ * waits: it reads the slot and the sequence (seqlock), a slot changed
+ * while read is a miss.  A writer takes the lock of the shard only if
+ * it is free, otherwise the result is not stored.
+ *
+ * A value with its spans must fit in one slot to be cached.
+ */
+struct lxb_grammar_cache_shared {
+    lxb_grammar_cache_shared_shard_t *shards;
+    size_t                           shard_mask;
+    size_t                           slot_mask;
+    size_t                           slot_words;
+
+    void                             *memory;
+};
+
+
+LXB_API lxb_grammar_cache_shared_t *
+lxb_grammar_cache_shared_create(void);
+
+/*
+ * Shards and slots of a shard are rounded up to powers of two, the slot
+ * size up to LXB_GRAMMAR_CACHE_SHARED_LINE.  0 for defaults.
+ */
+LXB_API lxb_status_t
+lxb_grammar_cache_shared_init(lxb_grammar_cache_shared_t *cache,
+                              size_t shards, size_t slots, size_t slot_size);
+
+/* Not thread-safe. */
+LXB_API void
+lxb_grammar_cache_shared_clean(lxb_grammar_cache_shared_t *cache);
+
+LXB_API lxb_grammar_cache_shared_t *
+lxb_grammar_cache_shared_destroy(lxb_grammar_cache_shared_t *cache,
+                                 bool self_destroy);
+
+/*
+ * Returns true if the value is found, its spans are appended to the array
+ * of lxb_grammar_match_span_t with pointers to the data.
+ */
+LXB_API bool
+lxb_grammar_cache_shared_find(lxb_grammar_cache_shared_t *cache,
+                              size_t decl,
+                              const lxb_char_t *data, size_t size,
+                              lexbor_array_obj_t *spans, bool *accepted);
+
+/* Returns false if the result is not stored: too large or shard is busy. */
+LXB_API bool
+lxb_grammar_cache_shared_insert(lxb_grammar_cache_shared_t *cache,
+                                size_t decl,
+                                const lxb_char_t *data, size_t size,
+                                const lxb_grammar_match_result_t *result);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_CACHE_SHARED_H */
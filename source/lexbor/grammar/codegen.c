@@ -0,0 +1,1836 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include <stdarg.h>
+
+#include "lexbor/grammar/codegen.h"
+#include "lexbor/grammar/type.h"
+#include "lexbor/grammar/phash.h"
+#include "lexbor/grammar/ambiguity.h"
+
+#include "lexbor/core/conv.h"
+
+
+#define lxb_grammar_codegen_send(data, len)                                    \
+    do {                                                                       \
+        status = func((const lxb_char_t *) (data), (len), ctx);                \
+        if (status != LXB_STATUS_OK) {                                         \
+            return status;                                                     \
+        }                                                                      \
+    }                                                                          \
+    while (0)
+
+
+/* Set of positions in the generated code: "in", "out", "s + 3 * w". */
+typedef struct {
+    char   data[64];
+    size_t length;
+}
+lxb_grammar_codegen_ref_t;
+
+
+static void
+lxb_grammar_codegen_node(lxb_grammar_codegen_t *cg, lxb_grammar_node_t *node,
+                         const lxb_grammar_codegen_ref_t *in,
+                         const lxb_grammar_codegen_ref_t *out);
+
+static void
+lxb_grammar_codegen_once(lxb_grammar_codegen_t *cg, lxb_grammar_node_t *node,
+                         const lxb_grammar_codegen_ref_t *in,
+                         const lxb_grammar_codegen_ref_t *out);
+
+static void
+lxb_grammar_codegen_group(lxb_grammar_codegen_t *cg, lxb_grammar_node_t *group,
+                          const lxb_grammar_codegen_ref_t *in,
+                          const lxb_grammar_codegen_ref_t *out);
+
+
+lxb_grammar_codegen_t *
+lxb_grammar_codegen_create(void)
+{
+    return lexbor_calloc(1, sizeof(lxb_grammar_codegen_t));
+}
+
+lxb_status_t
+lxb_grammar_codegen_init(lxb_grammar_codegen_t *cg, lxb_grammar_tree_t *tree)
+{
+    lxb_status_t status;
+
+    if (cg == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    if (tree == NULL || tree->nodes->length == 0) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    cg->tree = tree;
+    cg->inline_max = LXB_GRAMMAR_CODEGEN_INLINE_MAX;
+    cg->deterministic = false;
+    cg->last_node = NULL;
+    cg->last_error = NULL;
+
+    cg->mraw = lexbor_mraw_create();
+    status = lexbor_mraw_init(cg->mraw, 4096);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    cg->names = lexbor_calloc(tree->nodes->length, sizeof(lexbor_str_t));
+    if (cg->names == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    status = lxb_grammar_first_init(&cg->first, tree);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    cg->first_rows = lexbor_calloc(tree->nodes->length, sizeof(size_t));
+    if (cg->first_rows == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    cg->first_count = 0;
+
+    if (lexbor_str_init(&cg->head, cg->mraw, 256) == NULL
+        || lexbor_str_init(&cg->body, cg->mraw, 4096) == NULL
+        || lexbor_str_init(&cg->vars, cg->mraw, 64) == NULL
+        || lexbor_str_init(&cg->subsets, cg->mraw, 16) == NULL)
+    {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    cg->inlined = lexbor_array_create();
+    return lexbor_array_init(cg->inlined, 16);
+}
+
+void
+lxb_grammar_codegen_clean(lxb_grammar_codegen_t *cg)
+{
+    cg->head.length = 0;
+    cg->body.length = 0;
+    cg->vars.length = 0;
+    cg->subsets.length = 0;
+
+    lexbor_array_clean(cg->inlined);
+
+    cg->slots = 0;
+    cg->uid = 0;
+    cg->indent = 0;
+    cg->use_tokens = false;
+    cg->use_length = false;
+    cg->use_status = false;
+    cg->status = LXB_STATUS_OK;
+    cg->last_node = NULL;
+    cg->last_error = NULL;
+}
+
+lxb_grammar_codegen_t *
+lxb_grammar_codegen_destroy(lxb_grammar_codegen_t *cg, bool self_destroy)
+{
+    if (cg == NULL) {
+        return NULL;
+    }
+
+    cg->inlined = lexbor_array_destroy(cg->inlined, true);
+    cg->mraw = lexbor_mraw_destroy(cg->mraw, true);
+
+    if (cg->names != NULL) {
+        cg->names = lexbor_free(cg->names);
+    }
+
+    if (cg->first_rows != NULL) {
+        cg->first_rows = lexbor_free(cg->first_rows);
+    }
+
+    lxb_grammar_first_destroy(&cg->first, false);
+
+    if (self_destroy) {
+        return lexbor_free(cg);
+    }
+
+    return cg;
+}
+
+static void
+lxb_grammar_codegen_append(lxb_grammar_codegen_t *cg, lexbor_str_t *str,
+                           const void *data, size_t len)
+{
+    if (cg->status != LXB_STATUS_OK || len == 0) {
+        return;
+    }
+
+    if (lexbor_str_append(str, cg->mraw, data, len) == NULL) {
+        cg->status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+}
+
+static void
+lxb_grammar_codegen_append_num(lxb_grammar_codegen_t *cg, lexbor_str_t *str,
+                               size_t num)
+{
+    size_t len;
+    lxb_char_t buf[128];
+
+    len = lexbor_conv_long_to_data((long) num, buf, sizeof(buf));
+
+    lxb_grammar_codegen_append(cg, str, buf, len);
+}
+
+/*
+ * Format:
+ *     %s -- const char *
+ *     %S -- const lxb_char_t *, size_t
+ *     %z -- size_t
+ *     %x -- size_t as a hex constant
+ *     %R -- const lxb_grammar_codegen_ref_t *
+ *     %N -- C name of a declaration, lxb_grammar_node_t *
+ */
+static void
+lxb_grammar_codegen_vformat(lxb_grammar_codegen_t *cg, lexbor_str_t *str,
+                            const char *fmt, va_list args)
+{
+    size_t num, len;
+    uint64_t num64;
+    const char *begin, *s;
+    const lxb_char_t *data;
+    lxb_grammar_node_t *node;
+    const lxb_grammar_codegen_ref_t *ref;
+    static const char hex[] = "0123456789abcdef";
+    lxb_char_t buf[32];
+
+    begin = fmt;
+
+    for (; *fmt != '\0'; fmt++) {
+        if (*fmt != '%') {
+            continue;
+        }
+
+        lxb_grammar_codegen_append(cg, str, begin, fmt - begin);
+
+        fmt++;
+
+        switch (*fmt) {
+            case 's':
+                s = va_arg(args, const char *);
+                lxb_grammar_codegen_append(cg, str, s, strlen(s));
+                break;
+
+            case 'S':
+                data = va_arg(args, const lxb_char_t *);
+                num = va_arg(args, size_t);
+                lxb_grammar_codegen_append(cg, str, data, num);
+                break;
+
+            case 'z':
+                num = va_arg(args, size_t);
+                lxb_grammar_codegen_append_num(cg, str, num);
+                break;
+
+            case 'x':
+                num = va_arg(args, size_t);
+                len = sizeof(buf);
+
+                do {
+                    buf[--len] = hex[num & 0x0f];
+                    num >>= 4;
+                }
+                while (num != 0);
+
+                lxb_grammar_codegen_append(cg, str, "0x", 2);
+                lxb_grammar_codegen_append(cg, str, &buf[len],
+                                           sizeof(buf) - len);
+                break;
+
+            case 'X':
+                num64 = va_arg(args, uint64_t);
+                len = sizeof(buf);
+
+                do {
+                    buf[--len] = hex[num64 & 0x0f];
+                    num64 >>= 4;
+                }
+                while (num64 != 0);
+
+                lxb_grammar_codegen_append(cg, str, "0x", 2);
+                lxb_grammar_codegen_append(cg, str, &buf[len],
+                                           sizeof(buf) - len);
+                break;
+
+            case 'R':
+                ref = va_arg(args, const lxb_grammar_codegen_ref_t *);
+                lxb_grammar_codegen_append(cg, str, ref->data, ref->length);
+                break;
+
+            case 'N':
+                node = va_arg(args, lxb_grammar_node_t *);
+                lxb_grammar_codegen_append(cg, str, cg->names[node->id].data,
+                                           cg->names[node->id].length);
+                break;
+
+            default:
+                lxb_grammar_codegen_append(cg, str, fmt, 1);
+                break;
+        }
+
+        begin = fmt + 1;
+    }
+
+    lxb_grammar_codegen_append(cg, str, begin, fmt - begin);
+}
+
+/* Line of the function body with indent, "\n" is added. */
+static void
+lxb_grammar_codegen_line(lxb_grammar_codegen_t *cg, const char *fmt, ...)
+{
+    va_list args;
+
+    if (*fmt != '\0') {
+        for (size_t i = 0; i < cg->indent; i++) {
+            lxb_grammar_codegen_append(cg, &cg->body, "    ", 4);
+        }
+    }
+
+    va_start(args, fmt);
+    lxb_grammar_codegen_vformat(cg, &cg->body, fmt, args);
+    va_end(args);
+
+    lxb_grammar_codegen_append(cg, &cg->body, "\n", 1);
+}
+
+static void
+lxb_grammar_codegen_format(lxb_grammar_codegen_t *cg, lexbor_str_t *str,
+                           const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    lxb_grammar_codegen_vformat(cg, str, fmt, args);
+    va_end(args);
+}
+
+static void
+lxb_grammar_codegen_ref(lxb_grammar_codegen_ref_t *ref, const char *str)
+{
+    ref->length = strlen(str);
+    memcpy(ref->data, str, ref->length);
+}
+
+static void
+lxb_grammar_codegen_ref_append(lxb_grammar_codegen_ref_t *ref,
+                               const char *str, size_t num, bool with_num)
+{
+    size_t len;
+
+    len = strlen(str);
+    memcpy(&ref->data[ref->length], str, len);
+    ref->length += len;
+
+    if (with_num) {
+        ref->length += lexbor_conv_long_to_data((long) num,
+                                          (lxb_char_t *) &ref->data[ref->length],
+                                          sizeof(ref->data) - ref->length);
+    }
+}
+
+/* "s + <slot> * w" */
+static void
+lxb_grammar_codegen_ref_slot(lxb_grammar_codegen_ref_t *ref, size_t slot)
+{
+    ref->length = 0;
+
+    lxb_grammar_codegen_ref_append(ref, "s + ", slot, true);
+    lxb_grammar_codegen_ref_append(ref, " * w", 0, false);
+}
+
+/* "s + (<base> + m<uid>) * w" or "s + (<base> + (m<uid> | <bit>)) * w" */
+static void
+lxb_grammar_codegen_ref_state(lxb_grammar_codegen_ref_t *ref, size_t base,
+                              size_t uid, size_t bit, bool with_bit)
+{
+    ref->length = 0;
+
+    lxb_grammar_codegen_ref_append(ref, "s + (", base, true);
+
+    if (with_bit) {
+        lxb_grammar_codegen_ref_append(ref, " + (m", uid, true);
+        lxb_grammar_codegen_ref_append(ref, " | ", bit, true);
+        lxb_grammar_codegen_ref_append(ref, "))", 0, false);
+    }
+    else {
+        lxb_grammar_codegen_ref_append(ref, " + m", uid, true);
+        lxb_grammar_codegen_ref_append(ref, ")", 0, false);
+    }
+
+    lxb_grammar_codegen_ref_append(ref, " * w", 0, false);
+}
+
+lxb_inline size_t
+lxb_grammar_codegen_slot(lxb_grammar_codegen_t *cg, size_t count)
+{
+    cg->slots += count;
+
+    return cg->slots - count;
+}
+
+/* C string literal, the grammar may contain anything. */
+static void
+lxb_grammar_codegen_cstring(lxb_grammar_codegen_t *cg, lexbor_str_t *str,
+                            const lxb_char_t *data, size_t len)
+{
+    lxb_char_t buf[4];
+
+    lxb_grammar_codegen_append(cg, str, "\"", 1);
+
+    for (size_t i = 0; i < len; i++) {
+        if (data[i] == '"' || data[i] == '\\' || data[i] == '?') {
+            buf[0] = '\\';
+            buf[1] = data[i];
+
+            lxb_grammar_codegen_append(cg, str, buf, 2);
+        }
+        else if (data[i] < 0x20 || data[i] >= 0x7f) {
+            buf[0] = '\\';
+            buf[1] = '0' + (data[i] >> 6);
+            buf[2] = '0' + ((data[i] >> 3) & 0x07);
+            buf[3] = '0' + (data[i] & 0x07);
+
+            lxb_grammar_codegen_append(cg, str, buf, 4);
+        }
+        else {
+            lxb_grammar_codegen_append(cg, str, &data[i], 1);
+        }
+    }
+
+    lxb_grammar_codegen_append(cg, str, "\"", 1);
+}
+
+static lxb_grammar_node_t *
+lxb_grammar_codegen_reference(lxb_grammar_node_t *node)
+{
+    if (node->type == LXB_GRAMMAR_NODE_ELEMENT
+        && node->bst_declaration != NULL)
+    {
+        return node->bst_declaration->value;
+    }
+
+    return NULL;
+}
+
+/* Matches one token, without repetition. */
+static bool
+lxb_grammar_codegen_is_term(lxb_grammar_node_t *node)
+{
+    if (node->type == LXB_GRAMMAR_NODE_GROUP
+        || node->type == LXB_GRAMMAR_NODE_DECLARATION
+        || lxb_grammar_codegen_reference(node) != NULL)
+    {
+        return false;
+    }
+
+    return lxb_grammar_node_repeat_min(node) == 1
+           && lxb_grammar_node_repeat_max(node) == 1
+           && !lxb_grammar_node_is_required(node);
+}
+
+static size_t
+lxb_grammar_codegen_count(lxb_grammar_node_t *node)
+{
+    size_t count = 1;
+
+    for (node = node->first_child; node != NULL; node = node->next) {
+        count += lxb_grammar_codegen_count(node);
+    }
+
+    return count;
+}
+
+/* Part of a line, without indent. */
+static void
+lxb_grammar_codegen_text(lxb_grammar_codegen_t *cg, const char *fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    lxb_grammar_codegen_vformat(cg, &cg->body, fmt, args);
+    va_end(args);
+}
+
+static void
+lxb_grammar_codegen_indent(lxb_grammar_codegen_t *cg)
+{
+    for (size_t i = 0; i < cg->indent; i++) {
+        lxb_grammar_codegen_append(cg, &cg->body, "    ", 4);
+    }
+}
+
+static void
+lxb_grammar_codegen_var(lxb_grammar_codegen_t *cg, const char *name,
+                        size_t uid)
+{
+    lxb_grammar_codegen_format(cg, &cg->vars, ", %s%z", name, uid);
+}
+
+/* Condition for tokens[p]. */
+static void
+lxb_grammar_codegen_cond(lxb_grammar_codegen_t *cg, lxb_grammar_node_t *node)
+{
+    size_t len;
+    lxb_char_t buf[128];
+    const lxb_char_t *name;
+
+    switch (node->type) {
+        case LXB_GRAMMAR_NODE_UNQUOTED:
+            lxb_grammar_codegen_text(cg, "tokens[p].keyword_id == %z",
+                                     node->keyword_id);
+            break;
+
+        case LXB_GRAMMAR_NODE_STRING:
+        case LXB_GRAMMAR_NODE_DELIM:
+            lxb_grammar_codegen_text(cg, "lxb_grammar_codegen_rt_literal("
+                                     "&tokens[p], ");
+            lxb_grammar_codegen_cstring(cg, &cg->body, node->u.str.data,
+                                        node->u.str.length);
+            lxb_grammar_codegen_text(cg, ", %z)", node->u.str.length);
+            break;
+
+        case LXB_GRAMMAR_NODE_NUMBER:
+            len = lexbor_conv_float_to_data(node->u.num, buf, sizeof(buf));
+
+            lxb_grammar_codegen_text(cg, "(tokens[p].type == "
+                                     "LXB_GRAMMAR_VALUE_NUMBER "
+                                     "&& tokens[p].num == %S)", buf, len);
+            break;
+
+        case LXB_GRAMMAR_NODE_ELEMENT:
+            name = lxb_grammar_type_name(node->type_id, &len);
+            if (name == NULL) {
+                lxb_grammar_codegen_text(cg, "false");
+                break;
+            }
+
+            lxb_grammar_codegen_text(cg, "lxb_grammar_type_match(%z /* <%S> */, "
+                                     "&tokens[p])", (size_t) node->type_id,
+                                     name, len);
+            break;
+
+        default:
+            lxb_grammar_codegen_text(cg, "false");
+            break;
+    }
+}
+
+/* Same keyword earlier among the siblings, case labels must be unique. */
+static bool
+lxb_grammar_codegen_keyword_seen(lxb_grammar_node_t *first,
+                                 lxb_grammar_node_t *node)
+{
+    for (; first != node; first = first->next) {
+        if (first->type == LXB_GRAMMAR_NODE_UNQUOTED
+            && first->keyword_id == node->keyword_id)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * One pass over the positions for a single term, or for all children
+ * of [ a | b | c ] if they are terms.  Keywords go to a switch.
+ */
+static void
+lxb_grammar_codegen_terms(lxb_grammar_codegen_t *cg, lxb_grammar_node_t *first,
+                          bool siblings,
+                          const lxb_grammar_codegen_ref_t *in,
+                          const lxb_grammar_codegen_ref_t *out)
+{
+    size_t keywords, others;
+    lxb_grammar_node_t *node, *last;
+
+    last = (siblings) ? NULL : first->next;
+    keywords = 0;
+    others = 0;
+
+    for (node = first; node != last; node = node->next) {
+        if (node->type == LXB_GRAMMAR_NODE_UNQUOTED) {
+            keywords++;
+        }
+        else {
+            others++;
+        }
+    }
+
+    cg->use_tokens = true;
+
+    lxb_grammar_codegen_line(cg, "for (p = lxb_grammar_codegen_rt_next(%R, w, 0); "
+                             "p < n;", in);
+    lxb_grammar_codegen_line(cg, "     p = lxb_grammar_codegen_rt_next(%R, w, p + 1))",
+                             in);
+    lxb_grammar_codegen_line(cg, "{");
+
+    cg->indent++;
+
+    if (keywords > 1) {
+        lxb_grammar_codegen_line(cg, "switch (tokens[p].keyword_id) {");
+
+        for (node = first; node != last; node = node->next) {
+            if (node->type == LXB_GRAMMAR_NODE_UNQUOTED
+                && !lxb_grammar_codegen_keyword_seen(first, node))
+            {
+                lxb_grammar_codegen_line(cg, "    case %z:", node->keyword_id);
+            }
+        }
+
+        lxb_grammar_codegen_line(cg, "        lxb_grammar_codegen_rt_add(%R, p + 1);",
+                                 out);
+        lxb_grammar_codegen_line(cg, "        continue;");
+        lxb_grammar_codegen_line(cg, "");
+        lxb_grammar_codegen_line(cg, "    default:");
+        lxb_grammar_codegen_line(cg, "        break;");
+        lxb_grammar_codegen_line(cg, "}");
+
+        if (others != 0) {
+            lxb_grammar_codegen_line(cg, "");
+        }
+    }
+
+    if (keywords == 1 || others != 0) {
+        lxb_grammar_codegen_indent(cg);
+        lxb_grammar_codegen_text(cg, "if (");
+
+        others = 0;
+
+        for (node = first; node != last; node = node->next) {
+            if (keywords > 1 && node->type == LXB_GRAMMAR_NODE_UNQUOTED) {
+                continue;
+            }
+
+            if (others++ != 0) {
+                lxb_grammar_codegen_text(cg, "\n");
+                lxb_grammar_codegen_indent(cg);
+                lxb_grammar_codegen_text(cg, "    || ");
+            }
+
+            lxb_grammar_codegen_cond(cg, node);
+        }
+
+        if (others > 1) {
+            lxb_grammar_codegen_text(cg, ")\n");
+            lxb_grammar_codegen_line(cg, "{");
+        }
+        else {
+            lxb_grammar_codegen_text(cg, ") {\n");
+        }
+
+        lxb_grammar_codegen_line(cg, "    lxb_grammar_codegen_rt_add(%R, p + 1);",
+                                 out);
+        lxb_grammar_codegen_line(cg, "}");
+    }
+
+    cg->indent--;
+
+    lxb_grammar_codegen_line(cg, "}");
+}
+
+/* The node must match at least one token: "!" multiplier. */
+static void
+lxb_grammar_codegen_required(lxb_grammar_codegen_t *cg,
+                             lxb_grammar_node_t *node,
+                             const lxb_grammar_codegen_ref_t *in,
+                             const lxb_grammar_codegen_ref_t *out)
+{
+    size_t uid;
+    lxb_grammar_codegen_ref_t one, res;
+
+    uid = cg->uid++;
+    cg->use_length = true;
+
+    lxb_grammar_codegen_var(cg, "q", uid);
+
+    lxb_grammar_codegen_ref_slot(&one, lxb_grammar_codegen_slot(cg, 1));
+    lxb_grammar_codegen_ref_slot(&res, lxb_grammar_codegen_slot(cg, 1));
+
+    lxb_grammar_codegen_line(cg, "/* Not empty. */");
+    lxb_grammar_codegen_line(cg, "for (q%z = lxb_grammar_codegen_rt_next(%R, w, 0); "
+                             "q%z <= n;", uid, in, uid);
+    lxb_grammar_codegen_line(cg, "     q%z = lxb_grammar_codegen_rt_next(%R, w, q%z + 1))",
+                             uid, in, uid);
+    lxb_grammar_codegen_line(cg, "{");
+
+    cg->indent++;
+
+    lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_clear(%R, w);", &one);
+    lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_clear(%R, w);", &res);
+    lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_add(%R, q%z);",
+                             &one, uid);
+    lxb_grammar_codegen_line(cg, "");
+
+    lxb_grammar_codegen_once(cg, node, &one, &res);
+
+    lxb_grammar_codegen_line(cg, "");
+    lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_del(%R, q%z);",
+                             &res, uid);
+    lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_union(%R, %R, w);",
+                             out, &res);
+
+    cg->indent--;
+
+    lxb_grammar_codegen_line(cg, "}");
+}
+
+/*
+ * Iterations go breadth-first: the set of positions after k iterations.
+ *
+ * The bytecode does not allow an empty iteration after the minimum.
+ * It matters only for the first iteration of "#" with zero minimum,
+ * later iterations begin with a comma.  Otherwise an empty iteration
+ * gives positions which are already found.
+ *
+ * The loop stops when the positions after an iteration are all seen,
+ * the next iterations can not give new ones.
+ */
+static void
+lxb_grammar_codegen_loop(lxb_grammar_codegen_t *cg, lxb_grammar_node_t *node,
+                         long min, long max,
+                         const lxb_grammar_codegen_ref_t *in,
+                         const lxb_grammar_codegen_ref_t *out)
+{
+    size_t uid, stable;
+    bool comma, seen;
+    lxb_grammar_codegen_ref_t cur, next, tmp, one, res, seen_ref;
+
+    uid = cg->uid++;
+    comma = node->is_comma_separated;
+
+    lxb_grammar_codegen_var(cg, "k", uid);
+    stable = (min > 1) ? (size_t) min : 1;
+    seen = max < 0 || (size_t) max > stable;
+
+    lxb_grammar_codegen_ref_slot(&cur, lxb_grammar_codegen_slot(cg, 1));
+    lxb_grammar_codegen_ref_slot(&next, lxb_grammar_codegen_slot(cg, 1));
+
+    if (seen) {
+        lxb_grammar_codegen_ref_slot(&seen_ref, lxb_grammar_codegen_slot(cg, 1));
+    }
+
+    if (comma) {
+        lxb_grammar_codegen_ref_slot(&tmp, lxb_grammar_codegen_slot(cg, 1));
+    }
+
+    if (comma && min == 0) {
+        cg->use_length = true;
+
+        lxb_grammar_codegen_var(cg, "q", uid);
+
+        lxb_grammar_codegen_ref_slot(&one, lxb_grammar_codegen_slot(cg, 1));
+        lxb_grammar_codegen_ref_slot(&res, lxb_grammar_codegen_slot(cg, 1));
+    }
+
+    lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_copy(%R, %R, w);",
+                             &cur, in);
+
+    if (seen) {
+        lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_clear(%R, w);",
+                                 &seen_ref);
+    }
+
+    if (min == 0) {
+        lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_union(%R, %R, w);",
+                                 out, in);
+    }
+
+    lxb_grammar_codegen_line(cg, "");
+
+    if (max < 0) {
+        lxb_grammar_codegen_line(cg, "for (k%z = 1; ; k%z++) {", uid, uid);
+    }
+    else {
+        lxb_grammar_codegen_line(cg, "for (k%z = 1; k%z <= %z; k%z++) {",
+                                 uid, uid, (size_t) max, uid);
+    }
+
+    cg->indent++;
+
+    lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_clear(%R, w);", &next);
+    lxb_grammar_codegen_line(cg, "");
+
+    if (comma) {
+        cg->use_tokens = true;
+
+        lxb_grammar_codegen_line(cg, "if (k%z > 1) {", uid);
+
+        cg->indent++;
+
+        lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_clear(%R, w);",
+                                 &tmp);
+        lxb_grammar_codegen_line(cg, "");
+        lxb_grammar_codegen_line(cg, "for (p = lxb_grammar_codegen_rt_next(%R, w, 0); "
+                                 "p < n;", &cur);
+        lxb_grammar_codegen_line(cg, "     p = lxb_grammar_codegen_rt_next(%R, w, p + 1))",
+                                 &cur);
+        lxb_grammar_codegen_line(cg, "{");
+        lxb_grammar_codegen_line(cg, "    if (lxb_grammar_codegen_rt_comma(&tokens[p])) {");
+        lxb_grammar_codegen_line(cg, "        lxb_grammar_codegen_rt_add(%R, p + 1);",
+                                 &tmp);
+        lxb_grammar_codegen_line(cg, "    }");
+        lxb_grammar_codegen_line(cg, "}");
+        lxb_grammar_codegen_line(cg, "");
+
+        lxb_grammar_codegen_once(cg, node, &tmp, &next);
+
+        cg->indent--;
+
+        lxb_grammar_codegen_line(cg, "}");
+        lxb_grammar_codegen_line(cg, "else {");
+
+        cg->indent++;
+
+        if (min == 0) {
+            lxb_grammar_codegen_line(cg, "/* Not empty. */");
+            lxb_grammar_codegen_line(cg, "for (q%z = lxb_grammar_codegen_rt_next(%R, w, 0); "
+                                     "q%z <= n;", uid, &cur, uid);
+            lxb_grammar_codegen_line(cg, "     q%z = lxb_grammar_codegen_rt_next(%R, w, q%z + 1))",
+                                     uid, &cur, uid);
+            lxb_grammar_codegen_line(cg, "{");
+
+            cg->indent++;
+
+            lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_clear(%R, w);",
+                                     &one);
+            lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_clear(%R, w);",
+                                     &res);
+            lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_add(%R, q%z);",
+                                     &one, uid);
+            lxb_grammar_codegen_line(cg, "");
+
+            lxb_grammar_codegen_once(cg, node, &one, &res);
+
+            lxb_grammar_codegen_line(cg, "");
+            lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_del(%R, q%z);",
+                                     &res, uid);
+            lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_union(%R, %R, w);",
+                                     &next, &res);
+
+            cg->indent--;
+
+            lxb_grammar_codegen_line(cg, "}");
+        }
+        else {
+            lxb_grammar_codegen_once(cg, node, &cur, &next);
+        }
+
+        cg->indent--;
+
+        lxb_grammar_codegen_line(cg, "}");
+    }
+    else {
+        lxb_grammar_codegen_once(cg, node, &cur, &next);
+    }
+
+    lxb_grammar_codegen_line(cg, "");
+    lxb_grammar_codegen_line(cg, "if (lxb_grammar_codegen_rt_is_empty(%R, w)) {",
+                             &next);
+    lxb_grammar_codegen_line(cg, "    break;");
+    lxb_grammar_codegen_line(cg, "}");
+    lxb_grammar_codegen_line(cg, "");
+    lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_copy(%R, %R, w);",
+                             &cur, &next);
+
+    if (min > 1) {
+        lxb_grammar_codegen_line(cg, "");
+        lxb_grammar_codegen_line(cg, "if (k%z >= %z) {", uid, (size_t) min);
+        lxb_grammar_codegen_line(cg, "    lxb_grammar_codegen_rt_union(%R, %R, w);",
+                                 out, &cur);
+        lxb_grammar_codegen_line(cg, "}");
+    }
+    else {
+        lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_union(%R, %R, w);",
+                                 out, &cur);
+    }
+
+    if (seen) {
+        lxb_grammar_codegen_line(cg, "");
+
+        if (stable > 1) {
+            lxb_grammar_codegen_line(cg, "if (k%z < %z) {", uid, stable);
+            lxb_grammar_codegen_line(cg, "    continue;");
+            lxb_grammar_codegen_line(cg, "}");
+            lxb_grammar_codegen_line(cg, "");
+        }
+
+        lxb_grammar_codegen_line(cg, "if (k%z > %z", uid, stable);
+        lxb_grammar_codegen_line(cg, "    && lxb_grammar_codegen_rt_subset(%R, %R, w))",
+                                 &cur, &seen_ref);
+        lxb_grammar_codegen_line(cg, "{");
+        lxb_grammar_codegen_line(cg, "    break;");
+        lxb_grammar_codegen_line(cg, "}");
+        lxb_grammar_codegen_line(cg, "");
+        lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_union(%R, %R, w);",
+                                 &seen_ref, &cur);
+    }
+
+    cg->indent--;
+
+    lxb_grammar_codegen_line(cg, "}");
+}
+
+static void
+lxb_grammar_codegen_node(lxb_grammar_codegen_t *cg, lxb_grammar_node_t *node,
+                         const lxb_grammar_codegen_ref_t *in,
+                         const lxb_grammar_codegen_ref_t *out)
+{
+    long min, max;
+
+    if (cg->status != LXB_STATUS_OK) {
+        return;
+    }
+
+    if (lxb_grammar_node_is_required(node)) {
+        lxb_grammar_codegen_required(cg, node, in, out);
+        return;
+    }
+
+    min = lxb_grammar_node_repeat_min(node);
+    max = lxb_grammar_node_repeat_max(node);
+
+    if (min == 1 && max == 1) {
+        lxb_grammar_codegen_once(cg, node, in, out);
+        return;
+    }
+
+    lxb_grammar_codegen_loop(cg, node, min, max, in, out);
+}
+
+static bool
+lxb_grammar_codegen_is_inlined(lxb_grammar_codegen_t *cg,
+                               lxb_grammar_node_t *decl)
+{
+    for (size_t i = 0; i < cg->inlined->length; i++) {
+        if (cg->inlined->list[i] == decl) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void
+lxb_grammar_codegen_once(lxb_grammar_codegen_t *cg, lxb_grammar_node_t *node,
+                         const lxb_grammar_codegen_ref_t *in,
+                         const lxb_grammar_codegen_ref_t *out)
+{
+    size_t len;
+    const lxb_char_t *name;
+    lxb_grammar_node_t *decl;
+
+    if (cg->status != LXB_STATUS_OK) {
+        return;
+    }
+
+    if (node->type == LXB_GRAMMAR_NODE_GROUP) {
+        lxb_grammar_codegen_group(cg, node, in, out);
+        return;
+    }
+
+    decl = (node->type == LXB_GRAMMAR_NODE_DECLARATION)
+           ? node : lxb_grammar_codegen_reference(node);
+
+    if (decl == NULL) {
+        lxb_grammar_codegen_terms(cg, node, false, in, out);
+        return;
+    }
+
+    if (cg->inlined->length <= LXB_GRAMMAR_CODEGEN_INLINE_DEPTH
+        && !lxb_grammar_codegen_is_inlined(cg, decl)
+        && lxb_grammar_codegen_count(decl) <= cg->inline_max)
+    {
+        cg->status = lexbor_array_push(cg->inlined, decl);
+        if (cg->status != LXB_STATUS_OK) {
+            return;
+        }
+
+        name = lxb_grammar_tree_node_name(decl, &len);
+
+        lxb_grammar_codegen_line(cg, "/* <%S> */", name, len);
+
+        lxb_grammar_codegen_group(cg, decl, in, out);
+
+        lexbor_array_pop(cg->inlined);
+
+        return;
+    }
+
+    cg->use_status = true;
+
+    lxb_grammar_codegen_line(cg, "status = %N(rt, %R, %R);", decl, in, out);
+    lxb_grammar_codegen_line(cg, "if (status != LXB_STATUS_OK) {");
+    lxb_grammar_codegen_line(cg, "    return status;");
+    lxb_grammar_codegen_line(cg, "}");
+}
+
+/*
+ * States of the reached subsets only, kept by the runtime.  Matching
+ * of every child is tried from every state without the child.
+ */
+static void
+lxb_grammar_codegen_subsets(lxb_grammar_codegen_t *cg,
+                            lxb_grammar_node_t *group, size_t count,
+                            const lxb_grammar_codegen_ref_t *in,
+                            const lxb_grammar_codegen_ref_t *out)
+{
+    size_t uid;
+    uint64_t bit;
+    lxb_grammar_node_t *node;
+    lxb_grammar_codegen_ref_t from, to;
+
+    uid = cg->uid++;
+    cg->use_status = true;
+
+    lxb_grammar_codegen_format(cg, &cg->subsets, ", q%z", uid);
+
+    from.length = 0;
+
+    lxb_grammar_codegen_ref_append(&from, "q", uid, true);
+    lxb_grammar_codegen_ref_append(&from, ".set", 0, false);
+
+    lxb_grammar_codegen_ref_slot(&to, lxb_grammar_codegen_slot(cg, 1));
+
+    lxb_grammar_codegen_line(cg, "/* %s, %z children */",
+                             (group->combinator == LXB_GRAMMAR_COMBINATOR_AND)
+                             ? "&&" : "||", count);
+    lxb_grammar_codegen_line(cg, "status = lxb_grammar_codegen_rt_subsets_begin("
+                             "rt, &q%z, %R, %z, %s);", uid, in, count,
+                             (group->combinator == LXB_GRAMMAR_COMBINATOR_AND)
+                             ? "false" : "true");
+    lxb_grammar_codegen_line(cg, "if (status != LXB_STATUS_OK) {");
+    lxb_grammar_codegen_line(cg, "    return status;");
+    lxb_grammar_codegen_line(cg, "}");
+    lxb_grammar_codegen_line(cg, "");
+    lxb_grammar_codegen_line(cg, "while (lxb_grammar_codegen_rt_subsets_next("
+                             "rt, &q%z, %R)) {", uid, out);
+
+    cg->indent++;
+
+    bit = 1;
+
+    for (node = group->first_child; node != NULL; node = node->next) {
+        if (node != group->first_child) {
+            lxb_grammar_codegen_line(cg, "");
+        }
+
+        lxb_grammar_codegen_line(cg, "if ((q%z.mask & %X) == 0) {", uid, bit);
+
+        cg->indent++;
+
+        lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_clear(%R, w);",
+                                 &to);
+
+        lxb_grammar_codegen_node(cg, node, &from, &to);
+
+        lxb_grammar_codegen_line(cg, "");
+        lxb_grammar_codegen_line(cg, "status = lxb_grammar_codegen_rt_subsets_add("
+                                 "rt, &q%z, %X, %R);", uid, bit, &to);
+        lxb_grammar_codegen_line(cg, "if (status != LXB_STATUS_OK) {");
+        lxb_grammar_codegen_line(cg, "    return status;");
+        lxb_grammar_codegen_line(cg, "}");
+
+        cg->indent--;
+
+        lxb_grammar_codegen_line(cg, "}");
+
+        bit <<= 1;
+    }
+
+    cg->indent--;
+
+    lxb_grammar_codegen_line(cg, "}");
+}
+
+/*
+ * States for each subset of the children, in order of the masks:
+ * a state is final before any superset.
+ */
+static void
+lxb_grammar_codegen_set(lxb_grammar_codegen_t *cg, lxb_grammar_node_t *group,
+                        const lxb_grammar_codegen_ref_t *in,
+                        const lxb_grammar_codegen_ref_t *out)
+{
+    size_t uid, count, base, full, bit;
+    lxb_grammar_node_t *node;
+    lxb_grammar_codegen_ref_t from, to;
+
+    count = 0;
+
+    for (node = group->first_child; node != NULL; node = node->next) {
+        count++;
+    }
+
+    if (count == 0) {
+        lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_union(%R, %R, w);",
+                                 out, in);
+        return;
+    }
+
+    if (count > LXB_GRAMMAR_CODEGEN_SET_MAX) {
+        lxb_grammar_codegen_subsets(cg, group, count, in, out);
+        return;
+    }
+
+    uid = cg->uid++;
+    full = ((size_t) 1 << count) - 1;
+
+    lxb_grammar_codegen_var(cg, "m", uid);
+    base = lxb_grammar_codegen_slot(cg, full + 1);
+
+    lxb_grammar_codegen_ref_state(&from, base, uid, 0, false);
+
+    lxb_grammar_codegen_line(cg, "/* %s */",
+                             (group->combinator == LXB_GRAMMAR_COMBINATOR_AND)
+                             ? "&&" : "||");
+    lxb_grammar_codegen_line(cg, "for (m%z = 1; m%z <= %x; m%z++) {",
+                             uid, uid, full, uid);
+    lxb_grammar_codegen_line(cg, "    lxb_grammar_codegen_rt_clear(%R, w);",
+                             &from);
+    lxb_grammar_codegen_line(cg, "}");
+    lxb_grammar_codegen_line(cg, "");
+
+    lxb_grammar_codegen_ref_slot(&to, base);
+
+    lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_copy(%R, %R, w);",
+                             &to, in);
+    lxb_grammar_codegen_line(cg, "");
+    lxb_grammar_codegen_line(cg, "for (m%z = 0; m%z < %x; m%z++) {",
+                             uid, uid, full, uid);
+
+    cg->indent++;
+
+    lxb_grammar_codegen_line(cg, "if (lxb_grammar_codegen_rt_is_empty(%R, w)) {",
+                             &from);
+    lxb_grammar_codegen_line(cg, "    continue;");
+    lxb_grammar_codegen_line(cg, "}");
+
+    bit = 1;
+
+    for (node = group->first_child; node != NULL; node = node->next) {
+        lxb_grammar_codegen_ref_state(&to, base, uid, bit, true);
+
+        lxb_grammar_codegen_line(cg, "");
+        lxb_grammar_codegen_line(cg, "if ((m%z & %x) == 0) {", uid, bit);
+
+        cg->indent++;
+
+        lxb_grammar_codegen_node(cg, node, &from, &to);
+
+        cg->indent--;
+
+        lxb_grammar_codegen_line(cg, "}");
+
+        bit <<= 1;
+    }
+
+    cg->indent--;
+
+    lxb_grammar_codegen_line(cg, "}");
+    lxb_grammar_codegen_line(cg, "");
+
+    if (group->combinator == LXB_GRAMMAR_COMBINATOR_AND) {
+        lxb_grammar_codegen_ref_slot(&to, base + full);
+
+        lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_union(%R, %R, w);",
+                                 out, &to);
+        return;
+    }
+
+    lxb_grammar_codegen_line(cg, "for (m%z = 1; m%z <= %x; m%z++) {",
+                             uid, uid, full, uid);
+    lxb_grammar_codegen_line(cg, "    lxb_grammar_codegen_rt_union(%R, %R, w);",
+                             out, &from);
+    lxb_grammar_codegen_line(cg, "}");
+}
+
+/* Only positions where the alternative can begin. */
+static void
+lxb_grammar_codegen_alternative(lxb_grammar_codegen_t *cg,
+                                lxb_grammar_node_t *node,
+                                const lxb_grammar_codegen_ref_t *in,
+                                const lxb_grammar_codegen_ref_t *out)
+{
+    lxb_grammar_codegen_ref_t from;
+
+    cg->use_tokens = true;
+    cg->use_length = true;
+
+    lxb_grammar_codegen_ref_slot(&from, lxb_grammar_codegen_slot(cg, 1));
+
+    lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_clear(%R, w);", &from);
+    lxb_grammar_codegen_line(cg, "for (p = lxb_grammar_codegen_rt_next(%R, w, 0); "
+                             "p < n;", in);
+    lxb_grammar_codegen_line(cg, "     p = lxb_grammar_codegen_rt_next(%R, w, "
+                             "p + 1))", in);
+    lxb_grammar_codegen_line(cg, "{");
+    lxb_grammar_codegen_line(cg, "    if (lxb_grammar_first_token(%S_first + %z, "
+                             "&tokens[p])) {", cg->prefix, cg->prefix_len,
+                             (cg->first_rows[node->id] - 1) * cg->first.words);
+    lxb_grammar_codegen_line(cg, "        lxb_grammar_codegen_rt_add(%R, p);",
+                             &from);
+    lxb_grammar_codegen_line(cg, "    }");
+    lxb_grammar_codegen_line(cg, "}");
+    lxb_grammar_codegen_line(cg, "");
+    lxb_grammar_codegen_line(cg, "if (!lxb_grammar_codegen_rt_is_empty(%R, w)) {",
+                             &from);
+
+    cg->indent++;
+
+    lxb_grammar_codegen_node(cg, node, &from, out);
+
+    cg->indent--;
+
+    lxb_grammar_codegen_line(cg, "}");
+}
+
+static void
+lxb_grammar_codegen_group(lxb_grammar_codegen_t *cg, lxb_grammar_node_t *group,
+                          const lxb_grammar_codegen_ref_t *in,
+                          const lxb_grammar_codegen_ref_t *out)
+{
+    size_t uid, count;
+    lxb_grammar_node_t *node;
+    lxb_grammar_codegen_ref_t cur, next;
+
+    if (cg->status != LXB_STATUS_OK) {
+        return;
+    }
+
+    switch (group->combinator) {
+        case LXB_GRAMMAR_COMBINATOR_ONE_OF:
+            for (node = group->first_child; node != NULL; node = node->next) {
+                if (!lxb_grammar_codegen_is_term(node)) {
+                    break;
+                }
+            }
+
+            if (node == NULL && group->first_child != NULL) {
+                lxb_grammar_codegen_terms(cg, group->first_child, true,
+                                          in, out);
+                return;
+            }
+
+            for (node = group->first_child; node != NULL; node = node->next) {
+                if (node != group->first_child) {
+                    lxb_grammar_codegen_line(cg, "");
+                }
+
+                if (cg->first_rows[node->id] != 0) {
+                    lxb_grammar_codegen_alternative(cg, node, in, out);
+                }
+                else {
+                    lxb_grammar_codegen_node(cg, node, in, out);
+                }
+            }
+
+            return;
+
+        case LXB_GRAMMAR_COMBINATOR_AND:
+        case LXB_GRAMMAR_COMBINATOR_OR:
+            lxb_grammar_codegen_set(cg, group, in, out);
+            return;
+
+        default:
+            break;
+    }
+
+    /* Sequence, stops when no positions are left. */
+    count = 0;
+
+    for (node = group->first_child; node != NULL; node = node->next) {
+        count++;
+    }
+
+    if (count == 0) {
+        lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_union(%R, %R, w);",
+                                 out, in);
+        return;
+    }
+
+    if (count == 1) {
+        lxb_grammar_codegen_node(cg, group->first_child, in, out);
+        return;
+    }
+
+    uid = cg->uid++;
+    cur = *in;
+
+    for (node = group->first_child; node->next != NULL; node = node->next) {
+        lxb_grammar_codegen_ref_slot(&next, lxb_grammar_codegen_slot(cg, 1));
+
+        lxb_grammar_codegen_line(cg, "lxb_grammar_codegen_rt_clear(%R, w);",
+                                 &next);
+
+        lxb_grammar_codegen_node(cg, node, &cur, &next);
+
+        lxb_grammar_codegen_line(cg, "");
+        lxb_grammar_codegen_line(cg, "if (lxb_grammar_codegen_rt_is_empty(%R, w)) {",
+                                 &next);
+        lxb_grammar_codegen_line(cg, "    goto seq%z;", uid);
+        lxb_grammar_codegen_line(cg, "}");
+        lxb_grammar_codegen_line(cg, "");
+
+        cur = next;
+    }
+
+    lxb_grammar_codegen_node(cg, node, &cur, out);
+
+    lxb_grammar_codegen_line(cg, "");
+    lxb_grammar_codegen_line(cg, "seq%z: ;", uid);
+}
+
+
+static lxb_status_t
+lxb_grammar_codegen_flush(lxb_grammar_codegen_t *cg, lexbor_str_t *str,
+                          lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    lxb_status_t status;
+
+    if (cg->status != LXB_STATUS_OK) {
+        return cg->status;
+    }
+
+    if (str->length != 0) {
+        lxb_grammar_codegen_send(str->data, str->length);
+    }
+
+    str->length = 0;
+
+    return LXB_STATUS_OK;
+}
+
+/* <prefix>_<name>, other characters are replaced by '_'. */
+static lxb_status_t
+lxb_grammar_codegen_names(lxb_grammar_codegen_t *cg, lxb_grammar_node_t *root)
+{
+    size_t len;
+    lexbor_str_t *str;
+    const lxb_char_t *name;
+    lxb_grammar_node_t *node, *prev;
+
+    for (node = root->first_child; node != NULL; node = node->next) {
+        str = &cg->names[node->id];
+
+        if (str->data == NULL
+            && lexbor_str_init(str, cg->mraw, cg->prefix_len + 32) == NULL)
+        {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        str->length = 0;
+
+        lxb_grammar_codegen_format(cg, str, "%S_", cg->prefix, cg->prefix_len);
+
+        name = lxb_grammar_tree_node_name(node, &len);
+
+        for (size_t i = 0; i < len; i++) {
+            if ((name[i] >= 'a' && name[i] <= 'z')
+                || (name[i] >= 'A' && name[i] <= 'Z')
+                || (name[i] >= '0' && name[i] <= '9'))
+            {
+                lxb_grammar_codegen_append(cg, str, &name[i], 1);
+            }
+            else {
+                lxb_grammar_codegen_append(cg, str, "_", 1);
+            }
+        }
+
+        for (prev = root->first_child; prev != node; prev = prev->next) {
+            if (cg->names[prev->id].length == str->length
+                && memcmp(cg->names[prev->id].data, str->data,
+                          str->length) == 0)
+            {
+                lxb_grammar_codegen_format(cg, str, "_%z", node->id);
+                break;
+            }
+        }
+
+        if (cg->status != LXB_STATUS_OK) {
+            return cg->status;
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static void
+lxb_grammar_codegen_prototype(lxb_grammar_codegen_t *cg, lexbor_str_t *str,
+                              lxb_grammar_node_t *decl)
+{
+    lxb_grammar_codegen_format(cg, str, "static lxb_status_t\n%N(", decl);
+    lxb_grammar_codegen_format(cg, str, "lxb_grammar_codegen_rt_t *rt, "
+                               "const uint64_t *in, uint64_t *out)");
+}
+
+/*
+ * All temporary sets of the function are allocated at once, every
+ * construct has own slots.  Recursion goes through calls only.
+ */
+static lxb_status_t
+lxb_grammar_codegen_function(lxb_grammar_codegen_t *cg,
+                             lxb_grammar_node_t *decl,
+                             lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    size_t len;
+    lxb_status_t status;
+    const lxb_char_t *name;
+    lexbor_str_t *head = &cg->head;
+    lxb_grammar_codegen_ref_t in, out;
+
+    cg->body.length = 0;
+    cg->vars.length = 0;
+    cg->subsets.length = 0;
+    cg->slots = 0;
+    cg->uid = 0;
+    cg->indent = 1;
+    cg->use_tokens = false;
+    cg->use_length = false;
+    cg->use_status = false;
+
+    lexbor_array_clean(cg->inlined);
+
+    cg->status = lexbor_array_push(cg->inlined, decl);
+    if (cg->status != LXB_STATUS_OK) {
+        return cg->status;
+    }
+
+    lxb_grammar_codegen_ref(&in, "in");
+    lxb_grammar_codegen_ref(&out, "out");
+
+    lxb_grammar_codegen_group(cg, decl, &in, &out);
+
+    if (cg->status != LXB_STATUS_OK) {
+        return cg->status;
+    }
+
+    name = lxb_grammar_tree_node_name(decl, &len);
+
+    lxb_grammar_codegen_format(cg, head, "/* <%S> */\n", name, len);
+    lxb_grammar_codegen_prototype(cg, head, decl);
+    lxb_grammar_codegen_format(cg, head, "\n{\n");
+
+    if (cg->use_tokens) {
+        lxb_grammar_codegen_format(cg, head, "    size_t p%S;\n",
+                                   cg->vars.data, cg->vars.length);
+    }
+    else if (cg->vars.length != 0) {
+        lxb_grammar_codegen_format(cg, head, "    size_t %S;\n",
+                                   cg->vars.data + 2, cg->vars.length - 2);
+    }
+
+    if (cg->use_status) {
+        lxb_grammar_codegen_format(cg, head, "    lxb_status_t status;\n");
+    }
+
+    if (cg->subsets.length != 0) {
+        lxb_grammar_codegen_format(cg, head, "    lxb_grammar_codegen_rt_subsets_t "
+                                   "%S;\n", cg->subsets.data + 2,
+                                   cg->subsets.length - 2);
+    }
+
+    if (cg->slots != 0) {
+        lxb_grammar_codegen_format(cg, head, "    uint64_t *s;\n"
+                                   "    lxb_grammar_codegen_rt_mark_t mark;\n");
+    }
+
+    if (cg->use_tokens) {
+        lxb_grammar_codegen_format(cg, head, "    const lxb_grammar_value_token_t "
+                                   "*tokens;\n");
+    }
+
+    if (cg->use_tokens || cg->use_length) {
+        lxb_grammar_codegen_format(cg, head, "    const size_t n = rt->length;\n");
+    }
+
+    lxb_grammar_codegen_format(cg, head, "    const size_t w = rt->words;\n\n");
+
+    lxb_grammar_codegen_format(cg, head,
+        "    if (lxb_grammar_codegen_rt_is_empty(in, w)) {\n"
+        "        return LXB_STATUS_OK;\n"
+        "    }\n\n"
+        "    if (rt->depth >= LXB_GRAMMAR_MATCH_DEPTH_MAX) {\n"
+        "        return LXB_STATUS_ERROR_OVERFLOW;\n"
+        "    }\n\n");
+
+    if (cg->use_tokens) {
+        lxb_grammar_codegen_format(cg, head,
+            "    tokens = (const lxb_grammar_value_token_t *) rt->tokens.list;\n\n");
+    }
+
+    if (cg->slots != 0) {
+        lxb_grammar_codegen_format(cg, head,
+            "    mark = lxb_grammar_codegen_rt_mark(rt);\n\n"
+            "    s = lxb_grammar_codegen_rt_sets(rt, %z);\n"
+            "    if (s == NULL) {\n"
+            "        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;\n"
+            "    }\n\n", cg->slots);
+    }
+
+    lxb_grammar_codegen_format(cg, head, "    rt->depth++;\n\n");
+
+    status = lxb_grammar_codegen_flush(cg, head, func, ctx);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lxb_grammar_codegen_flush(cg, &cg->body, func, ctx);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    lxb_grammar_codegen_format(cg, head, "\n    rt->depth--;\n\n");
+
+    if (cg->slots != 0) {
+        lxb_grammar_codegen_format(cg, head,
+                                   "    lxb_grammar_codegen_rt_release(rt, mark);\n\n");
+    }
+
+    lxb_grammar_codegen_format(cg, head, "    return LXB_STATUS_OK;\n}\n\n");
+
+    return lxb_grammar_codegen_flush(cg, head, func, ctx);
+}
+
+static int
+lxb_grammar_codegen_cmp(const lxb_char_t *first, size_t first_len,
+                        const lxb_char_t *second, size_t second_len)
+{
+    int res;
+
+    res = memcmp(first, second, (first_len < second_len) ? first_len
+                                                          : second_len);
+    if (res != 0) {
+        return res;
+    }
+
+    if (first_len == second_len) {
+        return 0;
+    }
+
+    return (first_len < second_len) ? -1 : 1;
+}
+
+static int
+lxb_grammar_codegen_keyword_cmp(const void *first, const void *second)
+{
+    const lexbor_bst_map_entry_t *a = *(const lexbor_bst_map_entry_t **) first;
+    const lexbor_bst_map_entry_t *b = *(const lexbor_bst_map_entry_t **) second;
+
+    return lxb_grammar_codegen_cmp(a->str.data, a->str.length,
+                                   b->str.data, b->str.length);
+}
+
+static int
+lxb_grammar_codegen_decl_cmp(const void *first, const void *second)
+{
+    size_t a_len, b_len;
+    const lxb_char_t *a, *b;
+
+    a = lxb_grammar_tree_node_name(*(lxb_grammar_node_t **) first, &a_len);
+    b = lxb_grammar_tree_node_name(*(lxb_grammar_node_t **) second, &b_len);
+
+    return lxb_grammar_codegen_cmp(a, a_len, b, b_len);
+}
+
+/* Indexes refer to the sorted keywords. */
+static lxb_status_t
+lxb_grammar_codegen_hash(lxb_grammar_codegen_t *cg,
+                         lexbor_bst_map_entry_t **keywords, size_t length)
+{
+    size_t size;
+    uint32_t *table;
+    lexbor_str_t *keys;
+    lxb_status_t status;
+    lexbor_str_t *head = &cg->head;
+
+    size = lxb_grammar_phash_size(length);
+
+    keys = lexbor_malloc(sizeof(lexbor_str_t) * length
+                         + sizeof(uint32_t) * size);
+    if (keys == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    table = (uint32_t *) (keys + length);
+
+    for (size_t i = 0; i < length; i++) {
+        keys[i] = keywords[i]->str;
+    }
+
+    status = lxb_grammar_phash_make(keys, length, table);
+    if (status != LXB_STATUS_OK) {
+        cg->last_error = "Failed to make hash of keywords.";
+        goto done;
+    }
+
+    lxb_grammar_codegen_format(cg, head, "/* Buckets: %z, then slots. */\n"
+                               "static const uint32_t\n"
+                               "%S_keyword_hash[] = {",
+                               lxb_grammar_phash_buckets(length),
+                               cg->prefix, cg->prefix_len);
+
+    for (size_t i = 0; i < size; i++) {
+        lxb_grammar_codegen_format(cg, head, "%s%z",
+                                   (i == 0) ? "\n    "
+                                   : (i % 8 == 0) ? ",\n    " : ", ",
+                                   (size_t) table[i]);
+    }
+
+    lxb_grammar_codegen_format(cg, head, "\n};\n\n");
+
+    status = cg->status;
+
+done:
+
+    lexbor_free(keys);
+
+    return status;
+}
+
+/* Sorted as lxb_grammar_codegen_rt_match() expects. */
+static lxb_status_t
+lxb_grammar_codegen_tables(lxb_grammar_codegen_t *cg, lxb_grammar_node_t *root,
+                           lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    size_t len, count;
+    const lxb_char_t *name;
+    lxb_grammar_node_t *node, **decls;
+    lexbor_bst_map_entry_t *entry, **keywords;
+    lexbor_array_t *list = cg->tree->keyword_list;
+    lexbor_str_t *head = &cg->head;
+
+    count = 0;
+
+    for (node = root->first_child; node != NULL; node = node->next) {
+        count++;
+    }
+
+    decls = lexbor_malloc(sizeof(lxb_grammar_node_t *) * (count + 1));
+    keywords = lexbor_malloc(sizeof(lexbor_bst_map_entry_t *)
+                             * (list->length + 1));
+
+    if (decls == NULL || keywords == NULL) {
+        lexbor_free(decls);
+        lexbor_free(keywords);
+
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    count = 0;
+
+    for (node = root->first_child; node != NULL; node = node->next) {
+        decls[count++] = node;
+    }
+
+    qsort(decls, count, sizeof(lxb_grammar_node_t *),
+          lxb_grammar_codegen_decl_cmp);
+
+    memcpy(keywords, list->list, sizeof(void *) * list->length);
+
+    qsort(keywords, list->length, sizeof(lexbor_bst_map_entry_t *),
+          lxb_grammar_codegen_keyword_cmp);
+
+    if (list->length != 0) {
+        lxb_grammar_codegen_format(cg, head, "static const "
+                                   "lxb_grammar_codegen_rt_keyword_t\n"
+                                   "%S_keywords[] = {\n",
+                                   cg->prefix, cg->prefix_len);
+
+        for (size_t i = 0; i < list->length; i++) {
+            entry = keywords[i];
+
+            lxb_grammar_codegen_format(cg, head, "    {");
+            lxb_grammar_codegen_cstring(cg, head, entry->str.data,
+                                        entry->str.length);
+            lxb_grammar_codegen_format(cg, head, ", %z, %z}%s\n",
+                                       entry->str.length,
+                                       (size_t) (uintptr_t) entry->value,
+                                       (i + 1 < list->length) ? "," : "");
+        }
+
+        lxb_grammar_codegen_format(cg, head, "};\n\n");
+
+        cg->status = lxb_grammar_codegen_hash(cg, keywords, list->length);
+    }
+
+    lxb_grammar_codegen_format(cg, head, "static const "
+                               "lxb_grammar_codegen_rt_decl_t\n"
+                               "%S_declarations[] = {\n",
+                               cg->prefix, cg->prefix_len);
+
+    for (size_t i = 0; i < count; i++) {
+        name = lxb_grammar_tree_node_name(decls[i], &len);
+
+        lxb_grammar_codegen_format(cg, head, "    {");
+        lxb_grammar_codegen_cstring(cg, head, name, len);
+        lxb_grammar_codegen_format(cg, head, ", %z, %N}%s\n", len, decls[i],
+                                   (i + 1 < count) ? "," : "");
+    }
+
+    lxb_grammar_codegen_format(cg, head, "};\n\n");
+
+    lxb_grammar_codegen_format(cg, head, "const lxb_grammar_codegen_rt_grammar_t\n"
+                               "%S_grammar = {\n"
+                               "    %S_declarations, %z,\n",
+                               cg->prefix, cg->prefix_len,
+                               cg->prefix, cg->prefix_len, count);
+
+    if (list->length != 0) {
+        lxb_grammar_codegen_format(cg, head, "    %S_keywords, %z, %z,\n"
+                                   "    %S_keyword_hash\n",
+                                   cg->prefix, cg->prefix_len, list->length,
+                                   cg->tree->keyword_max_len,
+                                   cg->prefix, cg->prefix_len);
+    }
+    else {
+        lxb_grammar_codegen_format(cg, head, "    NULL, 0, 0, NULL\n");
+    }
+
+    lxb_grammar_codegen_format(cg, head, "};\n");
+
+    lexbor_free(decls);
+    lexbor_free(keywords);
+
+    return lxb_grammar_codegen_flush(cg, head, func, ctx);
+}
+
+/*
+ * Rows for alternatives of | groups which consume at least one token.
+ * Plain terms are checked by the position loop itself.
+ */
+static void
+lxb_grammar_codegen_first(lxb_grammar_codegen_t *cg)
+{
+    const uint64_t *set;
+    lxb_grammar_node_t *node, *parent, *child;
+    lexbor_str_t *head = &cg->head;
+
+    memset(cg->first_rows, 0, sizeof(size_t) * cg->tree->nodes->length);
+    cg->first_count = 0;
+
+    for (size_t i = 0; i < cg->tree->nodes->length; i++) {
+        node = cg->tree->nodes->list[i];
+        parent = node->parent;
+
+        if (parent == NULL
+            || (parent->type != LXB_GRAMMAR_NODE_GROUP
+                && parent->type != LXB_GRAMMAR_NODE_DECLARATION)
+            || parent->combinator != LXB_GRAMMAR_COMBINATOR_ONE_OF
+            || lxb_grammar_codegen_is_term(node)
+            || lxb_grammar_first_is_nullable(&cg->first, node))
+        {
+            continue;
+        }
+
+        for (child = parent->first_child; child != NULL; child = child->next) {
+            if (!lxb_grammar_codegen_is_term(child)) {
+                break;
+            }
+        }
+
+        if (child == NULL) {
+            continue;
+        }
+
+        if (cg->first_count == 0) {
+            lxb_grammar_codegen_format(cg, head, "\n/* FIRST sets, see "
+                                       "lexbor/grammar/first.h. */\n"
+                                       "static const uint64_t\n"
+                                       "%S_first[] = {\n",
+                                       cg->prefix, cg->prefix_len);
+        }
+        else {
+            lxb_grammar_codegen_format(cg, head, ",\n");
+        }
+
+        cg->first_rows[node->id] = ++cg->first_count;
+
+        set = lxb_grammar_first_set(&cg->first, node);
+
+        lxb_grammar_codegen_format(cg, head, "    ");
+
+        for (size_t w = 0; w < cg->first.words; w++) {
+            lxb_grammar_codegen_format(cg, head, (w == 0) ? "%X" : ", %X",
+                                       set[w]);
+        }
+    }
+
+    if (cg->first_count != 0) {
+        lxb_grammar_codegen_format(cg, head, "\n};\n");
+    }
+}
+
+lxb_status_t
+lxb_grammar_codegen_serialize(lxb_grammar_codegen_t *cg,
+                              const lxb_char_t *prefix, size_t prefix_len,
+                              lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    lxb_status_t status;
+    lxb_grammar_node_t *root, *node;
+
+    root = cg->tree->nodes->list[0];
+
+    if (root->type != LXB_GRAMMAR_NODE_ROOT || prefix_len == 0) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    lxb_grammar_codegen_clean(cg);
+
+    cg->prefix = prefix;
+    cg->prefix_len = prefix_len;
+
+    if (cg->deterministic) {
+        status = lxb_grammar_ambiguity_verify(cg->tree, &cg->last_node);
+        if (status != LXB_STATUS_OK) {
+            if (cg->last_node != NULL) {
+                cg->last_error = "Ambiguous grammar in deterministic mode.";
+            }
+
+            return status;
+        }
+    }
+
+    status = lxb_grammar_codegen_names(cg, root);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    lxb_grammar_codegen_format(cg, &cg->head,
+        "/*\n"
+        " * Generated by lxb_grammar_codegen_serialize(), do not edit.\n"
+        " */\n\n"
+        "#include \"lexbor/grammar/codegen_rt.h\"\n\n\n");
+
+    for (node = root->first_child; node != NULL; node = node->next) {
+        lxb_grammar_codegen_prototype(cg, &cg->head, node);
+        lxb_grammar_codegen_format(cg, &cg->head, ";\n\n");
+    }
+
+    lxb_grammar_codegen_first(cg);
+
+    lxb_grammar_codegen_format(cg, &cg->head, "\n");
+
+    status = lxb_grammar_codegen_flush(cg, &cg->head, func, ctx);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    for (node = root->first_child; node != NULL; node = node->next) {
+        status = lxb_grammar_codegen_function(cg, node, func, ctx);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+    }
+
+    return lxb_grammar_codegen_tables(cg, root, func, ctx);
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_CODEGEN_H
+#define LEXBOR_GRAMMAR_CODEGEN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/tree.h"
+#include "lexbor/grammar/node.h"
+#include "lexbor/grammar/first.h"
+
+#include "lexbor/core/array.h"
+#include "lexbor/core/mraw.h"
+#include "lexbor/core/str.h"
+
+
+/* Declarations with more nodes are called, not inlined. */
+#define LXB_GRAMMAR_CODEGEN_INLINE_MAX 48
+
+/* Nesting of inlined declarations. */
+#define LXB_GRAMMAR_CODEGEN_INLINE_DEPTH 4
+
+/*
+ * Children of && and || group, states are kept for each subset.  Larger
+ * groups keep states of the reached subsets only, see
+ * lxb_grammar_codegen_rt_subsets_begin().
+ */
+#define LXB_GRAMMAR_CODEGEN_SET_MAX 8
+
+
+struct lxb_grammar_codegen {
+    lxb_grammar_tree_t *tree;
+
+    const lxb_char_t   *prefix;
+    size_t             prefix_len;
+
+    /* Settings, may be changed after init. */
+    size_t             inline_max;
+    bool               deterministic;  /* See lexbor/grammar/ambiguity.h. */
+
+    lexbor_mraw_t      *mraw;
+
+    /* C names of declarations by node->id. */
+    lexbor_str_t       *names;
+
+    /*
+     * Alternatives of | groups are tried only at positions where they
+     * can begin.  Row of the FIRST set + 1 by node->id, 0 for none.
+     */
+    lxb_grammar_first_t first;
+    size_t             *first_rows;
+    size_t             first_count;
+
+    /* Function in progress. */
+    lexbor_str_t       head;
+    lexbor_str_t       body;
+    lexbor_str_t       vars;
+    lexbor_str_t       subsets;
+    lexbor_array_t     *inlined;
+    size_t             slots;
+    size_t             uid;
+    size_t             indent;
+    bool               use_tokens;
+    bool               use_length;
+    bool               use_status;
+
+    lxb_status_t       status;
+    lxb_grammar_node_t *last_node;
+    const char         *last_error;
+};
+
+
+LXB_API lxb_grammar_codegen_t *
+lxb_grammar_codegen_create(void);
+
+/* The tree must be made by lxb_grammar_tree_make(). */
+LXB_API lxb_status_t
+lxb_grammar_codegen_init(lxb_grammar_codegen_t *cg, lxb_grammar_tree_t *tree);
+
+LXB_API void
+lxb_grammar_codegen_clean(lxb_grammar_codegen_t *cg);
+
+LXB_API lxb_grammar_codegen_t *
+lxb_grammar_codegen_destroy(lxb_grammar_codegen_t *cg, bool self_destroy);
+
+/*
+ * Writes C source with one function per declaration, see
+ * lexbor/grammar/codegen_rt.h.  All symbols begin with the prefix,
+ * the only external one is "<prefix>_grammar".
+ *
+ * Referenced declarations are inlined unless they are recursive or large.
+ * In deterministic mode a grammar with LL(1) conflicts is refused.
+ */
+LXB_API lxb_status_t
+lxb_grammar_codegen_serialize(lxb_grammar_codegen_t *cg,
+                              const lxb_char_t *prefix, size_t prefix_len,
+                              lxb_grammar_serialize_cb_f func, void *ctx);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_CODEGEN_H */
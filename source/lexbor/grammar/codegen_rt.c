@@ -0,0 +1,423 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/codegen_rt.h"
+
+
+#define LXB_GRAMMAR_CODEGEN_RT_BLOCK_SIZE 4096
+
+
+static int
+lxb_grammar_codegen_rt_cmp(const char *first, size_t first_len,
+                           const lxb_char_t *second, size_t second_len);
+
+
+lxb_grammar_codegen_rt_t *
+lxb_grammar_codegen_rt_create(void)
+{
+    return lexbor_calloc(1, sizeof(lxb_grammar_codegen_rt_t));
+}
+
+lxb_status_t
+lxb_grammar_codegen_rt_init(lxb_grammar_codegen_rt_t *rt)
+{
+    lxb_status_t status;
+
+    if (rt == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    rt->length = 0;
+    rt->words = 0;
+    rt->depth = 0;
+    rt->first = NULL;
+    rt->block = NULL;
+    rt->buf = NULL;
+    rt->buf_size = 0;
+
+    status = lexbor_array_obj_init(&rt->tokens, 64,
+                                   sizeof(lxb_grammar_value_token_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    return lexbor_array_obj_init(&rt->subsets, 64,
+                                 sizeof(lxb_grammar_codegen_rt_subset_t));
+}
+
+void
+lxb_grammar_codegen_rt_clean(lxb_grammar_codegen_rt_t *rt)
+{
+    lexbor_array_obj_clean(&rt->tokens);
+    lexbor_array_obj_clean(&rt->subsets);
+
+    rt->length = 0;
+    rt->words = 0;
+    rt->depth = 0;
+    rt->block = NULL;
+}
+
+lxb_grammar_codegen_rt_t *
+lxb_grammar_codegen_rt_destroy(lxb_grammar_codegen_rt_t *rt,
+                               bool self_destroy)
+{
+    lxb_grammar_codegen_rt_block_t *block, *next;
+
+    if (rt == NULL) {
+        return NULL;
+    }
+
+    lexbor_array_obj_destroy(&rt->tokens, false);
+    lexbor_array_obj_destroy(&rt->subsets, false);
+
+    for (block = rt->first; block != NULL; block = next) {
+        next = block->next;
+
+        lexbor_free(block->data);
+        lexbor_free(block);
+    }
+
+    rt->first = NULL;
+    rt->block = NULL;
+
+    if (rt->buf != NULL) {
+        rt->buf = lexbor_free(rt->buf);
+    }
+
+    if (self_destroy) {
+        return lexbor_free(rt);
+    }
+
+    return rt;
+}
+
+uint64_t *
+lxb_grammar_codegen_rt_sets(lxb_grammar_codegen_rt_t *rt, size_t count)
+{
+    size_t need;
+    uint64_t *sets;
+    lxb_grammar_codegen_rt_block_t *block, *next;
+
+    need = count * rt->words;
+    block = rt->block;
+
+    if (block != NULL && block->size - block->length >= need) {
+        sets = block->data + block->length;
+        block->length += need;
+
+        memset(sets, 0, need * sizeof(uint64_t));
+
+        return sets;
+    }
+
+    next = (block != NULL) ? block->next : rt->first;
+
+    if (next == NULL || next->size < need) {
+        next = lexbor_calloc(1, sizeof(lxb_grammar_codegen_rt_block_t));
+        if (next == NULL) {
+            return NULL;
+        }
+
+        next->size = (need > LXB_GRAMMAR_CODEGEN_RT_BLOCK_SIZE)
+                     ? need : LXB_GRAMMAR_CODEGEN_RT_BLOCK_SIZE;
+
+        next->data = lexbor_malloc(next->size * sizeof(uint64_t));
+        if (next->data == NULL) {
+            lexbor_free(next);
+            return NULL;
+        }
+
+        /* Between the current block and the following one. */
+        next->prev = block;
+
+        if (block != NULL) {
+            next->next = block->next;
+            block->next = next;
+        }
+        else {
+            next->next = rt->first;
+            rt->first = next;
+        }
+
+        if (next->next != NULL) {
+            next->next->prev = next;
+        }
+    }
+
+    next->length = need;
+    rt->block = next;
+
+    memset(next->data, 0, need * sizeof(uint64_t));
+
+    return next->data;
+}
+
+lxb_status_t
+lxb_grammar_codegen_rt_subsets_begin(lxb_grammar_codegen_rt_t *rt,
+                                     lxb_grammar_codegen_rt_subsets_t *q,
+                                     const uint64_t *in, size_t count,
+                                     bool any)
+{
+    lxb_grammar_codegen_rt_subset_t *entry;
+
+    q->begin = rt->subsets.length;
+    q->pos = q->begin;
+    q->full = (count >= 64) ? UINT64_MAX : (((uint64_t) 1 << count) - 1);
+    q->any = any;
+    q->mark = lxb_grammar_codegen_rt_mark(rt);
+    q->mask = 0;
+    q->set = NULL;
+
+    entry = lexbor_array_obj_push(&rt->subsets);
+    if (entry == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    entry->mask = 0;
+    entry->set = lxb_grammar_codegen_rt_sets(rt, 1);
+
+    if (entry->set == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    lxb_grammar_codegen_rt_copy(entry->set, in, rt->words);
+
+    return LXB_STATUS_OK;
+}
+
+bool
+lxb_grammar_codegen_rt_subsets_next(lxb_grammar_codegen_rt_t *rt,
+                                    lxb_grammar_codegen_rt_subsets_t *q,
+                                    uint64_t *out)
+{
+    lxb_grammar_codegen_rt_subset_t *entry;
+
+    while (q->pos < rt->subsets.length) {
+        entry = lexbor_array_obj_get(&rt->subsets, q->pos++);
+
+        if (entry->mask == q->full || (q->any && entry->mask != 0)) {
+            lxb_grammar_codegen_rt_union(out, entry->set, rt->words);
+        }
+
+        if (entry->mask != q->full) {
+            q->mask = entry->mask;
+            q->set = entry->set;
+
+            return true;
+        }
+    }
+
+    rt->subsets.length = q->begin;
+    lxb_grammar_codegen_rt_release(rt, q->mark);
+
+    return false;
+}
+
+/* States after the current one have one child more or the same count. */
+lxb_status_t
+lxb_grammar_codegen_rt_subsets_add(lxb_grammar_codegen_rt_t *rt,
+                                   lxb_grammar_codegen_rt_subsets_t *q,
+                                   uint64_t bit, const uint64_t *set)
+{
+    uint64_t mask;
+    lxb_grammar_codegen_rt_subset_t *entry;
+
+    if (lxb_grammar_codegen_rt_is_empty(set, rt->words)) {
+        return LXB_STATUS_OK;
+    }
+
+    mask = q->mask | bit;
+
+    for (size_t i = q->pos; i < rt->subsets.length; i++) {
+        entry = lexbor_array_obj_get(&rt->subsets, i);
+
+        if (entry->mask == mask) {
+            lxb_grammar_codegen_rt_union(entry->set, set, rt->words);
+
+            return LXB_STATUS_OK;
+        }
+    }
+
+    entry = lexbor_array_obj_push(&rt->subsets);
+    if (entry == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    entry->mask = mask;
+    entry->set = lxb_grammar_codegen_rt_sets(rt, 1);
+
+    if (entry->set == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    lxb_grammar_codegen_rt_copy(entry->set, set, rt->words);
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_codegen_rt_keywords(lxb_grammar_codegen_rt_t *rt,
+                                const lxb_grammar_codegen_rt_grammar_t *grammar)
+{
+    size_t idx;
+    lxb_char_t *buf;
+    lxb_grammar_value_token_t *token, *end;
+    const lxb_grammar_codegen_rt_keyword_t *keyword;
+
+    if (rt->buf_size < grammar->keyword_max_len) {
+        buf = lexbor_realloc(rt->buf, grammar->keyword_max_len);
+        if (buf == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        rt->buf = buf;
+        rt->buf_size = grammar->keyword_max_len;
+    }
+
+    token = (lxb_grammar_value_token_t *) rt->tokens.list;
+    end = token + rt->tokens.length;
+
+    for (; token < end; token++) {
+        token->keyword_id = 0;
+
+        if (token->type != LXB_GRAMMAR_VALUE_IDENT
+            || token->length > grammar->keyword_max_len)
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < token->length; i++) {
+            rt->buf[i] = token->data[i];
+
+            if (rt->buf[i] >= 'A' && rt->buf[i] <= 'Z') {
+                rt->buf[i] |= 0x20;
+            }
+        }
+
+        idx = lxb_grammar_phash_find(grammar->keyword_hash,
+                                     grammar->keywords_length,
+                                     rt->buf, token->length);
+        if (idx >= grammar->keywords_length) {
+            continue;
+        }
+
+        keyword = &grammar->keywords[idx];
+
+        if (keyword->length == token->length
+            && memcmp(keyword->name, rt->buf, token->length) == 0)
+        {
+            token->keyword_id = keyword->id;
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_codegen_rt_run(lxb_grammar_codegen_rt_t *rt,
+                           const lxb_grammar_codegen_rt_grammar_t *grammar,
+                           lxb_grammar_codegen_rt_decl_f func,
+                           const lxb_char_t *data, size_t size,
+                           bool *accepted)
+{
+    uint64_t *sets;
+    lxb_status_t status;
+
+    *accepted = false;
+
+    lxb_grammar_codegen_rt_clean(rt);
+
+    status = lxb_grammar_value_tokenize(&rt->tokens, data, size);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lxb_grammar_codegen_rt_keywords(rt, grammar);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    rt->length = rt->tokens.length;
+    rt->words = (rt->length >> 6) + 1;
+
+    sets = lxb_grammar_codegen_rt_sets(rt, 2);
+    if (sets == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    lxb_grammar_codegen_rt_add(sets, 0);
+
+    status = func(rt, sets, sets + rt->words);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    *accepted = lxb_grammar_codegen_rt_has(sets + rt->words, rt->length);
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_codegen_rt_match(lxb_grammar_codegen_rt_t *rt,
+                             const lxb_grammar_codegen_rt_grammar_t *grammar,
+                             const lxb_char_t *name, size_t name_len,
+                             const lxb_char_t *data, size_t size,
+                             bool *accepted)
+{
+    int res;
+    size_t left, right, mid;
+    const lxb_grammar_codegen_rt_decl_t *decl;
+
+    *accepted = false;
+
+    if (name_len >= 2 && name[0] == '<' && name[name_len - 1] == '>') {
+        name++;
+        name_len -= 2;
+    }
+
+    left = 0;
+    right = grammar->decls_length;
+
+    while (left < right) {
+        mid = left + (right - left) / 2;
+        decl = &grammar->decls[mid];
+
+        res = lxb_grammar_codegen_rt_cmp(decl->name, decl->length,
+                                         name, name_len);
+        if (res == 0) {
+            return lxb_grammar_codegen_rt_run(rt, grammar, decl->func,
+                                              data, size, accepted);
+        }
+
+        if (res < 0) {
+            left = mid + 1;
+        }
+        else {
+            right = mid;
+        }
+    }
+
+    return LXB_STATUS_ERROR_NOT_EXISTS;
+}
+
+static int
+lxb_grammar_codegen_rt_cmp(const char *first, size_t first_len,
+                           const lxb_char_t *second, size_t second_len)
+{
+    int res;
+
+    res = memcmp(first, second, (first_len < second_len) ? first_len
+                                                          : second_len);
+    if (res != 0) {
+        return res;
+    }
+
+    if (first_len == second_len) {
+        return 0;
+    }
+
+    return (first_len < second_len) ? -1 : 1;
+}
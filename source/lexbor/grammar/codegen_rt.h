@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_CODEGEN_RT_H
+#define LEXBOR_GRAMMAR_CODEGEN_RT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/value.h"
+#include "lexbor/grammar/type.h"
+#include "lexbor/grammar/match.h"
+#include "lexbor/grammar/phash.h"
+#include "lexbor/grammar/first.h"
+
+#include "lexbor/core/array_obj.h"
+#include "lexbor/core/str.h"
+
+
+/*
+ * Runtime of the generated matchers, see lexbor/grammar/codegen.h.
+ *
+ * A generated function takes the set of token positions where matching
+ * begins and adds to "out" all positions where it can end.  Sets are
+ * bitsets of rt->words words, position N is the end of the value.
+ */
+typedef lxb_status_t
+(*lxb_grammar_codegen_rt_decl_f)(lxb_grammar_codegen_rt_t *rt,
+                                 const uint64_t *in, uint64_t *out);
+
+typedef struct {
+    const char                    *name;
+    size_t                        length;
+    lxb_grammar_codegen_rt_decl_f func;
+}
+lxb_grammar_codegen_rt_decl_t;
+
+typedef struct {
+    const char *name;      /* Lowercase. */
+    size_t     length;
+    size_t     id;
+}
+lxb_grammar_codegen_rt_keyword_t;
+
+/*
+ * Emitted by the generator, arrays are sorted by name.
+ * Keywords are found by the perfect hash, see lexbor/grammar/phash.h.
+ */
+typedef struct {
+    const lxb_grammar_codegen_rt_decl_t    *decls;
+    size_t                                 decls_length;
+
+    const lxb_grammar_codegen_rt_keyword_t *keywords;
+    size_t                                 keywords_length;
+    size_t                                 keyword_max_len;
+    const uint32_t                         *keyword_hash;
+}
+lxb_grammar_codegen_rt_grammar_t;
+
+typedef struct lxb_grammar_codegen_rt_block lxb_grammar_codegen_rt_block_t;
+
+/* Sets are never moved, blocks are chained. */
+struct lxb_grammar_codegen_rt_block {
+    uint64_t                       *data;
+    size_t                         size;
+    size_t                         length;
+
+    lxb_grammar_codegen_rt_block_t *next;
+    lxb_grammar_codegen_rt_block_t *prev;
+};
+
+typedef struct {
+    lxb_grammar_codegen_rt_block_t *block;
+    size_t                         length;
+}
+lxb_grammar_codegen_rt_mark_t;
+
+/* State of && or || group: children matched so far and the positions. */
+typedef struct {
+    uint64_t mask;
+    uint64_t *set;
+}
+lxb_grammar_codegen_rt_subset_t;
+
+/*
+ * Group with more than LXB_GRAMMAR_CODEGEN_SET_MAX children.  Only the
+ * reached subsets have states, they are taken by count of children:
+ * a state is final before any superset.
+ */
+typedef struct {
+    size_t                        begin;  /* First state in rt->subsets. */
+    size_t                        pos;    /* Next state. */
+    uint64_t                      full;
+    bool                          any;    /* ||: any nonempty subset. */
+    lxb_grammar_codegen_rt_mark_t mark;
+
+    /* Current state. */
+    uint64_t                      mask;
+    uint64_t                      *set;
+}
+lxb_grammar_codegen_rt_subsets_t;
+
+struct lxb_grammar_codegen_rt {
+    lexbor_array_obj_t             tokens;
+    lexbor_array_obj_t             subsets;
+
+    /* Number of tokens and words in a set. */
+    size_t                         length;
+    size_t                         words;
+
+    size_t                         depth;
+
+    lxb_grammar_codegen_rt_block_t *first;
+    lxb_grammar_codegen_rt_block_t *block;
+
+    /* For lowercase keywords. */
+    lxb_char_t                     *buf;
+    size_t                         buf_size;
+};
+
+
+LXB_API lxb_grammar_codegen_rt_t *
+lxb_grammar_codegen_rt_create(void);
+
+LXB_API lxb_status_t
+lxb_grammar_codegen_rt_init(lxb_grammar_codegen_rt_t *rt);
+
+LXB_API void
+lxb_grammar_codegen_rt_clean(lxb_grammar_codegen_rt_t *rt);
+
+LXB_API lxb_grammar_codegen_rt_t *
+lxb_grammar_codegen_rt_destroy(lxb_grammar_codegen_rt_t *rt,
+                               bool self_destroy);
+
+/* Tokenizes the value and runs the generated function of a declaration. */
+LXB_API lxb_status_t
+lxb_grammar_codegen_rt_run(lxb_grammar_codegen_rt_t *rt,
+                           const lxb_grammar_codegen_rt_grammar_t *grammar,
+                           lxb_grammar_codegen_rt_decl_f func,
+                           const lxb_char_t *data, size_t size,
+                           bool *accepted);
+
+/* By declaration name, "<name>" is accepted too. */
+LXB_API lxb_status_t
+lxb_grammar_codegen_rt_match(lxb_grammar_codegen_rt_t *rt,
+                             const lxb_grammar_codegen_rt_grammar_t *grammar,
+                             const lxb_char_t *name, size_t name_len,
+                             const lxb_char_t *data, size_t size,
+                             bool *accepted);
+
+/* Zeroed sets, live until lxb_grammar_codegen_rt_release(). */
+LXB_API uint64_t *
+lxb_grammar_codegen_rt_sets(lxb_grammar_codegen_rt_t *rt, size_t count);
+
+/* The first state is the empty subset at positions of "in". */
+LXB_API lxb_status_t
+lxb_grammar_codegen_rt_subsets_begin(lxb_grammar_codegen_rt_t *rt,
+                                     lxb_grammar_codegen_rt_subsets_t *q,
+                                     const uint64_t *in, size_t count,
+                                     bool any);
+
+/*
+ * Takes the next state, positions of a final one are added to "out".
+ * Returns false when no states are left, the states are released.
+ */
+LXB_API bool
+lxb_grammar_codegen_rt_subsets_next(lxb_grammar_codegen_rt_t *rt,
+                                    lxb_grammar_codegen_rt_subsets_t *q,
+                                    uint64_t *out);
+
+/* Positions after the child "bit" is matched from the current state. */
+LXB_API lxb_status_t
+lxb_grammar_codegen_rt_subsets_add(lxb_grammar_codegen_rt_t *rt,
+                                   lxb_grammar_codegen_rt_subsets_t *q,
+                                   uint64_t bit, const uint64_t *set);
+
+/*
+ * Inline functions
+ */
+lxb_inline lxb_grammar_codegen_rt_mark_t
+lxb_grammar_codegen_rt_mark(lxb_grammar_codegen_rt_t *rt)
+{
+    lxb_grammar_codegen_rt_mark_t mark;
+
+    mark.block = rt->block;
+    mark.length = (rt->block != NULL) ? rt->block->length : 0;
+
+    return mark;
+}
+
+lxb_inline void
+lxb_grammar_codegen_rt_release(lxb_grammar_codegen_rt_t *rt,
+                               lxb_grammar_codegen_rt_mark_t mark)
+{
+    rt->block = mark.block;
+
+    if (mark.block != NULL) {
+        mark.block->length = mark.length;
+    }
+}
+
+lxb_inline void
+lxb_grammar_codegen_rt_clear(uint64_t *set, size_t words)
+{
+    memset(set, 0, words * sizeof(uint64_t));
+}
+
+lxb_inline void
+lxb_grammar_codegen_rt_copy(uint64_t *dst, const uint64_t *src, size_t words)
+{
+    memcpy(dst, src, words * sizeof(uint64_t));
+}
+
+lxb_inline void
+lxb_grammar_codegen_rt_union(uint64_t *dst, const uint64_t *src, size_t words)
+{
+    for (size_t i = 0; i < words; i++) {
+        dst[i] |= src[i];
+    }
+}
+
+lxb_inline bool
+lxb_grammar_codegen_rt_is_empty(const uint64_t *set, size_t words)
+{
+    for (size_t i = 0; i < words; i++) {
+        if (set[i] != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* All positions of the first set are in the second one. */
+lxb_inline bool
+lxb_grammar_codegen_rt_subset(const uint64_t *first, const uint64_t *second,
+                              size_t words)
+{
+    for (size_t i = 0; i < words; i++) {
+        if ((first[i] & ~second[i]) != 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+lxb_inline void
+lxb_grammar_codegen_rt_add(uint64_t *set, size_t pos)
+{
+    set[pos >> 6] |= (uint64_t) 1 << (pos & 63);
+}
+
+lxb_inline void
+lxb_grammar_codegen_rt_del(uint64_t *set, size_t pos)
+{
+    set[pos >> 6] &= ~((uint64_t) 1 << (pos & 63));
+}
+
+lxb_inline bool
+lxb_grammar_codegen_rt_has(const uint64_t *set, size_t pos)
+{
+    return (set[pos >> 6] >> (pos & 63)) & 1;
+}
+
+/* First position >= pos, or words * 64 if none. */
+lxb_inline size_t
+lxb_grammar_codegen_rt_next(const uint64_t *set, size_t words, size_t pos)
+{
+    size_t i;
+    uint64_t word;
+
+    i = pos >> 6;
+
+    if (i >= words) {
+        return words << 6;
+    }
+
+    word = set[i] & (UINT64_MAX << (pos & 63));
+
+    while (word == 0) {
+        if (++i == words) {
+            return words << 6;
+        }
+
+        word = set[i];
+    }
+
+#if defined(__GNUC__)
+    return (i << 6) + (size_t) __builtin_ctzll(word);
+#else
+    pos = i << 6;
+
+    while ((word & 1) == 0) {
+        word >>= 1;
+        pos++;
+    }
+
+    return pos;
+#endif
+}
+
+lxb_inline bool
+lxb_grammar_codegen_rt_literal(const lxb_grammar_value_token_t *token,
+                               const char *str, size_t length)
+{
+    return (size_t) (token->end - token->begin) == length
+           && lexbor_str_data_ncasecmp(token->begin,
+                                       (const lxb_char_t *) str, length);
+}
+
+lxb_inline bool
+lxb_grammar_codegen_rt_comma(const lxb_grammar_value_token_t *token)
+{
+    return token->type == LXB_GRAMMAR_VALUE_DELIM && *token->data == ',';
+}
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_CODEGEN_RT_H */
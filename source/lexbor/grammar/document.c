@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/document.h"
+#include "lexbor/grammar/token.h"
+#include "lexbor/grammar/node.h"
+
+
+#define LXB_GRAMMAR_DOCUMENT_SLAB_CHUNK 1024
+
+
+static lxb_status_t
+lxb_grammar_document_slab(lexbor_dobject_t **slab, size_t struct_size);
+
+
+lxb_grammar_document_t *
+lxb_grammar_document_create(void)
+{
+    return lexbor_calloc(1, sizeof(lxb_grammar_document_t));
+}
+
+lxb_status_t
+lxb_grammar_document_init(lxb_grammar_document_t *document)
+{
+    lxb_status_t status;
+
+    if (document == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    document->mraw = lexbor_mraw_create();
+    status = lexbor_mraw_init(document->mraw, 4096 * 4);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    document->text = lexbor_mraw_create();
+    status = lexbor_mraw_init(document->text, 4096);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lexbor_array_init(&document->tokens, 1024);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    document->names = lexbor_bst_map_create();
+    status = lexbor_bst_map_init(document->names, 128);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    return lexbor_array_init(&document->strings, 64);
+}
+
+lxb_grammar_document_t *
+lxb_grammar_document_destroy(lxb_grammar_document_t *document)
+{
+    if (document == NULL) {
+        return NULL;
+    }
+
+    lexbor_array_destroy(&document->tokens, false);
+    lexbor_array_destroy(&document->strings, false);
+
+    document->names = lexbor_bst_map_destroy(document->names, true);
+
+    document->token_slab = lexbor_dobject_destroy(document->token_slab, true);
+    document->node_slab = lexbor_dobject_destroy(document->node_slab, true);
+
+    document->mraw = lexbor_mraw_destroy(document->mraw, true);
+    document->text = lexbor_mraw_destroy(document->text, true);
+
+    return lexbor_free(document);
+}
+
+static lxb_status_t
+lxb_grammar_document_slab(lexbor_dobject_t **slab, size_t struct_size)
+{
+    if (*slab != NULL) {
+        return LXB_STATUS_OK;
+    }
+
+    *slab = lexbor_dobject_create();
+
+    return lexbor_dobject_init(*slab, LXB_GRAMMAR_DOCUMENT_SLAB_CHUNK,
+                               struct_size);
+}
+
+lxb_status_t
+lxb_grammar_document_token_slab(lxb_grammar_document_t *document)
+{
+    if (document->tokens_mraw) {
+        return LXB_STATUS_ERROR_WRONG_STAGE;
+    }
+
+    return lxb_grammar_document_slab(&document->token_slab,
+                                     sizeof(lxb_grammar_token_t));
+}
+
+lxb_status_t
+lxb_grammar_document_token_mraw(lxb_grammar_document_t *document)
+{
+    if (document->token_slab != NULL) {
+        return LXB_STATUS_ERROR_WRONG_STAGE;
+    }
+
+    document->tokens_mraw = true;
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_document_node_slab(lxb_grammar_document_t *document)
+{
+    if (document->nodes_mraw) {
+        return LXB_STATUS_ERROR_WRONG_STAGE;
+    }
+
+    return lxb_grammar_document_slab(&document->node_slab,
+                                     sizeof(lxb_grammar_node_t));
+}
+
+lxb_status_t
+lxb_grammar_document_node_mraw(lxb_grammar_document_t *document)
+{
+    if (document->node_slab != NULL) {
+        return LXB_STATUS_ERROR_WRONG_STAGE;
+    }
+
+    document->nodes_mraw = true;
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_document_nodes_clean(lxb_grammar_document_t *document)
+{
+    if (document->node_slab == NULL) {
+        return LXB_STATUS_ERROR_WRONG_STAGE;
+    }
+
+    lexbor_dobject_clean(document->node_slab);
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_document_intern(lxb_grammar_document_t *document,
+                            const lxb_char_t *data, size_t length,
+                            uint32_t *id)
+{
+    lxb_status_t status;
+    lexbor_bst_map_entry_t *entry;
+
+    entry = lexbor_bst_map_insert_not_exists(document->names,
+                                             &document->names_root,
+                                             data, length);
+    if (entry == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    /* Value of the entry is id + 1. */
+    if (entry->value == NULL) {
+        if (document->strings.length >= UINT32_MAX - 1) {
+            return LXB_STATUS_ERROR_OVERFLOW;
+        }
+
+        status = lexbor_array_push(&document->strings, entry);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        entry->value = (void *) (uintptr_t) document->strings.length;
+    }
+
+    *id = (uint32_t) ((uintptr_t) entry->value - 1);
+
+    return LXB_STATUS_OK;
+}
@@ -11,18 +11,111 @@
 extern "C" {
 #endif
 
-#include "lexbor/html/interfaces/document.h"
+#include "lexbor/core/base.h"
+#include "lexbor/core/mraw.h"
+#include "lexbor/core/array.h"
+#include "lexbor/core/bst_map.h"
+#include "lexbor/core/dobject.h"
 
 
-typedef lxb_html_document_t lxb_grammar_document_t;
+typedef struct lxb_grammar_document lxb_grammar_document_t;
 
+/*
+ * Everything of one grammar: tokens, elements, nodes, entries of the tree
+ * and strings.  Nothing is freed alone, the document is released at once.
+ */
+struct lxb_grammar_document {
+    lexbor_mraw_t       *mraw;   /* Tokens, elements, nodes, the tree. */
+    lexbor_mraw_t       *text;   /* Strings of tokens and nodes. */
+
+    lexbor_array_t      tokens;  /* lxb_grammar_token_t, in order. */
+
+    /* Fixed-size tokens and nodes without headers, NULL if in mraw. */
+    lexbor_dobject_t    *token_slab;
+    lexbor_dobject_t    *node_slab;
+
+    /* The mraw is chosen, the slab can not be made any more. */
+    bool                tokens_mraw;
+    bool                nodes_mraw;
+
+    /* Names and values of elements, lexbor_bst_map_entry_t by id. */
+    lexbor_bst_map_t    *names;
+    lexbor_bst_entry_t  *names_root;
+    lexbor_array_t      strings;
+
+    /* Bytes, see lexbor/grammar/memory.h. */
+    size_t              memory_peak;
+    size_t              memory_held;
+};
+
+
+LXB_API lxb_grammar_document_t *
+lxb_grammar_document_create(void);
+
+LXB_API lxb_status_t
+lxb_grammar_document_init(lxb_grammar_document_t *document);
+
+/* Always with the document itself. */
+LXB_API lxb_grammar_document_t *
+lxb_grammar_document_destroy(lxb_grammar_document_t *document);
+
+/*
+ * Tokens or nodes of the document are allocated by a slab of fixed-size
+ * objects with a free list, see lexbor_dobject_t, or by the mraw.
+ *
+ * The allocator is chosen once for the document: by the first of these
+ * calls, or by the first token or node allocated in the mraw.  Asking for
+ * the other one after that gives LXB_STATUS_ERROR_WRONG_STAGE.
+ */
+LXB_API lxb_status_t
+lxb_grammar_document_token_slab(lxb_grammar_document_t *document);
+
+LXB_API lxb_status_t
+lxb_grammar_document_token_mraw(lxb_grammar_document_t *document);
 
-lxb_inline lxb_grammar_document_t *
-lxb_grammar_document_destroy(lxb_grammar_document_t *document)
+LXB_API lxb_status_t
+lxb_grammar_document_node_slab(lxb_grammar_document_t *document);
+
+LXB_API lxb_status_t
+lxb_grammar_document_node_mraw(lxb_grammar_document_t *document);
+
+/* Releases all nodes at once, only with the slab of nodes. */
+LXB_API lxb_status_t
+lxb_grammar_document_nodes_clean(lxb_grammar_document_t *document);
+
+/* The same data gives the same id, ids are 0, 1, 2... in order of first. */
+LXB_API lxb_status_t
+lxb_grammar_document_intern(lxb_grammar_document_t *document,
+                            const lxb_char_t *data, size_t length,
+                            uint32_t *id);
+
+
+/*
+ * Inline functions
+ */
+lxb_inline lexbor_mraw_t *
+lxb_grammar_document_mraw(lxb_grammar_document_t *document)
 {
-    (void) lxb_html_document_destroy(document);
+    return document->mraw;
+}
 
-    return NULL;
+lxb_inline lexbor_mraw_t *
+lxb_grammar_document_text(lxb_grammar_document_t *document)
+{
+    return document->text;
+}
+
+lxb_inline const lxb_char_t *
+lxb_grammar_document_string(lxb_grammar_document_t *document, uint32_t id,
+                            size_t *len)
+{
+    lexbor_bst_map_entry_t *entry = document->strings.list[id];
+
+    if (len != NULL) {
+        *len = entry->str.length;
+    }
+
+    return entry->str.data;
 }
 
 
@@ -31,4 +124,3 @@ lxb_grammar_document_destroy(lxb_grammar_document_t *document)
 #endif
 
 #endif /* LEXBOR_GRAMMAR_DOCUMENT_H */
-
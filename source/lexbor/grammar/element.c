@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/element.h"
+
+
+#define lxb_grammar_element_send(data, len)                                    \
+    do {                                                                       \
+        status = func((const lxb_char_t *) (data), (len), ctx);                \
+        if (status != LXB_STATUS_OK) {                                         \
+            return status;                                                     \
+        }                                                                      \
+    }                                                                          \
+    while (0)
+
+
+lxb_grammar_element_t *
+lxb_grammar_element_create(lxb_grammar_document_t *document, size_t length)
+{
+    lxb_grammar_element_t *element;
+
+    element = lexbor_mraw_alloc(document->mraw, sizeof(lxb_grammar_element_t)
+                                + length * sizeof(lxb_grammar_element_attr_t));
+    if (element == NULL) {
+        return NULL;
+    }
+
+    element->document = document;
+    element->length = (uint32_t) length;
+
+    return element;
+}
+
+/* Escaped as in HTML, the value goes back through the HTML tokenizer. */
+static lxb_status_t
+lxb_grammar_element_serialize_value(const lxb_char_t *data, size_t len,
+                                    lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    lxb_status_t status;
+    const lxb_char_t *begin, *end;
+
+    begin = data;
+    end = data + len;
+
+    for (; data < end; data++) {
+        switch (*data) {
+            case '&':
+                lxb_grammar_element_send(begin, data - begin);
+                lxb_grammar_element_send("&amp;", 5);
+                break;
+
+            case '"':
+                lxb_grammar_element_send(begin, data - begin);
+                lxb_grammar_element_send("&quot;", 6);
+                break;
+
+            default:
+                continue;
+        }
+
+        begin = data + 1;
+    }
+
+    if (begin < end) {
+        lxb_grammar_element_send(begin, end - begin);
+    }
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_element_serialize(lxb_grammar_element_t *element,
+                              lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    size_t len;
+    lxb_status_t status;
+    const lxb_char_t *data;
+
+    data = lxb_grammar_element_name(element, &len);
+
+    lxb_grammar_element_send("<", 1);
+    lxb_grammar_element_send(data, len);
+
+    for (size_t i = 0; i < element->length; i++) {
+        data = lxb_grammar_element_attr_name(element, i, &len);
+
+        lxb_grammar_element_send(" ", 1);
+        lxb_grammar_element_send(data, len);
+
+        data = lxb_grammar_element_attr_value(element, i, &len);
+        if (data == NULL) {
+            continue;
+        }
+
+        lxb_grammar_element_send("=\"", 2);
+
+        status = lxb_grammar_element_serialize_value(data, len, func, ctx);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        lxb_grammar_element_send("\"", 1);
+    }
+
+    lxb_grammar_element_send(">", 1);
+
+    return LXB_STATUS_OK;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_ELEMENT_H
+#define LEXBOR_GRAMMAR_ELEMENT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+
+
+/* Attribute without "=value". */
+#define LXB_GRAMMAR_ELEMENT_NO_VALUE UINT32_MAX
+
+
+typedef struct {
+    uint32_t name;
+    uint32_t value;
+}
+lxb_grammar_element_attr_t;
+
+/*
+ * <name key="value" ...> of ELEMENT tokens and of DECLARATION and ELEMENT
+ * nodes.  Names and values are ids of strings interned by the document,
+ * see lxb_grammar_document_intern().
+ */
+struct lxb_grammar_element {
+    lxb_grammar_document_t     *document;
+
+    uint32_t                   name;
+    uint32_t                   length;   /* Count of attributes. */
+    lxb_grammar_element_attr_t attrs[];
+};
+
+
+/* In the memory of the document, with names and values not set. */
+LXB_API lxb_grammar_element_t *
+lxb_grammar_element_create(lxb_grammar_document_t *document, size_t length);
+
+LXB_API lxb_status_t
+lxb_grammar_element_serialize(lxb_grammar_element_t *element,
+                              lxb_grammar_serialize_cb_f func, void *ctx);
+
+
+/*
+ * Inline functions
+ */
+lxb_inline const lxb_char_t *
+lxb_grammar_element_name(lxb_grammar_element_t *element, size_t *len)
+{
+    return lxb_grammar_document_string(element->document, element->name, len);
+}
+
+lxb_inline const lxb_char_t *
+lxb_grammar_element_attr_name(lxb_grammar_element_t *element, size_t idx,
+                              size_t *len)
+{
+    return lxb_grammar_document_string(element->document,
+                                       element->attrs[idx].name, len);
+}
+
+/* NULL if the attribute has no value. */
+lxb_inline const lxb_char_t *
+lxb_grammar_element_attr_value(lxb_grammar_element_t *element, size_t idx,
+                               size_t *len)
+{
+    if (element->attrs[idx].value == LXB_GRAMMAR_ELEMENT_NO_VALUE) {
+        if (len != NULL) {
+            *len = 0;
+        }
+
+        return NULL;
+    }
+
+    return lxb_grammar_document_string(element->document,
+                                       element->attrs[idx].value, len);
+}
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_ELEMENT_H */
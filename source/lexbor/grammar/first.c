@@ -0,0 +1,377 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/first.h"
+#include "lexbor/grammar/type.h"
+
+
+#define LXB_GRAMMAR_FIRST_BIT(type) ((uint64_t) 1 << (type))
+
+#define LXB_GRAMMAR_FIRST_ANY                                                  \
+    (LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_IDENT)                            \
+     | LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_HASH)                           \
+     | LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_STRING)                         \
+     | LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_URL)                            \
+     | LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_NUMBER)                         \
+     | LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_PERCENTAGE)                     \
+     | LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_DIMENSION)                      \
+     | LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_DELIM))
+
+#define lxb_grammar_first_send(data, len)                                      \
+    do {                                                                       \
+        status = func((const lxb_char_t *) (data), (len), ctx);                \
+        if (status != LXB_STATUS_OK) {                                         \
+            return status;                                                     \
+        }                                                                      \
+    }                                                                          \
+    while (0)
+
+
+/* Tokens of the basic types, see lxb_grammar_type_match(). */
+static const uint64_t
+lxb_grammar_first_types[LXB_GRAMMAR_TYPE__LAST_ENTRY] = {
+    0,
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_IDENT),      /* <ident> */
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_IDENT),      /* <custom-ident> */
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_IDENT),      /* <dashed-ident> */
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_STRING),     /* <string> */
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_URL),        /* <url> */
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_NUMBER),     /* <number> */
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_NUMBER),     /* <integer> */
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_PERCENTAGE), /* <percentage> */
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_DIMENSION),  /* <dimension> */
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_DIMENSION)   /* <length> */
+    | LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_NUMBER),
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_DIMENSION)   /* <length-percentage> */
+    | LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_NUMBER)
+    | LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_PERCENTAGE),
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_DIMENSION)   /* <angle> */
+    | LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_NUMBER),
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_DIMENSION),  /* <time> */
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_DIMENSION),  /* <frequency> */
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_DIMENSION),  /* <resolution> */
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_DIMENSION),  /* <flex> */
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_HASH),       /* <hex-color> */
+    LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_HASH)        /* <hash-token> */
+};
+
+
+static bool
+lxb_grammar_first_node(lxb_grammar_first_t *first, lxb_grammar_node_t *node);
+
+
+lxb_grammar_first_t *
+lxb_grammar_first_create(void)
+{
+    return lexbor_calloc(1, sizeof(lxb_grammar_first_t));
+}
+
+lxb_status_t
+lxb_grammar_first_init(lxb_grammar_first_t *first, lxb_grammar_tree_t *tree)
+{
+    bool changed;
+    lxb_grammar_node_t *root, *node;
+
+    if (first == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    if (tree == NULL || tree->nodes->length == 0) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    root = tree->nodes->list[0];
+
+    if (root->type != LXB_GRAMMAR_NODE_ROOT) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    first->tree = tree;
+    first->length = tree->nodes->length;
+    first->words = (LXB_GRAMMAR_FIRST_KEYWORD + tree->keyword_list->length
+                    + 63) >> 6;
+
+    first->sets = lexbor_calloc(first->length * first->words,
+                                sizeof(uint64_t));
+    if (first->sets == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    first->nullable = lexbor_calloc(first->length, sizeof(bool));
+    if (first->nullable == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    /* Sets only grow, references to declarations settle down. */
+    do {
+        changed = false;
+
+        for (node = root->first_child; node != NULL; node = node->next) {
+            changed |= lxb_grammar_first_node(first, node);
+        }
+    }
+    while (changed);
+
+    return LXB_STATUS_OK;
+}
+
+lxb_grammar_first_t *
+lxb_grammar_first_destroy(lxb_grammar_first_t *first, bool self_destroy)
+{
+    if (first == NULL) {
+        return NULL;
+    }
+
+    if (first->sets != NULL) {
+        first->sets = lexbor_free(first->sets);
+    }
+
+    if (first->nullable != NULL) {
+        first->nullable = lexbor_free(first->nullable);
+    }
+
+    if (self_destroy) {
+        return lexbor_free(first);
+    }
+
+    return first;
+}
+
+static bool
+lxb_grammar_first_union(lxb_grammar_first_t *first, uint64_t *dst,
+                        const uint64_t *src)
+{
+    uint64_t word;
+    bool changed = false;
+
+    for (size_t i = 0; i < first->words; i++) {
+        word = dst[i] | src[i];
+
+        if (word != dst[i]) {
+            dst[i] = word;
+            changed = true;
+        }
+    }
+
+    return changed;
+}
+
+/* A literal is compared with the whole token, it has the type of the token. */
+static uint64_t
+lxb_grammar_first_literal(const lexbor_str_t *str)
+{
+    uint64_t bits;
+    lxb_status_t status;
+    lexbor_array_obj_t tokens;
+    lxb_grammar_value_token_t *token;
+
+    status = lexbor_array_obj_init(&tokens, 4,
+                                   sizeof(lxb_grammar_value_token_t));
+    if (status != LXB_STATUS_OK) {
+        return LXB_GRAMMAR_FIRST_ANY;
+    }
+
+    bits = LXB_GRAMMAR_FIRST_ANY;
+
+    status = lxb_grammar_value_tokenize(&tokens, str->data, str->length);
+
+    if (status == LXB_STATUS_OK && tokens.length == 1) {
+        token = lexbor_array_obj_get(&tokens, 0);
+
+        if ((size_t) (token->end - token->begin) == str->length) {
+            bits = LXB_GRAMMAR_FIRST_BIT(token->type);
+        }
+    }
+
+    lexbor_array_obj_destroy(&tokens, false);
+
+    return bits;
+}
+
+/* Returns true if the set or nullability of the node is changed. */
+static bool
+lxb_grammar_first_node(lxb_grammar_first_t *first, lxb_grammar_node_t *node)
+{
+    size_t bit;
+    bool changed, nullable, result;
+    uint64_t *set;
+    lxb_grammar_node_t *child, *decl;
+
+    set = first->sets + node->id * first->words;
+    changed = false;
+
+    switch (node->type) {
+        case LXB_GRAMMAR_NODE_GROUP:
+        case LXB_GRAMMAR_NODE_DECLARATION:
+            for (child = node->first_child; child != NULL;
+                 child = child->next)
+            {
+                changed |= lxb_grammar_first_node(first, child);
+            }
+
+            switch (node->combinator) {
+                case LXB_GRAMMAR_COMBINATOR_ONE_OF:
+                case LXB_GRAMMAR_COMBINATOR_OR:
+                    nullable = (node->first_child == NULL);
+
+                    for (child = node->first_child; child != NULL;
+                         child = child->next)
+                    {
+                        changed |= lxb_grammar_first_union(first, set,
+                                             lxb_grammar_first_set(first, child));
+                        nullable |= first->nullable[child->id];
+                    }
+
+                    break;
+
+                case LXB_GRAMMAR_COMBINATOR_AND:
+                    nullable = true;
+
+                    for (child = node->first_child; child != NULL;
+                         child = child->next)
+                    {
+                        changed |= lxb_grammar_first_union(first, set,
+                                             lxb_grammar_first_set(first, child));
+                        nullable &= first->nullable[child->id];
+                    }
+
+                    break;
+
+                default:
+                    nullable = true;
+
+                    for (child = node->first_child; child != NULL && nullable;
+                         child = child->next)
+                    {
+                        changed |= lxb_grammar_first_union(first, set,
+                                             lxb_grammar_first_set(first, child));
+                        nullable = first->nullable[child->id];
+                    }
+
+                    break;
+            }
+
+            break;
+
+        case LXB_GRAMMAR_NODE_ELEMENT:
+            if (node->bst_declaration != NULL) {
+                decl = node->bst_declaration->value;
+
+                changed |= lxb_grammar_first_union(first, set,
+                                              lxb_grammar_first_set(first, decl));
+                nullable = first->nullable[decl->id];
+                break;
+            }
+
+            if (node->type_id < LXB_GRAMMAR_TYPE__LAST_ENTRY) {
+                changed |= (set[0] | lxb_grammar_first_types[node->type_id])
+                           != set[0];
+                set[0] |= lxb_grammar_first_types[node->type_id];
+            }
+
+            nullable = false;
+            break;
+
+        case LXB_GRAMMAR_NODE_UNQUOTED:
+            bit = LXB_GRAMMAR_FIRST_KEYWORD + node->keyword_id - 1;
+
+            if (node->keyword_id != 0 && !lxb_grammar_first_has(set, bit)) {
+                set[bit >> 6] |= (uint64_t) 1 << (bit & 63);
+                changed = true;
+            }
+
+            nullable = false;
+            break;
+
+        case LXB_GRAMMAR_NODE_NUMBER:
+            changed |= (set[0] & LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_NUMBER))
+                       == 0;
+            set[0] |= LXB_GRAMMAR_FIRST_BIT(LXB_GRAMMAR_VALUE_NUMBER);
+
+            nullable = false;
+            break;
+
+        case LXB_GRAMMAR_NODE_STRING:
+        case LXB_GRAMMAR_NODE_DELIM:
+            /* Literals never change, computed once. */
+            if (set[0] == 0) {
+                set[0] = lxb_grammar_first_literal(&node->u.str);
+                changed = true;
+            }
+
+            nullable = false;
+            break;
+
+        default:
+            nullable = false;
+            break;
+    }
+
+    /* Own multiplier of the node. */
+    if (lxb_grammar_node_is_required(node)) {
+        result = false;
+    }
+    else {
+        result = nullable || lxb_grammar_node_repeat_min(node) == 0;
+    }
+
+    if (result && !first->nullable[node->id]) {
+        first->nullable[node->id] = true;
+        changed = true;
+    }
+
+    return changed;
+}
+
+lxb_status_t
+lxb_grammar_first_serialize(lxb_grammar_first_t *first,
+                            lxb_grammar_node_t *node,
+                            lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    size_t len;
+    lxb_status_t status;
+    const lxb_char_t *name;
+    const uint64_t *set;
+    const char *sep;
+    lexbor_bst_map_entry_t *entry;
+
+    set = lxb_grammar_first_set(first, node);
+    sep = " ";
+
+    lxb_grammar_first_send("first:", 6);
+
+    for (size_t i = LXB_GRAMMAR_VALUE_IDENT; i <= LXB_GRAMMAR_VALUE_DELIM; i++) {
+        if (!lxb_grammar_first_has(set, i)) {
+            continue;
+        }
+
+        name = lxb_grammar_value_type_name(i, &len);
+
+        lxb_grammar_first_send(sep, strlen(sep));
+        lxb_grammar_first_send(name, len);
+
+        sep = ", ";
+    }
+
+    for (size_t i = 0; i < first->tree->keyword_list->length; i++) {
+        if (!lxb_grammar_first_has(set, LXB_GRAMMAR_FIRST_KEYWORD + i)) {
+            continue;
+        }
+
+        entry = first->tree->keyword_list->list[i];
+
+        lxb_grammar_first_send(sep, strlen(sep));
+        lxb_grammar_first_send(entry->str.data, entry->str.length);
+
+        sep = ", ";
+    }
+
+    if (first->nullable[node->id]) {
+        lxb_grammar_first_send("; nullable", 10);
+    }
+
+    return LXB_STATUS_OK;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_FIRST_H
+#define LEXBOR_GRAMMAR_FIRST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/node.h"
+#include "lexbor/grammar/tree.h"
+#include "lexbor/grammar/value.h"
+
+
+/*
+ * Bits of a set: lxb_grammar_value_type_t of the token, then keyword ids
+ * from LXB_GRAMMAR_FIRST_KEYWORD.  The IDENT bit means any identifier.
+ */
+#define LXB_GRAMMAR_FIRST_KEYWORD 16
+
+/* Not a token type, in FOLLOW sets: the end of the value. */
+#define LXB_GRAMMAR_FIRST_END 0
+
+
+/*
+ * FIRST sets: tokens which can begin a match of the node, and nullability:
+ * the node can match nothing.  Sets are wider than exact, never narrower.
+ */
+struct lxb_grammar_first {
+    lxb_grammar_tree_t *tree;
+
+    /* By node->id, words in each set. */
+    uint64_t           *sets;
+    bool               *nullable;
+    size_t             words;
+    size_t             length;
+};
+
+
+LXB_API lxb_grammar_first_t *
+lxb_grammar_first_create(void);
+
+/* Computes sets of all nodes of the tree, see lxb_grammar_tree_make(). */
+LXB_API lxb_status_t
+lxb_grammar_first_init(lxb_grammar_first_t *first, lxb_grammar_tree_t *tree);
+
+LXB_API lxb_grammar_first_t *
+lxb_grammar_first_destroy(lxb_grammar_first_t *first, bool self_destroy);
+
+LXB_API lxb_status_t
+lxb_grammar_first_serialize(lxb_grammar_first_t *first,
+                            lxb_grammar_node_t *node,
+                            lxb_grammar_serialize_cb_f func, void *ctx);
+
+
+/*
+ * Inline functions
+ */
+lxb_inline bool
+lxb_grammar_first_has(const uint64_t *set, size_t bit)
+{
+    return (set[bit >> 6] >> (bit & 63)) & 1;
+}
+
+/* The token can begin a match of the set. */
+lxb_inline bool
+lxb_grammar_first_token(const uint64_t *set,
+                        const lxb_grammar_value_token_t *token)
+{
+    return lxb_grammar_first_has(set, token->type)
+           || (token->keyword_id != 0
+               && lxb_grammar_first_has(set, LXB_GRAMMAR_FIRST_KEYWORD
+                                             + token->keyword_id - 1));
+}
+
+lxb_inline const uint64_t *
+lxb_grammar_first_set(const lxb_grammar_first_t *first,
+                      const lxb_grammar_node_t *node)
+{
+    return first->sets + node->id * first->words;
+}
+
+lxb_inline bool
+lxb_grammar_first_is_nullable(const lxb_grammar_first_t *first,
+                              const lxb_grammar_node_t *node)
+{
+    return first->nullable[node->id];
+}
+
+/*
+ * The node can match at the token, NULL is the end of the value.
+ * If false, trying the node is useless.
+ */
+lxb_inline bool
+lxb_grammar_first_viable(const lxb_grammar_first_t *first,
+                         const lxb_grammar_node_t *node,
+                         const lxb_grammar_value_token_t *token)
+{
+    return first->nullable[node->id]
+           || (token != NULL
+               && lxb_grammar_first_token(lxb_grammar_first_set(first, node),
+                                          token));
+}
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_FIRST_H */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/frozen.h"
+#include "lexbor/grammar/artifact.h"
+
+
+static lxb_status_t
+lxb_grammar_frozen_image_cb(const lxb_char_t *data, size_t len, void *ctx);
+
+
+lxb_grammar_frozen_t *
+lxb_grammar_frozen_create(void)
+{
+    return lexbor_calloc(1, sizeof(lxb_grammar_frozen_t));
+}
+
+lxb_status_t
+lxb_grammar_frozen_init(lxb_grammar_frozen_t *frozen,
+                        lxb_grammar_bytecode_t *bc)
+{
+    lxb_status_t status;
+
+    if (frozen == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    if (bc == NULL) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    status = lxb_grammar_artifact_serialize(bc, lxb_grammar_frozen_image_cb,
+                                            frozen);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    /* The image is ours and just written, the check is not needed. */
+    return lxb_grammar_artifact_load(&frozen->bc, frozen->data, frozen->length,
+                                     LXB_GRAMMAR_ARTIFACT_OPT_NO_CHECKSUM
+                                     |LXB_GRAMMAR_ARTIFACT_OPT_NO_VALIDATE);
+}
+
+lxb_grammar_frozen_t *
+lxb_grammar_frozen_destroy(lxb_grammar_frozen_t *frozen, bool self_destroy)
+{
+    if (frozen == NULL) {
+        return NULL;
+    }
+
+    lxb_grammar_bytecode_destroy(&frozen->bc, false);
+
+    frozen->data = lexbor_free(frozen->data);
+    frozen->length = 0;
+    frozen->size = 0;
+
+    if (self_destroy) {
+        return lexbor_free(frozen);
+    }
+
+    return frozen;
+}
+
+static lxb_status_t
+lxb_grammar_frozen_image_cb(const lxb_char_t *data, size_t len, void *ctx)
+{
+    size_t size;
+    lxb_char_t *tmp;
+    lxb_grammar_frozen_t *frozen = ctx;
+
+    if (frozen->length + len > frozen->size) {
+        size = (frozen->length + len) * 2;
+
+        /* The heap is aligned enough for LXB_GRAMMAR_ARTIFACT_ALIGN. */
+        tmp = lexbor_realloc(frozen->data, size);
+        if (tmp == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        frozen->data = tmp;
+        frozen->size = size;
+    }
+
+    memcpy(frozen->data + frozen->length, data, len);
+    frozen->length += len;
+
+    return LXB_STATUS_OK;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_FROZEN_H
+#define LEXBOR_GRAMMAR_FROZEN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/bytecode.h"
+
+
+/*
+ * Compiled grammar detached from the document, the tree and their mraw:
+ * one heap block with the binary image, see lexbor/grammar/artifact.h.
+ *
+ * Nothing is changed after init, so any number of threads can match
+ * against it at the same time, each with its own lxb_grammar_vm_t.
+ * Spans have node == NULL, use span->id.
+ */
+struct lxb_grammar_frozen {
+    lxb_grammar_bytecode_t bc;     /* Bound to the image. */
+
+    lxb_char_t             *data;
+    size_t                 length;
+    size_t                 size;
+};
+
+
+LXB_API lxb_grammar_frozen_t *
+lxb_grammar_frozen_create(void);
+
+/*
+ * Copies the bytecode.  The bytecode, its tree and document can be
+ * destroyed right after.
+ */
+LXB_API lxb_status_t
+lxb_grammar_frozen_init(lxb_grammar_frozen_t *frozen,
+                        lxb_grammar_bytecode_t *bc);
+
+/* All VMs of the frozen grammar must be destroyed before. */
+LXB_API lxb_grammar_frozen_t *
+lxb_grammar_frozen_destroy(lxb_grammar_frozen_t *frozen, bool self_destroy);
+
+
+/*
+ * Inline functions
+ */
+
+/*
+ * For lxb_grammar_vm_init(), one VM per thread.  The VM only reads
+ * the bytecode, no locks are needed.
+ */
+lxb_inline lxb_grammar_bytecode_t *
+lxb_grammar_frozen_bytecode(lxb_grammar_frozen_t *frozen)
+{
+    return &frozen->bc;
+}
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_FROZEN_H */
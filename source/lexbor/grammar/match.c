@@ -0,0 +1,1416 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/match.h"
+#include "lexbor/grammar/ambiguity.h"
+#include "lexbor/grammar/cache.h"
+
+
+enum {
+    LXB_GRAMMAR_MATCH_MEMO_NONE = 0x00,
+    LXB_GRAMMAR_MATCH_MEMO_PROGRESS,
+    LXB_GRAMMAR_MATCH_MEMO_DONE
+};
+
+typedef struct lxb_grammar_match_cont lxb_grammar_match_cont_t;
+
+/*
+ * Continuation: called with the position after the matched node,
+ * returns true if the rest of the value matched too.
+ */
+typedef bool
+(*lxb_grammar_match_cont_f)(lxb_grammar_match_t *match,
+                            lxb_grammar_match_cont_t *cont, size_t pos);
+
+struct lxb_grammar_match_cont {
+    lxb_grammar_match_cont_f func;
+    lxb_grammar_match_cont_t *next;
+
+    lxb_grammar_node_t       *node;
+
+    size_t                   begin;  /* Position before all repetitions. */
+    size_t                   pos;    /* Position before current repetition. */
+    size_t                   count;
+    uint64_t                 mask;
+
+    size_t                   id;     /* See lxb_grammar_match_memo_cont(). */
+};
+
+/* Data of a continuation which defines its result at a position. */
+typedef struct {
+    lxb_grammar_match_cont_f func;
+    lxb_grammar_node_t       *node;
+
+    size_t                   begin;
+    size_t                   pos;
+    size_t                   count;
+    uint64_t                 mask;
+
+    size_t                   next;   /* Id of the next continuation. */
+}
+lxb_grammar_match_memo_cont_t;
+
+
+static bool
+lxb_grammar_match_node(lxb_grammar_match_t *match, lxb_grammar_node_t *node,
+                       size_t pos, lxb_grammar_match_cont_t *next);
+
+static bool
+lxb_grammar_match_repeat(lxb_grammar_match_t *match, lxb_grammar_node_t *node,
+                         size_t begin, size_t pos, size_t count,
+                         lxb_grammar_match_cont_t *next);
+
+static bool
+lxb_grammar_match_repeat_next(lxb_grammar_match_t *match,
+                              lxb_grammar_match_cont_t *cont, size_t pos);
+
+static bool
+lxb_grammar_match_once(lxb_grammar_match_t *match, lxb_grammar_node_t *node,
+                       size_t pos, lxb_grammar_match_cont_t *next);
+
+static bool
+lxb_grammar_match_group(lxb_grammar_match_t *match, lxb_grammar_node_t *group,
+                        size_t pos, lxb_grammar_match_cont_t *next);
+
+static bool
+lxb_grammar_match_memo(lxb_grammar_match_t *match, lxb_grammar_node_t *node,
+                       size_t pos, lxb_grammar_match_cont_t *next);
+
+static bool
+lxb_grammar_match_memo_collect(lxb_grammar_match_t *match,
+                               lxb_grammar_match_cont_t *cont, size_t pos);
+
+static bool
+lxb_grammar_match_sequence(lxb_grammar_match_t *match,
+                           lxb_grammar_node_t *node, size_t pos,
+                           lxb_grammar_match_cont_t *next);
+
+static bool
+lxb_grammar_match_sequence_next(lxb_grammar_match_t *match,
+                                lxb_grammar_match_cont_t *cont, size_t pos);
+
+static bool
+lxb_grammar_match_set(lxb_grammar_match_t *match, lxb_grammar_node_t *group,
+                      uint64_t mask, size_t pos,
+                      lxb_grammar_match_cont_t *next);
+
+static bool
+lxb_grammar_match_set_next(lxb_grammar_match_t *match,
+                           lxb_grammar_match_cont_t *cont, size_t pos);
+
+static bool
+lxb_grammar_match_end(lxb_grammar_match_t *match,
+                      lxb_grammar_match_cont_t *cont, size_t pos);
+
+
+static lxb_status_t
+lxb_grammar_match_memo_init(lxb_grammar_match_t *match,
+                            lxb_grammar_tree_t *tree);
+
+
+lxb_grammar_match_t *
+lxb_grammar_match_create(void)
+{
+    return lexbor_calloc(1, sizeof(lxb_grammar_match_t));
+}
+
+lxb_status_t
+lxb_grammar_match_init(lxb_grammar_match_t *match, lxb_grammar_tree_t *tree)
+{
+    lxb_status_t status;
+
+    if (match == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    if (tree == NULL) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    status = lexbor_array_obj_init(&match->tokens, 64,
+                                   sizeof(lxb_grammar_value_token_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lexbor_array_obj_init(&match->spans, 128,
+                                   sizeof(lxb_grammar_match_span_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lxb_grammar_first_init(&match->first, tree);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lxb_grammar_bounds_init(&match->bounds, tree);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    match->tree = tree;
+    match->buf = NULL;
+    match->buf_size = 0;
+    match->memo = false;
+    match->cache = NULL;
+    match->data = NULL;
+    match->memo_table = NULL;
+    match->memo_size = 0;
+    match->memo_hash = NULL;
+    match->memo_hash_size = 0;
+    match->memo_fails = NULL;
+    match->memo_fails_size = 0;
+    match->memo_fails_length = 0;
+
+    status = lexbor_array_obj_init(&match->memo_ends, 64,
+                                   sizeof(lxb_grammar_match_memo_end_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lexbor_array_obj_init(&match->memo_spans, 128,
+                                   sizeof(lxb_grammar_match_span_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lexbor_array_obj_init(&match->memo_conts, 64,
+                                   sizeof(lxb_grammar_match_memo_cont_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    return lxb_grammar_match_memo_init(match, tree);
+}
+
+static lxb_status_t
+lxb_grammar_match_memo_init(lxb_grammar_match_t *match,
+                            lxb_grammar_tree_t *tree)
+{
+    lxb_status_t status;
+    lxb_grammar_node_t *root, *node;
+    lxb_grammar_ambiguity_t amb = {0};
+    lxb_grammar_ambiguity_conflict_t *conflict;
+
+    match->memo_count = 0;
+
+    match->memo_index = lexbor_calloc(tree->nodes->length, sizeof(size_t));
+    if (match->memo_index == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    status = lxb_grammar_ambiguity_init(&amb, tree);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    root = tree->nodes->list[0];
+
+    for (node = root->first_child; node != NULL; node = node->next) {
+        if (lxb_grammar_ambiguity_is_backtracking(&amb, node)) {
+            match->memo_index[node->id] = ++match->memo_count;
+        }
+    }
+
+    /*
+     * A group written in place makes the choice itself, it is memoized
+     * by one repetition as a declaration by one reference.
+     */
+    for (size_t i = 0; i < lxb_grammar_ambiguity_length(&amb); i++) {
+        conflict = lxb_grammar_ambiguity_get(&amb, i);
+        node = conflict->node;
+
+        if (node->type == LXB_GRAMMAR_NODE_GROUP
+            && match->memo_index[node->id] == 0)
+        {
+            match->memo_index[node->id] = ++match->memo_count;
+        }
+    }
+
+done:
+
+    (void) lxb_grammar_ambiguity_destroy(&amb, false);
+
+    return status;
+}
+
+void
+lxb_grammar_match_clean(lxb_grammar_match_t *match)
+{
+    lexbor_array_obj_clean(&match->tokens);
+    lexbor_array_obj_clean(&match->spans);
+    lexbor_array_obj_clean(&match->memo_ends);
+    lexbor_array_obj_clean(&match->memo_spans);
+    lexbor_array_obj_clean(&match->memo_conts);
+
+    match->data = NULL;
+    match->depth = 0;
+    match->status = LXB_STATUS_OK;
+}
+
+lxb_grammar_match_t *
+lxb_grammar_match_destroy(lxb_grammar_match_t *match, bool self_destroy)
+{
+    if (match == NULL) {
+        return NULL;
+    }
+
+    lexbor_array_obj_destroy(&match->tokens, false);
+    lexbor_array_obj_destroy(&match->spans, false);
+
+    lexbor_array_obj_destroy(&match->memo_ends, false);
+    lexbor_array_obj_destroy(&match->memo_spans, false);
+    lexbor_array_obj_destroy(&match->memo_conts, false);
+
+    lxb_grammar_first_destroy(&match->first, false);
+    lxb_grammar_bounds_destroy(&match->bounds, false);
+
+    if (match->buf != NULL) {
+        match->buf = lexbor_free(match->buf);
+    }
+
+    if (match->memo_index != NULL) {
+        match->memo_index = lexbor_free(match->memo_index);
+    }
+
+    if (match->memo_table != NULL) {
+        match->memo_table = lexbor_free(match->memo_table);
+    }
+
+    if (match->memo_hash != NULL) {
+        match->memo_hash = lexbor_free(match->memo_hash);
+    }
+
+    if (match->memo_fails != NULL) {
+        match->memo_fails = lexbor_free(match->memo_fails);
+    }
+
+    if (self_destroy) {
+        return lexbor_free(match);
+    }
+
+    return match;
+}
+
+lxb_status_t
+lxb_grammar_match(lxb_grammar_match_t *match,
+                  const lxb_char_t *name, size_t name_len,
+                  const lxb_char_t *data, size_t size,
+                  lxb_grammar_match_result_t *result)
+{
+    lxb_grammar_node_t *declaration;
+
+    result->accepted = false;
+    result->spans = NULL;
+    result->length = 0;
+
+    declaration = lxb_grammar_tree_declaration(match->tree, name, name_len);
+    if (declaration == NULL) {
+        return LXB_STATUS_ERROR_NOT_EXISTS;
+    }
+
+    return lxb_grammar_match_declaration(match, declaration,
+                                         data, size, result);
+}
+
+static lxb_status_t
+lxb_grammar_match_keywords(lxb_grammar_match_t *match)
+{
+    lxb_char_t *buf;
+    lxb_grammar_tree_t *tree = match->tree;
+    lxb_grammar_value_token_t *token, *end;
+    lexbor_bst_map_entry_t *entry;
+
+    if (match->buf_size < tree->keyword_max_len) {
+        buf = lexbor_realloc(match->buf, tree->keyword_max_len);
+        if (buf == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        match->buf = buf;
+        match->buf_size = tree->keyword_max_len;
+    }
+
+    token = (lxb_grammar_value_token_t *) match->tokens.list;
+    end = token + match->tokens.length;
+
+    for (; token < end; token++) {
+        if (token->type != LXB_GRAMMAR_VALUE_IDENT
+            || token->length > tree->keyword_max_len)
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < token->length; i++) {
+            match->buf[i] = token->data[i];
+
+            if (match->buf[i] >= 'A' && match->buf[i] <= 'Z') {
+                match->buf[i] |= 0x20;
+            }
+        }
+
+        entry = lexbor_bst_map_search(tree->keywords, tree->keywords_root,
+                                      match->buf, token->length);
+        if (entry != NULL) {
+            token->keyword_id = (size_t) (uintptr_t) entry->value;
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+/* Entries of all memoized nodes at every position, even the end. */
+static lxb_status_t
+lxb_grammar_match_memo_reset(lxb_grammar_match_t *match)
+{
+    size_t size;
+    lxb_grammar_match_memo_entry_t *table;
+
+    /* Positions and ids are packed into 32 bits. */
+    if (match->tokens.length >= UINT32_MAX) {
+        return LXB_STATUS_ERROR_OVERFLOW;
+    }
+
+    size = match->memo_count * (match->tokens.length + 1);
+
+    if (match->memo_size < size) {
+        table = lexbor_realloc(match->memo_table,
+                               size * sizeof(lxb_grammar_match_memo_entry_t));
+        if (table == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        match->memo_table = table;
+        match->memo_size = size;
+    }
+
+    memset(match->memo_table, 0, size * sizeof(lxb_grammar_match_memo_entry_t));
+
+    if (match->memo_hash != NULL) {
+        memset(match->memo_hash, 0, match->memo_hash_size * sizeof(size_t));
+    }
+
+    if (match->memo_fails != NULL) {
+        memset(match->memo_fails, 0,
+               match->memo_fails_size * sizeof(uint64_t));
+    }
+
+    match->memo_fails_length = 0;
+
+    return LXB_STATUS_OK;
+}
+
+/* Spans of the value are appended to the spans of previous values. */
+static lxb_status_t
+lxb_grammar_match_value(lxb_grammar_match_t *match,
+                        lxb_grammar_node_t *declaration,
+                        const lxb_char_t *data, size_t size, bool *accepted)
+{
+    size_t begin;
+    lxb_status_t status;
+    lxb_grammar_match_result_t result;
+    lxb_grammar_match_cont_t end = {0};
+    const lxb_grammar_cache_entry_t *cached;
+
+    match->data = NULL;
+
+    if (match->cache != NULL) {
+        cached = lxb_grammar_cache_find(match->cache, declaration->id,
+                                        data, size);
+        if (cached != NULL) {
+            *accepted = cached->accepted;
+
+            return lxb_grammar_cache_spans(cached, data, &match->spans);
+        }
+    }
+
+    lexbor_array_obj_clean(&match->tokens);
+    lexbor_array_obj_clean(&match->memo_ends);
+    lexbor_array_obj_clean(&match->memo_spans);
+    lexbor_array_obj_clean(&match->memo_conts);
+
+    match->depth = 0;
+    match->status = LXB_STATUS_OK;
+
+    status = lxb_grammar_value_tokenize(&match->tokens, data, size);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    begin = match->spans.length;
+
+    /* Rejected without matching, but cached. */
+    if (!lxb_grammar_bounds_fit(&match->bounds, declaration,
+                                match->tokens.length))
+    {
+        *accepted = false;
+        goto done;
+    }
+
+    status = lxb_grammar_match_keywords(match);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    if (match->memo && match->memo_count != 0) {
+        status = lxb_grammar_match_memo_reset(match);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+    }
+
+    match->data = data;
+    match->data_end = data + size;
+
+    end.func = lxb_grammar_match_end;
+
+    *accepted = lxb_grammar_match_node(match, declaration, 0, &end);
+
+    if (!*accepted) {
+        match->spans.length = begin;
+    }
+
+done:
+
+    if (match->cache == NULL || match->status != LXB_STATUS_OK) {
+        return match->status;
+    }
+
+    result.accepted = *accepted;
+    result.spans = ((lxb_grammar_match_span_t *) match->spans.list) + begin;
+    result.length = match->spans.length - begin;
+
+    return lxb_grammar_cache_insert(match->cache, declaration->id,
+                                    data, size, &result);
+}
+
+lxb_status_t
+lxb_grammar_match_declaration(lxb_grammar_match_t *match,
+                              lxb_grammar_node_t *declaration,
+                              const lxb_char_t *data, size_t size,
+                              lxb_grammar_match_result_t *result)
+{
+    bool accepted;
+    lxb_status_t status;
+
+    result->accepted = false;
+    result->spans = NULL;
+    result->length = 0;
+
+    if (declaration->type != LXB_GRAMMAR_NODE_DECLARATION) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    lxb_grammar_match_clean(match);
+
+    status = lxb_grammar_match_value(match, declaration, data, size,
+                                     &accepted);
+    if (status != LXB_STATUS_OK) {
+        lexbor_array_obj_clean(&match->spans);
+
+        return status;
+    }
+
+    result->accepted = accepted;
+
+    if (accepted) {
+        result->spans = (lxb_grammar_match_span_t *) match->spans.list;
+        result->length = match->spans.length;
+    }
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_match_batch(lxb_grammar_match_t *match,
+                        lxb_grammar_node_t *declaration,
+                        const lxb_grammar_match_value_t *values, size_t count,
+                        lxb_grammar_match_result_t *results)
+{
+    bool accepted;
+    size_t begin;
+    lxb_status_t status;
+    lxb_grammar_match_span_t *spans;
+
+    for (size_t i = 0; i < count; i++) {
+        results[i].accepted = false;
+        results[i].spans = NULL;
+        results[i].length = 0;
+    }
+
+    if (declaration->type != LXB_GRAMMAR_NODE_DECLARATION) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    lxb_grammar_match_clean(match);
+
+    for (size_t i = 0; i < count; i++) {
+        begin = match->spans.length;
+
+        status = lxb_grammar_match_value(match, declaration, values[i].data,
+                                         values[i].length, &accepted);
+        if (status != LXB_STATUS_OK) {
+            lexbor_array_obj_clean(&match->spans);
+
+            for (size_t n = 0; n < i; n++) {
+                results[n].accepted = false;
+                results[n].length = 0;
+            }
+
+            return status;
+        }
+
+        results[i].accepted = accepted;
+        results[i].length = match->spans.length - begin;
+    }
+
+    /* The spans are in one array, it is not reallocated anymore. */
+    spans = (lxb_grammar_match_span_t *) match->spans.list;
+
+    for (size_t i = 0; i < count; i++) {
+        if (results[i].accepted) {
+            results[i].spans = spans;
+            spans += results[i].length;
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_match_events(lxb_grammar_match_t *match,
+                         const lxb_char_t *data, size_t size,
+                         const lxb_grammar_match_result_t *result,
+                         lxb_grammar_match_event_t *events, size_t capacity,
+                         size_t *length)
+{
+    lxb_status_t status;
+
+    *length = 0;
+
+    if (!result->accepted) {
+        return LXB_STATUS_OK;
+    }
+
+    if (match->data != data || match->data_end != data + size) {
+        lexbor_array_obj_clean(&match->tokens);
+
+        match->data = NULL;
+
+        status = lxb_grammar_value_tokenize(&match->tokens, data, size);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        status = lxb_grammar_match_keywords(match);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        match->data = data;
+        match->data_end = data + size;
+    }
+
+    return lxb_grammar_match_result_events(result, &match->tokens,
+                                           events, capacity, length);
+}
+
+/*
+ * Children are placed before the parents, so the first span with the token
+ * is the innermost one.
+ */
+lxb_status_t
+lxb_grammar_match_result_events(const lxb_grammar_match_result_t *result,
+                                const lexbor_array_obj_t *tokens,
+                                lxb_grammar_match_event_t *events,
+                                size_t capacity, size_t *length)
+{
+    size_t last;
+    const lxb_grammar_match_span_t *span, *end;
+    const lxb_grammar_value_token_t *list;
+
+    if (!result->accepted) {
+        *length = 0;
+        return LXB_STATUS_OK;
+    }
+
+    *length = tokens->length;
+
+    if (capacity < tokens->length) {
+        return LXB_STATUS_ERROR_SMALL_BUFFER;
+    }
+
+    list = (const lxb_grammar_value_token_t *) tokens->list;
+
+    for (size_t i = 0; i < tokens->length; i++) {
+        events[i].token = NULL;
+    }
+
+    span = result->spans;
+    end = span + result->length;
+
+    for (; span < end; span++) {
+        last = (span->last < tokens->length) ? span->last : tokens->length;
+
+        for (size_t i = span->first; i < last; i++) {
+            if (events[i].token == NULL) {
+                events[i].node = span->node;
+                events[i].id = span->id;
+                events[i].token = &list[i];
+            }
+        }
+    }
+
+    /* Spans are not of these tokens. */
+    for (size_t i = 0; i < tokens->length; i++) {
+        if (events[i].token == NULL) {
+            *length = 0;
+            return LXB_STATUS_ERROR_WRONG_ARGS;
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+lxb_inline lxb_grammar_value_token_t *
+lxb_grammar_match_token(lxb_grammar_match_t *match, size_t pos)
+{
+    if (pos >= match->tokens.length) {
+        return NULL;
+    }
+
+    return ((lxb_grammar_value_token_t *) match->tokens.list) + pos;
+}
+
+lxb_inline bool
+lxb_grammar_match_literal(const lxb_grammar_value_token_t *token,
+                          const lexbor_str_t *str)
+{
+    size_t len = token->end - token->begin;
+
+    return len == str->length
+           && lexbor_str_data_ncasecmp(token->begin, str->data, len);
+}
+
+static bool
+lxb_grammar_match_terminal(lxb_grammar_node_t *node,
+                           const lxb_grammar_value_token_t *token)
+{
+    switch (node->type) {
+        case LXB_GRAMMAR_NODE_UNQUOTED:
+            return token->type == LXB_GRAMMAR_VALUE_IDENT
+                   && token->keyword_id != 0
+                   && token->keyword_id == node->keyword_id;
+
+        case LXB_GRAMMAR_NODE_STRING:
+        case LXB_GRAMMAR_NODE_DELIM:
+            return lxb_grammar_match_literal(token, &node->u.str);
+
+        case LXB_GRAMMAR_NODE_NUMBER:
+            return token->type == LXB_GRAMMAR_VALUE_NUMBER
+                   && token->num == node->u.num;
+
+        case LXB_GRAMMAR_NODE_ELEMENT:
+            return lxb_grammar_type_match(node->type_id, token);
+
+        default:
+            return false;
+    }
+}
+
+static bool
+lxb_grammar_match_span(lxb_grammar_match_t *match, lxb_grammar_node_t *node,
+                       size_t first, size_t last,
+                       lxb_grammar_match_cont_t *next)
+{
+    lxb_grammar_match_span_t *span;
+    lxb_grammar_value_token_t *token;
+
+    span = lexbor_array_obj_push(&match->spans);
+    if (span == NULL) {
+        match->status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        return false;
+    }
+
+    span->node = node;
+    span->id = node->id;
+    span->first = first;
+    span->last = last;
+
+    token = lxb_grammar_match_token(match, first);
+    span->begin = (token != NULL) ? token->begin : match->data_end;
+
+    if (first == last) {
+        span->end = span->begin;
+    }
+    else {
+        span->end = lxb_grammar_match_token(match, last - 1)->end;
+    }
+
+    if (next->func(match, next, last)) {
+        return true;
+    }
+
+    /* Not found, the span is not part of the result. */
+    match->spans.length--;
+
+    return false;
+}
+
+static bool
+lxb_grammar_match_node(lxb_grammar_match_t *match, lxb_grammar_node_t *node,
+                       size_t pos, lxb_grammar_match_cont_t *next)
+{
+    return lxb_grammar_match_repeat(match, node, pos, pos, 0, next);
+}
+
+static bool
+lxb_grammar_match_repeat(lxb_grammar_match_t *match, lxb_grammar_node_t *node,
+                         size_t begin, size_t pos, size_t count,
+                         lxb_grammar_match_cont_t *next)
+{
+    size_t start;
+    long max;
+    lxb_grammar_value_token_t *token;
+    lxb_grammar_match_cont_t cont;
+
+    max = lxb_grammar_node_repeat_max(node);
+
+    /* Greedy: try one more repetition before the rest of the value. */
+    if (max < 0 || count < (size_t) max) {
+        start = pos;
+
+        if (node->is_comma_separated && count != 0) {
+            token = lxb_grammar_match_token(match, pos);
+
+            if (token == NULL || token->type != LXB_GRAMMAR_VALUE_DELIM
+                || *token->data != ',')
+            {
+                goto done;
+            }
+
+            start++;
+        }
+
+        cont.func = lxb_grammar_match_repeat_next;
+        cont.next = next;
+        cont.node = node;
+        cont.begin = begin;
+        cont.pos = pos;
+        cont.count = count;
+        cont.id = 0;
+
+        if (lxb_grammar_match_once(match, node, start, &cont)) {
+            return true;
+        }
+
+        if (match->status != LXB_STATUS_OK) {
+            return false;
+        }
+    }
+
+done:
+
+    if (count < (size_t) lxb_grammar_node_repeat_min(node)) {
+        return false;
+    }
+
+    return lxb_grammar_match_span(match, node, begin, pos, next);
+}
+
+static bool
+lxb_grammar_match_repeat_next(lxb_grammar_match_t *match,
+                              lxb_grammar_match_cont_t *cont, size_t pos)
+{
+    /*
+     * Empty repetition is needed only to reach the minimum,
+     * otherwise it is endless loop.
+     */
+    if (pos == cont->pos) {
+        if (cont->count >= (size_t) lxb_grammar_node_repeat_min(cont->node)
+            || lxb_grammar_node_is_required(cont->node))
+        {
+            return false;
+        }
+    }
+
+    return lxb_grammar_match_repeat(match, cont->node, cont->begin, pos,
+                                    cont->count + 1, cont->next);
+}
+
+static bool
+lxb_grammar_match_once(lxb_grammar_match_t *match, lxb_grammar_node_t *node,
+                       size_t pos, lxb_grammar_match_cont_t *next)
+{
+    bool res;
+    lxb_grammar_node_t *decl;
+    lxb_grammar_value_token_t *token;
+
+    /* Continuations nest until the end of the value, count all of them. */
+    if (match->depth >= LXB_GRAMMAR_MATCH_DEPTH_MAX) {
+        match->status = LXB_STATUS_ERROR_OVERFLOW;
+        return false;
+    }
+
+    match->depth++;
+
+    switch (node->type) {
+        case LXB_GRAMMAR_NODE_GROUP:
+            if (match->memo && match->memo_index[node->id] != 0) {
+                res = lxb_grammar_match_memo(match, node, pos, next);
+                break;
+            }
+
+            /* Fall through. */
+
+        case LXB_GRAMMAR_NODE_DECLARATION:
+            res = lxb_grammar_match_group(match, node, pos, next);
+            break;
+
+        case LXB_GRAMMAR_NODE_ELEMENT:
+            if (node->bst_declaration != NULL) {
+                decl = node->bst_declaration->value;
+
+                if (match->memo && match->memo_index[decl->id] != 0) {
+                    res = lxb_grammar_match_memo(match, decl, pos, next);
+                }
+                else {
+                    res = lxb_grammar_match_group(match, decl, pos, next);
+                }
+
+                break;
+            }
+
+            /* Fall through. */
+
+        default:
+            token = lxb_grammar_match_token(match, pos);
+
+            if (token == NULL || !lxb_grammar_match_terminal(node, token)) {
+                res = false;
+                break;
+            }
+
+            res = next->func(match, next, pos + 1);
+            break;
+    }
+
+    match->depth--;
+
+    return res;
+}
+
+lxb_inline uint64_t
+lxb_grammar_match_memo_mix(uint64_t hash, uint64_t value)
+{
+    hash ^= value;
+    hash *= 0x9E3779B97F4A7C15;
+
+    return hash ^ (hash >> 29);
+}
+
+static uint64_t
+lxb_grammar_match_memo_hash(const lxb_grammar_match_memo_cont_t *key)
+{
+    uint64_t hash;
+
+    hash = lxb_grammar_match_memo_mix(0, (uintptr_t) key->node);
+    hash = lxb_grammar_match_memo_mix(hash, key->begin);
+    hash = lxb_grammar_match_memo_mix(hash, key->pos);
+    hash = lxb_grammar_match_memo_mix(hash, key->count);
+    hash = lxb_grammar_match_memo_mix(hash, key->mask);
+
+    return lxb_grammar_match_memo_mix(hash, key->next);
+}
+
+static lxb_status_t
+lxb_grammar_match_memo_grow(lxb_grammar_match_t *match)
+{
+    size_t size, idx;
+    size_t *hash;
+    lxb_grammar_match_memo_cont_t *key;
+
+    size = (match->memo_hash_size != 0) ? match->memo_hash_size * 2 : 256;
+
+    hash = lexbor_calloc(size, sizeof(size_t));
+    if (hash == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    for (size_t i = 0; i < match->memo_conts.length; i++) {
+        key = lexbor_array_obj_get(&match->memo_conts, i);
+        idx = lxb_grammar_match_memo_hash(key) & (size - 1);
+
+        while (hash[idx] != 0) {
+            idx = (idx + 1) & (size - 1);
+        }
+
+        hash[idx] = i + 1;
+    }
+
+    if (match->memo_hash != NULL) {
+        lexbor_free(match->memo_hash);
+    }
+
+    match->memo_hash = hash;
+    match->memo_hash_size = size;
+
+    return LXB_STATUS_OK;
+}
+
+/*
+ * Continuations with equal data and equal next ones give equal results,
+ * they get one id.  Returns 0 on error.
+ */
+static size_t
+lxb_grammar_match_memo_cont(lxb_grammar_match_t *match,
+                            lxb_grammar_match_cont_t *cont)
+{
+    long min;
+    size_t idx, slot;
+    lxb_grammar_match_memo_cont_t key, *entry;
+
+    if (cont->id != 0) {
+        return cont->id;
+    }
+
+    /* Padding is compared too. */
+    memset(&key, 0, sizeof(lxb_grammar_match_memo_cont_t));
+
+    key.func = cont->func;
+
+    if (cont->next != NULL) {
+        key.next = lxb_grammar_match_memo_cont(match, cont->next);
+        if (key.next == 0) {
+            return 0;
+        }
+    }
+
+    if (cont->func == lxb_grammar_match_repeat_next) {
+        key.node = cont->node;
+        key.begin = cont->begin;
+        key.pos = cont->pos;
+        key.count = cont->count;
+
+        /* Without maximum, the count matters only up to the minimum. */
+        if (lxb_grammar_node_repeat_max(cont->node) < 0) {
+            min = lxb_grammar_node_repeat_min(cont->node);
+            min = (min < 1) ? 1 : min;
+
+            if (key.count > (size_t) min) {
+                key.count = (size_t) min;
+            }
+        }
+    }
+    else if (cont->func == lxb_grammar_match_sequence_next) {
+        key.node = cont->node;
+    }
+    else if (cont->func == lxb_grammar_match_set_next) {
+        key.node = cont->node;
+        key.mask = cont->mask;
+    }
+    else if (cont->func == lxb_grammar_match_memo_collect) {
+        key.node = cont->node;
+        key.begin = cont->begin;
+        key.count = cont->count;
+    }
+
+    if ((match->memo_conts.length + 1) * 2 > match->memo_hash_size) {
+        match->status = lxb_grammar_match_memo_grow(match);
+        if (match->status != LXB_STATUS_OK) {
+            return 0;
+        }
+    }
+
+    idx = lxb_grammar_match_memo_hash(&key) & (match->memo_hash_size - 1);
+
+    for (; (slot = match->memo_hash[idx]) != 0;
+         idx = (idx + 1) & (match->memo_hash_size - 1))
+    {
+        entry = lexbor_array_obj_get(&match->memo_conts, slot - 1);
+
+        if (memcmp(entry, &key, sizeof(lxb_grammar_match_memo_cont_t)) == 0) {
+            cont->id = slot;
+            return slot;
+        }
+    }
+
+    if (match->memo_conts.length >= UINT32_MAX - 1) {
+        match->status = LXB_STATUS_ERROR_OVERFLOW;
+        return 0;
+    }
+
+    entry = lexbor_array_obj_push(&match->memo_conts);
+    if (entry == NULL) {
+        match->status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        return 0;
+    }
+
+    *entry = key;
+
+    match->memo_hash[idx] = match->memo_conts.length;
+    cont->id = match->memo_conts.length;
+
+    return cont->id;
+}
+
+lxb_inline size_t
+lxb_grammar_match_memo_slot(uint64_t key, size_t size)
+{
+    return (size_t) lxb_grammar_match_memo_mix(0, key) & (size - 1);
+}
+
+static bool
+lxb_grammar_match_memo_failed(lxb_grammar_match_t *match, uint64_t key)
+{
+    size_t idx;
+
+    if (match->memo_fails_length == 0) {
+        return false;
+    }
+
+    idx = lxb_grammar_match_memo_slot(key, match->memo_fails_size);
+
+    while (match->memo_fails[idx] != 0) {
+        if (match->memo_fails[idx] == key) {
+            return true;
+        }
+
+        idx = (idx + 1) & (match->memo_fails_size - 1);
+    }
+
+    return false;
+}
+
+static lxb_status_t
+lxb_grammar_match_memo_fail(lxb_grammar_match_t *match, uint64_t key)
+{
+    size_t idx, size;
+    uint64_t *fails;
+
+    if ((match->memo_fails_length + 1) * 2 > match->memo_fails_size) {
+        size = (match->memo_fails_size != 0) ? match->memo_fails_size * 2
+                                             : 256;
+
+        fails = lexbor_calloc(size, sizeof(uint64_t));
+        if (fails == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        for (size_t i = 0; i < match->memo_fails_size; i++) {
+            if (match->memo_fails[i] == 0) {
+                continue;
+            }
+
+            idx = lxb_grammar_match_memo_slot(match->memo_fails[i], size);
+
+            while (fails[idx] != 0) {
+                idx = (idx + 1) & (size - 1);
+            }
+
+            fails[idx] = match->memo_fails[i];
+        }
+
+        if (match->memo_fails != NULL) {
+            lexbor_free(match->memo_fails);
+        }
+
+        match->memo_fails = fails;
+        match->memo_fails_size = size;
+    }
+
+    idx = lxb_grammar_match_memo_slot(key, match->memo_fails_size);
+
+    while (match->memo_fails[idx] != 0) {
+        idx = (idx + 1) & (match->memo_fails_size - 1);
+    }
+
+    match->memo_fails[idx] = key;
+    match->memo_fails_length++;
+
+    return LXB_STATUS_OK;
+}
+
+/*
+ * The first time all ends of the declaration or the group at the position
+ * are collected with spans of the first derivation of each.  Then the ends
+ * are given to the continuation in the same order as without the memo.
+ */
+static bool
+lxb_grammar_match_memo(lxb_grammar_match_t *match, lxb_grammar_node_t *node,
+                       size_t pos, lxb_grammar_match_cont_t *next)
+{
+    size_t idx, id, length;
+    uint64_t key;
+    lxb_grammar_match_cont_t cont;
+    lxb_grammar_match_memo_end_t end;
+    lxb_grammar_match_span_t *span;
+    lxb_grammar_match_memo_entry_t *entry;
+
+    idx = (match->memo_index[node->id] - 1) * (match->tokens.length + 1) + pos;
+    entry = &match->memo_table[idx];
+
+    /* Left recursion, the same position gives nothing new. */
+    if (entry->state == LXB_GRAMMAR_MATCH_MEMO_PROGRESS) {
+        return false;
+    }
+
+    if (entry->state == LXB_GRAMMAR_MATCH_MEMO_NONE) {
+        entry->state = LXB_GRAMMAR_MATCH_MEMO_PROGRESS;
+
+        cont.func = lxb_grammar_match_memo_collect;
+        cont.next = NULL;
+        cont.node = node;
+        cont.begin = match->spans.length;
+        cont.pos = pos;
+        cont.count = idx;
+        cont.id = 0;
+
+        (void) lxb_grammar_match_group(match, node, pos, &cont);
+
+        if (match->status != LXB_STATUS_OK) {
+            return false;
+        }
+
+        entry->state = LXB_GRAMMAR_MATCH_MEMO_DONE;
+    }
+
+    id = lxb_grammar_match_memo_cont(match, next);
+    if (id == 0) {
+        return false;
+    }
+
+    length = match->spans.length;
+
+    for (idx = entry->first; idx != 0; idx = end.next) {
+        /* The pool can be reallocated by the continuation. */
+        end = *(lxb_grammar_match_memo_end_t *)
+               lexbor_array_obj_get(&match->memo_ends, idx - 1);
+
+        key = ((uint64_t) id << 32) | end.pos;
+
+        if (lxb_grammar_match_memo_failed(match, key)) {
+            continue;
+        }
+
+        for (size_t i = 0; i < end.length; i++) {
+            span = lexbor_array_obj_push(&match->spans);
+            if (span == NULL) {
+                match->status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+                return false;
+            }
+
+            *span = *(lxb_grammar_match_span_t *)
+                     lexbor_array_obj_get(&match->memo_spans, end.spans + i);
+        }
+
+        if (next->func(match, next, end.pos)) {
+            return true;
+        }
+
+        if (match->status != LXB_STATUS_OK) {
+            return false;
+        }
+
+        match->spans.length = length;
+
+        match->status = lxb_grammar_match_memo_fail(match, key);
+        if (match->status != LXB_STATUS_OK) {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+/* Saves the end once and asks for the next derivation. */
+static bool
+lxb_grammar_match_memo_collect(lxb_grammar_match_t *match,
+                               lxb_grammar_match_cont_t *cont, size_t pos)
+{
+    size_t idx;
+    lxb_grammar_match_span_t *span;
+    lxb_grammar_match_memo_end_t *end;
+    lxb_grammar_match_memo_entry_t *entry;
+
+    entry = &match->memo_table[cont->count];
+
+    for (idx = entry->first; idx != 0; idx = end->next) {
+        end = lexbor_array_obj_get(&match->memo_ends, idx - 1);
+
+        if (end->pos == pos) {
+            return false;
+        }
+    }
+
+    end = lexbor_array_obj_push(&match->memo_ends);
+    if (end == NULL) {
+        goto failed;
+    }
+
+    end->pos = pos;
+    end->spans = match->memo_spans.length;
+    end->length = match->spans.length - cont->begin;
+    end->next = 0;
+
+    idx = match->memo_ends.length;
+
+    if (entry->last != 0) {
+        end = lexbor_array_obj_get(&match->memo_ends, entry->last - 1);
+        end->next = idx;
+    }
+    else {
+        entry->first = idx;
+    }
+
+    entry->last = idx;
+
+    for (size_t i = cont->begin; i < match->spans.length; i++) {
+        span = lexbor_array_obj_push(&match->memo_spans);
+        if (span == NULL) {
+            goto failed;
+        }
+
+        *span = *(lxb_grammar_match_span_t *)
+                 lexbor_array_obj_get(&match->spans, i);
+    }
+
+    return false;
+
+failed:
+
+    match->status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+
+    return false;
+}
+
+static bool
+lxb_grammar_match_group(lxb_grammar_match_t *match, lxb_grammar_node_t *group,
+                        size_t pos, lxb_grammar_match_cont_t *next)
+{
+    lxb_grammar_node_t *node;
+    lxb_grammar_value_token_t *token;
+
+    switch (group->combinator) {
+        case LXB_GRAMMAR_COMBINATOR_ONE_OF:
+            token = lxb_grammar_match_token(match, pos);
+
+            for (node = group->first_child; node != NULL; node = node->next) {
+                if (!lxb_grammar_first_viable(&match->first, node, token)) {
+                    continue;
+                }
+
+                if (lxb_grammar_match_node(match, node, pos, next)) {
+                    return true;
+                }
+
+                if (match->status != LXB_STATUS_OK) {
+                    return false;
+                }
+            }
+
+            return false;
+
+        case LXB_GRAMMAR_COMBINATOR_AND:
+        case LXB_GRAMMAR_COMBINATOR_OR:
+            return lxb_grammar_match_set(match, group, 0, pos, next);
+
+        default:
+            return lxb_grammar_match_sequence(match, group->first_child,
+                                              pos, next);
+    }
+}
+
+static bool
+lxb_grammar_match_sequence(lxb_grammar_match_t *match,
+                           lxb_grammar_node_t *node, size_t pos,
+                           lxb_grammar_match_cont_t *next)
+{
+    lxb_grammar_match_cont_t cont;
+
+    if (node == NULL) {
+        return next->func(match, next, pos);
+    }
+
+    cont.func = lxb_grammar_match_sequence_next;
+    cont.next = next;
+    cont.node = node;
+    cont.id = 0;
+
+    return lxb_grammar_match_node(match, node, pos, &cont);
+}
+
+static bool
+lxb_grammar_match_sequence_next(lxb_grammar_match_t *match,
+                                lxb_grammar_match_cont_t *cont, size_t pos)
+{
+    return lxb_grammar_match_sequence(match, cont->node->next, pos, cont->next);
+}
+
+static bool
+lxb_grammar_match_set(lxb_grammar_match_t *match, lxb_grammar_node_t *group,
+                      uint64_t mask, size_t pos,
+                      lxb_grammar_match_cont_t *next)
+{
+    uint64_t bit;
+    lxb_grammar_node_t *node;
+    lxb_grammar_value_token_t *token;
+    lxb_grammar_match_cont_t cont;
+
+    cont.func = lxb_grammar_match_set_next;
+    cont.next = next;
+    cont.node = group;
+
+    token = lxb_grammar_match_token(match, pos);
+
+    for (node = group->first_child, bit = 1; node != NULL;
+         node = node->next, bit <<= 1)
+    {
+        if ((mask & bit)
+            || !lxb_grammar_first_viable(&match->first, node, token))
+        {
+            continue;
+        }
+
+        cont.mask = mask | bit;
+        cont.id = 0;
+
+        if (lxb_grammar_match_node(match, node, pos, &cont)) {
+            return true;
+        }
+
+        if (match->status != LXB_STATUS_OK) {
+            return false;
+        }
+    }
+
+    /* All children must occur for &&, one or more for ||. */
+    if (mask == ((bit == 0) ? UINT64_MAX : (bit - 1))) {
+        return next->func(match, next, pos);
+    }
+
+    if (group->combinator == LXB_GRAMMAR_COMBINATOR_OR && mask != 0) {
+        return next->func(match, next, pos);
+    }
+
+    return false;
+}
+
+static bool
+lxb_grammar_match_set_next(lxb_grammar_match_t *match,
+                           lxb_grammar_match_cont_t *cont, size_t pos)
+{
+    return lxb_grammar_match_set(match, cont->node, cont->mask,
+                                 pos, cont->next);
+}
+
+static bool
+lxb_grammar_match_end(lxb_grammar_match_t *match,
+                      lxb_grammar_match_cont_t *cont, size_t pos)
+{
+    return pos == match->tokens.length;
+}
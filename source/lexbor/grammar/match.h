@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_MATCH_H
+#define LEXBOR_GRAMMAR_MATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/node.h"
+#include "lexbor/grammar/tree.h"
+#include "lexbor/grammar/value.h"
+#include "lexbor/grammar/first.h"
+#include "lexbor/grammar/bounds.h"
+
+#include "lexbor/core/array_obj.h"
+
+
+/* Maximum nesting of matched nodes, protects the C stack. */
+#ifndef LXB_GRAMMAR_MATCH_DEPTH_MAX
+#define LXB_GRAMMAR_MATCH_DEPTH_MAX 2048
+#endif
+
+
+typedef struct {
+    lxb_grammar_node_t *node;
+    size_t             id;     /* node->id */
+
+    /* Token indexes, [first, last). */
+    size_t             first;
+    size_t             last;
+
+    /* Bytes of the value. */
+    const lxb_char_t   *begin;
+    const lxb_char_t   *end;
+}
+lxb_grammar_match_span_t;
+
+typedef struct {
+    size_t  first;   /* Index of the first end + 1, 0 if none. */
+    size_t  last;
+    uint8_t state;
+}
+lxb_grammar_match_memo_entry_t;
+
+/* Position after the node and spans of its first derivation. */
+typedef struct {
+    size_t pos;
+    size_t spans;    /* Index in the span pool. */
+    size_t length;
+    size_t next;     /* Index of the next end + 1, 0 if none. */
+}
+lxb_grammar_match_memo_end_t;
+
+/*
+ * The spans refer to the memory of the lxb_grammar_match_t object and valid
+ * until the next call.  Children are placed before the parents.
+ */
+typedef struct {
+    bool                           accepted;
+
+    const lxb_grammar_match_span_t *spans;
+    size_t                         length;
+}
+lxb_grammar_match_result_t;
+
+typedef struct {
+    const lxb_char_t *data;
+    size_t           length;
+}
+lxb_grammar_match_value_t;
+
+/*
+ * Token of the accepted value and the innermost node matched it: a term,
+ * or a group for "," of #.  The node is NULL if bytecode has no tree.
+ *
+ * Type, number, unit and keyword id are in the token, see
+ * lexbor/grammar/value.h.
+ */
+typedef struct {
+    lxb_grammar_node_t              *node;
+    size_t                          id;     /* node->id */
+
+    const lxb_grammar_value_token_t *token;
+}
+lxb_grammar_match_event_t;
+
+struct lxb_grammar_match {
+    lxb_grammar_tree_t *tree;
+
+    /* Alternatives which can not begin at the token are skipped. */
+    lxb_grammar_first_t first;
+
+    /* Values with too few or too many tokens are not matched. */
+    lxb_grammar_bounds_t bounds;
+
+    /* Settings, may be changed after init. */
+    bool               memo;
+    lxb_grammar_cache_t *cache;  /* See lexbor/grammar/cache.h. */
+
+    /*
+     * Packrat memo: all ends of a node by (node, token index).  Only for
+     * declarations which can be matched again at the same position, see
+     * lxb_grammar_ambiguity_is_backtracking(), and for groups where the
+     * ambiguity analysis finds a conflict.
+     */
+    size_t                         *memo_index;  /* By node->id, 0 if none. */
+    size_t                         memo_count;
+    lxb_grammar_match_memo_entry_t *memo_table;
+    size_t                         memo_size;
+    lexbor_array_obj_t             memo_ends;
+    lexbor_array_obj_t             memo_spans;
+
+    /*
+     * Continuations which failed after a memoized declaration,
+     * "(id << 32) | token index".  Equal continuations share the id.
+     */
+    lexbor_array_obj_t             memo_conts;
+    size_t                         *memo_hash;   /* Index of memo_conts + 1. */
+    size_t                         memo_hash_size;
+    uint64_t                       *memo_fails;
+    size_t                         memo_fails_size;
+    size_t                         memo_fails_length;
+
+    lexbor_array_obj_t tokens;
+    lexbor_array_obj_t spans;
+
+    /* For lowercase keywords. */
+    lxb_char_t         *buf;
+    size_t             buf_size;
+
+    /* Value of the tokens, NULL if the last value was not tokenized. */
+    const lxb_char_t   *data;
+    const lxb_char_t   *data_end;
+    size_t             depth;
+    lxb_status_t       status;
+};
+
+
+LXB_API lxb_grammar_match_t *
+lxb_grammar_match_create(void);
+
+/* The tree must be made by lxb_grammar_tree_make(). */
+LXB_API lxb_status_t
+lxb_grammar_match_init(lxb_grammar_match_t *match, lxb_grammar_tree_t *tree);
+
+LXB_API void
+lxb_grammar_match_clean(lxb_grammar_match_t *match);
+
+LXB_API lxb_grammar_match_t *
+lxb_grammar_match_destroy(lxb_grammar_match_t *match, bool self_destroy);
+
+/*
+ * Checks CSS value against the declaration of the compiled grammar
+ * (see lxb_grammar_tree_make()).
+ *
+ * Returns LXB_STATUS_OK and result->accepted if the value was checked.
+ * LXB_STATUS_ERROR_NOT_EXISTS if declaration not found.
+ *
+ * After warm-up the call does not allocate memory.
+ *
+ * With the memo setting, every memoized declaration and conflicting group
+ * is matched once at a position, the time does not grow exponentially on
+ * backtracking.
+ *
+ * With the cache setting, a value seen before is not matched again.
+ */
+LXB_API lxb_status_t
+lxb_grammar_match(lxb_grammar_match_t *match,
+                  const lxb_char_t *name, size_t name_len,
+                  const lxb_char_t *data, size_t size,
+                  lxb_grammar_match_result_t *result);
+
+LXB_API lxb_status_t
+lxb_grammar_match_declaration(lxb_grammar_match_t *match,
+                              lxb_grammar_node_t *declaration,
+                              const lxb_char_t *data, size_t size,
+                              lxb_grammar_match_result_t *result);
+
+/*
+ * Checks many values against one declaration, a result for each value.
+ * The buffers of the object are reused for all values, spans of all
+ * results are valid until the next call.
+ *
+ * On error no value is accepted.
+ */
+LXB_API lxb_status_t
+lxb_grammar_match_batch(lxb_grammar_match_t *match,
+                        lxb_grammar_node_t *declaration,
+                        const lxb_grammar_match_value_t *values, size_t count,
+                        lxb_grammar_match_result_t *results);
+
+/*
+ * Events of the accepted result: one for each token of the value, in order
+ * of the value.  Nothing is copied, tokens refer to the data.
+ *
+ * The value and the result are of the last call of lxb_grammar_match()
+ * or any value with its result.  Without the tokens of the value in the
+ * object (batch, cache) the value is tokenized again, the result is not
+ * matched again.
+ *
+ * Events are written to the buffer.  The length is the count of tokens,
+ * 0 if not accepted; LXB_STATUS_ERROR_SMALL_BUFFER if the capacity is less.
+ * Tokens are valid until the next call.
+ */
+LXB_API lxb_status_t
+lxb_grammar_match_events(lxb_grammar_match_t *match,
+                         const lxb_char_t *data, size_t size,
+                         const lxb_grammar_match_result_t *result,
+                         lxb_grammar_match_event_t *events, size_t capacity,
+                         size_t *length);
+
+/* Events by the tokens of the value (lxb_grammar_value_tokenize()). */
+LXB_API lxb_status_t
+lxb_grammar_match_result_events(const lxb_grammar_match_result_t *result,
+                                const lexbor_array_obj_t *tokens,
+                                lxb_grammar_match_event_t *events,
+                                size_t capacity, size_t *length);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_MATCH_H */
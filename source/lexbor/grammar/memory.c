@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/memory.h"
+#include "lexbor/grammar/token.h"
+#include "lexbor/grammar/node.h"
+#include "lexbor/grammar/tree.h"
+#include "lexbor/grammar/bytecode.h"
+
+#include "lexbor/core/conv.h"
+
+
+#define lxb_grammar_memory_send(data, len)                                     \
+    do {                                                                       \
+        status = func((const lxb_char_t *) (data), (len), ctx);                \
+        if (status != LXB_STATUS_OK) {                                         \
+            return status;                                                     \
+        }                                                                      \
+    }                                                                          \
+    while (0)
+
+
+lxb_inline size_t
+lxb_grammar_memory_slab(lexbor_dobject_t *slab)
+{
+    if (slab == NULL) {
+        return 0;
+    }
+
+    return lexbor_dobject_allocated(slab) * slab->struct_size;
+}
+
+lxb_inline size_t
+lxb_grammar_memory_array(const lexbor_array_t *array)
+{
+    return array->size * sizeof(void *);
+}
+
+lxb_inline size_t
+lxb_grammar_memory_array_obj(const lexbor_array_obj_t *array)
+{
+    return array->size * array->struct_size;
+}
+
+lxb_inline size_t
+lxb_grammar_memory_bst_map(lexbor_bst_map_t *map)
+{
+    return (map != NULL) ? lxb_grammar_memory_mraw(lexbor_bst_map_mraw(map))
+                         : 0;
+}
+
+void
+lxb_grammar_memory_count(lxb_grammar_memory_t *memory,
+                         lxb_grammar_document_t *document,
+                         lxb_grammar_tree_t *tree, lxb_grammar_bytecode_t *bc)
+{
+    memset(memory, 0, sizeof(lxb_grammar_memory_t));
+
+    memory->tokens = lxb_grammar_memory_slab(document->token_slab)
+                     + lxb_grammar_memory_array(&document->tokens);
+
+    memory->nodes = lxb_grammar_memory_slab(document->node_slab);
+
+    memory->strings = lxb_grammar_memory_mraw(document->text)
+                      + lxb_grammar_memory_bst_map(document->names)
+                      + lxb_grammar_memory_array(&document->strings);
+
+    memory->tree = lxb_grammar_memory_mraw(document->mraw);
+
+    if (tree != NULL) {
+        memory->tree += lxb_grammar_memory_bst_map(tree->declarations)
+                        + lxb_grammar_memory_bst_map(tree->keywords);
+
+        if (tree->keyword_list != NULL) {
+            memory->tree += lxb_grammar_memory_array(tree->keyword_list);
+        }
+
+        if (tree->nodes != NULL) {
+            memory->tree += lxb_grammar_memory_array(tree->nodes);
+        }
+    }
+
+    if (bc != NULL) {
+        memory->tables = lxb_grammar_memory_mraw(bc->mraw);
+
+        if (!bc->external) {
+            memory->tables += lxb_grammar_memory_array_obj(&bc->code)
+                              + lxb_grammar_memory_array_obj(&bc->terms)
+                              + lxb_grammar_memory_array_obj(&bc->decls)
+                              + lxb_grammar_memory_array_obj(&bc->index)
+                              + lxb_grammar_memory_array_obj(&bc->keywords)
+                              + lxb_grammar_memory_array_obj(&bc->hash);
+        }
+    }
+
+    memory->total = memory->tokens + memory->nodes + memory->strings
+                    + memory->tree + memory->tables;
+
+    if (memory->total + document->memory_held > document->memory_peak) {
+        document->memory_peak = memory->total + document->memory_held;
+    }
+
+    memory->peak = document->memory_peak;
+}
+
+void
+lxb_grammar_memory_peak(lxb_grammar_document_t *document,
+                        lxb_grammar_tree_t *tree, lxb_grammar_bytecode_t *bc)
+{
+    lxb_grammar_memory_t memory;
+
+    lxb_grammar_memory_count(&memory, document, tree, bc);
+}
+
+void
+lxb_grammar_memory_hold(lxb_grammar_document_t *document, size_t size)
+{
+    document->memory_held += size;
+}
+
+void
+lxb_grammar_memory_release(lxb_grammar_document_t *document,
+                           lxb_grammar_tree_t *tree, lxb_grammar_bytecode_t *bc,
+                           size_t size)
+{
+    lxb_grammar_memory_peak(document, tree, bc);
+
+    document->memory_held -= size;
+}
+
+size_t
+lxb_grammar_memory_mraw(const lexbor_mraw_t *mraw)
+{
+    size_t size;
+    const lexbor_mem_chunk_t *chunk;
+
+    if (mraw == NULL || mraw->mem == NULL) {
+        return 0;
+    }
+
+    size = 0;
+
+    for (chunk = mraw->mem->chunk_first; chunk != NULL; chunk = chunk->next) {
+        size += chunk->length;
+    }
+
+    return size;
+}
+
+lxb_status_t
+lxb_grammar_memory_serialize(const lxb_grammar_memory_t *memory,
+                             lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    size_t len;
+    lxb_status_t status;
+    lxb_char_t buf[128];
+
+    static const char *names[] = {
+        "tokens: ", "; nodes: ", "; strings: ", "; tree: ", "; tables: ",
+        "; total: ", "; peak: "
+    };
+
+    const size_t values[] = {
+        memory->tokens, memory->nodes, memory->strings, memory->tree,
+        memory->tables, memory->total, memory->peak
+    };
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(size_t); i++) {
+        lxb_grammar_memory_send(names[i], strlen(names[i]));
+
+        len = lexbor_conv_long_to_data((long) values[i], buf, sizeof(buf));
+
+        lxb_grammar_memory_send(buf, len);
+    }
+
+    return LXB_STATUS_OK;
+}
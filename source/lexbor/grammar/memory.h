@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_MEMORY_H
+#define LEXBOR_GRAMMAR_MEMORY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/document.h"
+
+
+/*
+ * Bytes taken by a grammar, from the counters of its arenas: used length
+ * of mraw chunks, live objects of slabs and sizes of arrays.  A block freed
+ * to mraw stays counted, mraw does not give memory back.
+ */
+typedef struct {
+    size_t tokens;   /* Tokens and the list of them. */
+    size_t nodes;    /* Nodes of the AST. */
+    size_t strings;  /* Text of tokens, names and values of elements. */
+    size_t tree;     /* Groups, entries and elements, the tables of the tree.
+                        Tokens and nodes too if they are not in slabs. */
+    size_t tables;   /* Compiled bytecode, without loaded tables. */
+
+    size_t total;
+    size_t peak;     /* Largest total of the document while compiled, with
+                        the held blocks of lxb_grammar_memory_hold(). */
+}
+lxb_grammar_memory_t;
+
+
+/*
+ * The tree and the bytecode can be NULL.  Raises the peak of the document
+ * to the total and the held bytes.
+ */
+LXB_API void
+lxb_grammar_memory_count(lxb_grammar_memory_t *memory,
+                         lxb_grammar_document_t *document,
+                         lxb_grammar_tree_t *tree, lxb_grammar_bytecode_t *bc);
+
+/*
+ * Called by each stage of compilation when it is done: the tokenizer,
+ * the parser, lxb_grammar_tree_make() and lxb_grammar_bytecode_make().
+ */
+LXB_API void
+lxb_grammar_memory_peak(lxb_grammar_document_t *document,
+                        lxb_grammar_tree_t *tree, lxb_grammar_bytecode_t *bc);
+
+/*
+ * Heap blocks a stage frees before it is done: sets of the ambiguity check,
+ * bounds, indexes.  They are not in the total but are in the peak while
+ * held.  The arenas only grow, so the peak is taken on release.
+ */
+LXB_API void
+lxb_grammar_memory_hold(lxb_grammar_document_t *document, size_t size);
+
+LXB_API void
+lxb_grammar_memory_release(lxb_grammar_document_t *document,
+                           lxb_grammar_tree_t *tree, lxb_grammar_bytecode_t *bc,
+                           size_t size);
+
+/* Used bytes of all chunks. */
+LXB_API size_t
+lxb_grammar_memory_mraw(const lexbor_mraw_t *mraw);
+
+LXB_API lxb_status_t
+lxb_grammar_memory_serialize(const lxb_grammar_memory_t *memory,
+                             lxb_grammar_serialize_cb_f func, void *ctx);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_MEMORY_H */
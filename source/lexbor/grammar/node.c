@@ -7,45 +7,123 @@
 #include "lexbor/grammar/node.h"
 #include "lexbor/grammar/tokenizer.h"
 #include "lexbor/grammar/parser.h"
+#include "lexbor/grammar/stats.h"
 
 #include "lexbor/core/conv.h"
-#include "lexbor/html/serialize.h"
 
 
-#define lxb_grammar_node_serialize_send(data, len, cb, ctx)                    \
+/* Fragments are copied to the buffer, see lxb_grammar_node_writer_t. */
+#define lxb_grammar_node_write(wr, frag, flen)                                 \
     do {                                                                       \
-        status = cb((const lxb_char_t *) data, len, ctx);                      \
-        if (status != LXB_STATUS_OK) {                                         \
-            return status;                                                     \
+        if ((wr)->length + (size_t) (flen) < (wr)->size) {                     \
+            memcpy((wr)->data + (wr)->length, (frag), (flen));                 \
+            (wr)->length += (flen);                                            \
+        }                                                                      \
+        else {                                                                 \
+            status = lxb_grammar_node_writer_flush((wr),                       \
+                                         (const lxb_char_t *) (frag), (flen)); \
+            if (status != LXB_STATUS_OK) {                                     \
+                return status;                                                 \
+            }                                                                  \
         }                                                                      \
     }                                                                          \
     while (0)
 
-#define lxb_grammar_node_serialize_send_indent(count, cb, ctx)                 \
+#define lxb_grammar_node_write_indent(wr, count)                               \
     do {                                                                       \
         for (size_t i = 0; i < count; i++) {                                   \
-            lxb_grammar_node_serialize_send("  ", 2, cb, ctx);                 \
+            lxb_grammar_node_write(wr, "  ", 2);                               \
         }                                                                      \
     }                                                                          \
     while (0)
 
 
+/*
+ * Output of the serializers: fragments are collected in the buffer and
+ * go to the callback in blocks, or the buffer is the string itself and
+ * grows.  Without the callback and the string the buffer is fixed, and
+ * without the buffer only the length is counted.
+ */
+typedef struct {
+    lxb_char_t                 *data;
+    size_t                     length;
+    size_t                     size;
+
+    lxb_grammar_serialize_cb_f func;
+    void                       *ctx;
+
+    /* Instead of the callback. */
+    lexbor_str_t               *str;
+    lexbor_mraw_t              *mraw;
+}
+lxb_grammar_node_writer_t;
+
+
+static lxb_status_t
+lxb_grammar_node_writer_str(lxb_grammar_node_writer_t *wr,
+                            lexbor_str_t *str, lexbor_mraw_t *mraw);
+
+static void
+lxb_grammar_node_writer_str_end(lxb_grammar_node_writer_t *wr);
+
+static lxb_status_t
+lxb_grammar_node_writer_flush(lxb_grammar_node_writer_t *wr,
+                              const lxb_char_t *data, size_t len);
+
+static lxb_status_t
+lxb_grammar_node_write_node(lxb_grammar_node_writer_t *wr,
+                            lxb_grammar_node_t *node);
+
+static lxb_status_t
+lxb_grammar_node_write_deep(lxb_grammar_node_writer_t *wr,
+                            lxb_grammar_node_t *root);
+
+static lxb_status_t
+lxb_grammar_node_write_branch(lxb_grammar_node_writer_t *wr,
+                              lxb_grammar_node_t *node);
+
+static lxb_status_t
+lxb_grammar_node_write_ast(lxb_grammar_node_writer_t *wr,
+                           lxb_grammar_node_t *root);
+
+
+lxb_grammar_node_t *
+lxb_grammar_node_alloc(lxb_grammar_document_t *document)
+{
+    lxb_grammar_node_t *node;
+
+    if (document->node_slab != NULL) {
+        node = lexbor_dobject_calloc(document->node_slab);
+    }
+    else {
+        /* From now on the slab can not be made, see node_destroy(). */
+        document->nodes_mraw = true;
+
+        node = lexbor_mraw_calloc(document->mraw, sizeof(lxb_grammar_node_t));
+    }
+
+    if (node != NULL) {
+        node->document = document;
+    }
+
+    return node;
+}
+
 lxb_grammar_node_t *
 lxb_grammar_node_create(lxb_grammar_parser_t *parser, lxb_grammar_token_t *token,
                         lxb_grammar_node_type_t type)
 {
     lxb_grammar_node_t *node;
-    lxb_grammar_document_t *document = parser->document;
 
-    node = lexbor_mraw_calloc(document->dom_document.mraw,
-                              sizeof(lxb_grammar_node_t));
+    node = lxb_grammar_node_alloc(parser->document);
     if (node == NULL) {
         return NULL;
     }
 
+    lxb_grammar_stats_inc(parser->stats, nodes);
+
     node->type = type;
     node->token = token;
-    node->document = parser->document;
     node->multiplier.start = -1;
 
     if (token == NULL) {
@@ -55,7 +133,7 @@ lxb_grammar_node_create(lxb_grammar_parser_t *parser, lxb_grammar_token_t *token
     switch (type) {
         case LXB_GRAMMAR_NODE_DECLARATION:
         case LXB_GRAMMAR_NODE_ELEMENT:
-            node->u.node = token->u.node;
+            node->u.element = token->u.element;
             break;
 
         case LXB_GRAMMAR_NODE_NUMBER:
@@ -93,7 +171,11 @@ lxb_grammar_node_destroy(lxb_grammar_node_t *node)
         return NULL;
     }
 
-    return lexbor_mraw_free(node->document->dom_document.mraw, node);
+    if (node->document->node_slab != NULL) {
+        return lexbor_dobject_free(node->document->node_slab, node);
+    }
+
+    return lexbor_mraw_free(node->document->mraw, node);
 }
 
 void
@@ -176,27 +258,340 @@ lxb_grammar_node_remove(lxb_grammar_node_t *node)
     node->prev = NULL;
 }
 
+lxb_status_t
+lxb_grammar_node_serialize_deep(lxb_grammar_node_t *root,
+                                lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    lxb_status_t status;
+    lxb_char_t buf[LXB_GRAMMAR_NODE_SERIALIZE_BUFFER];
+    lxb_grammar_node_writer_t wr = {buf, 0, sizeof(buf), func, ctx, NULL, NULL};
+
+    status = lxb_grammar_node_write_deep(&wr, root);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    return lxb_grammar_node_writer_flush(&wr, NULL, 0);
+}
+
+lxb_status_t
+lxb_grammar_node_serialize_deep_str(lxb_grammar_node_t *root,
+                                    lexbor_str_t *str, lexbor_mraw_t *mraw)
+{
+    lxb_status_t status;
+    lxb_grammar_node_writer_t wr;
+
+    status = lxb_grammar_node_writer_str(&wr, str, mraw);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lxb_grammar_node_write_deep(&wr, root);
+
+    lxb_grammar_node_writer_str_end(&wr);
+
+    return status;
+}
+
+lxb_status_t
+lxb_grammar_node_serialize_deep_length(lxb_grammar_node_t *root,
+                                       size_t *length)
+{
+    lxb_status_t status;
+    lxb_grammar_node_writer_t wr = {NULL, 0, 0, NULL, NULL, NULL, NULL};
+
+    status = lxb_grammar_node_write_deep(&wr, root);
+
+    *length = wr.length;
+
+    return status;
+}
+
+lxb_status_t
+lxb_grammar_node_serialize_deep_data(lxb_grammar_node_t *root,
+                                     lxb_char_t *data, size_t size,
+                                     size_t *length)
+{
+    lxb_status_t status;
+    lxb_grammar_node_writer_t wr = {data, 0, size, NULL, NULL, NULL, NULL};
+
+    status = lxb_grammar_node_write_deep(&wr, root);
+
+    *length = wr.length;
+
+    return status;
+}
+
+lxb_char_t *
+lxb_grammar_node_serialize_deep_dup(lxb_grammar_node_t *root, size_t *length)
+{
+    size_t len;
+    lxb_char_t *data;
+    lxb_status_t status;
+
+    status = lxb_grammar_node_serialize_deep_length(root, &len);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    data = lexbor_malloc(len + 1);
+    if (data == NULL) {
+        goto failed;
+    }
+
+    status = lxb_grammar_node_serialize_deep_data(root, data, len, &len);
+    if (status != LXB_STATUS_OK) {
+        lexbor_free(data);
+        goto failed;
+    }
+
+    data[len] = 0x00;
+
+    if (length != NULL) {
+        *length = len;
+    }
+
+    return data;
+
+failed:
+
+    if (length != NULL) {
+        *length = 0;
+    }
+
+    return NULL;
+}
+
+lxb_status_t
+lxb_grammar_node_serialize(lxb_grammar_node_t *node,
+                           lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    /* Without the buffer: the fragments go to the callback as is. */
+    lxb_grammar_node_writer_t wr = {NULL, 0, 0, func, ctx, NULL, NULL};
+
+    return lxb_grammar_node_write_node(&wr, node);
+}
+
+lxb_status_t
+lxb_grammar_node_serialize_branch(lxb_grammar_node_t *node,
+                                  lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    lxb_status_t status;
+    lxb_char_t buf[LXB_GRAMMAR_NODE_SERIALIZE_BUFFER];
+    lxb_grammar_node_writer_t wr = {buf, 0, sizeof(buf), func, ctx, NULL, NULL};
+
+    status = lxb_grammar_node_write_branch(&wr, node);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    return lxb_grammar_node_writer_flush(&wr, NULL, 0);
+}
+
+lxb_status_t
+lxb_grammar_node_serialize_ast(lxb_grammar_node_t *root,
+                               lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    lxb_status_t status;
+    lxb_char_t buf[LXB_GRAMMAR_NODE_SERIALIZE_BUFFER];
+    lxb_grammar_node_writer_t wr = {buf, 0, sizeof(buf), func, ctx, NULL, NULL};
+
+    status = lxb_grammar_node_write_ast(&wr, root);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    return lxb_grammar_node_writer_flush(&wr, NULL, 0);
+}
+
+lxb_status_t
+lxb_grammar_node_serialize_ast_str(lxb_grammar_node_t *root,
+                                   lexbor_str_t *str, lexbor_mraw_t *mraw)
+{
+    lxb_status_t status;
+    lxb_grammar_node_writer_t wr;
+
+    status = lxb_grammar_node_writer_str(&wr, str, mraw);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lxb_grammar_node_write_ast(&wr, root);
+
+    lxb_grammar_node_writer_str_end(&wr);
+
+    return status;
+}
+
+/* The string is written in place, from its end. */
+static lxb_status_t
+lxb_grammar_node_writer_str(lxb_grammar_node_writer_t *wr,
+                            lexbor_str_t *str, lexbor_mraw_t *mraw)
+{
+    if (str->data == NULL) {
+        if (lexbor_str_init(str, mraw, LXB_GRAMMAR_NODE_SERIALIZE_BUFFER)
+            == NULL)
+        {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+    }
+
+    wr->data = str->data;
+    wr->length = str->length;
+    wr->size = lexbor_str_size(str) - 1;  /* For the terminating 0x00. */
+    wr->func = NULL;
+    wr->ctx = NULL;
+    wr->str = str;
+    wr->mraw = mraw;
+
+    return LXB_STATUS_OK;
+}
+
+static void
+lxb_grammar_node_writer_str_end(lxb_grammar_node_writer_t *wr)
+{
+    wr->str->length = wr->length;
+    wr->str->data[wr->length] = 0x00;
+}
+
+/*
+ * The fragment does not fit.  Data NULL: only the buffer goes to
+ * the callback.
+ */
+static lxb_status_t
+lxb_grammar_node_writer_flush(lxb_grammar_node_writer_t *wr,
+                              const lxb_char_t *data, size_t len)
+{
+    size_t size;
+    lxb_status_t status;
+
+    if (wr->str != NULL) {
+        if (len > SIZE_MAX / 2 - wr->length) {
+            return LXB_STATUS_ERROR_OVERFLOW;
+        }
+
+        size = (wr->size + 1) * 2;
+
+        if (size < wr->length + len + 1) {
+            size = wr->length + len + 1;
+        }
+
+        if (lexbor_str_realloc(wr->str, wr->mraw, size) == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        wr->data = wr->str->data;
+        wr->size = lexbor_str_size(wr->str) - 1;
+
+        memcpy(wr->data + wr->length, data, len);
+        wr->length += len;
+
+        return LXB_STATUS_OK;
+    }
+
+    if (wr->func == NULL) {
+        if (wr->data == NULL) {
+            wr->length += len;
+
+            return LXB_STATUS_OK;
+        }
+
+        if (len > wr->size - wr->length) {
+            return LXB_STATUS_ERROR_SMALL_BUFFER;
+        }
+
+        memcpy(wr->data + wr->length, data, len);
+        wr->length += len;
+
+        return LXB_STATUS_OK;
+    }
+
+    if (wr->length != 0) {
+        status = wr->func(wr->data, wr->length, wr->ctx);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        wr->length = 0;
+    }
+
+    if (len == 0) {
+        return LXB_STATUS_OK;
+    }
+
+    if (len <= wr->size) {
+        memcpy(wr->data, data, len);
+        wr->length = len;
+
+        return LXB_STATUS_OK;
+    }
+
+    return wr->func(data, len, wr->ctx);
+}
+
+/* For lxb_grammar_element_serialize(). */
+static lxb_status_t
+lxb_grammar_node_writer_cb(const lxb_char_t *data, size_t len, void *ctx)
+{
+    lxb_status_t status;
+    lxb_grammar_node_writer_t *wr = ctx;
+
+    lxb_grammar_node_write(wr, data, len);
+
+    return LXB_STATUS_OK;
+}
+
+/* Counting the length, small counts are not formatted. */
+lxb_inline lxb_status_t
+lxb_grammar_node_write_count(lxb_grammar_node_writer_t *wr, long num)
+{
+    size_t len;
+    lxb_status_t status;
+    lxb_char_t buf[128];
+
+    if (wr->data == NULL && wr->func == NULL && wr->str == NULL
+        && num >= 0 && num < 1000000000)
+    {
+        len = 1;
+
+        while (num >= 10) {
+            num /= 10;
+            len++;
+        }
+
+        wr->length += len;
+
+        return LXB_STATUS_OK;
+    }
+
+    len = lexbor_conv_float_to_data((double) num, buf,
+                                    (sizeof(buf) / sizeof(lxb_char_t)));
+    lxb_grammar_node_write(wr, buf, len);
+
+    return LXB_STATUS_OK;
+}
+
 lxb_inline lxb_status_t
-lxb_grammar_node_serialize_combinator(lxb_grammar_node_t *group,
-                                      lxb_grammar_serialize_cb_f func, void *ctx)
+lxb_grammar_node_write_combinator(lxb_grammar_node_writer_t *wr,
+                                  lxb_grammar_node_t *group)
 {
     lxb_status_t status;
 
     switch (group->combinator) {
         case LXB_GRAMMAR_COMBINATOR_AND:
-            lxb_grammar_node_serialize_send(" && ", 4, func, ctx);
+            lxb_grammar_node_write(wr, " && ", 4);
             break;
 
         case LXB_GRAMMAR_COMBINATOR_OR:
-            lxb_grammar_node_serialize_send(" || ", 4, func, ctx);
+            lxb_grammar_node_write(wr, " || ", 4);
             break;
 
         case LXB_GRAMMAR_COMBINATOR_ONE_OF:
-            lxb_grammar_node_serialize_send(" | ", 3, func, ctx);
+            lxb_grammar_node_write(wr, " | ", 3);
             break;
 
         default:
-            lxb_grammar_node_serialize_send(" ", 1, func, ctx);
+            lxb_grammar_node_write(wr, " ", 1);
             break;
     }
 
@@ -204,26 +599,26 @@ lxb_grammar_node_serialize_combinator(lxb_grammar_node_t *group,
 }
 
 lxb_inline lxb_status_t
-lxb_grammar_node_serialize_combinator_wo_ws(lxb_grammar_node_t *group,
-                                     lxb_grammar_serialize_cb_f func, void *ctx)
+lxb_grammar_node_write_combinator_wo_ws(lxb_grammar_node_writer_t *wr,
+                                        lxb_grammar_node_t *group)
 {
     lxb_status_t status;
 
     switch (group->combinator) {
         case LXB_GRAMMAR_COMBINATOR_AND:
-            lxb_grammar_node_serialize_send("&&", 2, func, ctx);
+            lxb_grammar_node_write(wr, "&&", 2);
             break;
 
         case LXB_GRAMMAR_COMBINATOR_OR:
-            lxb_grammar_node_serialize_send("||", 2, func, ctx);
+            lxb_grammar_node_write(wr, "||", 2);
             break;
 
         case LXB_GRAMMAR_COMBINATOR_ONE_OF:
-            lxb_grammar_node_serialize_send("|", 1, func, ctx);
+            lxb_grammar_node_write(wr, "|", 1);
             break;
 
         default:
-            lxb_grammar_node_serialize_send(" ", 1, func, ctx);
+            lxb_grammar_node_write(wr, " ", 1);
             break;
     }
 
@@ -231,13 +626,11 @@ lxb_grammar_node_serialize_combinator_wo_ws(lxb_grammar_node_t *group,
 }
 
 lxb_inline lxb_status_t
-lxb_grammar_node_serialize_multiplier(lxb_grammar_node_t *node,
-                                      lxb_grammar_serialize_cb_f func, void *ctx)
+lxb_grammar_node_write_multiplier(lxb_grammar_node_writer_t *wr,
+                                  lxb_grammar_node_t *node)
 {
-    size_t len;
     lxb_status_t status;
     lxb_grammar_period_t *multiplier = &node->multiplier;
-    lxb_char_t buf[128];
 
     if (multiplier->start == -1) {
         return LXB_STATUS_OK;
@@ -245,14 +638,14 @@ lxb_grammar_node_serialize_multiplier(lxb_grammar_node_t *node,
 
     if (multiplier->stop == -1) {
         if (multiplier->start == 0) {
-            lxb_grammar_node_serialize_send("*", 1, func, ctx);
+            lxb_grammar_node_write(wr, "*", 1);
         }
         else if (multiplier->start == 1) {
             if (node->is_comma_separated) {
-                lxb_grammar_node_serialize_send("#", 1, func, ctx);
+                lxb_grammar_node_write(wr, "#", 1);
             }
             else {
-                lxb_grammar_node_serialize_send("+", 1, func, ctx);
+                lxb_grammar_node_write(wr, "+", 1);
             }
         }
 
@@ -260,46 +653,90 @@ lxb_grammar_node_serialize_multiplier(lxb_grammar_node_t *node,
     }
 
     if (multiplier->start == 1 && multiplier->stop == 0) {
-        lxb_grammar_node_serialize_send("!", 1, func, ctx);
+        lxb_grammar_node_write(wr, "!", 1);
         return LXB_STATUS_OK;
     }
     else if (multiplier->start == 0 && multiplier->stop == 1) {
-        lxb_grammar_node_serialize_send("?", 1, func, ctx);
+        lxb_grammar_node_write(wr, "?", 1);
         return LXB_STATUS_OK;
     }
 
-mod:
-
     if (node->is_comma_separated) {
-        lxb_grammar_node_serialize_send("#", 1, func, ctx);
+        lxb_grammar_node_write(wr, "#", 1);
     }
 
-    lxb_grammar_node_serialize_send("{", 1, func, ctx);
+    lxb_grammar_node_write(wr, "{", 1);
 
-    len = lexbor_conv_float_to_data(multiplier->start, buf,
-                                    (sizeof(buf) / sizeof(lxb_char_t)));
-    lxb_grammar_node_serialize_send(buf, len, func, ctx);
+    status = lxb_grammar_node_write_count(wr, multiplier->start);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
 
     if (multiplier->start == multiplier->stop) {
-        lxb_grammar_node_serialize_send("}", 1, func, ctx);
+        lxb_grammar_node_write(wr, "}", 1);
 
         return LXB_STATUS_OK;
     }
 
-    lxb_grammar_node_serialize_send(",", 1, func, ctx);
+    lxb_grammar_node_write(wr, ",", 1);
 
-    len = lexbor_conv_float_to_data(multiplier->stop, buf,
-                                    (sizeof(buf) / sizeof(lxb_char_t)));
+    status = lxb_grammar_node_write_count(wr, multiplier->stop);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
 
-    lxb_grammar_node_serialize_send(buf, len, func, ctx);
-    lxb_grammar_node_serialize_send("}", 1, func, ctx);
+    lxb_grammar_node_write(wr, "}", 1);
 
     return LXB_STATUS_OK;
 }
 
-lxb_status_t
-lxb_grammar_node_serialize_deep(lxb_grammar_node_t *root,
-                                lxb_grammar_serialize_cb_f func, void *ctx)
+static lxb_status_t
+lxb_grammar_node_write_node(lxb_grammar_node_writer_t *wr,
+                            lxb_grammar_node_t *node)
+{
+    size_t len;
+    lxb_char_t buf[128];
+    lxb_status_t status;
+
+    switch (node->type) {
+        case LXB_GRAMMAR_NODE_WHITESPACE:
+        case LXB_GRAMMAR_NODE_DELIM:
+        case LXB_GRAMMAR_NODE_UNQUOTED:
+            lxb_grammar_node_write(wr, node->u.str.data, node->u.str.length);
+            break;
+
+        case LXB_GRAMMAR_NODE_DECLARATION:
+        case LXB_GRAMMAR_NODE_ELEMENT:
+            return lxb_grammar_element_serialize(node->u.element,
+                                                 lxb_grammar_node_writer_cb, wr);
+
+        case LXB_GRAMMAR_NODE_STRING:
+            lxb_grammar_node_write(wr, "\"", 1);
+            lxb_grammar_node_write(wr, node->u.str.data, node->u.str.length);
+            lxb_grammar_node_write(wr, "\"", 1);
+            break;
+
+        case LXB_GRAMMAR_NODE_NUMBER:
+            len = lexbor_conv_float_to_data(node->u.num, buf,
+                                            (sizeof(buf) / sizeof(lxb_char_t)));
+            lxb_grammar_node_write(wr, buf, len);
+            break;
+
+        case LXB_GRAMMAR_NODE_ROOT:
+            lxb_grammar_node_write(wr, "<ROOT>", 6);
+            break;
+
+        default:
+            lxb_grammar_node_write(wr, "UNDEFINED", 9);
+            break;
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_node_write_deep(lxb_grammar_node_writer_t *wr,
+                            lxb_grammar_node_t *root)
 {
     lxb_status_t status;
     lxb_grammar_node_t *node;
@@ -315,16 +752,16 @@ lxb_grammar_node_serialize_deep(lxb_grammar_node_t *root,
         switch (node->type) {
             case LXB_GRAMMAR_NODE_GROUP:
                 if (node->prev == NULL) {
-                    lxb_grammar_node_serialize_send("[", 1, func, ctx);
+                    lxb_grammar_node_write(wr, "[", 1);
                 }
                 else {
-                    status = lxb_grammar_node_serialize_combinator(node->parent,
-                                                                   func, ctx);
+                    status = lxb_grammar_node_write_combinator(wr,
+                                                               node->parent);
                     if (status != LXB_STATUS_OK) {
                         return status;
                     }
 
-                    lxb_grammar_node_serialize_send("[", 1, func, ctx);
+                    lxb_grammar_node_write(wr, "[", 1);
                 }
 
                 if (node->first_child != NULL) {
@@ -332,9 +769,9 @@ lxb_grammar_node_serialize_deep(lxb_grammar_node_t *root,
                     continue;
                 }
 
-                lxb_grammar_node_serialize_send("]", 1, func, ctx);
+                lxb_grammar_node_write(wr, "]", 1);
 
-                status = lxb_grammar_node_serialize_multiplier(node, func, ctx);
+                status = lxb_grammar_node_write_multiplier(wr, node);
                 if (status != LXB_STATUS_OK) {
                     return status;
                 }
@@ -342,12 +779,12 @@ lxb_grammar_node_serialize_deep(lxb_grammar_node_t *root,
                 break;
 
             case LXB_GRAMMAR_NODE_DECLARATION:
-                status = lxb_grammar_node_serialize(node, func, ctx);
+                status = lxb_grammar_node_write_node(wr, node);
                 if (status != LXB_STATUS_OK) {
                     return status;
                 }
 
-                lxb_grammar_node_serialize_send(" = ", 3, func, ctx);
+                lxb_grammar_node_write(wr, " = ", 3);
 
                 node = node->first_child;
 
@@ -355,19 +792,19 @@ lxb_grammar_node_serialize_deep(lxb_grammar_node_t *root,
 
             default:
                 if (node->prev) {
-                    status = lxb_grammar_node_serialize_combinator(node->parent,
-                                                                   func, ctx);
+                    status = lxb_grammar_node_write_combinator(wr,
+                                                               node->parent);
                     if (status != LXB_STATUS_OK) {
                         return status;
                     }
                 }
 
-                status = lxb_grammar_node_serialize(node, func, ctx);
+                status = lxb_grammar_node_write_node(wr, node);
                 if (status != LXB_STATUS_OK) {
                     return status;
                 }
 
-                status = lxb_grammar_node_serialize_multiplier(node, func, ctx);
+                status = lxb_grammar_node_write_multiplier(wr, node);
                 if (status != LXB_STATUS_OK) {
                     return status;
                 }
@@ -384,13 +821,13 @@ lxb_grammar_node_serialize_deep(lxb_grammar_node_t *root,
 
             if (node->type == LXB_GRAMMAR_NODE_DECLARATION) {
                 if (node->next != NULL) {
-                    lxb_grammar_node_serialize_send("\n", 1, func, ctx);
+                    lxb_grammar_node_write(wr, "\n", 1);
                 }
             }
             else if (node->type != LXB_GRAMMAR_NODE_ROOT) {
-                lxb_grammar_node_serialize_send("]", 1, func, ctx);
+                lxb_grammar_node_write(wr, "]", 1);
 
-                status = lxb_grammar_node_serialize_multiplier(node, func, ctx);
+                status = lxb_grammar_node_write_multiplier(wr, node);
                 if (status != LXB_STATUS_OK) {
                     return status;
                 }
@@ -407,55 +844,62 @@ lxb_grammar_node_serialize_deep(lxb_grammar_node_t *root,
     return LXB_STATUS_OK;
 }
 
-lxb_status_t
-lxb_grammar_node_serialize(lxb_grammar_node_t *node,
-                           lxb_grammar_serialize_cb_f func, void *ctx)
+static lxb_status_t
+lxb_grammar_node_write_branch(lxb_grammar_node_writer_t *wr,
+                              lxb_grammar_node_t *node)
 {
-    size_t len;
-    lxb_char_t buf[128];
     lxb_status_t status;
+    lxb_grammar_node_t *child;
 
     switch (node->type) {
-        case LXB_GRAMMAR_NODE_WHITESPACE:
-        case LXB_GRAMMAR_NODE_DELIM:
-        case LXB_GRAMMAR_NODE_UNQUOTED:
-            return func(node->u.str.data, node->u.str.length, ctx);
-
         case LXB_GRAMMAR_NODE_DECLARATION:
-        case LXB_GRAMMAR_NODE_ELEMENT:
-            return lxb_html_serialize_cb(node->u.node, func, ctx);
-
-        case LXB_GRAMMAR_NODE_STRING:
-            status = func((lxb_char_t *) "\"", 1, ctx);
+            status = lxb_grammar_node_write_node(wr, node);
             if (status != LXB_STATUS_OK) {
                 return status;
             }
 
-            status = func(node->u.str.data, node->u.str.length, ctx);
+            lxb_grammar_node_write(wr, " = ", 3);
+            break;
+
+        case LXB_GRAMMAR_NODE_GROUP:
+            lxb_grammar_node_write(wr, "[", 1);
+            break;
+
+        default:
+            status = lxb_grammar_node_write_node(wr, node);
             if (status != LXB_STATUS_OK) {
                 return status;
             }
 
-            return func((lxb_char_t *) "\"", 1, ctx);
+            return lxb_grammar_node_write_multiplier(wr, node);
+    }
 
-        case LXB_GRAMMAR_NODE_NUMBER:
-            len = lexbor_conv_float_to_data(node->u.num, buf,
-                                            (sizeof(buf) / sizeof(lxb_char_t)));
-            return func(buf, len, ctx);
+    for (child = node->first_child; child != NULL; child = child->next) {
+        if (child->prev != NULL) {
+            status = lxb_grammar_node_write_combinator(wr, node);
+            if (status != LXB_STATUS_OK) {
+                return status;
+            }
+        }
 
-        case LXB_GRAMMAR_NODE_ROOT:
-            return func((lxb_char_t *) "<ROOT>", 6, ctx);
+        status = lxb_grammar_node_write_branch(wr, child);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+    }
 
-        default:
-            return func((lxb_char_t *) "UNDEFINED", 9, ctx);
+    if (node->type == LXB_GRAMMAR_NODE_DECLARATION) {
+        return LXB_STATUS_OK;
     }
 
-    return LXB_STATUS_OK;
+    lxb_grammar_node_write(wr, "]", 1);
+
+    return lxb_grammar_node_write_multiplier(wr, node);
 }
 
-lxb_status_t
-lxb_grammar_node_serialize_ast(lxb_grammar_node_t *root,
-                               lxb_grammar_serialize_cb_f func, void *ctx)
+static lxb_status_t
+lxb_grammar_node_write_ast(lxb_grammar_node_writer_t *wr,
+                           lxb_grammar_node_t *root)
 {
     lxb_status_t status;
     lxb_grammar_node_t *node;
@@ -472,25 +916,24 @@ lxb_grammar_node_serialize_ast(lxb_grammar_node_t *root,
 
         switch (node->type) {
             case LXB_GRAMMAR_NODE_GROUP:
-                lxb_grammar_node_serialize_send_indent(indent, func, ctx);
-                lxb_grammar_node_serialize_send("<#GROUP>", 8, func, ctx);
+                lxb_grammar_node_write_indent(wr, indent);
+                lxb_grammar_node_write(wr, "<#GROUP>", 8);
 
-                status = lxb_grammar_node_serialize_multiplier(node, func, ctx);
+                status = lxb_grammar_node_write_multiplier(wr, node);
                 if (status != LXB_STATUS_OK) {
                     return status;
                 }
 
                 if (node->combinator) {
-                    lxb_grammar_node_serialize_send(", ", 2, func, ctx);
+                    lxb_grammar_node_write(wr, ", ", 2);
 
-                    status = lxb_grammar_node_serialize_combinator_wo_ws(node,
-                                                                     func, ctx);
+                    status = lxb_grammar_node_write_combinator_wo_ws(wr, node);
                     if (status != LXB_STATUS_OK) {
                         return status;
                     }
                 }
 
-                lxb_grammar_node_serialize_send("\n", 1, func, ctx);
+                lxb_grammar_node_write(wr, "\n", 1);
 
                 indent++;
 
@@ -502,24 +945,23 @@ lxb_grammar_node_serialize_ast(lxb_grammar_node_t *root,
                 break;
 
             case LXB_GRAMMAR_NODE_DECLARATION:
-                lxb_grammar_node_serialize_send_indent(indent, func, ctx);
+                lxb_grammar_node_write_indent(wr, indent);
 
-                status = lxb_grammar_node_serialize(node, func, ctx);
+                status = lxb_grammar_node_write_node(wr, node);
                 if (status != LXB_STATUS_OK) {
                     return status;
                 }
 
                 if (node->combinator) {
-                    lxb_grammar_node_serialize_send(", ", 2, func, ctx);
+                    lxb_grammar_node_write(wr, ", ", 2);
 
-                    status = lxb_grammar_node_serialize_combinator_wo_ws(node,
-                                                                     func, ctx);
+                    status = lxb_grammar_node_write_combinator_wo_ws(wr, node);
                     if (status != LXB_STATUS_OK) {
                         return status;
                     }
                 }
 
-                lxb_grammar_node_serialize_send("\n", 1, func, ctx);
+                lxb_grammar_node_write(wr, "\n", 1);
 
                 node = node->first_child;
 
@@ -527,19 +969,19 @@ lxb_grammar_node_serialize_ast(lxb_grammar_node_t *root,
                 continue;
 
             default:
-                lxb_grammar_node_serialize_send_indent(indent, func, ctx);
+                lxb_grammar_node_write_indent(wr, indent);
 
-                status = lxb_grammar_node_serialize(node, func, ctx);
+                status = lxb_grammar_node_write_node(wr, node);
                 if (status != LXB_STATUS_OK) {
                     return status;
                 }
 
-                status = lxb_grammar_node_serialize_multiplier(node, func, ctx);
+                status = lxb_grammar_node_write_multiplier(wr, node);
                 if (status != LXB_STATUS_OK) {
                     return status;
                 }
 
-                lxb_grammar_node_serialize_send("\n", 1, func, ctx);
+                lxb_grammar_node_write(wr, "\n", 1);
 
                 break;
         }
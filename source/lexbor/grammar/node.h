@@ -13,10 +13,18 @@ extern "C" {
 
 #include "lexbor/grammar/base.h"
 #include "lexbor/grammar/token.h"
+#include "lexbor/grammar/type.h"
 
 #include "lexbor/core/bst_map.h"
 
 
+/*
+ * Serializers of many nodes collect the output and call the callback
+ * with blocks up to this size.
+ */
+#define LXB_GRAMMAR_NODE_SERIALIZE_BUFFER 4096
+
+
 typedef enum {
     LXB_GRAMMAR_NODE_UNDEF = 0x00,
     LXB_GRAMMAR_NODE_ROOT,
@@ -24,7 +32,7 @@ typedef enum {
     /* For [...] */
     LXB_GRAMMAR_NODE_GROUP,
 
-    /* In node->u.node */
+    /* In node->u.element */
     LXB_GRAMMAR_NODE_DECLARATION,
     LXB_GRAMMAR_NODE_ELEMENT,
 
@@ -53,7 +61,7 @@ struct lxb_grammar_node {
     union lxb_grammar_node_u {
         double         num;
         lexbor_str_t   str;
-        lxb_dom_node_t *node;
+        lxb_grammar_element_t *element;
     }
     u;
 
@@ -63,6 +71,11 @@ struct lxb_grammar_node {
     lxb_grammar_period_t     multiplier;
     bool                     is_comma_separated;
 
+    /* Set by lxb_grammar_tree_make(). */
+    size_t                   id;
+    size_t                   keyword_id;  /* For LXB_GRAMMAR_NODE_UNQUOTED. */
+    lxb_grammar_type_id_t    type_id;     /* For not linked ELEMENT. */
+
     lxb_grammar_token_t      *token;
     lxb_grammar_document_t   *document;
 
@@ -74,6 +87,10 @@ struct lxb_grammar_node {
 };
 
 
+/* Zeroed, only node->document is set. */
+LXB_API lxb_grammar_node_t *
+lxb_grammar_node_alloc(lxb_grammar_document_t *document);
+
 LXB_API lxb_grammar_node_t *
 lxb_grammar_node_create(lxb_grammar_parser_t *parser, lxb_grammar_token_t *token,
                         lxb_grammar_node_type_t type);
@@ -101,14 +118,81 @@ LXB_API lxb_status_t
 lxb_grammar_node_serialize_deep(lxb_grammar_node_t *root,
                                 lxb_grammar_serialize_cb_f func, void *ctx);
 
+/* Appends to the string, it is initialized if str->data is NULL. */
+LXB_API lxb_status_t
+lxb_grammar_node_serialize_deep_str(lxb_grammar_node_t *root,
+                                    lexbor_str_t *str, lexbor_mraw_t *mraw);
+
+/*
+ * Two passes for exactly one buffer: the length of the output, then the
+ * output into a buffer of the length.  The data is not terminated, it is
+ * LXB_STATUS_ERROR_SMALL_BUFFER if it is shorter than the output.
+ */
+LXB_API lxb_status_t
+lxb_grammar_node_serialize_deep_length(lxb_grammar_node_t *root,
+                                       size_t *length);
+
+LXB_API lxb_status_t
+lxb_grammar_node_serialize_deep_data(lxb_grammar_node_t *root,
+                                     lxb_char_t *data, size_t size,
+                                     size_t *length);
+
+/* Both passes, one lexbor_malloc() of length + 1 for the 0x00 at the end. */
+LXB_API lxb_char_t *
+lxb_grammar_node_serialize_deep_dup(lxb_grammar_node_t *root, size_t *length);
+
 LXB_API lxb_status_t
 lxb_grammar_node_serialize(lxb_grammar_node_t *node,
                            lxb_grammar_serialize_cb_f func, void *ctx);
 
+/* The node with all descendants, without siblings. */
+LXB_API lxb_status_t
+lxb_grammar_node_serialize_branch(lxb_grammar_node_t *node,
+                                  lxb_grammar_serialize_cb_f func, void *ctx);
+
 LXB_API lxb_status_t
 lxb_grammar_node_serialize_ast(lxb_grammar_node_t *root,
                                lxb_grammar_serialize_cb_f func, void *ctx);
 
+LXB_API lxb_status_t
+lxb_grammar_node_serialize_ast_str(lxb_grammar_node_t *root,
+                                   lexbor_str_t *str, lexbor_mraw_t *mraw);
+
+/*
+ * Inline functions
+ */
+lxb_inline long
+lxb_grammar_node_repeat_min(const lxb_grammar_node_t *node)
+{
+    if (node->multiplier.start == -1) {
+        return 1;
+    }
+
+    return node->multiplier.start;
+}
+
+/* -1 == infiniti */
+lxb_inline long
+lxb_grammar_node_repeat_max(const lxb_grammar_node_t *node)
+{
+    if (node->multiplier.start == -1) {
+        return 1;
+    }
+
+    /* The "!" multiplier: once, but must not be empty. */
+    if (node->multiplier.start == 1 && node->multiplier.stop == 0) {
+        return 1;
+    }
+
+    return node->multiplier.stop;
+}
+
+lxb_inline bool
+lxb_grammar_node_is_required(const lxb_grammar_node_t *node)
+{
+    return node->multiplier.start == 1 && node->multiplier.stop == 0;
+}
+
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -6,6 +6,8 @@
 
 #include "lexbor/grammar/parser.h"
 #include "lexbor/grammar/node.h"
+#include "lexbor/grammar/memory.h"
+#include "lexbor/grammar/stats.h"
 
 #include "lexbor/core/utils.h"
 
@@ -46,7 +48,7 @@ lxb_grammar_parser_state_declaration_mod(lxb_grammar_parser_t *parser,
 lxb_inline lxb_grammar_token_t *
 lxb_grammar_parser_current_token(lxb_grammar_parser_t *parser)
 {
-    lexbor_array_t *tokens = parser->document->dom_document.user;
+    lexbor_array_t *tokens = &parser->document->tokens;
 
     if (parser->cur_token_id >= (tokens->length - 1)) {
         return NULL;
@@ -58,7 +60,7 @@ lxb_grammar_parser_current_token(lxb_grammar_parser_t *parser)
 lxb_inline lxb_grammar_token_t *
 lxb_grammar_parser_next_token(lxb_grammar_parser_t *parser)
 {
-    lexbor_array_t *tokens = parser->document->dom_document.user;
+    lexbor_array_t *tokens = &parser->document->tokens;
 
     if (parser->cur_token_id >= (tokens->length - 1)) {
         return NULL;
@@ -69,9 +71,30 @@ lxb_grammar_parser_next_token(lxb_grammar_parser_t *parser)
     return tokens->list[ parser->cur_token_id ];
 }
 
+/* A line break inside of brackets does not end the declaration. */
+lxb_inline bool
+lxb_grammar_parser_in_brackets(lxb_grammar_parser_t *parser)
+{
+    lxb_grammar_node_t *node;
+
+    for (node = parser->group; node != NULL; node = node->parent) {
+        if (node->type == LXB_GRAMMAR_NODE_DECLARATION) {
+            return false;
+        }
+
+        if (node->token != NULL) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 lxb_inline void
 lxb_grammar_parser_dec_token(lxb_grammar_parser_t *parser, size_t count)
 {
+    lxb_grammar_stats_inc(parser->stats, backtracks);
+
     if ((parser->cur_token_id - count) <= 0) {
         parser->cur_token_id = 0;
     }
@@ -79,6 +102,26 @@ lxb_grammar_parser_dec_token(lxb_grammar_parser_t *parser, size_t count)
     parser->cur_token_id -= count;
 }
 
+#ifdef LXB_GRAMMAR_STATS
+/* Groups of [ ] have a token, groups made by combinators do not. */
+static void
+lxb_grammar_parser_stats_depth(lxb_grammar_parser_t *parser)
+{
+    size_t depth = 0;
+    lxb_grammar_node_t *node;
+
+    for (node = parser->group; node != NULL; node = node->parent) {
+        if (node->type == LXB_GRAMMAR_NODE_GROUP && node->token != NULL) {
+            depth++;
+        }
+    }
+
+    if (depth > parser->stats->max_depth) {
+        parser->stats->max_depth = depth;
+    }
+}
+#endif
+
 lxb_grammar_parser_t *
 lxb_grammar_parser_create(void)
 {
@@ -92,13 +135,22 @@ lxb_grammar_parser_init(lxb_grammar_parser_t *parser)
         return LXB_STATUS_ERROR_OBJECT_IS_NULL;
     }
 
+    parser->slab = true;
+    parser->stats = NULL;
+
     return LXB_STATUS_OK;
 }
 
 void
 lxb_grammar_parser_clean(lxb_grammar_parser_t *parser)
 {
+    bool slab = parser->slab;
+    lxb_grammar_stats_t *stats = parser->stats;
+
     memset(parser, 0, sizeof(lxb_grammar_parser_t));
+
+    parser->slab = slab;
+    parser->stats = stats;
 }
 
 lxb_grammar_parser_t *
@@ -123,14 +175,28 @@ lxb_grammar_parser_process(lxb_grammar_parser_t *parser,
     lxb_grammar_token_t *token;
 
     parser->document = document;
+    parser->last_token = NULL;
+    parser->last_error = NULL;
+
+    if (parser->slab) {
+        parser->status = lxb_grammar_document_node_slab(document);
+    }
+    else {
+        parser->status = lxb_grammar_document_node_mraw(document);
+    }
+
+    if (parser->status != LXB_STATUS_OK) {
+        parser->last_error = "Nodes of the document are in another allocator.";
+        return NULL;
+    }
 
     parser->root = lxb_grammar_node_create(parser, NULL, LXB_GRAMMAR_NODE_ROOT);
     if (parser->root == NULL) {
+        parser->status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
         return NULL;
     }
 
-    parser->last_token = NULL;
-    parser->last_error = NULL;
+    parser->cur_token_id = 0;
 
     parser->state = lxb_grammar_parser_state_begin;
 
@@ -139,10 +205,13 @@ lxb_grammar_parser_process(lxb_grammar_parser_t *parser,
     {
         status = parser->state(parser, token);
         if (status != LXB_STATUS_OK) {
+            parser->status = status;
             return NULL;
         }
     }
 
+    lxb_grammar_memory_peak(document, NULL, NULL);
+
     return parser->root;
 }
 
@@ -242,6 +311,8 @@ lxb_grammar_parser_rebuild_groups(lxb_grammar_parser_t *parser,
 {
     lxb_grammar_node_t *node, *group;
 
+    lxb_grammar_stats_inc(parser->stats, rebuild_groups);
+
     if (parser->group->first_child == parser->group->last_child) {
         parser->group->combinator = combinator;
 
@@ -267,6 +338,8 @@ lxb_grammar_parser_rebuild_groups(lxb_grammar_parser_t *parser,
             lxb_grammar_node_remove(node);
             lxb_grammar_node_insert_child(group, node);
 
+            lxb_grammar_stats_inc(parser->stats, moved_nodes);
+
             node = parser->group->first_child;
         }
         while (node != NULL);
@@ -289,6 +362,8 @@ lxb_grammar_parser_rebuild_groups(lxb_grammar_parser_t *parser,
     lxb_grammar_node_insert_child(group, node);
     lxb_grammar_node_insert_child(parser->group, group);
 
+    lxb_grammar_stats_inc(parser->stats, moved_nodes);
+
     parser->group = group;
     parser->node = group;
 
@@ -312,6 +387,12 @@ lxb_grammar_parser_state_declaration(lxb_grammar_parser_t *parser,
             lxb_grammar_node_insert_child(parser->group, parser->node);
             parser->group = parser->node;
 
+#ifdef LXB_GRAMMAR_STATS
+            if (parser->stats != NULL) {
+                lxb_grammar_parser_stats_depth(parser);
+            }
+#endif
+
             parser->state = lxb_grammar_parser_state_ws;
 
             break;
@@ -425,10 +506,10 @@ lxb_grammar_parser_state_combinator(lxb_grammar_parser_t *parser,
         case LXB_GRAMMAR_TOKEN_WHITESPACE:
             data = token->u.str.data + (token->u.str.length - 1);
 
-            if (*data == '\n' || *data == '\r') {
+            if ((*data == '\n' || *data == '\r')
+                && !lxb_grammar_parser_in_brackets(parser))
+            {
                 parser->state = lxb_grammar_parser_state_begin;
-
-                return LXB_STATUS_OK;
             }
 
             return LXB_STATUS_OK;
@@ -506,23 +587,17 @@ lxb_grammar_parser_state_combinator(lxb_grammar_parser_t *parser,
     return LXB_STATUS_OK;
 }
 
+/*
+ * After a combinator or the left bracket the declaration goes on,
+ * even on the next line.
+ */
 static lxb_status_t
 lxb_grammar_parser_state_ws(lxb_grammar_parser_t *parser,
                             lxb_grammar_token_t *token)
 {
-    lxb_char_t *data;
-
     parser->state = lxb_grammar_parser_state_declaration;
 
     if (token->type == LXB_GRAMMAR_TOKEN_WHITESPACE) {
-        data = token->u.str.data + (token->u.str.length - 1);
-
-        if (*data == '\n' || *data == '\r') {
-            parser->state = lxb_grammar_parser_state_begin;
-
-            return LXB_STATUS_OK;
-        }
-
         return LXB_STATUS_OK;
     }
 
@@ -14,8 +14,6 @@ extern "C" {
 #include "lexbor/grammar/base.h"
 #include "lexbor/grammar/node.h"
 
-#include "lexbor/html/interfaces/document.h"
-
 
 typedef lxb_status_t
 (*lxb_grammar_parser_state_f)(lxb_grammar_parser_t *parser,
@@ -34,6 +32,11 @@ struct lxb_grammar_parser {
 
     lxb_grammar_token_t        *last_token;
     const char                 *last_error;
+    lxb_status_t               status;
+
+    /* Settings, may be changed after init. */
+    bool                       slab;  /* lxb_grammar_document_node_slab() */
+    lxb_grammar_stats_t        *stats;  /* See lexbor/grammar/stats.h. */
 };
 
 
@@ -63,7 +66,7 @@ lxb_grammar_parser_print_last_error(lxb_grammar_parser_t *parser);
 lxb_inline lexbor_array_t *
 lxb_grammar_parser_tokens(lxb_grammar_parser_t *parser)
 {
-    return parser->document->dom_document.user;
+    return &parser->document->tokens;
 }
 
 
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/phash.h"
+
+
+#define LXB_GRAMMAR_PHASH_NONE UINT32_MAX
+
+
+static bool
+lxb_grammar_phash_place(const lexbor_str_t *keys, size_t length,
+                        const uint32_t *next, uint32_t first, uint32_t disp,
+                        uint32_t *slots);
+
+
+/*
+ * Buckets with more keys are placed first, while the table is empty.
+ * A displacement is searched for each bucket so that all its keys fall
+ * into free slots.
+ */
+lxb_status_t
+lxb_grammar_phash_make(const lexbor_str_t *keys, size_t length,
+                       uint32_t *table)
+{
+    size_t buckets, max;
+    uint32_t idx, disp, *next, *first, *count, *slots;
+    lxb_status_t status;
+
+    buckets = lxb_grammar_phash_buckets(length);
+    slots = table + buckets;
+
+    memset(table, 0, sizeof(uint32_t) * buckets);
+
+    if (length == 0) {
+        return LXB_STATUS_OK;
+    }
+
+    if (length >= LXB_GRAMMAR_PHASH_NONE) {
+        return LXB_STATUS_ERROR_OVERFLOW;
+    }
+
+    next = lexbor_malloc(sizeof(uint32_t) * (length + buckets * 2));
+    if (next == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    first = next + length;
+    count = first + buckets;
+
+    for (size_t i = 0; i < buckets; i++) {
+        first[i] = LXB_GRAMMAR_PHASH_NONE;
+        count[i] = 0;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        slots[i] = LXB_GRAMMAR_PHASH_NONE;
+    }
+
+    max = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        idx = lxb_grammar_phash_hash(keys[i].data, keys[i].length, 0)
+              % buckets;
+
+        next[i] = first[idx];
+        first[idx] = (uint32_t) i;
+
+        if (++count[idx] > max) {
+            max = count[idx];
+        }
+    }
+
+    status = LXB_STATUS_OK;
+
+    for (; max != 0; max--) {
+        for (size_t i = 0; i < buckets; i++) {
+            if (count[i] != max) {
+                continue;
+            }
+
+            for (disp = 1; disp < LXB_GRAMMAR_PHASH_TRIES; disp++) {
+                if (lxb_grammar_phash_place(keys, length, next, first[i],
+                                            disp, slots))
+                {
+                    break;
+                }
+            }
+
+            if (disp == LXB_GRAMMAR_PHASH_TRIES) {
+                status = LXB_STATUS_ERROR;
+                goto done;
+            }
+
+            table[i] = disp;
+        }
+    }
+
+done:
+
+    lexbor_free(next);
+
+    return status;
+}
+
+static bool
+lxb_grammar_phash_place(const lexbor_str_t *keys, size_t length,
+                        const uint32_t *next, uint32_t first, uint32_t disp,
+                        uint32_t *slots)
+{
+    size_t slot;
+    uint32_t idx, undo;
+
+    for (idx = first; idx != LXB_GRAMMAR_PHASH_NONE; idx = next[idx]) {
+        slot = lxb_grammar_phash_hash(keys[idx].data, keys[idx].length, disp)
+               % length;
+
+        if (slots[slot] != LXB_GRAMMAR_PHASH_NONE) {
+            goto failed;
+        }
+
+        slots[slot] = idx;
+    }
+
+    return true;
+
+failed:
+
+    for (undo = first; undo != idx; undo = next[undo]) {
+        slot = lxb_grammar_phash_hash(keys[undo].data, keys[undo].length, disp)
+               % length;
+
+        slots[slot] = LXB_GRAMMAR_PHASH_NONE;
+    }
+
+    return false;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_PHASH_H
+#define LEXBOR_GRAMMAR_PHASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+
+#include "lexbor/core/str.h"
+
+
+/*
+ * Minimal perfect hash of keywords (hash and displace).
+ *
+ * Table of uint32_t: displacements of buckets, then index of a key
+ * for each slot.  Any data is mapped to some slot, the caller compares
+ * the key of the slot with the data.
+ */
+
+/* Keys per bucket, on average. */
+#define LXB_GRAMMAR_PHASH_LOAD 2
+
+/* Limit of displacement search for one bucket. */
+#define LXB_GRAMMAR_PHASH_TRIES 0x100000
+
+
+/* Keys must be unique and lowercase. */
+LXB_API lxb_status_t
+lxb_grammar_phash_make(const lexbor_str_t *keys, size_t length,
+                       uint32_t *table);
+
+
+/*
+ * Inline functions
+ */
+lxb_inline size_t
+lxb_grammar_phash_buckets(size_t length)
+{
+    return length / LXB_GRAMMAR_PHASH_LOAD + 1;
+}
+
+/* Entries in the table for the number of keys. */
+lxb_inline size_t
+lxb_grammar_phash_size(size_t length)
+{
+    return lxb_grammar_phash_buckets(length) + length;
+}
+
+lxb_inline uint32_t
+lxb_grammar_phash_hash(const lxb_char_t *data, size_t len, uint32_t seed)
+{
+    uint32_t hash;
+
+    hash = 0x811c9dc5 ^ (seed * 0x9e3779b9);
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 0x01000193;
+    }
+
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+
+    return hash;
+}
+
+/* Index of the key to compare with, or length if the table is empty. */
+lxb_inline size_t
+lxb_grammar_phash_find(const uint32_t *table, size_t length,
+                       const lxb_char_t *data, size_t len)
+{
+    size_t buckets;
+    uint32_t disp;
+
+    if (length == 0) {
+        return 0;
+    }
+
+    buckets = lxb_grammar_phash_buckets(length);
+    disp = table[lxb_grammar_phash_hash(data, len, 0) % buckets];
+
+    return table[buckets + lxb_grammar_phash_hash(data, len, disp) % length];
+}
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_PHASH_H */
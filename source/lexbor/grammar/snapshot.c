@@ -0,0 +1,633 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/snapshot.h"
+
+#include "lexbor/core/bst_map.h"
+#include "lexbor/core/array_obj.h"
+
+#include <stdio.h>
+
+
+/* A count fits the long of the node and the 32 bits of the bytecode. */
+#define LXB_GRAMMAR_SNAPSHOT_COUNT_MAX INT32_MAX
+
+
+typedef struct {
+    lexbor_array_obj_t nodes;
+    lexbor_array_obj_t attrs;
+
+    /* Interned strings: value of an entry is offset + 1. */
+    lexbor_bst_map_t   *map;
+    lexbor_bst_entry_t *scope;
+    lexbor_str_t       strings;
+    lexbor_mraw_t      *mraw;
+}
+lxb_grammar_snapshot_ctx_t;
+
+
+static lxb_status_t
+lxb_grammar_snapshot_collect(lxb_grammar_snapshot_ctx_t *sc,
+                             lxb_grammar_node_t *root);
+
+static lxb_grammar_node_t *
+lxb_grammar_snapshot_node(lxb_grammar_document_t *document,
+                          const lxb_grammar_snapshot_node_t *rec,
+                          const lxb_grammar_snapshot_attr_t **attrs,
+                          const lxb_grammar_snapshot_attr_t *attrs_end,
+                          const lxb_char_t *strings, size_t length);
+
+static bool
+lxb_grammar_snapshot_multiplier(const lxb_grammar_snapshot_node_t *rec);
+
+
+lxb_status_t
+lxb_grammar_snapshot_serialize(lxb_grammar_node_t *root,
+                               lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    lxb_status_t status;
+    lxb_grammar_snapshot_ctx_t sc;
+    lxb_grammar_snapshot_header_t hdr;
+
+    if (root == NULL || root->type != LXB_GRAMMAR_NODE_ROOT) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    memset(&sc, 0, sizeof(lxb_grammar_snapshot_ctx_t));
+
+    status = lexbor_array_obj_init(&sc.nodes, 1024,
+                                   sizeof(lxb_grammar_snapshot_node_t));
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    status = lexbor_array_obj_init(&sc.attrs, 64,
+                                   sizeof(lxb_grammar_snapshot_attr_t));
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    sc.map = lexbor_bst_map_create();
+    status = lexbor_bst_map_init(sc.map, 128);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    sc.mraw = lexbor_mraw_create();
+    status = lexbor_mraw_init(sc.mraw, 4096);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    if (lexbor_str_init(&sc.strings, sc.mraw, 1024) == NULL) {
+        status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        goto done;
+    }
+
+    status = lxb_grammar_snapshot_collect(&sc, root);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    memset(&hdr, 0, sizeof(lxb_grammar_snapshot_header_t));
+
+    memcpy(hdr.magic, LXB_GRAMMAR_SNAPSHOT_MAGIC, sizeof(hdr.magic));
+
+    hdr.version = LXB_GRAMMAR_SNAPSHOT_VERSION;
+    hdr.byte_order = LXB_GRAMMAR_SNAPSHOT_BYTE_ORDER;
+    hdr.nodes = sc.nodes.length;
+    hdr.attributes = sc.attrs.length;
+    hdr.strings = sc.strings.length;
+
+    status = func((const lxb_char_t *) &hdr,
+                  sizeof(lxb_grammar_snapshot_header_t), ctx);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    status = func(sc.nodes.list,
+                  sc.nodes.length * sizeof(lxb_grammar_snapshot_node_t), ctx);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    if (sc.attrs.length != 0) {
+        status = func(sc.attrs.list,
+                      sc.attrs.length * sizeof(lxb_grammar_snapshot_attr_t),
+                      ctx);
+        if (status != LXB_STATUS_OK) {
+            goto done;
+        }
+    }
+
+    if (sc.strings.length != 0) {
+        status = func(sc.strings.data, sc.strings.length, ctx);
+    }
+
+done:
+
+    lexbor_array_obj_destroy(&sc.nodes, false);
+    lexbor_array_obj_destroy(&sc.attrs, false);
+    lexbor_bst_map_destroy(sc.map, true);
+    lexbor_mraw_destroy(sc.mraw, true);
+
+    return status;
+}
+
+static lxb_status_t
+lxb_grammar_snapshot_intern(lxb_grammar_snapshot_ctx_t *sc,
+                            const lxb_char_t *data, size_t length,
+                            lxb_grammar_snapshot_str_t *str)
+{
+    size_t offset;
+    lexbor_bst_map_entry_t *entry;
+
+    if (data == NULL) {
+        str->offset = LXB_GRAMMAR_SNAPSHOT_NO_STR;
+        str->length = 0;
+
+        return LXB_STATUS_OK;
+    }
+
+    entry = lexbor_bst_map_insert_not_exists(sc->map, &sc->scope,
+                                             data, length);
+    if (entry == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    if (entry->value == NULL) {
+        offset = sc->strings.length;
+
+        if (offset + length + 1 >= LXB_GRAMMAR_SNAPSHOT_NO_STR) {
+            return LXB_STATUS_ERROR_OVERFLOW;
+        }
+
+        if (lexbor_str_append(&sc->strings, sc->mraw, data, length) == NULL
+            || lexbor_str_append_one(&sc->strings, sc->mraw, 0x00) == NULL)
+        {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        entry->value = (void *) (uintptr_t) (offset + 1);
+    }
+
+    str->offset = (uint32_t) ((uintptr_t) entry->value - 1);
+    str->length = (uint32_t) length;
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_snapshot_element(lxb_grammar_snapshot_ctx_t *sc,
+                             lxb_grammar_element_t *element,
+                             lxb_grammar_snapshot_node_t *rec)
+{
+    size_t length;
+    lxb_status_t status;
+    const lxb_char_t *name, *value;
+    lxb_grammar_snapshot_attr_t *entry;
+
+    name = lxb_grammar_element_name(element, &length);
+
+    status = lxb_grammar_snapshot_intern(sc, name, length, &rec->u.str);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    for (size_t i = 0; i < element->length; i++) {
+        entry = lexbor_array_obj_push(&sc->attrs);
+        if (entry == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        name = lxb_grammar_element_attr_name(element, i, &length);
+
+        status = lxb_grammar_snapshot_intern(sc, name, length, &entry->name);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        value = lxb_grammar_element_attr_value(element, i, &length);
+
+        status = lxb_grammar_snapshot_intern(sc, value, length, &entry->value);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+    }
+
+    rec->attributes = element->length;
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_snapshot_collect(lxb_grammar_snapshot_ctx_t *sc,
+                             lxb_grammar_node_t *root)
+{
+    lxb_status_t status;
+    lxb_grammar_node_t *node, *child;
+    lxb_grammar_snapshot_node_t *rec;
+
+    node = root;
+
+    for (;;) {
+        rec = lexbor_array_obj_push(&sc->nodes);
+        if (rec == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        memset(rec, 0, sizeof(lxb_grammar_snapshot_node_t));
+
+        rec->type = (uint8_t) node->type;
+        rec->combinator = (uint8_t) node->combinator;
+        rec->is_comma_separated = node->is_comma_separated;
+        rec->start = node->multiplier.start;
+        rec->stop = node->multiplier.stop;
+
+        for (child = node->first_child; child != NULL; child = child->next) {
+            rec->children++;
+        }
+
+        switch (node->type) {
+            case LXB_GRAMMAR_NODE_DECLARATION:
+            case LXB_GRAMMAR_NODE_ELEMENT:
+                status = lxb_grammar_snapshot_element(sc, node->u.element, rec);
+                break;
+
+            case LXB_GRAMMAR_NODE_NUMBER:
+                rec->u.num = node->u.num;
+                status = LXB_STATUS_OK;
+                break;
+
+            case LXB_GRAMMAR_NODE_STRING:
+            case LXB_GRAMMAR_NODE_WHITESPACE:
+            case LXB_GRAMMAR_NODE_DELIM:
+            case LXB_GRAMMAR_NODE_UNQUOTED:
+                status = lxb_grammar_snapshot_intern(sc, node->u.str.data,
+                                                     node->u.str.length,
+                                                     &rec->u.str);
+                break;
+
+            default:
+                status = LXB_STATUS_OK;
+                break;
+        }
+
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        /* Pre-order, without siblings of the root. */
+        if (node->first_child != NULL) {
+            node = node->first_child;
+            continue;
+        }
+
+        while (node != root && node->next == NULL) {
+            node = node->parent;
+        }
+
+        if (node == root) {
+            return LXB_STATUS_OK;
+        }
+
+        node = node->next;
+    }
+}
+
+static lxb_status_t
+lxb_grammar_snapshot_file_cb(const lxb_char_t *data, size_t len, void *ctx)
+{
+    if (fwrite(data, 1, len, ctx) != len) {
+        return LXB_STATUS_ERROR;
+    }
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_snapshot_save(lxb_grammar_node_t *root, const lxb_char_t *path)
+{
+    FILE *fh;
+    lxb_status_t status;
+
+    fh = fopen((const char *) path, "wb");
+    if (fh == NULL) {
+        return LXB_STATUS_ERROR;
+    }
+
+    status = lxb_grammar_snapshot_serialize(root, lxb_grammar_snapshot_file_cb,
+                                            fh);
+
+    if (fclose(fh) != 0 && status == LXB_STATUS_OK) {
+        status = LXB_STATUS_ERROR;
+    }
+
+    return status;
+}
+
+lxb_status_t
+lxb_grammar_snapshot_load(const lxb_char_t *data, size_t size,
+                          lxb_grammar_node_t **root)
+{
+    size_t depth;
+    size_t *left;
+    lxb_status_t status;
+    lxb_char_t *strings;
+    lxb_grammar_node_t *node, **stack;
+    lxb_grammar_document_t *document;
+    lxb_grammar_snapshot_node_t rec;
+    lxb_grammar_snapshot_header_t hdr;
+    const lxb_char_t *nodes;
+    const lxb_grammar_snapshot_attr_t *attrs, *attrs_end;
+
+    if (root == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    *root = NULL;
+
+    if (data == NULL || size < sizeof(lxb_grammar_snapshot_header_t)) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    memcpy(&hdr, data, sizeof(lxb_grammar_snapshot_header_t));
+
+    if (memcmp(hdr.magic, LXB_GRAMMAR_SNAPSHOT_MAGIC, sizeof(hdr.magic)) != 0
+        || hdr.version != LXB_GRAMMAR_SNAPSHOT_VERSION
+        || hdr.byte_order != LXB_GRAMMAR_SNAPSHOT_BYTE_ORDER)
+    {
+        return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+    }
+
+    size -= sizeof(lxb_grammar_snapshot_header_t);
+
+    if (hdr.nodes == 0
+        || hdr.nodes > size / sizeof(lxb_grammar_snapshot_node_t))
+    {
+        return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+    }
+
+    size -= hdr.nodes * sizeof(lxb_grammar_snapshot_node_t);
+
+    if (hdr.attributes > size / sizeof(lxb_grammar_snapshot_attr_t)) {
+        return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+    }
+
+    size -= hdr.attributes * sizeof(lxb_grammar_snapshot_attr_t);
+
+    if (hdr.strings != size) {
+        return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+    }
+
+    nodes = data + sizeof(lxb_grammar_snapshot_header_t);
+    attrs = (const lxb_grammar_snapshot_attr_t *)
+            (nodes + hdr.nodes * sizeof(lxb_grammar_snapshot_node_t));
+    attrs_end = attrs + hdr.attributes;
+
+    document = lxb_grammar_document_create();
+    status = lxb_grammar_document_init(document);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    status = lxb_grammar_document_node_slab(document);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+
+    /* Strings of the nodes point here, one copy for all. */
+    strings = lexbor_mraw_alloc(document->text, hdr.strings + 1);
+    if (strings == NULL) {
+        goto failed;
+    }
+
+    memcpy(strings, attrs_end, hdr.strings);
+    strings[hdr.strings] = 0x00;
+
+    /* Parents with the count of children still to come. */
+    stack = lexbor_malloc(hdr.nodes * (sizeof(lxb_grammar_node_t *)
+                                       + sizeof(size_t)));
+    if (stack == NULL) {
+        goto failed;
+    }
+
+    left = (size_t *) (stack + hdr.nodes);
+    depth = 0;
+
+    status = LXB_STATUS_ERROR_UNEXPECTED_DATA;
+
+    for (size_t i = 0; i < hdr.nodes; i++) {
+        memcpy(&rec, nodes, sizeof(lxb_grammar_snapshot_node_t));
+        nodes += sizeof(lxb_grammar_snapshot_node_t);
+
+        if ((i == 0) != (rec.type == LXB_GRAMMAR_NODE_ROOT)
+            || (i != 0 && depth == 0))
+        {
+            goto bad;
+        }
+
+        node = lxb_grammar_snapshot_node(document, &rec, &attrs, attrs_end,
+                                         strings, hdr.strings);
+        if (node == NULL) {
+            goto bad;
+        }
+
+        if (i == 0) {
+            *root = node;
+        }
+        else {
+            lxb_grammar_node_insert_child(stack[depth - 1], node);
+            left[depth - 1]--;
+        }
+
+        if (rec.children != 0) {
+            stack[depth] = node;
+            left[depth] = rec.children;
+            depth++;
+        }
+        else {
+            while (depth != 0 && left[depth - 1] == 0) {
+                depth--;
+            }
+        }
+    }
+
+    lexbor_free(stack);
+
+    if (depth != 0 || attrs != attrs_end) {
+        goto failed;
+    }
+
+    return LXB_STATUS_OK;
+
+bad:
+
+    lexbor_free(stack);
+
+failed:
+
+    *root = NULL;
+
+    (void) lxb_grammar_document_destroy(document);
+
+    return status;
+}
+
+lxb_inline const lxb_char_t *
+lxb_grammar_snapshot_str(const lxb_grammar_snapshot_str_t *str,
+                         const lxb_char_t *strings, size_t length)
+{
+    if (str->offset == LXB_GRAMMAR_SNAPSHOT_NO_STR
+        || str->offset > length || str->length > length - str->offset)
+    {
+        return NULL;
+    }
+
+    return strings + str->offset;
+}
+
+/* Interned by the document. */
+static bool
+lxb_grammar_snapshot_id(lxb_grammar_document_t *document,
+                        const lxb_grammar_snapshot_str_t *str,
+                        const lxb_char_t *strings, size_t length, uint32_t *id)
+{
+    const lxb_char_t *data;
+
+    data = lxb_grammar_snapshot_str(str, strings, length);
+    if (data == NULL) {
+        return false;
+    }
+
+    return lxb_grammar_document_intern(document, data, str->length,
+                                       id) == LXB_STATUS_OK;
+}
+
+static lxb_grammar_node_t *
+lxb_grammar_snapshot_node(lxb_grammar_document_t *document,
+                          const lxb_grammar_snapshot_node_t *rec,
+                          const lxb_grammar_snapshot_attr_t **attrs,
+                          const lxb_grammar_snapshot_attr_t *attrs_end,
+                          const lxb_char_t *strings, size_t length)
+{
+    const lxb_char_t *str;
+    lxb_grammar_node_t *node;
+    lxb_grammar_element_t *element;
+    lxb_grammar_element_attr_t *entry;
+    lxb_grammar_snapshot_attr_t attr;
+
+    if (rec->type > LXB_GRAMMAR_NODE_UNQUOTED
+        || rec->combinator > LXB_GRAMMAR_COMBINATOR_ONE_OF
+        || !lxb_grammar_snapshot_multiplier(rec))
+    {
+        return NULL;
+    }
+
+    node = lxb_grammar_node_alloc(document);
+    if (node == NULL) {
+        return NULL;
+    }
+
+    node->type = rec->type;
+    node->combinator = rec->combinator;
+    node->is_comma_separated = rec->is_comma_separated != 0;
+    node->multiplier.start = (long) rec->start;
+    node->multiplier.stop = (long) rec->stop;
+
+    switch (node->type) {
+        case LXB_GRAMMAR_NODE_DECLARATION:
+        case LXB_GRAMMAR_NODE_ELEMENT:
+            str = lxb_grammar_snapshot_str(&rec->u.str, strings, length);
+            if (str == NULL
+                || rec->attributes > (size_t) (attrs_end - *attrs))
+            {
+                return NULL;
+            }
+
+            element = lxb_grammar_element_create(document, rec->attributes);
+            if (element == NULL
+                || !lxb_grammar_snapshot_id(document, &rec->u.str, strings,
+                                            length, &element->name))
+            {
+                return NULL;
+            }
+
+            for (uint32_t i = 0; i < rec->attributes; i++) {
+                memcpy(&attr, (*attrs)++, sizeof(lxb_grammar_snapshot_attr_t));
+
+                entry = &element->attrs[i];
+                entry->value = LXB_GRAMMAR_ELEMENT_NO_VALUE;
+
+                if (!lxb_grammar_snapshot_id(document, &attr.name, strings,
+                                             length, &entry->name))
+                {
+                    return NULL;
+                }
+
+                if (attr.value.offset != LXB_GRAMMAR_SNAPSHOT_NO_STR
+                    && !lxb_grammar_snapshot_id(document, &attr.value, strings,
+                                                length, &entry->value))
+                {
+                    return NULL;
+                }
+            }
+
+            node->u.element = element;
+            break;
+
+        case LXB_GRAMMAR_NODE_NUMBER:
+            node->u.num = rec->u.num;
+            break;
+
+        case LXB_GRAMMAR_NODE_STRING:
+        case LXB_GRAMMAR_NODE_WHITESPACE:
+        case LXB_GRAMMAR_NODE_DELIM:
+        case LXB_GRAMMAR_NODE_UNQUOTED:
+            str = lxb_grammar_snapshot_str(&rec->u.str, strings, length);
+            if (str == NULL) {
+                return NULL;
+            }
+
+            node->u.str.data = (lxb_char_t *) str;
+            node->u.str.length = rec->u.str.length;
+            break;
+
+        default:
+            break;
+    }
+
+    return node;
+}
+
+/*
+ * Only what the parser gives: none {-1, 0}, "!" {1, 0}, {m,} as {m, -1}
+ * and {m,n} with m <= n.
+ */
+static bool
+lxb_grammar_snapshot_multiplier(const lxb_grammar_snapshot_node_t *rec)
+{
+    if (rec->start == -1) {
+        return rec->stop == 0;
+    }
+
+    if (rec->start < 0 || rec->start > LXB_GRAMMAR_SNAPSHOT_COUNT_MAX) {
+        return false;
+    }
+
+    if (rec->stop == -1) {
+        return true;
+    }
+
+    if (rec->start == 1 && rec->stop == 0) {
+        return true;
+    }
+
+    return rec->stop >= rec->start
+           && rec->stop <= LXB_GRAMMAR_SNAPSHOT_COUNT_MAX;
+}
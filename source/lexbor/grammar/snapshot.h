@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_SNAPSHOT_H
+#define LEXBOR_GRAMMAR_SNAPSHOT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/node.h"
+
+
+#define LXB_GRAMMAR_SNAPSHOT_MAGIC "LXBGRAST"
+#define LXB_GRAMMAR_SNAPSHOT_VERSION 1
+
+/* Marker of the byte order, written as native uint32_t. */
+#define LXB_GRAMMAR_SNAPSHOT_BYTE_ORDER 0x01020304
+
+/* Not an offset: attribute without a value. */
+#define LXB_GRAMMAR_SNAPSHOT_NO_STR UINT32_MAX
+
+
+/* In the strings of the snapshot, terminated by 0x00. */
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+}
+lxb_grammar_snapshot_str_t;
+
+/*
+ * A node of the AST.  Name of DECLARATION and ELEMENT is in u.str, its
+ * attributes are the next ones in the attributes of the snapshot.
+ */
+typedef struct {
+    uint8_t                    type;        /* lxb_grammar_node_type_t */
+    uint8_t                    combinator;  /* lxb_grammar_combinator_t */
+    uint8_t                    is_comma_separated;
+    uint8_t                    reserved;
+    uint32_t                   children;
+
+    int64_t                    start;
+    int64_t                    stop;
+
+    union {
+        double                     num;
+        lxb_grammar_snapshot_str_t str;
+    }
+    u;
+
+    uint32_t                   attributes;
+    uint32_t                   reserved_2;
+}
+lxb_grammar_snapshot_node_t;
+
+typedef struct {
+    lxb_grammar_snapshot_str_t name;
+    lxb_grammar_snapshot_str_t value;
+}
+lxb_grammar_snapshot_attr_t;
+
+/*
+ * Layout: header, nodes in pre-order, attributes in order of their nodes,
+ * strings.  Each string is once in the strings.
+ */
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+
+    uint64_t nodes;
+    uint64_t attributes;
+    uint64_t strings;      /* Bytes. */
+}
+lxb_grammar_snapshot_header_t;
+
+
+/* Writes the root with all descendants, it is the result of the parser. */
+LXB_API lxb_status_t
+lxb_grammar_snapshot_serialize(lxb_grammar_node_t *root,
+                               lxb_grammar_serialize_cb_f func, void *ctx);
+
+LXB_API lxb_status_t
+lxb_grammar_snapshot_save(lxb_grammar_node_t *root, const lxb_char_t *path);
+
+/*
+ * Builds the AST in a new document, the data is not needed after.
+ * Nodes have no tokens.  Release by
+ * lxb_grammar_document_destroy(root->document).
+ */
+LXB_API lxb_status_t
+lxb_grammar_snapshot_load(const lxb_char_t *data, size_t size,
+                          lxb_grammar_node_t **root);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_SNAPSHOT_H */
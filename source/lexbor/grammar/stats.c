@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/stats.h"
+
+#include "lexbor/core/conv.h"
+
+
+#define lxb_grammar_stats_send(data, len)                                      \
+    do {                                                                       \
+        status = func((const lxb_char_t *) (data), (len), ctx);                \
+        if (status != LXB_STATUS_OK) {                                         \
+            return status;                                                     \
+        }                                                                      \
+    }                                                                          \
+    while (0)
+
+
+static lxb_status_t
+lxb_grammar_stats_line(const lxb_char_t *name, size_t name_len, size_t value,
+                       lxb_grammar_serialize_cb_f func, void *ctx);
+
+
+bool
+lxb_grammar_stats_enabled(void)
+{
+#ifdef LXB_GRAMMAR_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void
+lxb_grammar_stats_clean(lxb_grammar_stats_t *stats)
+{
+    memset(stats, 0, sizeof(lxb_grammar_stats_t));
+}
+
+lxb_status_t
+lxb_grammar_stats_serialize(const lxb_grammar_stats_t *stats,
+                            lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    size_t len;
+    lxb_status_t status;
+    const lxb_char_t *name;
+    lxb_grammar_token_t token;
+
+    static const char *names[] = {
+        "bytes", "char_copies", "nodes", "rebuild_groups", "moved_nodes",
+        "backtracks", "max_depth"
+    };
+
+    const size_t values[] = {
+        stats->bytes, stats->char_copies, stats->nodes, stats->rebuild_groups,
+        stats->moved_nodes, stats->backtracks, stats->max_depth
+    };
+
+    memset(&token, 0, sizeof(lxb_grammar_token_t));
+
+    for (size_t i = 0; i < LXB_GRAMMAR_STATS_TOKEN_TYPES; i++) {
+        token.type = (lxb_grammar_token_type_t) i;
+        name = lxb_grammar_token_name(&token, &len);
+
+        status = lxb_grammar_stats_line(name, len, stats->tokens[i],
+                                        func, ctx);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(values) / sizeof(size_t); i++) {
+        status = lxb_grammar_stats_line((const lxb_char_t *) names[i],
+                                        strlen(names[i]), values[i],
+                                        func, ctx);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_stats_line(const lxb_char_t *name, size_t name_len, size_t value,
+                       lxb_grammar_serialize_cb_f func, void *ctx)
+{
+    size_t len;
+    lxb_status_t status;
+    lxb_char_t buf[128];
+
+    len = lexbor_conv_long_to_data((long) value, buf, sizeof(buf));
+
+    lxb_grammar_stats_send(name, name_len);
+    lxb_grammar_stats_send(": ", 2);
+    lxb_grammar_stats_send(buf, len);
+    lxb_grammar_stats_send("\n", 1);
+
+    return LXB_STATUS_OK;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_STATS_H
+#define LEXBOR_GRAMMAR_STATS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/token.h"
+
+
+#define LXB_GRAMMAR_STATS_TOKEN_TYPES (LXB_GRAMMAR_TOKEN_END_OF_FILE + 1)
+
+/*
+ * Counters are only in a build with LXB_GRAMMAR_STATS defined (CMake option
+ * LEXBOR_GRAMMAR_STATS), without it they are not compiled and the stats stay
+ * zero.
+ */
+#ifdef LXB_GRAMMAR_STATS
+#define lxb_grammar_stats_add(stats, field, value)                             \
+    do {                                                                       \
+        if ((stats) != NULL) {                                                 \
+            (stats)->field += (value);                                         \
+        }                                                                      \
+    }                                                                          \
+    while (0)
+#else
+#define lxb_grammar_stats_add(stats, field, value) do {} while (0)
+#endif
+
+#define lxb_grammar_stats_inc(stats, field)                                    \
+    lxb_grammar_stats_add(stats, field, 1)
+
+
+/*
+ * Counters of the tokenizer and the parser, summed over all runs with
+ * the stats.  See the stats setting of lxb_grammar_tokenizer_t and
+ * lxb_grammar_parser_t.
+ */
+struct lxb_grammar_stats {
+    /* Tokenizer. */
+    size_t tokens[LXB_GRAMMAR_STATS_TOKEN_TYPES];  /* By type. */
+    size_t bytes;           /* Data of the grammar. */
+    size_t char_copies;     /* Calls of lxb_html_parser_char_process(). */
+
+    /* Parser. */
+    size_t nodes;           /* lxb_grammar_node_create() */
+    size_t rebuild_groups;  /* Combinators which rebuild groups. */
+    size_t moved_nodes;     /* Moved to a new group by them. */
+    size_t backtracks;      /* Steps back to a token already seen. */
+    size_t max_depth;       /* Most nesting of [ ]. */
+};
+
+
+/* True if the counters are built, see LXB_GRAMMAR_STATS. */
+LXB_API bool
+lxb_grammar_stats_enabled(void);
+
+LXB_API void
+lxb_grammar_stats_clean(lxb_grammar_stats_t *stats);
+
+/* One counter per line, tokens by name. */
+LXB_API lxb_status_t
+lxb_grammar_stats_serialize(const lxb_grammar_stats_t *stats,
+                            lxb_grammar_serialize_cb_f func, void *ctx);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_STATS_H */
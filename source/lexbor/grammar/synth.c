@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/synth.h"
+
+#include "lexbor/core/conv.h"
+
+
+#define LXB_GRAMMAR_SYNTH_SEED 0x2545F4914F6CDD1DULL
+#define LXB_GRAMMAR_SYNTH_KEYWORDS 64
+
+#define lxb_grammar_synth_send(data, len)                                      \
+    do {                                                                       \
+        status = ctx->func((const lxb_char_t *) (data), (len), ctx->ctx);      \
+        if (status != LXB_STATUS_OK) {                                         \
+            return status;                                                     \
+        }                                                                      \
+    }                                                                          \
+    while (0)
+
+#define lxb_grammar_synth_send_str(str)                                        \
+    lxb_grammar_synth_send((str), sizeof(str) - 1)
+
+
+typedef enum {
+    LXB_GRAMMAR_SYNTH_SEQUENCE = 0,
+    LXB_GRAMMAR_SYNTH_ONE_OF,
+    LXB_GRAMMAR_SYNTH_ANY,
+    LXB_GRAMMAR_SYNTH_ALL
+}
+lxb_grammar_synth_combinator_t;
+
+typedef struct {
+    const lxb_grammar_synth_t  *synth;
+    uint64_t                   state;
+    size_t                     index;      /* Current declaration. */
+    size_t                     multipliers;
+
+    lxb_grammar_serialize_cb_f func;
+    void                       *ctx;
+}
+lxb_grammar_synth_ctx_t;
+
+
+static const char *lxb_grammar_synth_types[] = {
+    "<number>", "<integer>", "<length>", "<percentage>",
+    "<length-percentage>", "<custom-ident>", "<string>", "<time>"
+};
+
+static const char *lxb_grammar_synth_separators[] = {" ", " | ", " || ",
+                                                     " && "};
+
+
+static lxb_status_t
+lxb_grammar_synth_group(lxb_grammar_synth_ctx_t *ctx, size_t depth);
+
+
+void
+lxb_grammar_synth_init(lxb_grammar_synth_t *synth)
+{
+    synth->seed = 1;
+    synth->declarations = 100;
+
+    synth->width = 4;
+    synth->depth = 3;
+    synth->all_size = 3;
+    synth->any_size = 3;
+
+    synth->multiplied = 30;
+    synth->multipliers = "*+?#{";
+
+    synth->references = 20;
+}
+
+lxb_status_t
+lxb_grammar_synth_serialize(const lxb_grammar_synth_t *synth,
+                            lxb_grammar_serialize_cb_f func, void *ctx_data)
+{
+    size_t len;
+    lxb_status_t status;
+    lxb_char_t buf[128];
+    lxb_grammar_synth_ctx_t context, *ctx;
+
+    ctx = &context;
+
+    ctx->synth = synth;
+    ctx->state = synth->seed ^ LXB_GRAMMAR_SYNTH_SEED;
+    ctx->multipliers = (synth->multipliers != NULL)
+                       ? strlen(synth->multipliers) : 0;
+    ctx->func = func;
+    ctx->ctx = ctx_data;
+
+    /* Xorshift stops on zero. */
+    if (ctx->state == 0) {
+        ctx->state = LXB_GRAMMAR_SYNTH_SEED;
+    }
+
+    for (ctx->index = 0; ctx->index < synth->declarations; ctx->index++) {
+        len = lexbor_conv_long_to_data((long) ctx->index, buf, sizeof(buf));
+
+        lxb_grammar_synth_send_str("<d-");
+        lxb_grammar_synth_send(buf, len);
+        lxb_grammar_synth_send_str("> = ");
+
+        status = lxb_grammar_synth_group(ctx, 0);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        lxb_grammar_synth_send_str("\n");
+    }
+
+    return LXB_STATUS_OK;
+}
+
+lxb_inline size_t
+lxb_grammar_synth_random(lxb_grammar_synth_ctx_t *ctx, size_t max)
+{
+    ctx->state ^= ctx->state << 13;
+    ctx->state ^= ctx->state >> 7;
+    ctx->state ^= ctx->state << 17;
+
+    return (max == 0) ? 0 : (size_t) (ctx->state % max);
+}
+
+/* From 2 to max, max is at least 2. */
+lxb_inline size_t
+lxb_grammar_synth_count(lxb_grammar_synth_ctx_t *ctx, size_t max)
+{
+    return 2 + lxb_grammar_synth_random(ctx, max - 1);
+}
+
+static lxb_status_t
+lxb_grammar_synth_multiplier(lxb_grammar_synth_ctx_t *ctx)
+{
+    char mult;
+    size_t len, min;
+    lxb_status_t status;
+    lxb_char_t buf[128];
+
+    if (ctx->multipliers == 0
+        || lxb_grammar_synth_random(ctx, 100) >= ctx->synth->multiplied)
+    {
+        return LXB_STATUS_OK;
+    }
+
+    mult = ctx->synth->multipliers[lxb_grammar_synth_random(ctx,
+                                                            ctx->multipliers)];
+    if (mult != '{') {
+        lxb_grammar_synth_send(&mult, 1);
+
+        return LXB_STATUS_OK;
+    }
+
+    min = lxb_grammar_synth_random(ctx, 3);
+
+    lxb_grammar_synth_send_str("{");
+
+    len = lexbor_conv_long_to_data((long) min, buf, sizeof(buf));
+    lxb_grammar_synth_send(buf, len);
+
+    lxb_grammar_synth_send_str(",");
+
+    len = lexbor_conv_long_to_data((long) (min + 1
+                                           + lxb_grammar_synth_random(ctx, 3)),
+                                   buf, sizeof(buf));
+    lxb_grammar_synth_send(buf, len);
+
+    lxb_grammar_synth_send_str("}");
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_synth_term(lxb_grammar_synth_ctx_t *ctx)
+{
+    size_t len, later, idx;
+    lxb_status_t status;
+    lxb_char_t buf[128];
+    const char *type;
+
+    later = ctx->synth->declarations - ctx->index - 1;
+
+    if (later != 0
+        && lxb_grammar_synth_random(ctx, 100) < ctx->synth->references)
+    {
+        idx = ctx->index + 1 + lxb_grammar_synth_random(ctx, later);
+        len = lexbor_conv_long_to_data((long) idx, buf, sizeof(buf));
+
+        lxb_grammar_synth_send_str("<d-");
+        lxb_grammar_synth_send(buf, len);
+        lxb_grammar_synth_send_str(">");
+    }
+    else if (lxb_grammar_synth_random(ctx, 4) == 0) {
+        idx = lxb_grammar_synth_random(ctx,
+                                       sizeof(lxb_grammar_synth_types)
+                                       / sizeof(lxb_grammar_synth_types[0]));
+        type = lxb_grammar_synth_types[idx];
+
+        lxb_grammar_synth_send(type, strlen(type));
+    }
+    else {
+        idx = lxb_grammar_synth_random(ctx, LXB_GRAMMAR_SYNTH_KEYWORDS);
+        len = lexbor_conv_long_to_data((long) idx, buf, sizeof(buf));
+
+        lxb_grammar_synth_send_str("k-");
+        lxb_grammar_synth_send(buf, len);
+    }
+
+    return lxb_grammar_synth_multiplier(ctx);
+}
+
+/* Children of a group, without brackets. */
+static lxb_status_t
+lxb_grammar_synth_group(lxb_grammar_synth_ctx_t *ctx, size_t depth)
+{
+    size_t count, variants;
+    const char *sep;
+    lxb_status_t status;
+    const lxb_grammar_synth_t *synth = ctx->synth;
+    lxb_grammar_synth_combinator_t list[4], comb;
+
+    variants = 0;
+
+    list[variants++] = LXB_GRAMMAR_SYNTH_SEQUENCE;
+
+    if (synth->width >= 2) {
+        list[variants++] = LXB_GRAMMAR_SYNTH_ONE_OF;
+    }
+
+    if (synth->any_size >= 2) {
+        list[variants++] = LXB_GRAMMAR_SYNTH_ANY;
+    }
+
+    if (synth->all_size >= 2) {
+        list[variants++] = LXB_GRAMMAR_SYNTH_ALL;
+    }
+
+    comb = list[lxb_grammar_synth_random(ctx, variants)];
+
+    switch (comb) {
+        case LXB_GRAMMAR_SYNTH_ONE_OF:
+            count = lxb_grammar_synth_count(ctx, synth->width);
+            break;
+
+        case LXB_GRAMMAR_SYNTH_ANY:
+            count = lxb_grammar_synth_count(ctx, synth->any_size);
+            break;
+
+        case LXB_GRAMMAR_SYNTH_ALL:
+            count = lxb_grammar_synth_count(ctx, synth->all_size);
+            break;
+
+        default:
+            count = 1 + lxb_grammar_synth_random(ctx, synth->width);
+            break;
+    }
+
+    sep = lxb_grammar_synth_separators[comb];
+
+    for (size_t i = 0; i < count; i++) {
+        if (i != 0) {
+            lxb_grammar_synth_send(sep, strlen(sep));
+        }
+
+        if (depth < synth->depth && lxb_grammar_synth_random(ctx, 3) == 0) {
+            lxb_grammar_synth_send_str("[ ");
+
+            status = lxb_grammar_synth_group(ctx, depth + 1);
+            if (status != LXB_STATUS_OK) {
+                return status;
+            }
+
+            lxb_grammar_synth_send_str(" ]");
+
+            status = lxb_grammar_synth_multiplier(ctx);
+        }
+        else {
+            status = lxb_grammar_synth_term(ctx);
+        }
+
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_SYNTH_H
+#define LEXBOR_GRAMMAR_SYNTH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+
+
+/*
+ * Shape of a generated grammar.  The same settings give the same text.
+ *
+ * Declarations are <d-0>, <d-1>...  A declaration refers only to the next
+ * ones, the grammar has no recursion.  Other terms are keywords k-N and
+ * basic data types.
+ */
+typedef struct {
+    uint64_t   seed;
+    size_t     declarations;
+
+    size_t     width;        /* Most children of a sequence and of |. */
+    size_t     depth;        /* Most nesting of [ ]. */
+    size_t     all_size;     /* Most children of &&, less than 2: no &&. */
+    size_t     any_size;     /* Most children of ||, less than 2: no ||. */
+
+    /* Percent of terms and groups with a multiplier. */
+    unsigned   multiplied;
+
+    /*
+     * Mix of multipliers, chars of "*+?#{", '{' is {m,n}.  A char given
+     * many times is used more often.
+     */
+    const char *multipliers;
+
+    /* Percent of terms which refer to a declaration. */
+    unsigned   references;
+}
+lxb_grammar_synth_t;
+
+
+/* Default settings, a grammar of 100 declarations. */
+LXB_API void
+lxb_grammar_synth_init(lxb_grammar_synth_t *synth);
+
+/* One declaration per line. */
+LXB_API lxb_status_t
+lxb_grammar_synth_serialize(const lxb_grammar_synth_t *synth,
+                            lxb_grammar_serialize_cb_f func, void *ctx);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_SYNTH_H */
@@ -8,7 +8,6 @@
 #include "lexbor/grammar/tokenizer.h"
 
 #include "lexbor/core/conv.h"
-#include "lexbor/html/serialize.h"
 
 
 lxb_grammar_token_t *
@@ -16,12 +15,19 @@ lxb_grammar_token_create(lxb_grammar_tokenizer_t *tkz,
                          lxb_grammar_token_type_t type)
 {
     lxb_grammar_token_t *token;
-    lxb_grammar_document_t *document;
 
-    document = tkz->html_parser->tree->document;
+    lxb_grammar_document_t *document = tkz->document;
+
+    if (document->token_slab != NULL) {
+        token = lexbor_dobject_calloc(document->token_slab);
+    }
+    else {
+        /* From now on the slab can not be made, see token_destroy(). */
+        document->tokens_mraw = true;
+
+        token = lexbor_mraw_calloc(document->mraw, sizeof(lxb_grammar_token_t));
+    }
 
-    token = lexbor_mraw_calloc(document->dom_document.mraw,
-                               sizeof(lxb_grammar_token_t));
     if (token == NULL) {
         return NULL;
     }
@@ -35,11 +41,13 @@ lxb_grammar_token_t *
 lxb_grammar_token_destroy(lxb_grammar_tokenizer_t *tkz,
                           lxb_grammar_token_t *token)
 {
-    lxb_grammar_document_t *document;
+    lxb_grammar_document_t *document = tkz->document;
 
-    document = tkz->html_parser->tree->document;
+    if (document->token_slab != NULL) {
+        return lexbor_dobject_free(document->token_slab, token);
+    }
 
-    return lexbor_mraw_free(document->dom_document.mraw, token);
+    return lexbor_mraw_free(document->mraw, token);
 }
 
 lxb_status_t
@@ -57,7 +65,7 @@ lxb_grammar_token_serialize(lxb_grammar_token_t *token,
             return func(token->u.str.data, token->u.str.length, ctx);
 
         case LXB_GRAMMAR_TOKEN_ELEMENT:
-            return lxb_html_serialize_cb(token->u.node, func, ctx);
+            return lxb_grammar_element_serialize(token->u.element, func, ctx);
 
         case LXB_GRAMMAR_TOKEN_EQUALS:
             return func((lxb_char_t *) "=", 1, ctx);
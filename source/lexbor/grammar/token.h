@@ -13,8 +13,9 @@ extern "C" {
 
 #include "lexbor/grammar/base.h"
 
+#include "lexbor/grammar/element.h"
+
 #include "lexbor/core/str.h"
-#include "lexbor/dom/interfaces/node.h"
 
 
 typedef enum {
@@ -56,7 +57,7 @@ typedef struct lxb_grammar_token {
         double                     num;
         long                       count;
         lexbor_str_t               str;
-        lxb_dom_node_t             *node;
+        lxb_grammar_element_t      *element;
         lxb_grammar_period_t       period;
     }
     u;
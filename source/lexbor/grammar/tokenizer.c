@@ -6,24 +6,25 @@
 
 #include "lexbor/grammar/tokenizer.h"
 #include "lexbor/grammar/token.h"
+#include "lexbor/grammar/memory.h"
+#include "lexbor/grammar/stats.h"
 
 #include "lexbor/core/conv.h"
 #include "lexbor/core/utils.h"
-#include "lexbor/dom/interfaces/element.h"
+#include "lexbor/html/token_attr.h"
+#include "lexbor/dom/interfaces/attr.h"
 #include "lexbor/tag/tag.h"
 
-lxb_status_t
-lxb_html_parse_chunk_prepare(lxb_html_parser_t *parser,
-                             lxb_grammar_document_t *document);
-
-const lxb_tag_data_t *
-lxb_tag_append(lexbor_hash_t *hash, lxb_tag_id_t tag_id,
-               const lxb_char_t *name, size_t length);
 
 static lxb_html_token_t *
 lxb_grammar_tokenizer_html_token(lxb_html_tokenizer_t *html_tkz,
                                  lxb_html_token_t *token, void *ctx);
 
+static lxb_grammar_element_t *
+lxb_grammar_tokenizer_element(lxb_grammar_tokenizer_t *tkz,
+                              lxb_html_tokenizer_t *html_tkz,
+                              lxb_html_token_t *token);
+
 static const lxb_char_t *
 lxb_grammar_tokenizer_state_data(lxb_grammar_tokenizer_t *tkz,
                                  lxb_html_token_t *token,
@@ -45,8 +46,8 @@ lxb_grammar_tokenizer_init(lxb_grammar_tokenizer_t *tkz)
         return LXB_STATUS_ERROR_OBJECT_IS_NULL;
     }
 
-    tkz->html_parser = lxb_html_parser_create();
-    status = lxb_html_parser_init(tkz->html_parser);
+    tkz->html_tkz = lxb_html_tokenizer_create();
+    status = lxb_html_tokenizer_init(tkz->html_tkz);
     if (status != LXB_STATUS_OK) {
         return status;
     }
@@ -55,7 +56,10 @@ lxb_grammar_tokenizer_init(lxb_grammar_tokenizer_t *tkz)
     tkz->pc.is_attribute = false;
     tkz->pc.state = lxb_html_parser_char_ref_data;
 
-    lxb_html_tokenizer_callback_token_done_set(tkz->html_parser->tkz,
+    tkz->slab = true;
+    tkz->stats = NULL;
+
+    lxb_html_tokenizer_callback_token_done_set(tkz->html_tkz,
                                          lxb_grammar_tokenizer_html_token, tkz);
 
     return LXB_STATUS_OK;
@@ -64,7 +68,7 @@ lxb_grammar_tokenizer_init(lxb_grammar_tokenizer_t *tkz)
 void
 lxb_grammar_tokenizer_clean(lxb_grammar_tokenizer_t *tkz)
 {
-    lxb_html_parser_clean(tkz->html_parser);
+    lxb_html_tokenizer_clean(tkz->html_tkz);
 }
 
 lxb_grammar_tokenizer_t *
@@ -74,7 +78,7 @@ lxb_grammar_tokenizer_destroy(lxb_grammar_tokenizer_t *tkz, bool self_destroy)
         return NULL;
     }
 
-    tkz->html_parser = lxb_html_parser_destroy(tkz->html_parser);
+    tkz->html_tkz = lxb_html_tokenizer_destroy(tkz->html_tkz);
 
     if (self_destroy) {
         return lexbor_free(tkz);
@@ -83,57 +87,83 @@ lxb_grammar_tokenizer_destroy(lxb_grammar_tokenizer_t *tkz, bool self_destroy)
     return tkz;
 }
 
+#ifdef LXB_GRAMMAR_STATS
+static void
+lxb_grammar_tokenizer_stats_tokens(lxb_grammar_stats_t *stats,
+                                   lxb_grammar_document_t *document)
+{
+    lxb_grammar_token_t *token;
+
+    for (size_t i = 0; i < document->tokens.length; i++) {
+        token = document->tokens.list[i];
+
+        stats->tokens[token->type]++;
+    }
+}
+#endif
+
 lxb_grammar_document_t *
 lxb_grammar_tokenizer_process(lxb_grammar_tokenizer_t *tkz,
                               const lxb_char_t *data, size_t size)
 {
-    lexbor_array_t *tokens;
     lxb_grammar_document_t *document;
-    const lxb_tag_data_t *tag;
-
-    document = lxb_html_parse_chunk_begin(tkz->html_parser);
-    if (document == NULL) {
-        return NULL;
-    }
 
-    tkz->status = lxb_html_parse_chunk_prepare(tkz->html_parser, document);
+    document = lxb_grammar_document_create();
+    tkz->status = lxb_grammar_document_init(document);
     if (tkz->status != LXB_STATUS_OK) {
-        return lxb_html_document_destroy(document);
+        return lxb_grammar_document_destroy(document);
     }
 
-    /* Create ROOT tag */
-    tag = lxb_tag_append(document->dom_document.tags, LXB_TAG__UNDEF,
-                         (const lxb_char_t *) "root", 4);
-    if (tag == NULL) {
-        return lxb_html_document_destroy(document);
+    if (tkz->slab) {
+        tkz->status = lxb_grammar_document_token_slab(document);
+    }
+    else {
+        tkz->status = lxb_grammar_document_token_mraw(document);
     }
 
-    /* Create ARRAY for tokens */
-    tokens = lexbor_mraw_alloc(lxb_html_document_mraw(document),
-                               sizeof(lexbor_array_t));
-
-    tkz->status = lexbor_array_init(tokens, 1024);
     if (tkz->status != LXB_STATUS_OK) {
-        return lxb_html_document_destroy(document);
+        return lxb_grammar_document_destroy(document);
     }
 
-    document->dom_document.user = tokens;
-
-    tkz->pc.mraw = document->dom_document.mraw;
+    tkz->document = document;
+    tkz->pc.mraw = document->text;
     tkz->state = lxb_grammar_tokenizer_state_data;
 
-    /* Process parsing */
-    tkz->status = lxb_html_parse_chunk_process(tkz->html_parser, data, size);
+    /* Only tokens of HTML, without a tree and DOM. */
+    tkz->status = lxb_html_tokenizer_begin(tkz->html_tkz);
+    if (tkz->status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    tkz->status = lxb_html_tokenizer_chunk(tkz->html_tkz, data, size);
     if (tkz->status != LXB_STATUS_OK) {
-        return lxb_html_document_destroy(document);
+        goto failed;
     }
 
-    tkz->status = lxb_html_parse_chunk_end(tkz->html_parser);
+    tkz->status = lxb_html_tokenizer_end(tkz->html_tkz);
     if (tkz->status != LXB_STATUS_OK) {
-        return lxb_html_document_destroy(document);
+        goto failed;
+    }
+
+    tkz->document = NULL;
+
+    lxb_grammar_stats_add(tkz->stats, bytes, size);
+
+#ifdef LXB_GRAMMAR_STATS
+    if (tkz->stats != NULL) {
+        lxb_grammar_tokenizer_stats_tokens(tkz->stats, document);
     }
+#endif
+
+    lxb_grammar_memory_peak(document, NULL, NULL);
 
     return document;
+
+failed:
+
+    tkz->document = NULL;
+
+    return lxb_grammar_document_destroy(document);
 }
 
 static lxb_html_token_t *
@@ -142,12 +172,11 @@ lxb_grammar_tokenizer_html_token(lxb_html_tokenizer_t *html_tkz,
 {
     lxb_status_t status;
     lexbor_array_t *tokens;
-    lxb_html_element_t *element;
+    lxb_grammar_element_t *element;
     lxb_grammar_token_t *grammar_token;
     lxb_grammar_tokenizer_t *tkz = ctx;
-    lxb_html_tree_t *tree = tkz->html_parser->tree;
 
-    tokens = tree->document->dom_document.user;
+    tokens = &tkz->document->tokens;
 
     if (token->tag_id == LXB_TAG__EM_COMMENT) {
         return token;
@@ -185,8 +214,7 @@ lxb_grammar_tokenizer_html_token(lxb_html_tokenizer_t *html_tkz,
         return NULL;
     }
 
-    element = lxb_html_tree_create_element_for_token(tree, token,
-                                                     LXB_NS_HTML, NULL);
+    element = lxb_grammar_tokenizer_element(tkz, html_tkz, token);
     if (element == NULL) {
         return NULL;
     }
@@ -196,7 +224,7 @@ lxb_grammar_tokenizer_html_token(lxb_html_tokenizer_t *html_tkz,
         return NULL;
     }
 
-    grammar_token->u.node = lxb_dom_interface_node(element);
+    grammar_token->u.element = element;
 
     status = lexbor_array_push(tokens, grammar_token);
     if (status != LXB_STATUS_OK) {
@@ -206,6 +234,72 @@ lxb_grammar_tokenizer_html_token(lxb_html_tokenizer_t *html_tkz,
     return token;
 }
 
+/* Name and attributes of the tag, interned by the document. */
+static lxb_grammar_element_t *
+lxb_grammar_tokenizer_element(lxb_grammar_tokenizer_t *tkz,
+                              lxb_html_tokenizer_t *html_tkz,
+                              lxb_html_token_t *token)
+{
+    size_t length;
+    const lxb_char_t *name;
+    lxb_html_token_attr_t *attr;
+    lxb_grammar_element_t *element;
+    lxb_grammar_element_attr_t *entry;
+    lxb_grammar_document_t *document = tkz->document;
+
+    length = 0;
+
+    for (attr = token->attr_first; attr != NULL; attr = attr->next) {
+        length++;
+    }
+
+    element = lxb_grammar_element_create(document, length);
+    if (element == NULL) {
+        tkz->status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        return NULL;
+    }
+
+    name = lxb_tag_name_by_id(html_tkz->tags, token->tag_id, &length);
+    if (name == NULL) {
+        tkz->status = LXB_STATUS_ERROR_UNEXPECTED_DATA;
+        return NULL;
+    }
+
+    tkz->status = lxb_grammar_document_intern(document, name, length,
+                                              &element->name);
+    if (tkz->status != LXB_STATUS_OK) {
+        return NULL;
+    }
+
+    entry = element->attrs;
+
+    for (attr = token->attr_first; attr != NULL; attr = attr->next) {
+        name = lexbor_hash_entry_str(&attr->name->entry);
+
+        tkz->status = lxb_grammar_document_intern(document, name,
+                                                  attr->name->entry.length,
+                                                  &entry->name);
+        if (tkz->status != LXB_STATUS_OK) {
+            return NULL;
+        }
+
+        entry->value = LXB_GRAMMAR_ELEMENT_NO_VALUE;
+
+        if (attr->value != NULL) {
+            tkz->status = lxb_grammar_document_intern(document, attr->value,
+                                                      attr->value_size,
+                                                      &entry->value);
+            if (tkz->status != LXB_STATUS_OK) {
+                return NULL;
+            }
+        }
+
+        entry++;
+    }
+
+    return element;
+}
+
 static const lxb_char_t *
 lxb_grammar_tokenizer_state_data(lxb_grammar_tokenizer_t *tkz,
                                  lxb_html_token_t *token,
@@ -217,12 +311,10 @@ lxb_grammar_tokenizer_state_data(lxb_grammar_tokenizer_t *tkz,
     lxb_status_t status;
     lexbor_array_t *tokens;
     lxb_grammar_token_t *g_token;
-    lxb_grammar_document_t *document;
     lxb_grammar_token_type_t type;
     const lxb_char_t *start;
 
-    document = tkz->html_parser->tree->document;
-    tokens = document->dom_document.user;
+    tokens = &tkz->document->tokens;
 
     while (data < end) {
         switch (*data) {
@@ -263,6 +355,8 @@ lxb_grammar_tokenizer_state_data(lxb_grammar_tokenizer_t *tkz,
 
             process_chars:
 
+                lxb_grammar_stats_inc(tkz->stats, char_copies);
+
                 status = lxb_html_parser_char_process(&tkz->pc, &g_token->u.str,
                                                   token->in_begin, start, data);
                 if (status != LXB_STATUS_OK) {
@@ -541,6 +635,8 @@ create_period:
                     goto failed;
                 }
 
+                lxb_grammar_stats_inc(tkz->stats, char_copies);
+
                 status = lxb_html_parser_char_process(&tkz->pc, &g_token->u.str,
                                                       token->in_begin, start, data);
                 if (status != LXB_STATUS_OK) {
@@ -622,6 +718,8 @@ create_period:
                     goto failed;
                 }
 
+                lxb_grammar_stats_inc(tkz->stats, char_copies);
+
                 status = lxb_html_parser_char_process(&tkz->pc, &g_token->u.str,
                                                       token->in_begin, start, data);
                 if (status != LXB_STATUS_OK) {
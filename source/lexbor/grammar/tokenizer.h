@@ -14,7 +14,8 @@ extern "C" {
 #include "lexbor/grammar/base.h"
 #include "lexbor/grammar/token.h"
 
-#include "lexbor/html/parser.h"
+#include "lexbor/html/tokenizer.h"
+#include "lexbor/html/parser_char.h"
 #include "lexbor/html/token.h"
 
 
@@ -27,10 +28,17 @@ typedef const lxb_char_t *
 struct lxb_grammar_tokenizer {
     lxb_grammar_tokenizer_state_f state;
 
-    lxb_html_parser_t             *html_parser;
+    lxb_html_tokenizer_t          *html_tkz;
+
+    /* While lxb_grammar_tokenizer_process(). */
+    lxb_grammar_document_t        *document;
 
     lxb_html_parser_char_t        pc;
     lxb_status_t                  status;
+
+    /* Settings, may be changed after init. */
+    bool                          slab;  /* lxb_grammar_document_token_slab() */
+    lxb_grammar_stats_t           *stats;  /* See lexbor/grammar/stats.h. */
 };
 
 
@@ -63,7 +71,7 @@ lxb_grammar_tokenizer_state_set(lxb_grammar_tokenizer_t *tkz,
 lxb_inline lexbor_array_t *
 lxb_grammar_tokenizer_tokens(lxb_grammar_document_t *document)
 {
-    return document->dom_document.user;
+    return &document->tokens;
 }
 
 
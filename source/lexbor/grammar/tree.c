@@ -6,16 +6,15 @@
 
 #include "lexbor/grammar/tree.h"
 #include "lexbor/grammar/node.h"
+#include "lexbor/grammar/memory.h"
 
-#include "lexbor/dom/interface.h"
-#include "lexbor/dom/interfaces/element.h"
 
+static lxb_status_t
+lxb_grammar_tree_make_node(lxb_grammar_tree_t *tree, lxb_grammar_node_t *node);
 
-typedef struct lxb_grammar_tree_context {
-    lxb_grammar_tree_group_t **groups;
-    lxb_grammar_tree_entry_t **ends;
-}
-lxb_grammar_tree_context_t;
+static lxb_status_t
+lxb_grammar_tree_keyword_reg(lxb_grammar_tree_t *tree,
+                             lxb_grammar_node_t *node);
 
 
 lxb_grammar_tree_t *
@@ -40,7 +39,24 @@ lxb_grammar_tree_init(lxb_grammar_tree_t *tree,
 
     tree->declarations = lexbor_bst_map_create();
     status = lexbor_bst_map_init(tree->declarations, 1024);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    tree->keywords = lexbor_bst_map_create();
+    status = lexbor_bst_map_init(tree->keywords, 1024);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
 
+    tree->keyword_list = lexbor_array_create();
+    status = lexbor_array_init(tree->keyword_list, 256);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    tree->nodes = lexbor_array_create();
+    status = lexbor_array_init(tree->nodes, 1024);
     if (status != LXB_STATUS_OK) {
         return status;
     }
@@ -54,12 +70,23 @@ void
 lxb_grammar_tree_clean(lxb_grammar_tree_t *tree)
 {
     lexbor_bst_map_t *declarations = tree->declarations;
+    lexbor_bst_map_t *keywords = tree->keywords;
+    lexbor_array_t *keyword_list = tree->keyword_list;
+    lexbor_array_t *nodes = tree->nodes;
+    lxb_grammar_document_t *document = tree->document;
 
     lexbor_bst_map_clean(declarations);
+    lexbor_bst_map_clean(keywords);
+    lexbor_array_clean(keyword_list);
+    lexbor_array_clean(nodes);
 
     memset(tree, 0, sizeof(lxb_grammar_tree_t));
 
     tree->declarations = declarations;
+    tree->keywords = keywords;
+    tree->keyword_list = keyword_list;
+    tree->nodes = nodes;
+    tree->document = document;
 }
 
 lxb_grammar_tree_t *
@@ -70,6 +97,9 @@ lxb_grammar_tree_destroy(lxb_grammar_tree_t *tree, bool self_destroy)
     }
 
     tree->declarations = lexbor_bst_map_destroy(tree->declarations, true);
+    tree->keywords = lexbor_bst_map_destroy(tree->keywords, true);
+    tree->keyword_list = lexbor_array_destroy(tree->keyword_list, true);
+    tree->nodes = lexbor_array_destroy(tree->nodes, true);
 
     if (self_destroy) {
         return lexbor_free(tree);
@@ -78,6 +108,181 @@ lxb_grammar_tree_destroy(lxb_grammar_tree_t *tree, bool self_destroy)
     return tree;
 }
 
+lxb_status_t
+lxb_grammar_tree_make(lxb_grammar_tree_t *tree, lxb_grammar_node_t *root)
+{
+    lxb_status_t status;
+    lxb_grammar_node_t *node;
+
+    if (root->type != LXB_GRAMMAR_NODE_ROOT) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    tree->last_node = NULL;
+    tree->last_error = NULL;
+
+    /* All declarations first, references may point forward. */
+    for (node = root->first_child; node != NULL; node = node->next) {
+        status = lxb_grammar_tree_declaration_reg(tree, node);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+    }
+
+    node = root;
+
+    while (node != NULL) {
+        status = lxb_grammar_tree_make_node(tree, node);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        if (node->first_child != NULL) {
+            node = node->first_child;
+            continue;
+        }
+
+        while (node != root && node->next == NULL) {
+            node = node->parent;
+        }
+
+        if (node == root) {
+            break;
+        }
+
+        node = node->next;
+    }
+
+    lxb_grammar_memory_peak(tree->document, tree, NULL);
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_tree_make_node(lxb_grammar_tree_t *tree, lxb_grammar_node_t *node)
+{
+    size_t len, count;
+    lxb_status_t status;
+    const lxb_char_t *name;
+    lxb_grammar_node_t *child;
+
+    node->id = tree->nodes->length;
+
+    status = lexbor_array_push(tree->nodes, node);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    switch (node->type) {
+        case LXB_GRAMMAR_NODE_UNQUOTED:
+            return lxb_grammar_tree_keyword_reg(tree, node);
+
+        case LXB_GRAMMAR_NODE_ELEMENT:
+            name = lxb_grammar_tree_node_name(node, &len);
+
+            node->bst_declaration = lexbor_bst_map_search(tree->declarations,
+                                                       tree->declarations_root,
+                                                       name, len);
+            if (node->bst_declaration == NULL) {
+                node->type_id = lxb_grammar_type_by_name(name, len);
+
+                if (node->type_id == LXB_GRAMMAR_TYPE__UNDEF) {
+                    tree->last_node = node;
+                    tree->last_error = "Undefined declaration or type.";
+
+                    return LXB_STATUS_ERROR_NOT_EXISTS;
+                }
+            }
+
+            break;
+
+        case LXB_GRAMMAR_NODE_GROUP:
+        case LXB_GRAMMAR_NODE_DECLARATION:
+            if (node->combinator != LXB_GRAMMAR_COMBINATOR_AND
+                && node->combinator != LXB_GRAMMAR_COMBINATOR_OR)
+            {
+                break;
+            }
+
+            count = 0;
+
+            for (child = node->first_child; child != NULL; child = child->next) {
+                count++;
+            }
+
+            /* Matched children are tracked by 64-bit mask. */
+            if (count > 64) {
+                tree->last_node = node;
+                tree->last_error = "Too many children in the && or || group.";
+
+                return LXB_STATUS_ERROR_OVERFLOW;
+            }
+
+            break;
+
+        default:
+            break;
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_tree_keyword_reg(lxb_grammar_tree_t *tree,
+                             lxb_grammar_node_t *node)
+{
+    lxb_status_t status;
+    lxb_char_t *lower;
+    lexbor_mraw_t *mraw;
+    lexbor_bst_map_entry_t *entry;
+    size_t len = node->u.str.length;
+
+    if (len == 0) {
+        node->keyword_id = 0;
+        return LXB_STATUS_OK;
+    }
+
+    mraw = tree->document->mraw;
+
+    lower = lexbor_mraw_alloc(mraw, len);
+    if (lower == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        lower[i] = node->u.str.data[i];
+
+        if (lower[i] >= 'A' && lower[i] <= 'Z') {
+            lower[i] |= 0x20;
+        }
+    }
+
+    entry = lexbor_bst_map_insert_not_exists(tree->keywords,
+                                             &tree->keywords_root, lower, len);
+    lexbor_mraw_free(mraw, lower);
+
+    if (entry == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    if (entry->value == NULL) {
+        status = lexbor_array_push(tree->keyword_list, entry);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        entry->value = (void *) (uintptr_t) tree->keyword_list->length;
+
+        if (len > tree->keyword_max_len) {
+            tree->keyword_max_len = len;
+        }
+    }
+
+    node->keyword_id = (size_t) (uintptr_t) entry->value;
+
+    return LXB_STATUS_OK;
+}
+
 lxb_status_t
 lxb_grammar_tree_declaration_reg(lxb_grammar_tree_t *tree,
                                  lxb_grammar_node_t *node)
@@ -90,8 +295,7 @@ lxb_grammar_tree_declaration_reg(lxb_grammar_tree_t *tree,
         return LXB_STATUS_ERROR_WRONG_ARGS;
     }
 
-    local_name = lxb_dom_element_local_name(lxb_dom_interface_element(node),
-                                            &len);
+    local_name = lxb_grammar_tree_node_name(node, &len);
 
     entry = lexbor_bst_map_insert_not_exists(tree->declarations,
                                              &tree->declarations_root,
@@ -100,51 +304,50 @@ lxb_grammar_tree_declaration_reg(lxb_grammar_tree_t *tree,
         return LXB_STATUS_ERROR;
     }
 
+    if (entry->value != NULL && entry->value != node) {
+        tree->last_node = node;
+        tree->last_error = "Duplicate declaration.";
+
+        return LXB_STATUS_ERROR;
+    }
+
     entry->value = node;
 
     return LXB_STATUS_OK;
 }
 
-lxb_status_t
-lxb_grammar_tree_make(lxb_grammar_tree_t *tree, lxb_grammar_node_t *group)
+lxb_grammar_node_t *
+lxb_grammar_tree_declaration(lxb_grammar_tree_t *tree,
+                             const lxb_char_t *name, size_t len)
 {
-    lxb_grammar_node_t *node;
+    lexbor_bst_map_entry_t *entry;
 
-    if (group->type != LXB_GRAMMAR_NODE_DECLARATION
-        && group->type != LXB_GRAMMAR_NODE_GROUP)
-    {
-        return LXB_STATUS_ERROR_WRONG_ARGS;
+    if (len >= 2 && name[0] == '<' && name[len - 1] == '>') {
+        name++;
+        len -= 2;
     }
 
-    node = group->first_child;
-
-    while (node != NULL) {
-
-
-        node = node->next;
+    entry = lexbor_bst_map_search(tree->declarations, tree->declarations_root,
+                                  name, len);
+    if (entry == NULL) {
+        return NULL;
     }
 
-    return LXB_STATUS_OK;
+    return entry->value;
 }
 
-lxb_status_t
-lxb_grammar_tree_make_2(lxb_grammar_tree_t *tree, lxb_grammar_node_t *group)
+const lxb_char_t *
+lxb_grammar_tree_node_name(lxb_grammar_node_t *node, size_t *len)
 {
-    lxb_grammar_node_t *node;
-
-    if (group->type != LXB_GRAMMAR_NODE_DECLARATION
-        && group->type != LXB_GRAMMAR_NODE_GROUP)
+    if (node->type != LXB_GRAMMAR_NODE_DECLARATION
+        && node->type != LXB_GRAMMAR_NODE_ELEMENT)
     {
-        return LXB_STATUS_ERROR_WRONG_ARGS;
-    }
+        if (len != NULL) {
+            *len = 0;
+        }
 
-    node = group->first_child;
-
-    while (node != NULL) {
-
-
-        node = node->next;
+        return NULL;
     }
 
-    return LXB_STATUS_OK;
+    return lxb_grammar_element_name(node->u.element, len);
 }
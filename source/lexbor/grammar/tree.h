@@ -13,9 +13,8 @@ extern "C" {
 
 #include "lexbor/grammar/base.h"
 
-#include "lexbor/html/interfaces/document.h"
-
 #include "lexbor/core/bst_map.h"
+#include "lexbor/core/array.h"
 
 
 typedef lxb_status_t
@@ -45,41 +44,70 @@ struct lxb_grammar_tree {
 
     lexbor_bst_map_t         *declarations;
     lexbor_bst_entry_t       *declarations_root;
+
+    /* Lowercase keyword -> id, ids begin with 1. */
+    lexbor_bst_map_t         *keywords;
+    lexbor_bst_entry_t       *keywords_root;
+    lexbor_array_t           *keyword_list;  /* lexbor_bst_map_entry_t by id - 1 */
+    size_t                   keyword_max_len;
+
+    /* All nodes by node->id. */
+    lexbor_array_t           *nodes;
+
+    lxb_grammar_node_t       *last_node;
+    const char               *last_error;
 };
 
 
-lxb_grammar_tree_t *
+LXB_API lxb_grammar_tree_t *
 lxb_grammar_tree_create(void);
 
-lxb_status_t
+LXB_API lxb_status_t
 lxb_grammar_tree_init(lxb_grammar_tree_t *tree,
                       lxb_grammar_document_t *document);
 
-void
+LXB_API void
 lxb_grammar_tree_clean(lxb_grammar_tree_t *tree);
 
-lxb_grammar_tree_t *
+LXB_API lxb_grammar_tree_t *
 lxb_grammar_tree_destroy(lxb_grammar_tree_t *tree, bool self_destroy);
 
+/*
+ * Registers all declarations of the AST, links <name> references
+ * with declarations or basic data types and interns keywords.
+ */
+LXB_API lxb_status_t
+lxb_grammar_tree_make(lxb_grammar_tree_t *tree, lxb_grammar_node_t *root);
 
-lxb_status_t
+LXB_API lxb_status_t
 lxb_grammar_tree_declaration_reg(lxb_grammar_tree_t *tree,
                                  lxb_grammar_node_t *node);
 
+/*
+ * Name without angle brackets, "<name>" is accepted too.
+ * Case-sensitive, names in the grammar are lowercase.
+ */
+LXB_API lxb_grammar_node_t *
+lxb_grammar_tree_declaration(lxb_grammar_tree_t *tree,
+                             const lxb_char_t *name, size_t len);
+
+LXB_API const lxb_char_t *
+lxb_grammar_tree_node_name(lxb_grammar_node_t *node, size_t *len);
+
 /*
  * Inline functions
  */
 lxb_inline lxb_grammar_tree_group_t *
 lxb_grammar_tree_group_create(lxb_grammar_tree_t *tree)
 {
-    return lexbor_mraw_calloc(tree->document->dom_document.mraw,
+    return lexbor_mraw_calloc(tree->document->mraw,
                               sizeof(lxb_grammar_tree_group_t));
 }
 
 lxb_inline lxb_grammar_tree_entry_t *
 lxb_grammar_tree_entry_create(lxb_grammar_tree_t *tree)
 {
-    return lexbor_mraw_calloc(tree->document->dom_document.mraw,
+    return lexbor_mraw_calloc(tree->document->mraw,
                               sizeof(lxb_grammar_tree_entry_t));
 }
 
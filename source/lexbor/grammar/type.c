@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/type.h"
+
+#include "lexbor/core/str.h"
+
+
+typedef struct {
+    const char            *name;
+    size_t                length;
+    lxb_grammar_type_id_t type;
+}
+lxb_grammar_type_entry_t;
+
+typedef struct {
+    const char *name;
+    size_t     length;
+}
+lxb_grammar_type_word_t;
+
+#define lxb_grammar_type_entry(name, type)                                     \
+    {name, (sizeof(name) - 1), type}
+
+#define lxb_grammar_type_word(name) {name, (sizeof(name) - 1)}
+
+
+static const lxb_grammar_type_entry_t lxb_grammar_type_entries[] = {
+    lxb_grammar_type_entry("ident", LXB_GRAMMAR_TYPE_IDENT),
+    lxb_grammar_type_entry("ident-token", LXB_GRAMMAR_TYPE_IDENT),
+    lxb_grammar_type_entry("custom-ident", LXB_GRAMMAR_TYPE_CUSTOM_IDENT),
+    lxb_grammar_type_entry("dashed-ident", LXB_GRAMMAR_TYPE_DASHED_IDENT),
+    lxb_grammar_type_entry("string", LXB_GRAMMAR_TYPE_STRING),
+    lxb_grammar_type_entry("string-token", LXB_GRAMMAR_TYPE_STRING),
+    lxb_grammar_type_entry("url", LXB_GRAMMAR_TYPE_URL),
+    lxb_grammar_type_entry("url-token", LXB_GRAMMAR_TYPE_URL),
+    lxb_grammar_type_entry("number", LXB_GRAMMAR_TYPE_NUMBER),
+    lxb_grammar_type_entry("number-token", LXB_GRAMMAR_TYPE_NUMBER),
+    lxb_grammar_type_entry("integer", LXB_GRAMMAR_TYPE_INTEGER),
+    lxb_grammar_type_entry("percentage", LXB_GRAMMAR_TYPE_PERCENTAGE),
+    lxb_grammar_type_entry("percentage-token", LXB_GRAMMAR_TYPE_PERCENTAGE),
+    lxb_grammar_type_entry("dimension", LXB_GRAMMAR_TYPE_DIMENSION),
+    lxb_grammar_type_entry("dimension-token", LXB_GRAMMAR_TYPE_DIMENSION),
+    lxb_grammar_type_entry("length", LXB_GRAMMAR_TYPE_LENGTH),
+    lxb_grammar_type_entry("length-percentage",
+                           LXB_GRAMMAR_TYPE_LENGTH_PERCENTAGE),
+    lxb_grammar_type_entry("angle", LXB_GRAMMAR_TYPE_ANGLE),
+    lxb_grammar_type_entry("time", LXB_GRAMMAR_TYPE_TIME),
+    lxb_grammar_type_entry("frequency", LXB_GRAMMAR_TYPE_FREQUENCY),
+    lxb_grammar_type_entry("resolution", LXB_GRAMMAR_TYPE_RESOLUTION),
+    lxb_grammar_type_entry("flex", LXB_GRAMMAR_TYPE_FLEX),
+    lxb_grammar_type_entry("hex-color", LXB_GRAMMAR_TYPE_HEX_COLOR),
+    lxb_grammar_type_entry("hash-token", LXB_GRAMMAR_TYPE_HASH)
+};
+
+/* Units, terminated by {NULL, 0}. */
+static const lxb_grammar_type_word_t lxb_grammar_type_units_length[] = {
+    lxb_grammar_type_word("px"), lxb_grammar_type_word("em"),
+    lxb_grammar_type_word("rem"), lxb_grammar_type_word("ex"),
+    lxb_grammar_type_word("rex"), lxb_grammar_type_word("cap"),
+    lxb_grammar_type_word("rcap"), lxb_grammar_type_word("ch"),
+    lxb_grammar_type_word("rch"), lxb_grammar_type_word("ic"),
+    lxb_grammar_type_word("ric"), lxb_grammar_type_word("lh"),
+    lxb_grammar_type_word("rlh"), lxb_grammar_type_word("vw"),
+    lxb_grammar_type_word("vh"), lxb_grammar_type_word("vi"),
+    lxb_grammar_type_word("vb"), lxb_grammar_type_word("vmin"),
+    lxb_grammar_type_word("vmax"), lxb_grammar_type_word("cm"),
+    lxb_grammar_type_word("mm"), lxb_grammar_type_word("q"),
+    lxb_grammar_type_word("in"), lxb_grammar_type_word("pt"),
+    lxb_grammar_type_word("pc"), {NULL, 0}
+};
+
+static const lxb_grammar_type_word_t lxb_grammar_type_units_angle[] = {
+    lxb_grammar_type_word("deg"), lxb_grammar_type_word("grad"),
+    lxb_grammar_type_word("rad"), lxb_grammar_type_word("turn"), {NULL, 0}
+};
+
+static const lxb_grammar_type_word_t lxb_grammar_type_units_time[] = {
+    lxb_grammar_type_word("s"), lxb_grammar_type_word("ms"), {NULL, 0}
+};
+
+static const lxb_grammar_type_word_t lxb_grammar_type_units_frequency[] = {
+    lxb_grammar_type_word("hz"), lxb_grammar_type_word("khz"), {NULL, 0}
+};
+
+static const lxb_grammar_type_word_t lxb_grammar_type_units_resolution[] = {
+    lxb_grammar_type_word("dpi"), lxb_grammar_type_word("dpcm"),
+    lxb_grammar_type_word("dppx"), lxb_grammar_type_word("x"), {NULL, 0}
+};
+
+static const lxb_grammar_type_word_t lxb_grammar_type_units_flex[] = {
+    lxb_grammar_type_word("fr"), {NULL, 0}
+};
+
+/* CSS-wide keywords, not allowed as <custom-ident>. */
+static const lxb_grammar_type_word_t lxb_grammar_type_wide_keywords[] = {
+    lxb_grammar_type_word("initial"), lxb_grammar_type_word("inherit"),
+    lxb_grammar_type_word("unset"), lxb_grammar_type_word("revert"),
+    lxb_grammar_type_word("default"), {NULL, 0}
+};
+
+
+lxb_grammar_type_id_t
+lxb_grammar_type_by_name(const lxb_char_t *name, size_t len)
+{
+    const lxb_grammar_type_entry_t *entry;
+    size_t count = sizeof(lxb_grammar_type_entries)
+                   / sizeof(lxb_grammar_type_entry_t);
+
+    for (size_t i = 0; i < count; i++) {
+        entry = &lxb_grammar_type_entries[i];
+
+        if (entry->length == len
+            && lexbor_str_data_ncasecmp((const lxb_char_t *) entry->name,
+                                        name, len))
+        {
+            return entry->type;
+        }
+    }
+
+    return LXB_GRAMMAR_TYPE__UNDEF;
+}
+
+const lxb_char_t *
+lxb_grammar_type_name(lxb_grammar_type_id_t type, size_t *len)
+{
+    const lxb_grammar_type_entry_t *entry;
+    size_t count = sizeof(lxb_grammar_type_entries)
+                   / sizeof(lxb_grammar_type_entry_t);
+
+    for (size_t i = 0; i < count; i++) {
+        entry = &lxb_grammar_type_entries[i];
+
+        if (entry->type == type) {
+            if (len != NULL) {
+                *len = entry->length;
+            }
+
+            return (const lxb_char_t *) entry->name;
+        }
+    }
+
+    if (len != NULL) {
+        *len = 0;
+    }
+
+    return NULL;
+}
+
+static bool
+lxb_grammar_type_in_list(const lxb_grammar_type_word_t *list,
+                         const lxb_char_t *data, size_t length)
+{
+    for (; list->name != NULL; list++) {
+        if (list->length == length
+            && lexbor_str_data_ncasecmp((const lxb_char_t *) list->name,
+                                        data, length))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+lxb_inline bool
+lxb_grammar_type_dimension(const lxb_grammar_value_token_t *token,
+                           const lxb_grammar_type_word_t *units)
+{
+    return token->type == LXB_GRAMMAR_VALUE_DIMENSION
+           && lxb_grammar_type_in_list(units, token->data, token->length);
+}
+
+lxb_inline bool
+lxb_grammar_type_zero(const lxb_grammar_value_token_t *token)
+{
+    return token->type == LXB_GRAMMAR_VALUE_NUMBER && token->num == 0;
+}
+
+bool
+lxb_grammar_type_match(lxb_grammar_type_id_t type,
+                       const lxb_grammar_value_token_t *token)
+{
+    size_t i;
+
+    switch (type) {
+        case LXB_GRAMMAR_TYPE_IDENT:
+            return token->type == LXB_GRAMMAR_VALUE_IDENT;
+
+        case LXB_GRAMMAR_TYPE_CUSTOM_IDENT:
+            return token->type == LXB_GRAMMAR_VALUE_IDENT
+                   && !lxb_grammar_type_in_list(lxb_grammar_type_wide_keywords,
+                                                token->data, token->length);
+
+        case LXB_GRAMMAR_TYPE_DASHED_IDENT:
+            return token->type == LXB_GRAMMAR_VALUE_IDENT
+                   && token->length > 2
+                   && token->data[0] == '-' && token->data[1] == '-';
+
+        case LXB_GRAMMAR_TYPE_STRING:
+            return token->type == LXB_GRAMMAR_VALUE_STRING;
+
+        case LXB_GRAMMAR_TYPE_URL:
+            return token->type == LXB_GRAMMAR_VALUE_URL;
+
+        case LXB_GRAMMAR_TYPE_NUMBER:
+            return token->type == LXB_GRAMMAR_VALUE_NUMBER;
+
+        case LXB_GRAMMAR_TYPE_INTEGER:
+            return token->type == LXB_GRAMMAR_VALUE_NUMBER
+                   && (token->flags & LXB_GRAMMAR_VALUE_FLAGS_INTEGER);
+
+        case LXB_GRAMMAR_TYPE_PERCENTAGE:
+            return token->type == LXB_GRAMMAR_VALUE_PERCENTAGE;
+
+        case LXB_GRAMMAR_TYPE_DIMENSION:
+            return token->type == LXB_GRAMMAR_VALUE_DIMENSION;
+
+        case LXB_GRAMMAR_TYPE_LENGTH:
+            return lxb_grammar_type_zero(token)
+                   || lxb_grammar_type_dimension(token,
+                                                 lxb_grammar_type_units_length);
+
+        case LXB_GRAMMAR_TYPE_LENGTH_PERCENTAGE:
+            return token->type == LXB_GRAMMAR_VALUE_PERCENTAGE
+                   || lxb_grammar_type_zero(token)
+                   || lxb_grammar_type_dimension(token,
+                                                 lxb_grammar_type_units_length);
+
+        case LXB_GRAMMAR_TYPE_ANGLE:
+            return lxb_grammar_type_zero(token)
+                   || lxb_grammar_type_dimension(token,
+                                                 lxb_grammar_type_units_angle);
+
+        case LXB_GRAMMAR_TYPE_TIME:
+            return lxb_grammar_type_dimension(token,
+                                              lxb_grammar_type_units_time);
+
+        case LXB_GRAMMAR_TYPE_FREQUENCY:
+            return lxb_grammar_type_dimension(token,
+                                              lxb_grammar_type_units_frequency);
+
+        case LXB_GRAMMAR_TYPE_RESOLUTION:
+            return lxb_grammar_type_dimension(token,
+                                             lxb_grammar_type_units_resolution);
+
+        case LXB_GRAMMAR_TYPE_FLEX:
+            return lxb_grammar_type_dimension(token,
+                                              lxb_grammar_type_units_flex);
+
+        case LXB_GRAMMAR_TYPE_HEX_COLOR:
+            if (token->type != LXB_GRAMMAR_VALUE_HASH) {
+                return false;
+            }
+
+            if (token->length != 3 && token->length != 4
+                && token->length != 6 && token->length != 8)
+            {
+                return false;
+            }
+
+            for (i = 0; i < token->length; i++) {
+                if ((token->data[i] < '0' || token->data[i] > '9')
+                    && (token->data[i] < 'a' || token->data[i] > 'f')
+                    && (token->data[i] < 'A' || token->data[i] > 'F'))
+                {
+                    return false;
+                }
+            }
+
+            return true;
+
+        case LXB_GRAMMAR_TYPE_HASH:
+            return token->type == LXB_GRAMMAR_VALUE_HASH;
+
+        default:
+            return false;
+    }
+}
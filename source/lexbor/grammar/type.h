@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_TYPE_H
+#define LEXBOR_GRAMMAR_TYPE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/value.h"
+
+
+/*
+ * Basic data types.  Used for <name> references which do not refer
+ * to a declaration of the grammar.
+ */
+typedef enum {
+    LXB_GRAMMAR_TYPE__UNDEF = 0x00,
+    LXB_GRAMMAR_TYPE_IDENT,             /* <ident>, <ident-token> */
+    LXB_GRAMMAR_TYPE_CUSTOM_IDENT,      /* <custom-ident> */
+    LXB_GRAMMAR_TYPE_DASHED_IDENT,      /* <dashed-ident> */
+    LXB_GRAMMAR_TYPE_STRING,            /* <string>, <string-token> */
+    LXB_GRAMMAR_TYPE_URL,               /* <url>, <url-token> */
+    LXB_GRAMMAR_TYPE_NUMBER,            /* <number>, <number-token> */
+    LXB_GRAMMAR_TYPE_INTEGER,           /* <integer> */
+    LXB_GRAMMAR_TYPE_PERCENTAGE,        /* <percentage>, <percentage-token> */
+    LXB_GRAMMAR_TYPE_DIMENSION,         /* <dimension>, <dimension-token> */
+    LXB_GRAMMAR_TYPE_LENGTH,            /* <length> */
+    LXB_GRAMMAR_TYPE_LENGTH_PERCENTAGE, /* <length-percentage> */
+    LXB_GRAMMAR_TYPE_ANGLE,             /* <angle> */
+    LXB_GRAMMAR_TYPE_TIME,              /* <time> */
+    LXB_GRAMMAR_TYPE_FREQUENCY,         /* <frequency> */
+    LXB_GRAMMAR_TYPE_RESOLUTION,        /* <resolution> */
+    LXB_GRAMMAR_TYPE_FLEX,              /* <flex> */
+    LXB_GRAMMAR_TYPE_HEX_COLOR,         /* <hex-color> */
+    LXB_GRAMMAR_TYPE_HASH,              /* <hash-token> */
+    LXB_GRAMMAR_TYPE__LAST_ENTRY
+}
+lxb_grammar_type_id_t;
+
+
+LXB_API lxb_grammar_type_id_t
+lxb_grammar_type_by_name(const lxb_char_t *name, size_t len);
+
+LXB_API const lxb_char_t *
+lxb_grammar_type_name(lxb_grammar_type_id_t type, size_t *len);
+
+LXB_API bool
+lxb_grammar_type_match(lxb_grammar_type_id_t type,
+                       const lxb_grammar_value_token_t *token);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_TYPE_H */
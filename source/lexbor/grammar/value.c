@@ -0,0 +1,499 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/value.h"
+
+#include "lexbor/core/str.h"
+#include "lexbor/core/conv.h"
+
+
+#define lxb_grammar_value_is_name_start(ch)                                    \
+    (((ch) >= 'a' && (ch) <= 'z') || ((ch) >= 'A' && (ch) <= 'Z')             \
+     || (ch) == '_' || (ch) >= 0x80)
+
+#define lxb_grammar_value_is_digit(ch) ((ch) >= '0' && (ch) <= '9')
+
+#define lxb_grammar_value_is_name(ch)                                          \
+    (lxb_grammar_value_is_name_start(ch) || lxb_grammar_value_is_digit(ch)     \
+     || (ch) == '-')
+
+
+static const lxb_char_t *
+lxb_grammar_value_name(const lxb_char_t *data, const lxb_char_t *end);
+
+static const lxb_char_t *
+lxb_grammar_value_url_quoted(lxb_grammar_value_token_t *token,
+                             const lxb_char_t *data, const lxb_char_t *end,
+                             const lxb_char_t *fallback);
+
+static const lxb_char_t *
+lxb_grammar_value_number(lxb_grammar_value_token_t *token,
+                         const lxb_char_t *data, const lxb_char_t *end);
+
+
+lxb_inline bool
+lxb_grammar_value_is_ident_start(const lxb_char_t *data, const lxb_char_t *end)
+{
+    if (lxb_grammar_value_is_name_start(*data) || *data == '\\') {
+        return true;
+    }
+
+    if (*data == '-' && (data + 1) < end) {
+        data++;
+
+        return lxb_grammar_value_is_name_start(*data)
+               || *data == '-' || *data == '\\';
+    }
+
+    return false;
+}
+
+lxb_inline bool
+lxb_grammar_value_is_number_start(const lxb_char_t *data,
+                                  const lxb_char_t *end)
+{
+    if (*data == '+' || *data == '-') {
+        data++;
+
+        if (data >= end) {
+            return false;
+        }
+    }
+
+    if (lxb_grammar_value_is_digit(*data)) {
+        return true;
+    }
+
+    return *data == '.' && (data + 1) < end
+           && lxb_grammar_value_is_digit(data[1]);
+}
+
+lxb_status_t
+lxb_grammar_value_tokenize(lexbor_array_obj_t *tokens,
+                           const lxb_char_t *data, size_t size)
+{
+    int flags;
+    lxb_char_t ch;
+    const lxb_char_t *end, *start;
+    lxb_grammar_value_token_t *token;
+
+    flags = LXB_GRAMMAR_VALUE_FLAGS_UNDEF;
+    end = data + size;
+
+    while (data < end) {
+        switch (*data) {
+            /*
+             * U+0009 CHARACTER TABULATION (tab)
+             * U+000A LINE FEED (LF)
+             * U+000C FORM FEED (FF)
+             * U+000D CARRIAGE RETURN (CR)
+             * U+0020 SPACE
+             */
+            case 0x09:
+            case 0x0A:
+            case 0x0C:
+            case 0x0D:
+            case 0x20:
+                flags |= LXB_GRAMMAR_VALUE_FLAGS_WS;
+
+                data++;
+                continue;
+
+            /* U+002F SOLIDUS (/) */
+            case 0x2F:
+                if ((data + 1) < end && data[1] == '*') {
+                    for (data += 2; (data + 1) < end; data++) {
+                        if (*data == '*' && data[1] == '/') {
+                            break;
+                        }
+                    }
+
+                    data = ((data + 2) < end) ? (data + 2) : end;
+                    flags |= LXB_GRAMMAR_VALUE_FLAGS_WS;
+
+                    continue;
+                }
+
+                goto delim;
+
+            default:
+                break;
+        }
+
+        token = lexbor_array_obj_push(tokens);
+        if (token == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        token->flags = flags;
+        token->begin = data;
+        token->num = 0;
+        token->keyword_id = 0;
+
+        flags = LXB_GRAMMAR_VALUE_FLAGS_UNDEF;
+
+        switch (*data) {
+            /*
+             * U+0022 QUOTATION MARK (")
+             * U+0027 APOSTROPHE (')
+             */
+            case 0x22:
+            case 0x27:
+                ch = *data++;
+
+                for (start = data; data < end; data++) {
+                    if (*data == ch) {
+                        break;
+                    }
+                    else if (*data == '\\') {
+                        data++;
+
+                        if (data >= end) {
+                            break;
+                        }
+                    }
+                }
+
+                token->type = LXB_GRAMMAR_VALUE_STRING;
+                token->data = start;
+                token->length = data - start;
+
+                if (data < end) {
+                    data++;
+                }
+
+                break;
+
+            /* U+0023 NUMBER SIGN (#) */
+            case 0x23:
+                if ((data + 1) < end && (lxb_grammar_value_is_name(data[1])
+                                         || data[1] == '\\'))
+                {
+                    start = data + 1;
+                    data = lxb_grammar_value_name(start, end);
+
+                    token->type = LXB_GRAMMAR_VALUE_HASH;
+                    token->data = start;
+                    token->length = data - start;
+
+                    break;
+                }
+
+                goto delim_token;
+
+            default:
+                if (lxb_grammar_value_is_number_start(data, end)) {
+                    data = lxb_grammar_value_number(token, data, end);
+                    break;
+                }
+
+                if (lxb_grammar_value_is_ident_start(data, end)) {
+                    start = data;
+                    data = lxb_grammar_value_name(data, end);
+
+                    token->type = LXB_GRAMMAR_VALUE_IDENT;
+                    token->data = start;
+                    token->length = data - start;
+
+                    /*
+                     * url(...) is a single token, the quoted form too:
+                     * <url> = url( <string> ) | <url-token>.
+                     */
+                    if ((data - start) == 3 && data < end && *data == '('
+                        && lexbor_str_data_ncasecmp(start,
+                                                    (const lxb_char_t *) "url", 3))
+                    {
+                        for (start = data + 1; start < end; start++) {
+                            if (*start != ' ' && *start != '\t'
+                                && *start != '\n' && *start != '\r'
+                                && *start != '\f')
+                            {
+                                break;
+                            }
+                        }
+
+                        if (start < end && (*start == '"' || *start == '\'')) {
+                            data = lxb_grammar_value_url_quoted(token, start,
+                                                                end, data);
+                        }
+                        else if (start < end) {
+                            for (data = start; data < end; data++) {
+                                if (*data == ')') {
+                                    break;
+                                }
+                                else if (*data == '\\') {
+                                    data++;
+
+                                    if (data >= end) {
+                                        break;
+                                    }
+                                }
+                            }
+
+                            token->type = LXB_GRAMMAR_VALUE_URL;
+                            token->data = start;
+                            token->length = data - start;
+
+                            /* Trim whitespace before ')'. */
+                            while (token->length != 0
+                                   && (start[token->length - 1] == ' '
+                                       || start[token->length - 1] == '\t'
+                                       || start[token->length - 1] == '\n'
+                                       || start[token->length - 1] == '\r'
+                                       || start[token->length - 1] == '\f'))
+                            {
+                                token->length--;
+                            }
+
+                            if (data < end) {
+                                data++;
+                            }
+                        }
+                    }
+
+                    break;
+                }
+
+                goto delim_token;
+        }
+
+        token->end = data;
+
+        continue;
+
+    delim:
+
+        token = lexbor_array_obj_push(tokens);
+        if (token == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        token->flags = flags;
+        token->begin = data;
+        token->num = 0;
+        token->keyword_id = 0;
+
+        flags = LXB_GRAMMAR_VALUE_FLAGS_UNDEF;
+
+    delim_token:
+
+        /* Bytes >= 0x80 start a name, a delimiter is always one byte. */
+        token->type = LXB_GRAMMAR_VALUE_DELIM;
+        token->data = data;
+        token->length = 1;
+
+        data++;
+
+        token->end = data;
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static const lxb_char_t *
+lxb_grammar_value_name(const lxb_char_t *data, const lxb_char_t *end)
+{
+    while (data < end) {
+        if (*data == '\\') {
+            data += 2;
+            continue;
+        }
+
+        if (!lxb_grammar_value_is_name(*data)) {
+            break;
+        }
+
+        data++;
+    }
+
+    return (data > end) ? end : data;
+}
+
+/*
+ * The data points to the quote after "url(" and whitespaces.  If there is
+ * no closing ')' after the string returns the fallback and the token stays
+ * an identifier.
+ */
+static const lxb_char_t *
+lxb_grammar_value_url_quoted(lxb_grammar_value_token_t *token,
+                             const lxb_char_t *data, const lxb_char_t *end,
+                             const lxb_char_t *fallback)
+{
+    lxb_char_t ch;
+    const lxb_char_t *start;
+
+    ch = *data++;
+
+    for (start = data; data < end; data++) {
+        if (*data == ch) {
+            break;
+        }
+        else if (*data == '\\') {
+            data++;
+
+            if (data >= end) {
+                return fallback;
+            }
+        }
+    }
+
+    if (data >= end) {
+        return fallback;
+    }
+
+    token->data = start;
+    token->length = data - start;
+
+    for (data++; data < end; data++) {
+        if (*data != ' ' && *data != '\t' && *data != '\n'
+            && *data != '\r' && *data != '\f')
+        {
+            break;
+        }
+    }
+
+    if (data >= end || *data != ')') {
+        token->data = token->begin;
+        token->length = fallback - token->begin;
+
+        return fallback;
+    }
+
+    token->type = LXB_GRAMMAR_VALUE_URL;
+
+    return data + 1;
+}
+
+static const lxb_char_t *
+lxb_grammar_value_number(lxb_grammar_value_token_t *token,
+                         const lxb_char_t *data, const lxb_char_t *end)
+{
+    bool have_minus;
+    const lxb_char_t *start, *num_end;
+
+    have_minus = false;
+    token->flags |= LXB_GRAMMAR_VALUE_FLAGS_INTEGER;
+
+    if (*data == '+' || *data == '-') {
+        have_minus = (*data == '-');
+        data++;
+    }
+
+    start = data;
+
+    while (data < end && lxb_grammar_value_is_digit(*data)) {
+        data++;
+    }
+
+    if ((data + 1) < end && *data == '.'
+        && lxb_grammar_value_is_digit(data[1]))
+    {
+        token->flags &= ~LXB_GRAMMAR_VALUE_FLAGS_INTEGER;
+
+        for (data += 2; data < end; data++) {
+            if (!lxb_grammar_value_is_digit(*data)) {
+                break;
+            }
+        }
+    }
+
+    /* Exponent only if digits follow, 1em is a dimension. */
+    if ((data + 1) < end && (*data == 'e' || *data == 'E')) {
+        num_end = data + 1;
+
+        if ((num_end + 1) < end && (*num_end == '+' || *num_end == '-')) {
+            num_end++;
+        }
+
+        if (lxb_grammar_value_is_digit(*num_end)) {
+            token->flags &= ~LXB_GRAMMAR_VALUE_FLAGS_INTEGER;
+
+            for (data = num_end; data < end; data++) {
+                if (!lxb_grammar_value_is_digit(*data)) {
+                    break;
+                }
+            }
+        }
+    }
+
+    num_end = data;
+
+    token->num = lexbor_conv_data_to_double(&start, (num_end - start));
+
+    if (have_minus) {
+        token->num = -token->num;
+    }
+
+    if (data < end && *data == '%') {
+        token->type = LXB_GRAMMAR_VALUE_PERCENTAGE;
+        token->data = data;
+        token->length = 1;
+
+        return data + 1;
+    }
+
+    if (data < end && lxb_grammar_value_is_ident_start(data, end)) {
+        start = data;
+        data = lxb_grammar_value_name(data, end);
+
+        token->type = LXB_GRAMMAR_VALUE_DIMENSION;
+        token->data = start;
+        token->length = data - start;
+
+        return data;
+    }
+
+    token->type = LXB_GRAMMAR_VALUE_NUMBER;
+    token->data = num_end;
+    token->length = 0;
+
+    return data;
+}
+
+const lxb_char_t *
+lxb_grammar_value_type_name(lxb_grammar_value_type_t type, size_t *len)
+{
+#define lxb_grammar_value_type_name_str(name)                                  \
+    do {                                                                       \
+        if (len != NULL) {                                                     \
+            *len = sizeof(name) - 1;                                           \
+        }                                                                      \
+                                                                               \
+        return (const lxb_char_t *) name;                                      \
+    }                                                                          \
+    while (0)
+
+    switch (type) {
+        case LXB_GRAMMAR_VALUE_IDENT:
+            lxb_grammar_value_type_name_str("IDENT");
+
+        case LXB_GRAMMAR_VALUE_HASH:
+            lxb_grammar_value_type_name_str("HASH");
+
+        case LXB_GRAMMAR_VALUE_STRING:
+            lxb_grammar_value_type_name_str("STRING");
+
+        case LXB_GRAMMAR_VALUE_URL:
+            lxb_grammar_value_type_name_str("URL");
+
+        case LXB_GRAMMAR_VALUE_NUMBER:
+            lxb_grammar_value_type_name_str("NUMBER");
+
+        case LXB_GRAMMAR_VALUE_PERCENTAGE:
+            lxb_grammar_value_type_name_str("PERCENTAGE");
+
+        case LXB_GRAMMAR_VALUE_DIMENSION:
+            lxb_grammar_value_type_name_str("DIMENSION");
+
+        case LXB_GRAMMAR_VALUE_DELIM:
+            lxb_grammar_value_type_name_str("DELIM");
+
+        default:
+            lxb_grammar_value_type_name_str("UNDEFINED");
+    }
+
+#undef lxb_grammar_value_type_name_str
+}
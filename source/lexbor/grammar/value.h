@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_VALUE_H
+#define LEXBOR_GRAMMAR_VALUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+
+#include "lexbor/core/array_obj.h"
+
+
+typedef enum {
+    LXB_GRAMMAR_VALUE_UNDEF = 0x00,
+    LXB_GRAMMAR_VALUE_IDENT,      /* abc */
+    LXB_GRAMMAR_VALUE_HASH,       /* #abc */
+    LXB_GRAMMAR_VALUE_STRING,     /* "abc" or 'abc' */
+    LXB_GRAMMAR_VALUE_URL,        /* url(abc) */
+    LXB_GRAMMAR_VALUE_NUMBER,     /* 12 */
+    LXB_GRAMMAR_VALUE_PERCENTAGE, /* 12% */
+    LXB_GRAMMAR_VALUE_DIMENSION,  /* 12px */
+    LXB_GRAMMAR_VALUE_DELIM       /* one char, like a ',', '/', '(' */
+}
+lxb_grammar_value_type_t;
+
+typedef enum {
+    LXB_GRAMMAR_VALUE_FLAGS_UNDEF   = 0x00,
+    LXB_GRAMMAR_VALUE_FLAGS_WS      = 0x01, /* Whitespace before token. */
+    LXB_GRAMMAR_VALUE_FLAGS_INTEGER = 0x02  /* Number without '.' and 'e'. */
+}
+lxb_grammar_value_flags_t;
+
+/*
+ * All pointers refer to the source data, nothing is copied.
+ *
+ * begin/end -- raw token bytes.
+ * data/length -- name for IDENT and HASH (without '#'), content for STRING
+ *                and URL, unit for DIMENSION, character for DELIM.
+ *                Escapes are not decoded.
+ */
+typedef struct {
+    lxb_grammar_value_type_t type;
+    int                      flags;
+
+    const lxb_char_t         *begin;
+    const lxb_char_t         *end;
+
+    const lxb_char_t         *data;
+    size_t                   length;
+
+    double                   num;
+
+    /* Interned keyword id for IDENT, 0 if IDENT is not a grammar keyword. */
+    size_t                   keyword_id;
+}
+lxb_grammar_value_token_t;
+
+
+/*
+ * Splits CSS value into tokens.  Whitespace and comments are dropped and
+ * reported by LXB_GRAMMAR_VALUE_FLAGS_WS in the next token.
+ *
+ * Tokens appended to the array of lxb_grammar_value_token_t, the array
+ * is not cleaned before.
+ */
+LXB_API lxb_status_t
+lxb_grammar_value_tokenize(lexbor_array_obj_t *tokens,
+                           const lxb_char_t *data, size_t size);
+
+LXB_API const lxb_char_t *
+lxb_grammar_value_type_name(lxb_grammar_value_type_t type, size_t *len);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_VALUE_H */
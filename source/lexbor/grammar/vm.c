@@ -0,0 +1,1098 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include "lexbor/grammar/vm.h"
+#include "lexbor/grammar/cache.h"
+#include "lexbor/grammar/cache_shared.h"
+
+
+#if defined(__GNUC__) && !defined(LXB_GRAMMAR_VM_NO_COMPUTED_GOTO)
+#define LXB_GRAMMAR_VM_COMPUTED_GOTO 1
+#endif
+
+#define LXB_GRAMMAR_VM_NONE UINT32_MAX
+
+#define lxb_grammar_vm_reg(idx)                                                \
+    (((lxb_grammar_vm_reg_t *) vm->regs.list) + base + (idx))
+
+#define lxb_grammar_vm_frame(idx)                                              \
+    (((lxb_grammar_vm_frame_t *) vm->frames.list) + (idx))
+
+/* Old value goes to the trail if backtracking can return to it. */
+#define lxb_grammar_vm_save(reg)                                               \
+    do {                                                                       \
+        if ((size_t) ((reg) - (lxb_grammar_vm_reg_t *) vm->regs.list)          \
+            < vm->mark)                                                        \
+        {                                                                      \
+            status = lxb_grammar_vm_trail(vm, reg);                            \
+            if (status != LXB_STATUS_OK) {                                     \
+                return status;                                                 \
+            }                                                                  \
+        }                                                                      \
+    }                                                                          \
+    while (0)
+
+#ifdef LXB_GRAMMAR_VM_COMPUTED_GOTO
+    #define lxb_grammar_vm_case(op) lxb_grammar_vm_op_ ## op
+    #define lxb_grammar_vm_dispatch() goto *lxb_grammar_vm_labels[ip->opcode]
+#else
+    #define lxb_grammar_vm_case(op) case LXB_GRAMMAR_BYTECODE_OP_ ## op
+    #define lxb_grammar_vm_dispatch() goto dispatch
+#endif
+
+
+lxb_grammar_vm_t *
+lxb_grammar_vm_create(void)
+{
+    return lexbor_calloc(1, sizeof(lxb_grammar_vm_t));
+}
+
+lxb_status_t
+lxb_grammar_vm_init(lxb_grammar_vm_t *vm, lxb_grammar_bytecode_t *bc)
+{
+    lxb_status_t status;
+
+    if (vm == NULL) {
+        return LXB_STATUS_ERROR_OBJECT_IS_NULL;
+    }
+
+    if (bc == NULL) {
+        return LXB_STATUS_ERROR_WRONG_ARGS;
+    }
+
+    status = lexbor_array_obj_init(&vm->tokens, 64,
+                                   sizeof(lxb_grammar_value_token_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lexbor_array_obj_init(&vm->spans, 128,
+                                   sizeof(lxb_grammar_match_span_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lexbor_array_obj_init(&vm->backtrack, 128,
+                                   sizeof(lxb_grammar_vm_backtrack_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lexbor_array_obj_init(&vm->trail, 128,
+                                   sizeof(lxb_grammar_vm_trail_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lexbor_array_obj_init(&vm->frames, 64,
+                                   sizeof(lxb_grammar_vm_frame_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lexbor_array_obj_init(&vm->regs, 256,
+                                   sizeof(lxb_grammar_vm_reg_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    vm->bc = bc;
+    vm->cache = NULL;
+    vm->shared = NULL;
+    vm->data = NULL;
+    vm->stream = NULL;
+    vm->mark = 0;
+    vm->buf = NULL;
+    vm->buf_size = 0;
+
+    return LXB_STATUS_OK;
+}
+
+void
+lxb_grammar_vm_clean(lxb_grammar_vm_t *vm)
+{
+    lexbor_array_obj_clean(&vm->tokens);
+    lexbor_array_obj_clean(&vm->spans);
+    lexbor_array_obj_clean(&vm->backtrack);
+    lexbor_array_obj_clean(&vm->trail);
+    lexbor_array_obj_clean(&vm->frames);
+    lexbor_array_obj_clean(&vm->regs);
+
+    vm->data = NULL;
+    vm->stream = NULL;
+    vm->mark = 0;
+}
+
+lxb_grammar_vm_t *
+lxb_grammar_vm_destroy(lxb_grammar_vm_t *vm, bool self_destroy)
+{
+    if (vm == NULL) {
+        return NULL;
+    }
+
+    lexbor_array_obj_destroy(&vm->tokens, false);
+    lexbor_array_obj_destroy(&vm->spans, false);
+    lexbor_array_obj_destroy(&vm->backtrack, false);
+    lexbor_array_obj_destroy(&vm->trail, false);
+    lexbor_array_obj_destroy(&vm->frames, false);
+    lexbor_array_obj_destroy(&vm->regs, false);
+
+    if (vm->buf != NULL) {
+        vm->buf = lexbor_free(vm->buf);
+    }
+
+    if (self_destroy) {
+        return lexbor_free(vm);
+    }
+
+    return vm;
+}
+
+lxb_status_t
+lxb_grammar_vm_match(lxb_grammar_vm_t *vm,
+                     const lxb_char_t *name, size_t name_len,
+                     const lxb_char_t *data, size_t size,
+                     lxb_grammar_match_result_t *result)
+{
+    long decl;
+
+    result->accepted = false;
+    result->spans = NULL;
+    result->length = 0;
+
+    decl = lxb_grammar_bytecode_declaration(vm->bc, name, name_len);
+    if (decl < 0) {
+        return LXB_STATUS_ERROR_NOT_EXISTS;
+    }
+
+    return lxb_grammar_vm_match_declaration(vm, (size_t) decl,
+                                            data, size, result);
+}
+
+/* Without a call for the common case: the array has room. */
+lxb_inline void *
+lxb_grammar_vm_push(lexbor_array_obj_t *array)
+{
+    void *entry;
+
+    if (array->length < array->size) {
+        entry = array->list + (array->length * array->struct_size);
+        array->length++;
+
+        return entry;
+    }
+
+    return lexbor_array_obj_push(array);
+}
+
+static lxb_status_t
+lxb_grammar_vm_keyword(lxb_grammar_vm_t *vm, lxb_grammar_value_token_t *token)
+{
+    lxb_char_t *buf;
+    lxb_grammar_bytecode_t *bc = vm->bc;
+
+    if (token->type != LXB_GRAMMAR_VALUE_IDENT
+        || token->length > bc->keyword_max_len)
+    {
+        token->keyword_id = 0;
+
+        return LXB_STATUS_OK;
+    }
+
+    if (vm->buf_size < bc->keyword_max_len) {
+        buf = lexbor_realloc(vm->buf, bc->keyword_max_len);
+        if (buf == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        vm->buf = buf;
+        vm->buf_size = bc->keyword_max_len;
+    }
+
+    for (size_t i = 0; i < token->length; i++) {
+        vm->buf[i] = token->data[i];
+
+        if (vm->buf[i] >= 'A' && vm->buf[i] <= 'Z') {
+            vm->buf[i] |= 0x20;
+        }
+    }
+
+    token->keyword_id = lxb_grammar_bytecode_keyword(bc, vm->buf,
+                                                     token->length);
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_vm_keywords(lxb_grammar_vm_t *vm)
+{
+    lxb_status_t status;
+    lxb_grammar_value_token_t *token, *end;
+
+    token = (lxb_grammar_value_token_t *) vm->tokens.list;
+    end = token + vm->tokens.length;
+
+    for (; token < end; token++) {
+        status = lxb_grammar_vm_keyword(vm, token);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+lxb_inline bool
+lxb_grammar_vm_term(lxb_grammar_bytecode_t *bc,
+                    const lxb_grammar_bytecode_term_t *term,
+                    const lxb_grammar_value_token_t *token)
+{
+    size_t len;
+
+    switch (term->type) {
+        case LXB_GRAMMAR_BYTECODE_TERM_KEYWORD:
+            return token->type == LXB_GRAMMAR_VALUE_IDENT
+                   && token->keyword_id != 0
+                   && token->keyword_id == term->value;
+
+        case LXB_GRAMMAR_BYTECODE_TERM_LITERAL:
+            len = token->end - token->begin;
+
+            return len == term->length
+                   && lexbor_str_data_ncasecmp(token->begin,
+                                 lxb_grammar_bytecode_string(bc, term->value),
+                                 len);
+
+        case LXB_GRAMMAR_BYTECODE_TERM_NUMBER:
+            return token->type == LXB_GRAMMAR_VALUE_NUMBER
+                   && token->num == term->num;
+
+        case LXB_GRAMMAR_BYTECODE_TERM_TYPE:
+            return lxb_grammar_type_match(term->value, token);
+
+        default:
+            return false;
+    }
+}
+
+static lxb_status_t
+lxb_grammar_vm_trail(lxb_grammar_vm_t *vm, lxb_grammar_vm_reg_t *reg)
+{
+    lxb_grammar_vm_trail_t *entry;
+
+    entry = lxb_grammar_vm_push(&vm->trail);
+    if (entry == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    entry->index = reg - (lxb_grammar_vm_reg_t *) vm->regs.list;
+    entry->reg = *reg;
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_vm_frame_push(lxb_grammar_vm_t *vm, uint32_t ret, size_t parent,
+                          size_t depth, size_t registers)
+{
+    lxb_grammar_vm_frame_t *frame;
+
+    if (depth >= LXB_GRAMMAR_MATCH_DEPTH_MAX) {
+        return LXB_STATUS_ERROR_OVERFLOW;
+    }
+
+    frame = lxb_grammar_vm_push(&vm->frames);
+    if (frame == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    frame->ret = ret;
+    frame->parent = parent;
+    frame->base = vm->regs.length;
+    frame->depth = depth;
+
+    /* Registers are set by *_ENTER before use. */
+    while (registers-- != 0) {
+        if (lxb_grammar_vm_push(&vm->regs) == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+lxb_grammar_vm_span(lxb_grammar_vm_t *vm, uint32_t id,
+                    size_t first, size_t last)
+{
+    lxb_grammar_tree_t *tree;
+    lxb_grammar_match_span_t *span;
+    const lxb_grammar_value_token_t *tokens;
+
+    span = lxb_grammar_vm_push(&vm->spans);
+    if (span == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    tree = vm->bc->tree;
+    tokens = (const lxb_grammar_value_token_t *) vm->tokens.list;
+
+    span->node = (tree != NULL) ? tree->nodes->list[id] : NULL;
+    span->id = id;
+    span->first = first;
+    span->last = last;
+
+    span->begin = (first < vm->tokens.length) ? tokens[first].begin
+                                              : vm->data_end;
+    span->end = (first == last) ? span->begin : tokens[last - 1].end;
+
+    return LXB_STATUS_OK;
+}
+
+/*
+ * Runs from the state of the VM (vm->pc, vm->pos, vm->fp).
+ *
+ * With the prefix the tokens may be followed by more tokens: the run stops
+ * where a path needs the token after the last one, the value is accepted
+ * (viable) and the state is saved.  The next call goes on from there with
+ * the same stacks, as if all the tokens were there from the start.
+ */
+static lxb_status_t
+lxb_grammar_vm_exec(lxb_grammar_vm_t *vm, bool prefix, bool *accepted)
+{
+    uint64_t full;
+    size_t pos, fp, base, ntokens;
+    lxb_status_t status;
+    lxb_grammar_vm_reg_t *reg;
+    lxb_grammar_vm_frame_t *frame;
+    lxb_grammar_vm_backtrack_t *bt;
+    lxb_grammar_vm_trail_t *trail, *trail_end;
+    const lxb_grammar_bytecode_instr_t *code, *ip;
+    const lxb_grammar_bytecode_term_t *terms;
+    const lxb_grammar_bytecode_decl_t *callee;
+    const lxb_grammar_value_token_t *tokens;
+    lxb_grammar_bytecode_t *bc = vm->bc;
+
+#ifdef LXB_GRAMMAR_VM_COMPUTED_GOTO
+    static const void *lxb_grammar_vm_labels[LXB_GRAMMAR_BYTECODE_OP__LAST_ENTRY] = {
+        &&lxb_grammar_vm_op_TERM,
+        &&lxb_grammar_vm_op_SPLIT,
+        &&lxb_grammar_vm_op_JUMP,
+        &&lxb_grammar_vm_op_CALL,
+        &&lxb_grammar_vm_op_RET,
+        &&lxb_grammar_vm_op_COUNTER_ENTER,
+        &&lxb_grammar_vm_op_COUNTER_LOOP,
+        &&lxb_grammar_vm_op_COUNTER_NEXT,
+        &&lxb_grammar_vm_op_COUNTER_EXIT,
+        &&lxb_grammar_vm_op_MASK_ENTER,
+        &&lxb_grammar_vm_op_MASK_TEST,
+        &&lxb_grammar_vm_op_MASK_SET,
+        &&lxb_grammar_vm_op_MASK_EXIT,
+        &&lxb_grammar_vm_op_FAIL,
+        &&lxb_grammar_vm_op_ACCEPT
+    };
+#endif
+
+    code = (const lxb_grammar_bytecode_instr_t *) bc->code.list;
+    terms = (const lxb_grammar_bytecode_term_t *) bc->terms.list;
+    tokens = (const lxb_grammar_value_token_t *) vm->tokens.list;
+    ntokens = vm->tokens.length;
+
+    pos = vm->pos;
+    fp = vm->fp;
+    base = lxb_grammar_vm_frame(fp)->base;
+    ip = code + vm->pc;
+
+    *accepted = false;
+
+    /* Stopped after the backtrack point of the loop, before the comma. */
+    if (vm->comma) {
+        vm->comma = false;
+        reg = lxb_grammar_vm_reg(ip->reg);
+
+        goto comma;
+    }
+
+#ifdef LXB_GRAMMAR_VM_COMPUTED_GOTO
+    lxb_grammar_vm_dispatch();
+#else
+dispatch:
+
+    switch (ip->opcode) {
+#endif
+
+    lxb_grammar_vm_case(TERM):
+        if (pos >= ntokens) {
+            goto end;
+        }
+
+        if (!lxb_grammar_vm_term(bc, &terms[ip->a], &tokens[pos])) {
+            goto fail;
+        }
+
+        pos++;
+        ip++;
+
+        lxb_grammar_vm_dispatch();
+
+    lxb_grammar_vm_case(SPLIT):
+        bt = lxb_grammar_vm_push(&vm->backtrack);
+        if (bt == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        bt->pc = ip->b;
+        bt->pos = pos;
+        bt->fp = fp;
+        bt->frames = vm->frames.length;
+        bt->regs = vm->regs.length;
+        bt->trail = vm->trail.length;
+        bt->spans = vm->spans.length;
+
+        vm->mark = vm->regs.length;
+
+        ip = code + ip->a;
+
+        lxb_grammar_vm_dispatch();
+
+    lxb_grammar_vm_case(JUMP):
+        ip = code + ip->a;
+
+        lxb_grammar_vm_dispatch();
+
+    lxb_grammar_vm_case(CALL):
+        callee = lxb_grammar_bytecode_decl(bc, ip->a);
+
+        status = lxb_grammar_vm_frame_push(vm, (uint32_t) (ip - code) + 1, fp,
+                                           lxb_grammar_vm_frame(fp)->depth + 1,
+                                           callee->registers);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        fp = vm->frames.length - 1;
+        base = lxb_grammar_vm_frame(fp)->base;
+        ip = code + callee->body;
+
+        lxb_grammar_vm_dispatch();
+
+    /* The frame is dropped if no backtrack point can return into it. */
+    lxb_grammar_vm_case(RET):
+        frame = lxb_grammar_vm_frame(fp);
+        bt = lexbor_array_obj_last(&vm->backtrack);
+
+        ip = code + frame->ret;
+
+        if (fp == vm->frames.length - 1 && (bt == NULL || bt->frames <= fp)) {
+            vm->frames.length = fp;
+            vm->regs.length = frame->base;
+        }
+
+        fp = frame->parent;
+        base = lxb_grammar_vm_frame(fp)->base;
+
+        lxb_grammar_vm_dispatch();
+
+    lxb_grammar_vm_case(COUNTER_ENTER):
+        reg = lxb_grammar_vm_reg(ip->reg);
+        lxb_grammar_vm_save(reg);
+
+        reg->begin = pos;
+        reg->pos = pos;
+        reg->value = 0;
+
+        ip++;
+
+        lxb_grammar_vm_dispatch();
+
+    /* Greedy: one more iteration first, the exit on backtracking. */
+    lxb_grammar_vm_case(COUNTER_LOOP):
+        reg = lxb_grammar_vm_reg(ip->reg);
+
+        if (ip->c != LXB_GRAMMAR_BYTECODE_INFINITY && reg->value >= ip->c) {
+            ip = code + ip->a;
+
+            lxb_grammar_vm_dispatch();
+        }
+
+        if (reg->value >= ip->b) {
+            bt = lxb_grammar_vm_push(&vm->backtrack);
+            if (bt == NULL) {
+                return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+            }
+
+            bt->pc = ip->a;
+            bt->pos = pos;
+            bt->fp = fp;
+            bt->frames = vm->frames.length;
+            bt->regs = vm->regs.length;
+            bt->trail = vm->trail.length;
+            bt->spans = vm->spans.length;
+
+            vm->mark = vm->regs.length;
+        }
+
+        if ((ip->flags & LXB_GRAMMAR_BYTECODE_FLAGS_COMMA) && reg->value != 0) {
+
+comma:
+
+            if (pos >= ntokens) {
+                goto end;
+            }
+
+            if (tokens[pos].type != LXB_GRAMMAR_VALUE_DELIM
+                || *tokens[pos].data != ',')
+            {
+                goto fail;
+            }
+
+            pos++;
+        }
+
+        ip++;
+
+        lxb_grammar_vm_dispatch();
+
+    /* Empty iteration is needed only to reach the minimum. */
+    lxb_grammar_vm_case(COUNTER_NEXT):
+        reg = lxb_grammar_vm_reg(ip->reg);
+
+        if (pos == reg->pos
+            && (reg->value >= ip->b
+                || (ip->flags & LXB_GRAMMAR_BYTECODE_FLAGS_REQUIRED)))
+        {
+            goto fail;
+        }
+
+        lxb_grammar_vm_save(reg);
+
+        reg->value++;
+        reg->pos = pos;
+
+        ip = code + ip->a;
+
+        lxb_grammar_vm_dispatch();
+
+    lxb_grammar_vm_case(COUNTER_EXIT):
+        reg = lxb_grammar_vm_reg(ip->reg);
+
+        if ((ip->flags & LXB_GRAMMAR_BYTECODE_FLAGS_REQUIRED)
+            && pos == reg->begin)
+        {
+            goto fail;
+        }
+
+        status = lxb_grammar_vm_span(vm, ip->a, reg->begin, pos);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        ip++;
+
+        lxb_grammar_vm_dispatch();
+
+    lxb_grammar_vm_case(MASK_ENTER):
+        reg = lxb_grammar_vm_reg(ip->reg);
+        lxb_grammar_vm_save(reg);
+
+        reg->value = 0;
+
+        ip++;
+
+        lxb_grammar_vm_dispatch();
+
+    lxb_grammar_vm_case(MASK_TEST):
+        if (lxb_grammar_vm_reg(ip->reg)->value & ((uint64_t) 1 << ip->a)) {
+            goto fail;
+        }
+
+        ip++;
+
+        lxb_grammar_vm_dispatch();
+
+    lxb_grammar_vm_case(MASK_SET):
+        reg = lxb_grammar_vm_reg(ip->reg);
+        lxb_grammar_vm_save(reg);
+
+        reg->value |= (uint64_t) 1 << ip->a;
+
+        ip++;
+
+        lxb_grammar_vm_dispatch();
+
+    /* All children must occur for &&, one or more for ||. */
+    lxb_grammar_vm_case(MASK_EXIT):
+        reg = lxb_grammar_vm_reg(ip->reg);
+        full = (ip->a >= 64) ? UINT64_MAX : (((uint64_t) 1 << ip->a) - 1);
+
+        if (reg->value != full
+            && ((ip->flags & LXB_GRAMMAR_BYTECODE_FLAGS_ANY) == 0
+                || reg->value == 0))
+        {
+            goto fail;
+        }
+
+        ip++;
+
+        lxb_grammar_vm_dispatch();
+
+    lxb_grammar_vm_case(ACCEPT):
+        if (pos != ntokens) {
+            goto fail;
+        }
+
+        /* More tokens can follow, then this path fails. */
+        if (prefix) {
+            goto end;
+        }
+
+        *accepted = true;
+
+        return LXB_STATUS_OK;
+
+    lxb_grammar_vm_case(FAIL):
+        goto fail;
+
+#ifndef LXB_GRAMMAR_VM_COMPUTED_GOTO
+        default:
+            return LXB_STATUS_ERROR_UNEXPECTED_DATA;
+    }
+#endif
+
+/* A token is needed after the last one. */
+end:
+
+    if (prefix) {
+        vm->pc = (uint32_t) (ip - code);
+        vm->pos = pos;
+        vm->fp = fp;
+        vm->comma = (ip->opcode == LXB_GRAMMAR_BYTECODE_OP_COUNTER_LOOP);
+
+        *accepted = true;
+
+        return LXB_STATUS_OK;
+    }
+
+fail:
+
+    if (vm->backtrack.length == 0) {
+        return LXB_STATUS_OK;
+    }
+
+    bt = lexbor_array_obj_pop(&vm->backtrack);
+
+    trail = ((lxb_grammar_vm_trail_t *) vm->trail.list) + bt->trail;
+    trail_end = ((lxb_grammar_vm_trail_t *) vm->trail.list)
+                + vm->trail.length;
+
+    while (trail_end > trail) {
+        trail_end--;
+
+        ((lxb_grammar_vm_reg_t *) vm->regs.list)[trail_end->index]
+                                                                = trail_end->reg;
+    }
+
+    vm->trail.length = bt->trail;
+    vm->frames.length = bt->frames;
+    vm->regs.length = bt->regs;
+    vm->spans.length = bt->spans;
+
+    pos = bt->pos;
+    fp = bt->fp;
+    base = lxb_grammar_vm_frame(fp)->base;
+    ip = code + bt->pc;
+
+    bt = lexbor_array_obj_last(&vm->backtrack);
+    vm->mark = (bt != NULL) ? bt->regs : 0;
+
+    lxb_grammar_vm_dispatch();
+}
+
+static lxb_status_t
+lxb_grammar_vm_run(lxb_grammar_vm_t *vm, const lxb_grammar_bytecode_decl_t *decl,
+                   bool prefix, bool *accepted)
+{
+    lxb_status_t status;
+
+    *accepted = false;
+
+    status = lxb_grammar_vm_frame_push(vm, LXB_GRAMMAR_VM_NONE, 0, 0,
+                                       decl->entry_registers);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    vm->pc = decl->entry;
+    vm->pos = 0;
+    vm->fp = 0;
+    vm->comma = false;
+
+    return lxb_grammar_vm_exec(vm, prefix, accepted);
+}
+
+lxb_inline void
+lxb_grammar_vm_reset(lxb_grammar_vm_t *vm)
+{
+    lexbor_array_obj_clean(&vm->backtrack);
+    lexbor_array_obj_clean(&vm->trail);
+    lexbor_array_obj_clean(&vm->frames);
+    lexbor_array_obj_clean(&vm->regs);
+
+    vm->mark = 0;
+}
+
+/* Spans of the value are appended to the spans of previous values. */
+static lxb_status_t
+lxb_grammar_vm_value(lxb_grammar_vm_t *vm,
+                     const lxb_grammar_bytecode_decl_t *entry,
+                     const lxb_char_t *data, size_t size, bool *accepted)
+{
+    size_t begin;
+    lxb_status_t status;
+    lxb_grammar_match_result_t result;
+    const lxb_grammar_cache_entry_t *cached;
+
+    vm->data = NULL;
+
+    if (vm->cache != NULL) {
+        cached = lxb_grammar_cache_find(vm->cache, entry->node_id, data, size);
+        if (cached != NULL) {
+            *accepted = cached->accepted;
+
+            return lxb_grammar_cache_spans(cached, data, &vm->spans);
+        }
+    }
+
+    if (vm->shared != NULL
+        && lxb_grammar_cache_shared_find(vm->shared, entry->node_id,
+                                         data, size, &vm->spans, accepted))
+    {
+        return LXB_STATUS_OK;
+    }
+
+    lexbor_array_obj_clean(&vm->tokens);
+    lxb_grammar_vm_reset(vm);
+
+    *accepted = false;
+
+    status = lxb_grammar_value_tokenize(&vm->tokens, data, size);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    begin = vm->spans.length;
+
+    /* Rejected without matching, but cached. */
+    if (!lxb_grammar_bytecode_decl_fit(entry, vm->tokens.length)) {
+        status = LXB_STATUS_OK;
+        goto done;
+    }
+
+    status = lxb_grammar_vm_keywords(vm);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    vm->data = data;
+    vm->data_end = data + size;
+
+    status = lxb_grammar_vm_run(vm, entry, false, accepted);
+
+    if (!*accepted) {
+        vm->spans.length = begin;
+    }
+
+done:
+
+    if ((vm->cache == NULL && vm->shared == NULL)
+        || status != LXB_STATUS_OK)
+    {
+        return status;
+    }
+
+    result.accepted = *accepted;
+    result.spans = ((lxb_grammar_match_span_t *) vm->spans.list) + begin;
+    result.length = vm->spans.length - begin;
+
+    if (vm->shared != NULL) {
+        (void) lxb_grammar_cache_shared_insert(vm->shared, entry->node_id,
+                                               data, size, &result);
+    }
+
+    if (vm->cache == NULL) {
+        return LXB_STATUS_OK;
+    }
+
+    return lxb_grammar_cache_insert(vm->cache, entry->node_id,
+                                    data, size, &result);
+}
+
+lxb_status_t
+lxb_grammar_vm_match_declaration(lxb_grammar_vm_t *vm, size_t decl,
+                                 const lxb_char_t *data, size_t size,
+                                 lxb_grammar_match_result_t *result)
+{
+    bool accepted;
+    lxb_status_t status;
+    const lxb_grammar_bytecode_decl_t *entry;
+
+    result->accepted = false;
+    result->spans = NULL;
+    result->length = 0;
+
+    entry = lxb_grammar_bytecode_decl(vm->bc, decl);
+    if (entry == NULL) {
+        return LXB_STATUS_ERROR_NOT_EXISTS;
+    }
+
+    lxb_grammar_vm_clean(vm);
+
+    status = lxb_grammar_vm_value(vm, entry, data, size, &accepted);
+    if (status != LXB_STATUS_OK) {
+        lexbor_array_obj_clean(&vm->spans);
+
+        return status;
+    }
+
+    result->accepted = accepted;
+
+    if (accepted) {
+        result->spans = (lxb_grammar_match_span_t *) vm->spans.list;
+        result->length = vm->spans.length;
+    }
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_vm_match_batch(lxb_grammar_vm_t *vm, size_t decl,
+                           const lxb_grammar_match_value_t *values,
+                           size_t count, lxb_grammar_match_result_t *results)
+{
+    bool accepted;
+    size_t begin;
+    lxb_status_t status;
+    lxb_grammar_match_span_t *spans;
+    const lxb_grammar_bytecode_decl_t *entry;
+
+    for (size_t i = 0; i < count; i++) {
+        results[i].accepted = false;
+        results[i].spans = NULL;
+        results[i].length = 0;
+    }
+
+    entry = lxb_grammar_bytecode_decl(vm->bc, decl);
+    if (entry == NULL) {
+        return LXB_STATUS_ERROR_NOT_EXISTS;
+    }
+
+    lxb_grammar_vm_clean(vm);
+
+    for (size_t i = 0; i < count; i++) {
+        begin = vm->spans.length;
+
+        status = lxb_grammar_vm_value(vm, entry, values[i].data,
+                                      values[i].length, &accepted);
+        if (status != LXB_STATUS_OK) {
+            lexbor_array_obj_clean(&vm->spans);
+
+            for (size_t n = 0; n < i; n++) {
+                results[n].accepted = false;
+                results[n].length = 0;
+            }
+
+            return status;
+        }
+
+        results[i].accepted = accepted;
+        results[i].length = vm->spans.length - begin;
+    }
+
+    /* The spans are in one array, it is not reallocated anymore. */
+    spans = (lxb_grammar_match_span_t *) vm->spans.list;
+
+    for (size_t i = 0; i < count; i++) {
+        if (results[i].accepted) {
+            results[i].spans = spans;
+            spans += results[i].length;
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_vm_begin(lxb_grammar_vm_t *vm, size_t decl)
+{
+    lxb_status_t status;
+    const lxb_grammar_bytecode_decl_t *entry;
+
+    entry = lxb_grammar_bytecode_decl(vm->bc, decl);
+    if (entry == NULL) {
+        return LXB_STATUS_ERROR_NOT_EXISTS;
+    }
+
+    lxb_grammar_vm_clean(vm);
+
+    vm->data_end = NULL;
+
+    /* Up to the first token. */
+    status = lxb_grammar_vm_run(vm, entry, true, &vm->viable);
+    if (status != LXB_STATUS_OK) {
+        lxb_grammar_vm_clean(vm);
+
+        return status;
+    }
+
+    vm->stream = entry;
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_vm_feed(lxb_grammar_vm_t *vm,
+                    const lxb_grammar_value_token_t *token, bool *viable)
+{
+    lxb_status_t status;
+    lxb_grammar_value_token_t *entry;
+
+    *viable = false;
+
+    if (vm->stream == NULL) {
+        return LXB_STATUS_ERROR_WRONG_STAGE;
+    }
+
+    /* Nothing can follow a rejected prefix. */
+    if (!vm->viable) {
+        return LXB_STATUS_OK;
+    }
+
+    entry = lxb_grammar_vm_push(&vm->tokens);
+    if (entry == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    *entry = *token;
+
+    status = lxb_grammar_vm_keyword(vm, entry);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    vm->data_end = entry->end;
+
+    if (vm->stream->max_tokens != UINT32_MAX
+        && vm->tokens.length > vm->stream->max_tokens)
+    {
+        vm->viable = false;
+
+        return LXB_STATUS_OK;
+    }
+
+    status = lxb_grammar_vm_exec(vm, true, &vm->viable);
+    if (status != LXB_STATUS_OK) {
+        vm->viable = false;
+
+        return status;
+    }
+
+    *viable = vm->viable;
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_vm_finish(lxb_grammar_vm_t *vm, lxb_grammar_match_result_t *result)
+{
+    bool accepted;
+    lxb_status_t status;
+    lxb_grammar_match_span_t *span, *end;
+    const lxb_grammar_value_token_t *tokens;
+    const lxb_grammar_bytecode_decl_t *entry;
+
+    result->accepted = false;
+    result->spans = NULL;
+    result->length = 0;
+
+    entry = vm->stream;
+    if (entry == NULL) {
+        return LXB_STATUS_ERROR_WRONG_STAGE;
+    }
+
+    vm->stream = NULL;
+
+    if (!vm->viable
+        || !lxb_grammar_bytecode_decl_fit(entry, vm->tokens.length))
+    {
+        lexbor_array_obj_clean(&vm->spans);
+
+        return LXB_STATUS_OK;
+    }
+
+    /* No more tokens: the paths waiting for one fail now. */
+    status = lxb_grammar_vm_exec(vm, false, &accepted);
+    if (status != LXB_STATUS_OK || !accepted) {
+        lexbor_array_obj_clean(&vm->spans);
+
+        return status;
+    }
+
+    /* An empty span made before its token was fed points to the token. */
+    tokens = (const lxb_grammar_value_token_t *) vm->tokens.list;
+    span = (lxb_grammar_match_span_t *) vm->spans.list;
+    end = span + vm->spans.length;
+
+    for (; span < end; span++) {
+        if (span->first == span->last && span->first < vm->tokens.length) {
+            span->begin = tokens[span->first].begin;
+            span->end = span->begin;
+        }
+    }
+
+    result->accepted = true;
+    result->spans = (lxb_grammar_match_span_t *) vm->spans.list;
+    result->length = vm->spans.length;
+
+    return LXB_STATUS_OK;
+}
+
+lxb_status_t
+lxb_grammar_vm_events(lxb_grammar_vm_t *vm,
+                      const lxb_char_t *data, size_t size,
+                      const lxb_grammar_match_result_t *result,
+                      lxb_grammar_match_event_t *events, size_t capacity,
+                      size_t *length)
+{
+    lxb_status_t status;
+
+    *length = 0;
+
+    if (!result->accepted) {
+        return LXB_STATUS_OK;
+    }
+
+    if (vm->data != data || vm->data_end != data + size) {
+        lexbor_array_obj_clean(&vm->tokens);
+
+        vm->data = NULL;
+
+        status = lxb_grammar_value_tokenize(&vm->tokens, data, size);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        status = lxb_grammar_vm_keywords(vm);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+
+        vm->data = data;
+        vm->data_end = data + size;
+    }
+
+    return lxb_grammar_match_result_events(result, &vm->tokens,
+                                           events, capacity, length);
+}
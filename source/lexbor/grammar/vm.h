@@ -0,0 +1,186 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#ifndef LEXBOR_GRAMMAR_VM_H
+#define LEXBOR_GRAMMAR_VM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "lexbor/grammar/base.h"
+#include "lexbor/grammar/bytecode.h"
+#include "lexbor/grammar/match.h"
+#include "lexbor/grammar/value.h"
+
+#include "lexbor/core/array_obj.h"
+
+
+/* Counter: begin, position of the current iteration, count. Mask: value. */
+typedef struct {
+    size_t   begin;
+    size_t   pos;
+    uint64_t value;
+}
+lxb_grammar_vm_reg_t;
+
+typedef struct {
+    uint32_t ret;
+    size_t   parent;
+    size_t   base;    /* First register of the frame. */
+    size_t   depth;
+}
+lxb_grammar_vm_frame_t;
+
+typedef struct {
+    uint32_t pc;
+    size_t   pos;
+    size_t   fp;
+
+    /* Lengths of the stacks. */
+    size_t   frames;
+    size_t   regs;
+    size_t   trail;
+    size_t   spans;
+}
+lxb_grammar_vm_backtrack_t;
+
+/* Old value of the register, restored on backtracking. */
+typedef struct {
+    size_t               index;
+    lxb_grammar_vm_reg_t reg;
+}
+lxb_grammar_vm_trail_t;
+
+struct lxb_grammar_vm {
+    lxb_grammar_bytecode_t *bc;
+
+    /* Settings, may be changed after init. */
+    lxb_grammar_cache_t    *cache;  /* See lexbor/grammar/cache.h. */
+
+    /* See lexbor/grammar/cache_shared.h. */
+    lxb_grammar_cache_shared_t *shared;
+
+    lexbor_array_obj_t     tokens;
+    lexbor_array_obj_t     spans;
+
+    lexbor_array_obj_t     backtrack;
+    lexbor_array_obj_t     trail;
+    lexbor_array_obj_t     frames;
+    lexbor_array_obj_t     regs;
+
+    /* Registers below the mark exist in the last backtrack point. */
+    size_t                 mark;
+
+    /* For lowercase keywords. */
+    lxb_char_t             *buf;
+    size_t                 buf_size;
+
+    /* Value of the tokens, NULL if the last value was not tokenized. */
+    const lxb_char_t       *data;
+    const lxb_char_t       *data_end;
+
+    /* Declaration of lxb_grammar_vm_begin(), NULL if no tokens are fed. */
+    const lxb_grammar_bytecode_decl_t *stream;
+    bool                   viable;
+
+    /* Where the run goes on with the next fed token. */
+    uint32_t               pc;
+    size_t                 pos;
+    size_t                 fp;
+    bool                   comma;
+};
+
+
+LXB_API lxb_grammar_vm_t *
+lxb_grammar_vm_create(void);
+
+LXB_API lxb_status_t
+lxb_grammar_vm_init(lxb_grammar_vm_t *vm, lxb_grammar_bytecode_t *bc);
+
+LXB_API void
+lxb_grammar_vm_clean(lxb_grammar_vm_t *vm);
+
+LXB_API lxb_grammar_vm_t *
+lxb_grammar_vm_destroy(lxb_grammar_vm_t *vm, bool self_destroy);
+
+/*
+ * Same as lxb_grammar_match(), but runs the bytecode.
+ * Spans have node == NULL if bytecode has no tree.
+ */
+LXB_API lxb_status_t
+lxb_grammar_vm_match(lxb_grammar_vm_t *vm,
+                     const lxb_char_t *name, size_t name_len,
+                     const lxb_char_t *data, size_t size,
+                     lxb_grammar_match_result_t *result);
+
+/* The decl is index from lxb_grammar_bytecode_declaration(). */
+LXB_API lxb_status_t
+lxb_grammar_vm_match_declaration(lxb_grammar_vm_t *vm, size_t decl,
+                                 const lxb_char_t *data, size_t size,
+                                 lxb_grammar_match_result_t *result);
+
+/* Same as lxb_grammar_match_batch(), but runs the bytecode. */
+LXB_API lxb_status_t
+lxb_grammar_vm_match_batch(lxb_grammar_vm_t *vm, size_t decl,
+                           const lxb_grammar_match_value_t *values,
+                           size_t count, lxb_grammar_match_result_t *results);
+
+/*
+ * Push matching: tokens of a value one by one, for example from a CSS
+ * tokenizer, without the whole value at hand.
+ *
+ *     lxb_grammar_vm_begin(vm, decl);
+ *
+ *     while (next token) {
+ *         lxb_grammar_vm_feed(vm, &token, &viable);
+ *         if (!viable) { the value is rejected, skip the rest of it }
+ *     }
+ *
+ *     lxb_grammar_vm_finish(vm, &result);
+ *
+ * The decl is index from lxb_grammar_bytecode_declaration().
+ */
+LXB_API lxb_status_t
+lxb_grammar_vm_begin(lxb_grammar_vm_t *vm, size_t decl);
+
+/*
+ * The token is copied, its data must live until the result is used.
+ * The keyword_id is set by the VM.
+ *
+ * Viable is false as soon as no value starting with the fed tokens can be
+ * accepted, following tokens are ignored then.
+ *
+ * The run of the bytecode stops where it needs the next token and goes on
+ * from there with the next feed, all feeds of a value take the time of one
+ * match of the value.  Fed tokens are kept for backtracking and spans.
+ */
+LXB_API lxb_status_t
+lxb_grammar_vm_feed(lxb_grammar_vm_t *vm,
+                    const lxb_grammar_value_token_t *token, bool *viable);
+
+/*
+ * Same result as lxb_grammar_vm_match_declaration() for the fed tokens.
+ * Empty spans at the end point to the end of the last token.
+ * The cache is not used.
+ */
+LXB_API lxb_status_t
+lxb_grammar_vm_finish(lxb_grammar_vm_t *vm, lxb_grammar_match_result_t *result);
+
+/* Same as lxb_grammar_match_events(). */
+LXB_API lxb_status_t
+lxb_grammar_vm_events(lxb_grammar_vm_t *vm,
+                      const lxb_char_t *data, size_t size,
+                      const lxb_grammar_match_result_t *result,
+                      lxb_grammar_match_event_t *events, size_t capacity,
+                      size_t *length);
+
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LEXBOR_GRAMMAR_VM_H */
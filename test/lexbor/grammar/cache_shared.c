@@ -0,0 +1,682 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+/*
+ * Shared cache: lookups and stores of one thread, then the grammars of
+ * the match tests from many threads on one shard, every result must be
+ * the same as without the cache.
+ */
+
+#include <pthread.h>
+
+#include <unit/test.h>
+#include <unit/kv.h>
+
+#include <lexbor/grammar/tokenizer.h>
+#include <lexbor/grammar/parser.h>
+#include <lexbor/grammar/tree.h>
+#include <lexbor/grammar/frozen.h>
+#include <lexbor/grammar/vm.h>
+#include <lexbor/grammar/cache_shared.h>
+
+
+#define THREADS 4
+#define ROUNDS  200
+
+
+typedef struct {
+    unit_kv_t                  *kv;
+}
+helper_t;
+
+typedef struct {
+    lxb_grammar_frozen_t       *frozen;
+    lxb_grammar_cache_shared_t *shared;
+    const lexbor_str_t         *name;
+    const lexbor_str_t         **values;
+    size_t                     length;
+    size_t                     index;
+    lxb_status_t               status;
+    pthread_t                  thread;
+}
+thread_t;
+
+
+static lxb_status_t
+single(void);
+
+static lxb_status_t
+single_find(lxb_grammar_cache_shared_t *cache, size_t decl, const char *data,
+            bool need, bool need_accepted, size_t need_spans);
+
+static lxb_status_t
+check(helper_t *helper, unit_kv_value_t *value);
+
+static lxb_status_t
+check_entry(helper_t *helper, unit_kv_value_t *entry,
+            lxb_grammar_cache_shared_t *shared);
+
+static lxb_grammar_frozen_t *
+compile(const lexbor_str_t *str);
+
+static size_t
+values_append(const lexbor_str_t **list, size_t length,
+              unit_kv_value_t *values);
+
+static void *
+thread_run(void *arg);
+
+static bool
+same(const lxb_grammar_match_result_t *result,
+     const lxb_grammar_match_result_t *cached);
+
+static lxb_status_t
+print_error(helper_t *helper, unit_kv_value_t *value);
+
+
+int
+main(int argc, const char * argv[])
+{
+    lxb_status_t status;
+    unit_kv_value_t *value;
+    helper_t helper = {0};
+
+    if (argc != 2) {
+        printf("Usage:\n\tgrammar_cache_shared <file path>\n");
+        return EXIT_FAILURE;
+    }
+
+    TEST_INIT();
+
+    status = single();
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    helper.kv = unit_kv_create();
+    status = unit_kv_init(helper.kv, 256);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    TEST_PRINTLN("Parse file: %s", argv[1]);
+
+    status = unit_kv_parse_file(helper.kv, (const lxb_char_t *) argv[1]);
+    if (status != LXB_STATUS_OK) {
+        lexbor_str_t str = unit_kv_parse_error_as_string(helper.kv);
+
+        TEST_PRINTLN("%s", str.data);
+
+        unit_kv_string_destroy(helper.kv, &str, false);
+
+        return EXIT_FAILURE;
+    }
+
+    value = unit_kv_value(helper.kv);
+    if (value == NULL) {
+        TEST_PRINTLN("Failed to get root value");
+        return EXIT_FAILURE;
+    }
+
+    status = check(&helper, value);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    TEST_RUN("lexbor/grammar/cache_shared");
+    TEST_RELEASE();
+
+done:
+
+    unit_kv_destroy(helper.kv, true);
+
+    return EXIT_FAILURE;
+}
+
+/* One shard of four slots, all of them are the ways of every value. */
+static lxb_status_t
+single(void)
+{
+    bool accepted;
+    size_t found;
+    lxb_status_t status;
+    lexbor_array_obj_t list;
+    lxb_grammar_cache_shared_t *cache;
+    lxb_grammar_match_result_t result;
+    lxb_grammar_match_span_t spans[2];
+    char large[LXB_GRAMMAR_CACHE_SHARED_SLOT];
+
+    static const char *const values[] = {"a b", "c", "d", "e", "f"};
+
+    TEST_PRINTLN("Single thread");
+
+    cache = lxb_grammar_cache_shared_create();
+    status = lxb_grammar_cache_shared_init(cache, 1, 4, 0);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    /* Miss */
+    status = single_find(cache, 1, values[0], false, false, 0);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    /* Accepted, with spans of "a" and "a b". */
+    memset(spans, 0, sizeof(spans));
+
+    spans[0].id = 3;
+    spans[0].last = 1;
+    spans[0].begin = (const lxb_char_t *) values[0];
+    spans[0].end = spans[0].begin + 1;
+
+    spans[1].id = 1;
+    spans[1].last = 2;
+    spans[1].begin = (const lxb_char_t *) values[0];
+    spans[1].end = spans[1].begin + 3;
+
+    result.accepted = true;
+    result.spans = spans;
+    result.length = 2;
+
+    if (!lxb_grammar_cache_shared_insert(cache, 1,
+                                         (const lxb_char_t *) values[0], 3,
+                                         &result))
+    {
+        TEST_PRINTLN("Accepted value is not stored");
+        goto failed;
+    }
+
+    status = single_find(cache, 1, values[0], true, true, 2);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    /* Other declaration, same value. */
+    status = single_find(cache, 2, values[0], false, false, 0);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    /* Rejected, without spans. */
+    result.accepted = false;
+    result.length = 0;
+
+    for (size_t i = 1; i < 4; i++) {
+        if (!lxb_grammar_cache_shared_insert(cache, 1,
+                                             (const lxb_char_t *) values[i],
+                                             strlen(values[i]), &result))
+        {
+            TEST_PRINTLN("Rejected value is not stored: %s", values[i]);
+            goto failed;
+        }
+    }
+
+    for (size_t i = 1; i < 4; i++) {
+        status = single_find(cache, 1, values[i], true, false, 0);
+        if (status != LXB_STATUS_OK) {
+            goto failed;
+        }
+    }
+
+    /* All four ways are full, one of them is replaced. */
+    if (!lxb_grammar_cache_shared_insert(cache, 1,
+                                         (const lxb_char_t *) values[4],
+                                         strlen(values[4]), &result))
+    {
+        TEST_PRINTLN("Value is not stored in the full shard");
+        goto failed;
+    }
+
+    status = single_find(cache, 1, values[4], true, false, 0);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    status = lexbor_array_obj_init(&list, 4,
+                                   sizeof(lxb_grammar_match_span_t));
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    found = 0;
+
+    for (size_t i = 0; i < 4; i++) {
+        found += lxb_grammar_cache_shared_find(cache, 1,
+                                               (const lxb_char_t *) values[i],
+                                               strlen(values[i]), &list,
+                                               &accepted);
+    }
+
+    lexbor_array_obj_destroy(&list, false);
+
+    if (found != 3) {
+        TEST_PRINTLN("Values left after eviction: "LEXBOR_FORMAT_Z, found);
+        goto failed;
+    }
+
+    /* Too large for a slot. */
+    memset(large, 'x', sizeof(large));
+
+    if (lxb_grammar_cache_shared_insert(cache, 1, (const lxb_char_t *) large,
+                                        sizeof(large), &result))
+    {
+        TEST_PRINTLN("Too large value is stored");
+        goto failed;
+    }
+
+    lxb_grammar_cache_shared_destroy(cache, true);
+
+    return LXB_STATUS_OK;
+
+failed:
+
+    lxb_grammar_cache_shared_destroy(cache, true);
+
+    return LXB_STATUS_ERROR;
+}
+
+static lxb_status_t
+single_find(lxb_grammar_cache_shared_t *cache, size_t decl, const char *data,
+            bool need, bool need_accepted, size_t need_spans)
+{
+    bool found, accepted;
+    char copy[32];
+    lxb_status_t status;
+    lexbor_array_obj_t list;
+    lxb_grammar_match_span_t *span;
+    size_t length = strlen(data);
+
+    status = lexbor_array_obj_init(&list, 4, sizeof(lxb_grammar_match_span_t));
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    /* Spans must refer to the given data, not to the stored one. */
+    memcpy(copy, data, length + 1);
+
+    accepted = !need_accepted;
+
+    found = lxb_grammar_cache_shared_find(cache, decl,
+                                          (const lxb_char_t *) copy, length,
+                                          &list, &accepted);
+
+    if (found != need) {
+        TEST_PRINTLN("Value must be %s: %s", (need) ? "found" : "missed",
+                     data);
+        goto failed;
+    }
+
+    if (!found) {
+        lexbor_array_obj_destroy(&list, false);
+        return LXB_STATUS_OK;
+    }
+
+    if (accepted != need_accepted || list.length != need_spans) {
+        TEST_PRINTLN("Bad result of value: %s", data);
+        goto failed;
+    }
+
+    for (size_t i = 0; i < list.length; i++) {
+        span = lexbor_array_obj_get(&list, i);
+
+        if (span->begin < (const lxb_char_t *) copy
+            || span->end > (const lxb_char_t *) copy + length)
+        {
+            TEST_PRINTLN("Bad span of value: %s", data);
+            goto failed;
+        }
+    }
+
+    lexbor_array_obj_destroy(&list, false);
+
+    return LXB_STATUS_OK;
+
+failed:
+
+    lexbor_array_obj_destroy(&list, false);
+
+    return LXB_STATUS_ERROR;
+}
+
+static lxb_status_t
+check(helper_t *helper, unit_kv_value_t *value)
+{
+    lxb_status_t status;
+    unit_kv_array_t *entries;
+    lxb_grammar_cache_shared_t *shared;
+
+    if (unit_kv_is_array(value) == false) {
+        return print_error(helper, value);
+    }
+
+    entries = unit_kv_array(value);
+
+    /* One small shard, all threads write to it and evict each other. */
+    shared = lxb_grammar_cache_shared_create();
+    status = lxb_grammar_cache_shared_init(shared, 1, 4, 0);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    for (size_t i = 0; i < entries->length; i++) {
+        if (unit_kv_is_hash(entries->list[i]) == false) {
+            status = print_error(helper, entries->list[i]);
+            goto failed;
+        }
+
+        if (unit_kv_hash_value_nolen_c(entries->list[i], "error") != NULL) {
+            continue;
+        }
+
+        TEST_PRINTLN("Test #"LEXBOR_FORMAT_Z, (i + 1));
+
+        lxb_grammar_cache_shared_clean(shared);
+
+        status = check_entry(helper, entries->list[i], shared);
+        if (status != LXB_STATUS_OK) {
+            goto failed;
+        }
+    }
+
+failed:
+
+    lxb_grammar_cache_shared_destroy(shared, true);
+
+    return status;
+}
+
+static lxb_status_t
+check_entry(helper_t *helper, unit_kv_value_t *entry,
+            lxb_grammar_cache_shared_t *shared)
+{
+    size_t length;
+    lxb_status_t status;
+    thread_t threads[THREADS];
+    lxb_grammar_frozen_t *frozen;
+    const lexbor_str_t **values;
+    unit_kv_value_t *grammar, *name, *valid, *invalid;
+
+    grammar = unit_kv_hash_value_nolen_c(entry, "grammar");
+    name = unit_kv_hash_value_nolen_c(entry, "declaration");
+
+    if (grammar == NULL || unit_kv_is_string(grammar) == false
+        || name == NULL || unit_kv_is_string(name) == false)
+    {
+        return print_error(helper, entry);
+    }
+
+    valid = unit_kv_hash_value_nolen_c(entry, "valid");
+    invalid = unit_kv_hash_value_nolen_c(entry, "invalid");
+
+    length = 0;
+    length += (valid != NULL) ? unit_kv_array(valid)->length : 0;
+    length += (invalid != NULL) ? unit_kv_array(invalid)->length : 0;
+
+    if (length == 0) {
+        return LXB_STATUS_OK;
+    }
+
+    values = lexbor_malloc(length * sizeof(lexbor_str_t *));
+    if (values == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    length = values_append(values, 0, valid);
+    length = values_append(values, length, invalid);
+
+    frozen = compile(unit_kv_string(grammar));
+    if (frozen == NULL) {
+        lexbor_free(values);
+        return print_error(helper, grammar);
+    }
+
+    for (size_t i = 0; i < THREADS; i++) {
+        threads[i].frozen = frozen;
+        threads[i].shared = shared;
+        threads[i].name = unit_kv_string(name);
+        threads[i].values = values;
+        threads[i].length = length;
+        threads[i].index = i;
+        threads[i].status = LXB_STATUS_OK;
+
+        if (pthread_create(&threads[i].thread, NULL, thread_run,
+                           &threads[i]))
+        {
+            TEST_PRINTLN("Failed to create thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    status = LXB_STATUS_OK;
+
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(threads[i].thread, NULL);
+
+        if (threads[i].status != LXB_STATUS_OK) {
+            status = threads[i].status;
+        }
+    }
+
+    lxb_grammar_frozen_destroy(frozen, true);
+    lexbor_free(values);
+
+    if (status != LXB_STATUS_OK) {
+        return print_error(helper, entry);
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_grammar_frozen_t *
+compile(const lexbor_str_t *str)
+{
+    lxb_status_t status;
+    lxb_grammar_node_t *root;
+    lxb_grammar_tree_t *tree;
+    lxb_grammar_bytecode_t *bc;
+    lxb_grammar_frozen_t *frozen;
+    lxb_grammar_parser_t *parser;
+    lxb_grammar_tokenizer_t *tkz;
+    lxb_grammar_document_t *document;
+
+    frozen = NULL;
+
+    tkz = lxb_grammar_tokenizer_create();
+    status = lxb_grammar_tokenizer_init(tkz);
+    if (status != LXB_STATUS_OK) {
+        return NULL;
+    }
+
+    document = lxb_grammar_tokenizer_process(tkz, str->data, str->length);
+
+    lxb_grammar_tokenizer_destroy(tkz, true);
+
+    if (document == NULL) {
+        return NULL;
+    }
+
+    parser = lxb_grammar_parser_create();
+    status = lxb_grammar_parser_init(parser);
+    if (status != LXB_STATUS_OK) {
+        goto failed_parser;
+    }
+
+    root = lxb_grammar_parser_process(parser, document);
+    if (root == NULL) {
+        lxb_grammar_parser_print_last_error(parser);
+        goto failed_parser;
+    }
+
+    tree = lxb_grammar_tree_create();
+    status = lxb_grammar_tree_init(tree, document);
+    if (status != LXB_STATUS_OK) {
+        goto failed_tree;
+    }
+
+    status = lxb_grammar_tree_make(tree, root);
+    if (status != LXB_STATUS_OK) {
+        goto failed_tree;
+    }
+
+    bc = lxb_grammar_bytecode_create();
+    status = lxb_grammar_bytecode_init(bc);
+    if (status != LXB_STATUS_OK) {
+        goto failed_bc;
+    }
+
+    status = lxb_grammar_bytecode_make(bc, tree);
+    if (status != LXB_STATUS_OK) {
+        goto failed_bc;
+    }
+
+    frozen = lxb_grammar_frozen_create();
+    status = lxb_grammar_frozen_init(frozen, bc);
+    if (status != LXB_STATUS_OK) {
+        frozen = lxb_grammar_frozen_destroy(frozen, true);
+    }
+
+failed_bc:
+
+    lxb_grammar_bytecode_destroy(bc, true);
+
+failed_tree:
+
+    lxb_grammar_tree_destroy(tree, true);
+
+failed_parser:
+
+    lxb_grammar_parser_destroy(parser, true);
+    lxb_grammar_document_destroy(document);
+
+    return frozen;
+}
+
+static size_t
+values_append(const lexbor_str_t **list, size_t length,
+              unit_kv_value_t *values)
+{
+    unit_kv_array_t *array;
+
+    if (values == NULL) {
+        return length;
+    }
+
+    array = unit_kv_array(values);
+
+    for (size_t i = 0; i < array->length; i++) {
+        list[length++] = unit_kv_string(array->list[i]);
+    }
+
+    return length;
+}
+
+/*
+ * Matches all values by a VM with the shared cache and by one without,
+ * each thread from its own value.
+ */
+static void *
+thread_run(void *arg)
+{
+    size_t idx;
+    const lexbor_str_t *str;
+    lxb_grammar_vm_t *vm, *cached_vm;
+    lxb_grammar_match_result_t result, cached;
+    thread_t *ctx = arg;
+
+    vm = lxb_grammar_vm_create();
+    ctx->status = lxb_grammar_vm_init(vm,
+                                      lxb_grammar_frozen_bytecode(ctx->frozen));
+    if (ctx->status != LXB_STATUS_OK) {
+        lxb_grammar_vm_destroy(vm, true);
+        return NULL;
+    }
+
+    cached_vm = lxb_grammar_vm_create();
+    ctx->status = lxb_grammar_vm_init(cached_vm,
+                                      lxb_grammar_frozen_bytecode(ctx->frozen));
+    if (ctx->status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    cached_vm->shared = ctx->shared;
+
+    for (size_t i = 0; i < ROUNDS * ctx->length; i++) {
+        idx = (i + ctx->index) % ctx->length;
+        str = ctx->values[idx];
+
+        ctx->status = lxb_grammar_vm_match(vm, ctx->name->data,
+                                           ctx->name->length,
+                                           str->data, str->length, &result);
+        if (ctx->status != LXB_STATUS_OK) {
+            break;
+        }
+
+        ctx->status = lxb_grammar_vm_match(cached_vm, ctx->name->data,
+                                           ctx->name->length,
+                                           str->data, str->length, &cached);
+        if (ctx->status != LXB_STATUS_OK) {
+            break;
+        }
+
+        if (!same(&result, &cached)) {
+            ctx->status = LXB_STATUS_ERROR;
+            break;
+        }
+    }
+
+done:
+
+    lxb_grammar_vm_destroy(cached_vm, true);
+    lxb_grammar_vm_destroy(vm, true);
+
+    return NULL;
+}
+
+static bool
+same(const lxb_grammar_match_result_t *result,
+     const lxb_grammar_match_result_t *cached)
+{
+    const lxb_grammar_match_span_t *span, *cached_span;
+
+    if (result->accepted != cached->accepted
+        || result->length != cached->length)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < result->length; i++) {
+        span = &result->spans[i];
+        cached_span = &cached->spans[i];
+
+        if (span->node != cached_span->node || span->id != cached_span->id
+            || span->first != cached_span->first
+            || span->last != cached_span->last
+            || span->begin != cached_span->begin
+            || span->end != cached_span->end)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static lxb_status_t
+print_error(helper_t *helper, unit_kv_value_t *value)
+{
+    lexbor_str_t str;
+
+    str = unit_kv_value_position_as_string(helper->kv, value);
+    TEST_PRINTLN("%s", str.data);
+    unit_kv_string_destroy(helper->kv, &str, false);
+
+    str = unit_kv_value_fragment_as_string(helper->kv, value);
+    TEST_PRINTLN("%s", str.data);
+    unit_kv_string_destroy(helper->kv, &str, false);
+
+    return LXB_STATUS_ERROR;
+}
@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+/*
+ * Matchers generated from the match tests by codegen/generate.c must
+ * give the same result as the bytecode.
+ */
+
+#include <unit/test.h>
+#include <unit/kv.h>
+
+#include <lexbor/grammar/tokenizer.h>
+#include <lexbor/grammar/parser.h>
+#include <lexbor/grammar/tree.h>
+#include <lexbor/grammar/vm.h>
+#include <lexbor/grammar/codegen_rt.h>
+
+
+typedef struct {
+    unit_kv_t                  *kv;
+    lxb_grammar_codegen_rt_t   *rt;
+}
+helper_t;
+
+
+extern const lxb_grammar_codegen_rt_grammar_t *test_codegen_grammars[];
+extern const size_t test_codegen_grammars_length;
+
+
+static lxb_status_t
+check(helper_t *helper, unit_kv_value_t *value);
+
+static lxb_status_t
+check_entry(helper_t *helper, unit_kv_value_t *entry,
+            const lxb_grammar_codegen_rt_grammar_t *generated);
+
+static lxb_status_t
+check_values(helper_t *helper, lxb_grammar_vm_t *vm,
+             const lxb_grammar_codegen_rt_grammar_t *generated,
+             const lexbor_str_t *name, unit_kv_value_t *values, bool need);
+
+static lxb_status_t
+print_error(helper_t *helper, unit_kv_value_t *value);
+
+
+int
+main(int argc, const char * argv[])
+{
+    lxb_status_t status;
+    unit_kv_value_t *value;
+    helper_t helper = {0};
+
+    if (argc != 2) {
+        printf("Usage:\n\tgrammar_codegen <file path>\n");
+        return EXIT_FAILURE;
+    }
+
+    TEST_INIT();
+
+    helper.kv = unit_kv_create();
+    status = unit_kv_init(helper.kv, 256);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    helper.rt = lxb_grammar_codegen_rt_create();
+    status = lxb_grammar_codegen_rt_init(helper.rt);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    TEST_PRINTLN("Parse file: %s", argv[1]);
+
+    status = unit_kv_parse_file(helper.kv, (const lxb_char_t *) argv[1]);
+    if (status != LXB_STATUS_OK) {
+        lexbor_str_t str = unit_kv_parse_error_as_string(helper.kv);
+
+        TEST_PRINTLN("%s", str.data);
+
+        unit_kv_string_destroy(helper.kv, &str, false);
+
+        return EXIT_FAILURE;
+    }
+
+    value = unit_kv_value(helper.kv);
+    if (value == NULL) {
+        TEST_PRINTLN("Failed to get root value");
+        return EXIT_FAILURE;
+    }
+
+    status = check(&helper, value);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    TEST_RUN("lexbor/grammar/codegen");
+    TEST_RELEASE();
+
+done:
+
+    unit_kv_destroy(helper.kv, true);
+    lxb_grammar_codegen_rt_destroy(helper.rt, true);
+
+    return EXIT_FAILURE;
+}
+
+static lxb_status_t
+check(helper_t *helper, unit_kv_value_t *value)
+{
+    lxb_status_t status;
+    unit_kv_array_t *entries;
+
+    if (unit_kv_is_array(value) == false) {
+        return print_error(helper, value);
+    }
+
+    entries = unit_kv_array(value);
+
+    /* The generated code must be rebuilt after the tests are changed. */
+    if (entries->length != test_codegen_grammars_length) {
+        TEST_PRINTLN("Generated matchers are out of date");
+        return LXB_STATUS_ERROR;
+    }
+
+    for (size_t i = 0; i < entries->length; i++) {
+        if (unit_kv_is_hash(entries->list[i]) == false) {
+            return print_error(helper, entries->list[i]);
+        }
+
+        if (unit_kv_hash_value_nolen_c(entries->list[i], "error") != NULL) {
+            continue;
+        }
+
+        TEST_PRINTLN("Test #"LEXBOR_FORMAT_Z, (i + 1));
+
+        status = check_entry(helper, entries->list[i],
+                             test_codegen_grammars[i]);
+        if (status != LXB_STATUS_OK) {
+            return status;
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+check_entry(helper_t *helper, unit_kv_value_t *entry,
+            const lxb_grammar_codegen_rt_grammar_t *generated)
+{
+    lxb_status_t status;
+    lexbor_str_t *str;
+    lxb_grammar_node_t *root;
+    lxb_grammar_tree_t *tree;
+    lxb_grammar_vm_t *vm;
+    lxb_grammar_bytecode_t *bc;
+    lxb_grammar_parser_t *parser;
+    lxb_grammar_tokenizer_t *tkz;
+    lxb_grammar_document_t *document;
+    unit_kv_value_t *grammar, *name, *valid, *invalid;
+
+    grammar = unit_kv_hash_value_nolen_c(entry, "grammar");
+    name = unit_kv_hash_value_nolen_c(entry, "declaration");
+
+    if (grammar == NULL || unit_kv_is_string(grammar) == false
+        || name == NULL || unit_kv_is_string(name) == false
+        || generated == NULL)
+    {
+        return print_error(helper, entry);
+    }
+
+    valid = unit_kv_hash_value_nolen_c(entry, "valid");
+    invalid = unit_kv_hash_value_nolen_c(entry, "invalid");
+
+    /* Compile */
+    str = unit_kv_string(grammar);
+
+    tkz = lxb_grammar_tokenizer_create();
+    status = lxb_grammar_tokenizer_init(tkz);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    document = lxb_grammar_tokenizer_process(tkz, str->data, str->length);
+
+    lxb_grammar_tokenizer_destroy(tkz, true);
+
+    if (document == NULL) {
+        return LXB_STATUS_ERROR;
+    }
+
+    parser = lxb_grammar_parser_create();
+    status = lxb_grammar_parser_init(parser);
+    if (status != LXB_STATUS_OK) {
+        goto failed_parser;
+    }
+
+    root = lxb_grammar_parser_process(parser, document);
+    if (root == NULL) {
+        lxb_grammar_parser_print_last_error(parser);
+
+        status = LXB_STATUS_ERROR;
+        goto failed_parser;
+    }
+
+    tree = lxb_grammar_tree_create();
+    status = lxb_grammar_tree_init(tree, document);
+    if (status != LXB_STATUS_OK) {
+        goto failed_tree;
+    }
+
+    status = lxb_grammar_tree_make(tree, root);
+    if (status != LXB_STATUS_OK) {
+        goto failed_tree;
+    }
+
+    bc = lxb_grammar_bytecode_create();
+    status = lxb_grammar_bytecode_init(bc);
+    if (status != LXB_STATUS_OK) {
+        goto failed_bc;
+    }
+
+    status = lxb_grammar_bytecode_make(bc, tree);
+    if (status != LXB_STATUS_OK) {
+        goto failed_bc;
+    }
+
+    vm = lxb_grammar_vm_create();
+    status = lxb_grammar_vm_init(vm, bc);
+    if (status != LXB_STATUS_OK) {
+        goto failed_vm;
+    }
+
+    str = unit_kv_string(name);
+
+    if (valid != NULL && unit_kv_is_array(valid)) {
+        status = check_values(helper, vm, generated, str, valid, true);
+        if (status != LXB_STATUS_OK) {
+            goto failed_vm;
+        }
+    }
+
+    if (invalid != NULL && unit_kv_is_array(invalid)) {
+        status = check_values(helper, vm, generated, str, invalid, false);
+    }
+
+failed_vm:
+
+    lxb_grammar_vm_destroy(vm, true);
+
+failed_bc:
+
+    lxb_grammar_bytecode_destroy(bc, true);
+
+failed_tree:
+
+    lxb_grammar_tree_destroy(tree, true);
+
+failed_parser:
+
+    lxb_grammar_parser_destroy(parser, true);
+    lxb_grammar_document_destroy(document);
+
+    return status;
+}
+
+static lxb_status_t
+check_values(helper_t *helper, lxb_grammar_vm_t *vm,
+             const lxb_grammar_codegen_rt_grammar_t *generated,
+             const lexbor_str_t *name, unit_kv_value_t *values, bool need)
+{
+    bool accepted;
+    lxb_status_t status;
+    lexbor_str_t *str;
+    unit_kv_array_t *list;
+    lxb_grammar_match_result_t result;
+
+    list = unit_kv_array(values);
+
+    for (size_t i = 0; i < list->length; i++) {
+        if (unit_kv_is_string(list->list[i]) == false) {
+            return print_error(helper, list->list[i]);
+        }
+
+        str = unit_kv_string(list->list[i]);
+
+        status = lxb_grammar_vm_match(vm, name->data, name->length,
+                                      str->data, str->length, &result);
+        if (status != LXB_STATUS_OK) {
+            TEST_PRINTLN("Failed to match value by bytecode: %s",
+                         (const char *) str->data);
+
+            return print_error(helper, list->list[i]);
+        }
+
+        status = lxb_grammar_codegen_rt_match(helper->rt, generated,
+                                              name->data, name->length,
+                                              str->data, str->length,
+                                              &accepted);
+        if (status != LXB_STATUS_OK) {
+            TEST_PRINTLN("Failed to match value by generated code: %s",
+                         (const char *) str->data);
+
+            return print_error(helper, list->list[i]);
+        }
+
+        if (accepted != result.accepted || accepted != need) {
+            TEST_PRINTLN("Generated code result differs for value: %s",
+                         (const char *) str->data);
+
+            return print_error(helper, list->list[i]);
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+print_error(helper_t *helper, unit_kv_value_t *value)
+{
+    lexbor_str_t str;
+
+    str = unit_kv_value_position_as_string(helper->kv, value);
+    TEST_PRINTLN("%s", str.data);
+    unit_kv_string_destroy(helper->kv, &str, false);
+
+    str = unit_kv_value_fragment_as_string(helper->kv, value);
+    TEST_PRINTLN("%s", str.data);
+    unit_kv_string_destroy(helper->kv, &str, false);
+
+    return LXB_STATUS_ERROR;
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+/*
+ * Usage: generate <ton file> <output file>
+ *
+ * Writes C matchers of the grammars of the match tests, prefix "test_<N>"
+ * for the entry N, and the table of them by entry: test_codegen_grammars.
+ * An entry with "error" gets NULL.
+ */
+
+#include <lexbor/grammar/tokenizer.h>
+#include <lexbor/grammar/parser.h>
+#include <lexbor/grammar/tree.h>
+#include <lexbor/grammar/codegen.h>
+
+#include <unit/kv.h>
+
+
+static lxb_status_t
+generate(FILE *fh, unit_kv_value_t *entry, const char *prefix);
+
+static lxb_status_t
+file_callback(const lxb_char_t *data, size_t length, void *ctx);
+
+
+int
+main(int argc, const char * argv[])
+{
+    FILE *fh;
+    char prefix[32];
+    lxb_status_t status;
+    unit_kv_t *kv;
+    unit_kv_value_t *value;
+    unit_kv_array_t *entries;
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: generate <ton file> <output file>\n");
+        return EXIT_FAILURE;
+    }
+
+    kv = unit_kv_create();
+    status = unit_kv_init(kv, 256);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    status = unit_kv_parse_file(kv, (const lxb_char_t *) argv[1]);
+    if (status != LXB_STATUS_OK) {
+        lexbor_str_t str = unit_kv_parse_error_as_string(kv);
+
+        fprintf(stderr, "%s\n", str.data);
+
+        unit_kv_string_destroy(kv, &str, false);
+
+        return EXIT_FAILURE;
+    }
+
+    value = unit_kv_value(kv);
+    if (value == NULL || unit_kv_is_array(value) == false) {
+        fprintf(stderr, "Root value must be an ARRAY\n");
+        return EXIT_FAILURE;
+    }
+
+    entries = unit_kv_array(value);
+
+    fh = fopen(argv[2], "wb");
+    if (fh == NULL) {
+        fprintf(stderr, "Failed to open file: %s\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < entries->length; i++) {
+        if (unit_kv_hash_value_nolen_c(entries->list[i], "error") != NULL) {
+            continue;
+        }
+
+        snprintf(prefix, sizeof(prefix), "test_"LEXBOR_FORMAT_Z, i + 1);
+
+        status = generate(fh, entries->list[i], prefix);
+        if (status != LXB_STATUS_OK) {
+            fprintf(stderr, "Failed to generate entry #"LEXBOR_FORMAT_Z"\n",
+                    i + 1);
+            goto failed;
+        }
+    }
+
+    fprintf(fh, "\nconst lxb_grammar_codegen_rt_grammar_t *\n"
+            "test_codegen_grammars[] = {\n");
+
+    for (size_t i = 0; i < entries->length; i++) {
+        if (unit_kv_hash_value_nolen_c(entries->list[i], "error") != NULL) {
+            fprintf(fh, "    NULL,\n");
+        }
+        else {
+            fprintf(fh, "    &test_"LEXBOR_FORMAT_Z"_grammar,\n", i + 1);
+        }
+    }
+
+    fprintf(fh, "    NULL\n};\n\n"
+            "const size_t test_codegen_grammars_length = "LEXBOR_FORMAT_Z";\n",
+            entries->length);
+
+    fclose(fh);
+    unit_kv_destroy(kv, true);
+
+    return EXIT_SUCCESS;
+
+failed:
+
+    fclose(fh);
+    remove(argv[2]);
+    unit_kv_destroy(kv, true);
+
+    return EXIT_FAILURE;
+}
+
+static lxb_status_t
+generate(FILE *fh, unit_kv_value_t *entry, const char *prefix)
+{
+    lxb_status_t status;
+    lexbor_str_t *str;
+    unit_kv_value_t *grammar;
+    lxb_grammar_tree_t *tree;
+    lxb_grammar_node_t *root;
+    lxb_grammar_parser_t *parser;
+    lxb_grammar_codegen_t *cg;
+    lxb_grammar_document_t *doc;
+    lxb_grammar_tokenizer_t *tkz;
+
+    grammar = unit_kv_hash_value_nolen_c(entry, "grammar");
+    if (grammar == NULL || unit_kv_is_string(grammar) == false) {
+        fprintf(stderr, "Required parameter missing: grammar\n");
+        return LXB_STATUS_ERROR;
+    }
+
+    str = unit_kv_string(grammar);
+
+    tkz = lxb_grammar_tokenizer_create();
+    status = lxb_grammar_tokenizer_init(tkz);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    doc = lxb_grammar_tokenizer_process(tkz, str->data, str->length);
+
+    lxb_grammar_tokenizer_destroy(tkz, true);
+
+    if (doc == NULL) {
+        return LXB_STATUS_ERROR;
+    }
+
+    parser = lxb_grammar_parser_create();
+    status = lxb_grammar_parser_init(parser);
+    if (status != LXB_STATUS_OK) {
+        goto failed_parser;
+    }
+
+    root = lxb_grammar_parser_process(parser, doc);
+    if (root == NULL) {
+        lxb_grammar_parser_print_last_error(parser);
+
+        status = LXB_STATUS_ERROR;
+        goto failed_parser;
+    }
+
+    tree = lxb_grammar_tree_create();
+    status = lxb_grammar_tree_init(tree, doc);
+    if (status != LXB_STATUS_OK) {
+        goto failed_tree;
+    }
+
+    status = lxb_grammar_tree_make(tree, root);
+    if (status != LXB_STATUS_OK) {
+        fprintf(stderr, "Failed to make tree: %s\n", tree->last_error);
+        goto failed_tree;
+    }
+
+    cg = lxb_grammar_codegen_create();
+    status = lxb_grammar_codegen_init(cg, tree);
+    if (status == LXB_STATUS_OK) {
+        status = lxb_grammar_codegen_serialize(cg, (const lxb_char_t *) prefix,
+                                               strlen(prefix),
+                                               file_callback, fh);
+        if (status != LXB_STATUS_OK) {
+            fprintf(stderr, "Failed to generate: %s\n",
+                    (cg->last_error != NULL) ? cg->last_error : "unknown");
+        }
+    }
+
+    lxb_grammar_codegen_destroy(cg, true);
+
+failed_tree:
+
+    lxb_grammar_tree_destroy(tree, true);
+
+failed_parser:
+
+    lxb_grammar_parser_destroy(parser, true);
+    lxb_grammar_document_destroy(doc);
+
+    return status;
+}
+
+static lxb_status_t
+file_callback(const lxb_char_t *data, size_t length, void *ctx)
+{
+    if (fwrite(data, 1, length, ctx) != length) {
+        return LXB_STATUS_ERROR;
+    }
+
+    return LXB_STATUS_OK;
+}
@@ -0,0 +1,1802 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+#include <time.h>
+
+#include <lexbor/core/fs.h>
+#include <lexbor/core/array.h>
+
+#include <unit/test.h>
+#include <unit/kv.h>
+
+#include <lexbor/grammar/tokenizer.h>
+#include <lexbor/grammar/parser.h>
+#include <lexbor/grammar/tree.h>
+#include <lexbor/grammar/match.h>
+#include <lexbor/grammar/vm.h>
+#include <lexbor/grammar/artifact.h>
+#include <lexbor/grammar/cache.h>
+#include <lexbor/grammar/ambiguity.h>
+#include <lexbor/grammar/frozen.h>
+#include <lexbor/grammar/memory.h>
+
+
+typedef struct {
+    unit_kv_t                  *kv;
+}
+helper_t;
+
+typedef struct {
+    lxb_char_t                 *data;
+    size_t                     length;
+    size_t                     size;
+}
+image_t;
+
+/* Field of lxb_grammar_bytecode_decl_t set to value (plus code length). */
+typedef struct {
+    size_t                     decl;
+    size_t                     field;
+    uint32_t                   value;
+    bool                       after_code;
+}
+tampered_t;
+
+#define tampered_field(name)                                                   \
+    (offsetof(lxb_grammar_bytecode_decl_t, name) / sizeof(uint32_t))
+
+typedef struct {
+    lxb_grammar_document_t     *document;
+    lxb_grammar_tree_t         *tree;
+    lxb_grammar_bytecode_t     *bc;
+}
+grammar_t;
+
+
+static lxb_status_t
+parse(helper_t *helper, const char *dir_path);
+
+static lexbor_action_t
+file_callback(const lxb_char_t *fullpath, size_t fullpath_len,
+              const lxb_char_t *filename, size_t filename_len, void *ctx);
+
+static lxb_status_t
+check(helper_t *helper, unit_kv_value_t *value);
+
+static lxb_status_t
+check_entry(helper_t *helper, unit_kv_value_t *entry,
+            lxb_grammar_tokenizer_t *tkz, lxb_grammar_parser_t *parser);
+
+static lxb_status_t
+check_values(helper_t *helper, lxb_grammar_match_t *match,
+             lxb_grammar_match_t *memo_match,
+             lxb_grammar_vm_t *vm, lxb_grammar_vm_t *loaded_vm,
+             lxb_grammar_node_t *declaration,
+             unit_kv_value_t *values, bool need);
+
+static lxb_status_t
+check_batch(lxb_grammar_match_t *match, lxb_grammar_vm_t *vm,
+            lxb_grammar_node_t *declaration, unit_kv_array_t *list,
+            bool need);
+
+static bool
+check_spans(const lxb_grammar_match_result_t *result,
+            const lxb_grammar_match_result_t *vm_result, bool with_node);
+
+static bool
+check_events(lxb_grammar_match_t *match, lxb_grammar_vm_t *vm,
+             const lexbor_str_t *str,
+             const lxb_grammar_match_result_t *result,
+             const lxb_grammar_match_result_t *vm_result);
+
+static bool
+check_stream(lxb_grammar_vm_t *vm, const lxb_char_t *name, size_t len,
+             const lexbor_str_t *str,
+             const lxb_grammar_match_result_t *vm_result);
+
+static lxb_status_t
+check_error(helper_t *helper, unit_kv_value_t *error, const char *last_error);
+
+static lxb_status_t
+check_conflicts(helper_t *helper, lxb_grammar_tree_t *tree,
+                unit_kv_value_t *conflicts);
+
+static lxb_status_t
+check_frozen(helper_t *helper, unit_kv_value_t *entry);
+
+static lxb_status_t
+check_frozen_values(helper_t *helper, lxb_grammar_vm_t *vm,
+                    lxb_grammar_vm_t *frozen_vm, const lexbor_str_t *name,
+                    unit_kv_value_t *values);
+
+static lxb_status_t
+memo(void);
+
+static lxb_status_t
+memo_ambiguous(const char *source);
+
+static lxb_status_t
+memo_match(lxb_grammar_match_t *match, const char *data,
+           lxb_status_t need_status, bool need);
+
+static lxb_status_t
+frames(void);
+
+static lxb_status_t
+peak(void);
+
+static lxb_status_t
+stream_long(void);
+
+static lxb_status_t
+tampered(void);
+
+static lxb_status_t
+tampered_load(const image_t *image, size_t decl_idx, size_t field,
+              uint32_t value, lxb_status_t need);
+
+static lxb_status_t
+grammar_make(grammar_t *grammar, const char *data);
+
+static void
+grammar_destroy(grammar_t *grammar);
+
+static lxb_status_t
+image_cb(const lxb_char_t *data, size_t len, void *ctx);
+
+static lxb_status_t
+print_error(helper_t *helper, unit_kv_value_t *value);
+
+
+int
+main(int argc, const char * argv[])
+{
+    lxb_status_t status;
+    helper_t helper = {0};
+    const char *dir_path;
+
+    if (argc != 2) {
+        printf("Usage:\n\tgrammar_match <directory path>\n");
+        return EXIT_FAILURE;
+    }
+
+    dir_path = argv[1];
+
+    TEST_INIT();
+
+    helper.kv = unit_kv_create();
+    status = unit_kv_init(helper.kv, 256);
+
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    status = parse(&helper, dir_path);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    status = memo();
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    status = frames();
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    status = peak();
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    status = stream_long();
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    status = tampered();
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    TEST_RUN("lexbor/grammar/match");
+    TEST_RELEASE();
+
+done:
+
+    unit_kv_destroy(helper.kv, true);
+
+    return EXIT_FAILURE;
+}
+
+static lxb_status_t
+parse(helper_t *helper, const char *dir_path)
+{
+    lxb_status_t status;
+
+    status = lexbor_fs_dir_read((const lxb_char_t *) dir_path,
+                                LEXBOR_FS_DIR_OPT_WITHOUT_DIR
+                                |LEXBOR_FS_DIR_OPT_WITHOUT_HIDDEN,
+                                file_callback, helper);
+
+    if (status != LXB_STATUS_OK) {
+        TEST_PRINTLN("Failed to read directory: %s", dir_path);
+    }
+
+    return status;
+}
+
+
+static lexbor_action_t
+file_callback(const lxb_char_t *fullpath, size_t fullpath_len,
+              const lxb_char_t *filename, size_t filename_len, void *ctx)
+{
+    lxb_status_t status;
+    unit_kv_value_t *value;
+    helper_t *helper;
+
+    if (filename_len < 5 ||
+        strncmp((const char *) &filename[ (filename_len - 4) ], ".ton", 4) != 0)
+    {
+        return LEXBOR_ACTION_OK;
+    }
+
+    helper = ctx;
+
+    TEST_PRINTLN("Parse file: %s", fullpath);
+
+    unit_kv_clean(helper->kv);
+
+    status = unit_kv_parse_file(helper->kv, (const lxb_char_t *) fullpath);
+    if (status != LXB_STATUS_OK) {
+        lexbor_str_t str = unit_kv_parse_error_as_string(helper->kv);
+
+        TEST_PRINTLN("%s", str.data);
+
+        unit_kv_string_destroy(helper->kv, &str, false);
+
+        exit(EXIT_FAILURE);
+    }
+
+    value = unit_kv_value(helper->kv);
+    if (value == NULL) {
+        TEST_PRINTLN("Failed to get root value");
+        exit(EXIT_FAILURE);
+    }
+
+    TEST_PRINTLN("Check file: %s", fullpath);
+
+    status = check(helper, value);
+    if (status != LXB_STATUS_OK) {
+        exit(EXIT_FAILURE);
+    }
+
+    return LEXBOR_ACTION_OK;
+}
+
+static lxb_status_t
+check(helper_t *helper, unit_kv_value_t *value)
+{
+    lxb_status_t status;
+    unit_kv_array_t *entries;
+    lxb_grammar_parser_t *parser;
+    lxb_grammar_tokenizer_t *tkz;
+
+    if (unit_kv_is_array(value) == false) {
+        print_error(helper, value);
+
+        return LXB_STATUS_ERROR;
+    }
+
+    entries = unit_kv_array(value);
+
+    tkz = lxb_grammar_tokenizer_create();
+    status = lxb_grammar_tokenizer_init(tkz);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    parser = lxb_grammar_parser_create();
+    status = lxb_grammar_parser_init(parser);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    for (size_t i = 0; i < entries->length; i++) {
+        if (unit_kv_is_hash(entries->list[i]) == false) {
+            return print_error(helper, entries->list[i]);
+        }
+
+        TEST_PRINTLN("Test #"LEXBOR_FORMAT_Z, (i + 1));
+
+        status = check_entry(helper, entries->list[i], tkz, parser);
+        if (status != LXB_STATUS_OK) {
+            goto failed;
+        }
+
+        status = check_frozen(helper, entries->list[i]);
+        if (status != LXB_STATUS_OK) {
+            goto failed;
+        }
+
+        lxb_grammar_tokenizer_clean(tkz);
+    }
+
+    lxb_grammar_tokenizer_destroy(tkz, true);
+    lxb_grammar_parser_destroy(parser, true);
+
+    return LXB_STATUS_OK;
+
+failed:
+
+    lxb_grammar_tokenizer_destroy(tkz, true);
+    lxb_grammar_parser_destroy(parser, true);
+
+    return LXB_STATUS_ERROR;
+}
+
+static lxb_status_t
+check_entry(helper_t *helper, unit_kv_value_t *entry,
+            lxb_grammar_tokenizer_t *tkz, lxb_grammar_parser_t *parser)
+{
+    lxb_status_t status;
+    lexbor_str_t *str;
+    lxb_grammar_document_t *document;
+    lxb_grammar_node_t *root, *declaration;
+    lxb_grammar_tree_t *tree;
+    lxb_grammar_match_t *match, *memo_match;
+    lxb_grammar_bytecode_t *bc, *loaded;
+    lxb_grammar_vm_t *vm, *loaded_vm;
+    image_t image = {0};
+    unit_kv_value_t *grammar, *name, *valid, *invalid, *error, *conflicts,
+                    *deterministic;
+
+    /* Validate */
+    grammar = unit_kv_hash_value_nolen_c(entry, "grammar");
+    if (grammar == NULL || unit_kv_is_string(grammar) == false) {
+        TEST_PRINTLN("Required parameter missing: grammar");
+
+        return print_error(helper, entry);
+    }
+
+    name = unit_kv_hash_value_nolen_c(entry, "declaration");
+    if (name == NULL || unit_kv_is_string(name) == false) {
+        TEST_PRINTLN("Required parameter missing: declaration");
+
+        return print_error(helper, entry);
+    }
+
+    valid = unit_kv_hash_value_nolen_c(entry, "valid");
+    if (valid != NULL && unit_kv_is_array(valid) == false) {
+        TEST_PRINTLN("Parameter 'valid' must be an ARRAY");
+
+        return print_error(helper, valid);
+    }
+
+    invalid = unit_kv_hash_value_nolen_c(entry, "invalid");
+    if (invalid != NULL && unit_kv_is_array(invalid) == false) {
+        TEST_PRINTLN("Parameter 'invalid' must be an ARRAY");
+
+        return print_error(helper, invalid);
+    }
+
+    error = unit_kv_hash_value_nolen_c(entry, "error");
+    if (error != NULL && unit_kv_is_string(error) == false) {
+        TEST_PRINTLN("Parameter 'error' must be a STRING");
+
+        return print_error(helper, error);
+    }
+
+    conflicts = unit_kv_hash_value_nolen_c(entry, "conflicts");
+    if (conflicts != NULL && unit_kv_is_array(conflicts) == false) {
+        TEST_PRINTLN("Parameter 'conflicts' must be an ARRAY");
+
+        return print_error(helper, conflicts);
+    }
+
+    deterministic = unit_kv_hash_value_nolen_c(entry, "deterministic");
+    if (deterministic != NULL && unit_kv_is_bool(deterministic) == false) {
+        TEST_PRINTLN("Parameter 'deterministic' must be a BOOLEAN");
+
+        return print_error(helper, deterministic);
+    }
+
+    /* Compile */
+    str = unit_kv_string(grammar);
+
+    document = lxb_grammar_tokenizer_process(tkz, str->data, str->length);
+    if (document == NULL) {
+        return LXB_STATUS_ERROR;
+    }
+
+    root = lxb_grammar_parser_process(parser, document);
+    if (root == NULL) {
+        lxb_grammar_parser_print_last_error(parser);
+        lxb_grammar_document_destroy(document);
+
+        return LXB_STATUS_ERROR;
+    }
+
+    tree = lxb_grammar_tree_create();
+    status = lxb_grammar_tree_init(tree, document);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    status = lxb_grammar_tree_make(tree, root);
+    if (status != LXB_STATUS_OK) {
+        if (error != NULL) {
+            status = check_error(helper, error, tree->last_error);
+            goto failed;
+        }
+
+        TEST_PRINTLN("Failed to make tree: %s", tree->last_error);
+        goto failed;
+    }
+
+    if (conflicts != NULL) {
+        status = check_conflicts(helper, tree, conflicts);
+        if (status != LXB_STATUS_OK) {
+            goto failed;
+        }
+    }
+
+    bc = lxb_grammar_bytecode_create();
+    status = lxb_grammar_bytecode_init(bc);
+    if (status != LXB_STATUS_OK) {
+        goto failed_bc;
+    }
+
+    if (deterministic != NULL) {
+        bc->deterministic = unit_kv_bool(deterministic);
+    }
+
+    status = lxb_grammar_bytecode_make(bc, tree);
+    if (status != LXB_STATUS_OK) {
+        if (error != NULL) {
+            status = check_error(helper, error, bc->last_error);
+            goto failed_bc;
+        }
+
+        TEST_PRINTLN("Failed to make bytecode: %s", bc->last_error);
+        goto failed_bc;
+    }
+
+    if (error != NULL) {
+        status = check_error(helper, error, NULL);
+        goto failed_bc;
+    }
+
+    vm = lxb_grammar_vm_create();
+    status = lxb_grammar_vm_init(vm, bc);
+    if (status != LXB_STATUS_OK) {
+        goto failed_vm;
+    }
+
+    /* Same bytecode through the binary image. */
+    status = lxb_grammar_artifact_serialize(bc, image_cb, &image);
+    if (status != LXB_STATUS_OK) {
+        goto failed_image;
+    }
+
+    loaded = lxb_grammar_bytecode_create();
+    status = lxb_grammar_artifact_load(loaded, image.data, image.length,
+                                       LXB_GRAMMAR_ARTIFACT_OPT_UNDEF);
+    if (status != LXB_STATUS_OK) {
+        TEST_PRINTLN("Failed to load artifact");
+        goto failed_loaded;
+    }
+
+    loaded_vm = lxb_grammar_vm_create();
+    status = lxb_grammar_vm_init(loaded_vm, loaded);
+    if (status != LXB_STATUS_OK) {
+        goto failed_loaded_vm;
+    }
+
+    match = lxb_grammar_match_create();
+    status = lxb_grammar_match_init(match, tree);
+    if (status != LXB_STATUS_OK) {
+        goto failed_match;
+    }
+
+    memo_match = lxb_grammar_match_create();
+    status = lxb_grammar_match_init(memo_match, tree);
+    if (status != LXB_STATUS_OK) {
+        goto destroy;
+    }
+
+    memo_match->memo = true;
+
+    str = unit_kv_string(name);
+
+    declaration = lxb_grammar_tree_declaration(tree, str->data, str->length);
+    if (declaration == NULL) {
+        TEST_PRINTLN("Declaration not found: %s", (const char *) str->data);
+
+        status = LXB_STATUS_ERROR_NOT_EXISTS;
+        goto destroy;
+    }
+
+    if (valid != NULL) {
+        status = check_values(helper, match, memo_match, vm, loaded_vm,
+                              declaration, valid, true);
+        if (status != LXB_STATUS_OK) {
+            goto destroy;
+        }
+    }
+
+    if (invalid != NULL) {
+        status = check_values(helper, match, memo_match, vm, loaded_vm,
+                              declaration, invalid, false);
+    }
+
+destroy:
+
+    lxb_grammar_match_destroy(memo_match, true);
+
+failed_match:
+
+    lxb_grammar_match_destroy(match, true);
+
+failed_loaded_vm:
+
+    lxb_grammar_vm_destroy(loaded_vm, true);
+
+failed_loaded:
+
+    lxb_grammar_bytecode_destroy(loaded, true);
+
+failed_image:
+
+    lexbor_free(image.data);
+
+failed_vm:
+
+    lxb_grammar_vm_destroy(vm, true);
+
+failed_bc:
+
+    lxb_grammar_bytecode_destroy(bc, true);
+
+failed:
+
+    lxb_grammar_tree_destroy(tree, true);
+    lxb_grammar_document_destroy(document);
+
+    return status;
+}
+
+static lxb_status_t
+check_values(helper_t *helper, lxb_grammar_match_t *match,
+             lxb_grammar_match_t *memo_match,
+             lxb_grammar_vm_t *vm, lxb_grammar_vm_t *loaded_vm,
+             lxb_grammar_node_t *declaration,
+             unit_kv_value_t *values, bool need)
+{
+    size_t len;
+    lxb_status_t status;
+    lexbor_str_t *str;
+    const lxb_char_t *name;
+    unit_kv_array_t *list;
+    lxb_grammar_match_result_t result, vm_result, memo_result;
+
+    list = unit_kv_array(values);
+
+    for (size_t i = 0; i < list->length; i++) {
+        if (unit_kv_is_string(list->list[i]) == false) {
+            TEST_PRINTLN("Value must be a STRING");
+
+            return print_error(helper, list->list[i]);
+        }
+
+        str = unit_kv_string(list->list[i]);
+
+        status = lxb_grammar_match_declaration(match, declaration,
+                                               str->data, str->length,
+                                               &result);
+        if (status != LXB_STATUS_OK) {
+            TEST_PRINTLN("Failed to match value: %s",
+                         (const char *) str->data);
+
+            return print_error(helper, list->list[i]);
+        }
+
+        if (result.accepted != need) {
+            TEST_PRINTLN("Value must be %s: %s",
+                         (need) ? "accepted" : "rejected",
+                         (const char *) str->data);
+
+            return print_error(helper, list->list[i]);
+        }
+
+        /* The declaration span is the last one. */
+        if (result.accepted
+            && (result.length == 0
+                || result.spans[result.length - 1].node != declaration))
+        {
+            TEST_PRINTLN("Bad spans for value: %s", (const char *) str->data);
+
+            return print_error(helper, list->list[i]);
+        }
+
+        /* Bounds are never narrower than an accepted value. */
+        if (result.accepted
+            && !lxb_grammar_bounds_fit(&match->bounds, declaration,
+                                       result.spans[result.length - 1].last))
+        {
+            TEST_PRINTLN("Bad bounds for value: %s", (const char *) str->data);
+
+            return print_error(helper, list->list[i]);
+        }
+
+        /* The memo must give the same result. */
+        status = lxb_grammar_match_declaration(memo_match, declaration,
+                                               str->data, str->length,
+                                               &memo_result);
+        if (status != LXB_STATUS_OK
+            || !check_spans(&result, &memo_result, true))
+        {
+            TEST_PRINTLN("Memo result differs for value: %s",
+                         (const char *) str->data);
+
+            return print_error(helper, list->list[i]);
+        }
+
+        /* The bytecode must give the same result. */
+        name = lxb_grammar_tree_node_name(declaration, &len);
+
+        status = lxb_grammar_vm_match(vm, name, len, str->data, str->length,
+                                      &vm_result);
+        if (status != LXB_STATUS_OK) {
+            TEST_PRINTLN("Failed to match value by bytecode: %s",
+                         (const char *) str->data);
+
+            return print_error(helper, list->list[i]);
+        }
+
+        if (!check_spans(&result, &vm_result, true)) {
+            TEST_PRINTLN("Bytecode result differs for value: %s",
+                         (const char *) str->data);
+
+            return print_error(helper, list->list[i]);
+        }
+
+        if (!check_events(match, vm, str, &result, &vm_result)) {
+            TEST_PRINTLN("Bad events for value: %s", (const char *) str->data);
+
+            return print_error(helper, list->list[i]);
+        }
+
+        if (!check_stream(vm, name, len, str, &result)) {
+            TEST_PRINTLN("Stream result differs for value: %s",
+                         (const char *) str->data);
+
+            return print_error(helper, list->list[i]);
+        }
+
+        /* Loaded bytecode has no tree, spans without nodes. */
+        status = lxb_grammar_vm_match(loaded_vm, name, len,
+                                      str->data, str->length, &vm_result);
+        if (status != LXB_STATUS_OK
+            || !check_spans(&result, &vm_result, false))
+        {
+            TEST_PRINTLN("Artifact result differs for value: %s",
+                         (const char *) str->data);
+
+            return print_error(helper, list->list[i]);
+        }
+    }
+
+    status = check_batch(match, vm, declaration, list, need);
+    if (status != LXB_STATUS_OK) {
+        TEST_PRINTLN("Batch result differs");
+
+        return print_error(helper, values);
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+check_batch(lxb_grammar_match_t *match, lxb_grammar_vm_t *vm,
+            lxb_grammar_node_t *declaration, unit_kv_array_t *list,
+            bool need)
+{
+    long decl;
+    size_t len;
+    lxb_status_t status;
+    lexbor_str_t *str;
+    const lxb_char_t *name;
+    lxb_grammar_cache_t *cache = NULL;
+    lxb_grammar_match_value_t *values;
+    lxb_grammar_match_result_t *results, *vm_results;
+
+    if (list->length == 0) {
+        return LXB_STATUS_OK;
+    }
+
+    name = lxb_grammar_tree_node_name(declaration, &len);
+
+    decl = lxb_grammar_bytecode_declaration(vm->bc, name, len);
+    if (decl < 0) {
+        return LXB_STATUS_ERROR_NOT_EXISTS;
+    }
+
+    values = lexbor_calloc(list->length, sizeof(lxb_grammar_match_value_t));
+    results = lexbor_calloc(list->length * 2,
+                            sizeof(lxb_grammar_match_result_t));
+
+    if (values == NULL || results == NULL) {
+        status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        goto done;
+    }
+
+    vm_results = &results[list->length];
+
+    for (size_t i = 0; i < list->length; i++) {
+        str = unit_kv_string(list->list[i]);
+
+        values[i].data = str->data;
+        values[i].length = str->length;
+    }
+
+    status = lxb_grammar_match_batch(match, declaration, values,
+                                     list->length, results);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    status = lxb_grammar_vm_match_batch(vm, (size_t) decl, values,
+                                        list->length, vm_results);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    for (size_t i = 0; i < list->length; i++) {
+        if (results[i].accepted != need
+            || !check_spans(&results[i], &vm_results[i], true))
+        {
+            status = LXB_STATUS_ERROR;
+            goto done;
+        }
+    }
+
+    /* The second pass takes all results from the cache. */
+    cache = lxb_grammar_cache_create();
+    status = lxb_grammar_cache_init(cache, 0, 0);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    match->cache = cache;
+
+    for (size_t pass = 0; pass < 2; pass++) {
+        status = lxb_grammar_match_batch(match, declaration, values,
+                                         list->length, results);
+        if (status != LXB_STATUS_OK) {
+            goto done;
+        }
+    }
+
+    if (cache->hits < list->length) {
+        status = LXB_STATUS_ERROR;
+        goto done;
+    }
+
+    for (size_t i = 0; i < list->length; i++) {
+        if (!check_spans(&results[i], &vm_results[i], true)) {
+            status = LXB_STATUS_ERROR;
+            goto done;
+        }
+    }
+
+done:
+
+    match->cache = NULL;
+
+    lxb_grammar_cache_destroy(cache, true);
+    lexbor_free(values);
+    lexbor_free(results);
+
+    return status;
+}
+
+static bool
+check_spans(const lxb_grammar_match_result_t *result,
+            const lxb_grammar_match_result_t *vm_result, bool with_node)
+{
+    const lxb_grammar_match_span_t *span, *vm_span;
+
+    if (result->accepted != vm_result->accepted
+        || result->length != vm_result->length)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < result->length; i++) {
+        span = &result->spans[i];
+        vm_span = &vm_result->spans[i];
+
+        if ((with_node && span->node != vm_span->node)
+            || (!with_node && vm_span->node != NULL)
+            || span->id != vm_span->id
+            || span->first != vm_span->first || span->last != vm_span->last
+            || span->begin != vm_span->begin || span->end != vm_span->end)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool
+check_events(lxb_grammar_match_t *match, lxb_grammar_vm_t *vm,
+             const lexbor_str_t *str,
+             const lxb_grammar_match_result_t *result,
+             const lxb_grammar_match_result_t *vm_result)
+{
+    size_t length, vm_length;
+    lxb_status_t status;
+    lxb_grammar_match_event_t events[128], vm_events[128];
+
+    status = lxb_grammar_match_events(match, str->data, str->length, result,
+                                      events, 128, &length);
+    if (status != LXB_STATUS_OK) {
+        return false;
+    }
+
+    status = lxb_grammar_vm_events(vm, str->data, str->length, vm_result,
+                                   vm_events, 128, &vm_length);
+    if (status != LXB_STATUS_OK || length != vm_length) {
+        return false;
+    }
+
+    for (size_t i = 0; i < length; i++) {
+        if (events[i].node == NULL || events[i].node != vm_events[i].node
+            || events[i].id != events[i].node->id
+            || events[i].token->begin != vm_events[i].token->begin
+            || events[i].token->end != vm_events[i].token->end)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Tokens fed one by one, an accepted value is never rejected early. */
+static bool
+check_stream(lxb_grammar_vm_t *vm, const lxb_char_t *name, size_t len,
+             const lexbor_str_t *str, const lxb_grammar_match_result_t *result)
+{
+    bool viable, ok;
+    long decl;
+    lxb_status_t status;
+    lexbor_array_obj_t tokens;
+    lxb_grammar_match_result_t stream;
+    const lxb_grammar_match_span_t *span, *stream_span;
+
+    decl = lxb_grammar_bytecode_declaration(vm->bc, name, len);
+    if (decl < 0) {
+        return false;
+    }
+
+    status = lexbor_array_obj_init(&tokens, 16,
+                                   sizeof(lxb_grammar_value_token_t));
+    if (status != LXB_STATUS_OK) {
+        return false;
+    }
+
+    ok = false;
+
+    status = lxb_grammar_value_tokenize(&tokens, str->data, str->length);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    status = lxb_grammar_vm_begin(vm, (size_t) decl);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    viable = true;
+
+    for (size_t i = 0; i < tokens.length && viable; i++) {
+        status = lxb_grammar_vm_feed(vm, lexbor_array_obj_get(&tokens, i),
+                                     &viable);
+        if (status != LXB_STATUS_OK) {
+            goto done;
+        }
+    }
+
+    if (!viable && result->accepted) {
+        goto done;
+    }
+
+    status = lxb_grammar_vm_finish(vm, &stream);
+    if (status != LXB_STATUS_OK
+        || stream.accepted != result->accepted
+        || stream.length != result->length)
+    {
+        goto done;
+    }
+
+    for (size_t i = 0; i < result->length; i++) {
+        span = &result->spans[i];
+        stream_span = &stream.spans[i];
+
+        /* Empty spans at the end point to the end of the last token. */
+        if (span->node != stream_span->node
+            || span->first != stream_span->first
+            || span->last != stream_span->last
+            || ((span->first != span->last || span->first < tokens.length)
+                && (span->begin != stream_span->begin
+                    || span->end != stream_span->end)))
+        {
+            goto done;
+        }
+    }
+
+    ok = true;
+
+done:
+
+    lexbor_array_obj_destroy(&tokens, false);
+
+    return ok;
+}
+
+static lxb_status_t
+check_error(helper_t *helper, unit_kv_value_t *error, const char *last_error)
+{
+    lexbor_str_t *str;
+
+    str = unit_kv_string(error);
+
+    if (last_error == NULL || strlen(last_error) != str->length
+        || memcmp(last_error, str->data, str->length) != 0)
+    {
+        TEST_PRINTLN("Expected error: %s; got: %s", (const char *) str->data,
+                     (last_error != NULL) ? last_error : "none");
+
+        return print_error(helper, error);
+    }
+
+    return LXB_STATUS_OK;
+}
+
+/* Each conflict is one serialized line, the lines go in the same order. */
+static lxb_status_t
+check_conflicts(helper_t *helper, lxb_grammar_tree_t *tree,
+                unit_kv_value_t *conflicts)
+{
+    size_t i, offset;
+    lxb_status_t status;
+    lexbor_str_t *str;
+    unit_kv_array_t *list;
+    lxb_grammar_ambiguity_t *amb;
+    image_t text = {0};
+
+    list = unit_kv_array(conflicts);
+
+    amb = lxb_grammar_ambiguity_create();
+    status = lxb_grammar_ambiguity_init(amb, tree);
+    if (status != LXB_STATUS_OK) {
+        TEST_PRINTLN("Failed to find conflicts");
+        goto done;
+    }
+
+    status = lxb_grammar_ambiguity_serialize(amb, image_cb, &text);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    offset = 0;
+
+    for (i = 0; i < list->length; i++) {
+        if (unit_kv_is_string(list->list[i]) == false) {
+            TEST_PRINTLN("Conflict must be a STRING");
+
+            status = print_error(helper, list->list[i]);
+            goto done;
+        }
+
+        str = unit_kv_string(list->list[i]);
+
+        if (text.length - offset <= str->length
+            || memcmp(&text.data[offset], str->data, str->length) != 0
+            || text.data[offset + str->length] != '\n')
+        {
+            break;
+        }
+
+        offset += str->length + 1;
+    }
+
+    if (i != list->length || offset != text.length) {
+        TEST_PRINTLN("Conflicts differ, got:\n%.*s", (int) text.length,
+                     (text.data != NULL) ? (const char *) text.data : "");
+
+        status = print_error(helper, conflicts);
+    }
+
+done:
+
+    lexbor_free(text.data);
+    lxb_grammar_ambiguity_destroy(amb, true);
+
+    return status;
+}
+
+/*
+ * The frozen grammar outlives the document, the tree and the bytecode
+ * and must match like the bytecode of the same grammar compiled again.
+ */
+static lxb_status_t
+check_frozen(helper_t *helper, unit_kv_value_t *entry)
+{
+    lxb_status_t status;
+    lxb_grammar_vm_t *vm, *frozen_vm;
+    lxb_grammar_frozen_t *frozen;
+    grammar_t grammar = {0};
+    const char *data;
+    unit_kv_value_t *source, *name, *valid, *invalid;
+
+    /* Checked by check_entry(). */
+    if (unit_kv_hash_value_nolen_c(entry, "error") != NULL) {
+        return LXB_STATUS_OK;
+    }
+
+    source = unit_kv_hash_value_nolen_c(entry, "grammar");
+    name = unit_kv_hash_value_nolen_c(entry, "declaration");
+    valid = unit_kv_hash_value_nolen_c(entry, "valid");
+    invalid = unit_kv_hash_value_nolen_c(entry, "invalid");
+
+    data = (const char *) unit_kv_string(source)->data;
+
+    status = grammar_make(&grammar, data);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    frozen = lxb_grammar_frozen_create();
+    status = lxb_grammar_frozen_init(frozen, grammar.bc);
+
+    grammar_destroy(&grammar);
+
+    if (status != LXB_STATUS_OK) {
+        TEST_PRINTLN("Failed to freeze grammar");
+        goto failed_frozen;
+    }
+
+    status = grammar_make(&grammar, data);
+    if (status != LXB_STATUS_OK) {
+        goto failed_frozen;
+    }
+
+    vm = lxb_grammar_vm_create();
+    status = lxb_grammar_vm_init(vm, grammar.bc);
+    if (status != LXB_STATUS_OK) {
+        goto failed_vm;
+    }
+
+    frozen_vm = lxb_grammar_vm_create();
+    status = lxb_grammar_vm_init(frozen_vm,
+                                 lxb_grammar_frozen_bytecode(frozen));
+    if (status != LXB_STATUS_OK) {
+        goto destroy;
+    }
+
+    if (valid != NULL) {
+        status = check_frozen_values(helper, vm, frozen_vm,
+                                     unit_kv_string(name), valid);
+        if (status != LXB_STATUS_OK) {
+            goto destroy;
+        }
+    }
+
+    if (invalid != NULL) {
+        status = check_frozen_values(helper, vm, frozen_vm,
+                                     unit_kv_string(name), invalid);
+    }
+
+destroy:
+
+    lxb_grammar_vm_destroy(frozen_vm, true);
+
+failed_vm:
+
+    lxb_grammar_vm_destroy(vm, true);
+
+failed_frozen:
+
+    lxb_grammar_frozen_destroy(frozen, true);
+
+failed:
+
+    grammar_destroy(&grammar);
+
+    return status;
+}
+
+static lxb_status_t
+check_frozen_values(helper_t *helper, lxb_grammar_vm_t *vm,
+                    lxb_grammar_vm_t *frozen_vm, const lexbor_str_t *name,
+                    unit_kv_value_t *values)
+{
+    lxb_status_t status;
+    lexbor_str_t *str;
+    unit_kv_array_t *list;
+    lxb_grammar_match_result_t result, frozen_result;
+
+    list = unit_kv_array(values);
+
+    for (size_t i = 0; i < list->length; i++) {
+        str = unit_kv_string(list->list[i]);
+
+        status = lxb_grammar_vm_match(vm, name->data, name->length,
+                                      str->data, str->length, &result);
+        if (status != LXB_STATUS_OK) {
+            return print_error(helper, list->list[i]);
+        }
+
+        /* Spans of the frozen grammar have no nodes, only ids. */
+        status = lxb_grammar_vm_match(frozen_vm, name->data, name->length,
+                                      str->data, str->length, &frozen_result);
+        if (status != LXB_STATUS_OK
+            || !check_spans(&result, &frozen_result, false))
+        {
+            TEST_PRINTLN("Frozen result differs for value: %s",
+                         (const char *) str->data);
+
+            return print_error(helper, list->list[i]);
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+/*
+ * Every memoized declaration and group is matched once at a position:
+ * an ambiguous repetition does not grow exponentially and a left recursion
+ * ends.
+ */
+static lxb_status_t
+memo(void)
+{
+    lxb_status_t status;
+    lxb_grammar_match_t *match;
+    grammar_t grammar = {0};
+
+    static const char *ambiguous[] = {
+        "<test> = <a>* z\n"
+        "<a> = x | x x",
+
+        /* The same choice in place, without a declaration. */
+        "<test> = [ x | x x ]* z"
+    };
+
+    TEST_PRINTLN("Memo");
+
+    for (size_t i = 0; i < sizeof(ambiguous) / sizeof(char *); i++) {
+        status = memo_ambiguous(ambiguous[i]);
+        if (status != LXB_STATUS_OK) {
+            TEST_PRINTLN("Memo: %s", ambiguous[i]);
+            return status;
+        }
+    }
+
+    /* Left recursion gives nothing new at the same position. */
+    status = grammar_make(&grammar, "<test> = <a>\n"
+                                    "<a> = <a> x | y");
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    match = lxb_grammar_match_create();
+    status = lxb_grammar_match_init(match, grammar.tree);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    /* Without the memo only the depth limit stops it. */
+    status = memo_match(match, "y", LXB_STATUS_ERROR_OVERFLOW, false);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    match->memo = true;
+
+    status = memo_match(match, "y", LXB_STATUS_OK, true);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    status = memo_match(match, "x", LXB_STATUS_OK, false);
+
+failed:
+
+    lxb_grammar_match_destroy(match, true);
+    grammar_destroy(&grammar);
+
+    return status;
+}
+
+/*
+ * 64 tokens of "x" are split in about 2^43 ways.  Without the memo
+ * the time grows about 7 times for every 4 tokens more.
+ */
+static lxb_status_t
+memo_ambiguous(const char *source)
+{
+    size_t count;
+    clock_t begin;
+    lxb_status_t status;
+    lxb_grammar_match_t *match;
+    grammar_t grammar = {0};
+    lexbor_str_t value = {0};
+    lexbor_mraw_t *mraw;
+
+    static const char x[] = "x ";
+
+    status = grammar_make(&grammar, source);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    mraw = grammar.document->mraw;
+
+    match = lxb_grammar_match_create();
+    status = lxb_grammar_match_init(match, grammar.tree);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    match->memo = true;
+
+    if (match->memo_count == 0) {
+        TEST_PRINTLN("Ambiguous grammar is not memoized");
+        status = LXB_STATUS_ERROR;
+        goto failed;
+    }
+
+    count = 64;
+
+    if (lexbor_str_init(&value, mraw, sizeof(x) * count) == NULL) {
+        status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        goto failed;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (lexbor_str_append(&value, mraw, (const lxb_char_t *) x,
+                              sizeof(x) - 1) == NULL)
+        {
+            status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+            goto failed;
+        }
+    }
+
+    begin = clock();
+
+    status = memo_match(match, (const char *) value.data,
+                        LXB_STATUS_OK, false);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    /* Linear in the tokens, far below a second even with sanitizers. */
+    if (clock() - begin > CLOCKS_PER_SEC) {
+        TEST_PRINTLN("Memo: the match is too slow");
+        status = LXB_STATUS_ERROR;
+        goto failed;
+    }
+
+    /* Two ends at most at every position. */
+    if (match->memo_ends.length > 2 * (count + 1)) {
+        TEST_PRINTLN("Too many memo ends: "LEXBOR_FORMAT_Z,
+                     match->memo_ends.length);
+        status = LXB_STATUS_ERROR;
+        goto failed;
+    }
+
+    if (lexbor_str_append(&value, mraw, (const lxb_char_t *) "z", 1) == NULL) {
+        status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        goto failed;
+    }
+
+    status = memo_match(match, (const char *) value.data, LXB_STATUS_OK, true);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+failed:
+
+    lxb_grammar_match_destroy(match, true);
+    grammar_destroy(&grammar);
+
+    return status;
+}
+
+static lxb_status_t
+memo_match(lxb_grammar_match_t *match, const char *data,
+           lxb_status_t need_status, bool need)
+{
+    lxb_status_t status;
+    lxb_grammar_match_result_t result;
+
+    status = lxb_grammar_match(match, (const lxb_char_t *) "test", 4,
+                               (const lxb_char_t *) data, strlen(data),
+                               &result);
+    if (status != need_status
+        || (status == LXB_STATUS_OK && result.accepted != need))
+    {
+        TEST_PRINTLN("Memo: value must be %s: %s",
+                     (need) ? "accepted" : "rejected", data);
+
+        return LXB_STATUS_ERROR;
+    }
+
+    return LXB_STATUS_OK;
+}
+
+/* A returned frame is dropped unless a backtrack point refers to it. */
+static lxb_status_t
+frames(void)
+{
+    lxb_status_t status;
+    lxb_grammar_vm_t *vm;
+    lxb_grammar_match_result_t result;
+    grammar_t grammar = {0};
+    lexbor_str_t value = {0};
+    lexbor_mraw_t *mraw;
+
+    static const char pair[] = "a 1, ";
+
+    TEST_PRINTLN("Frames");
+
+    status = grammar_make(&grammar, "<test> = <pair>#\n"
+                                    "<pair> = <ident> <number>");
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    mraw = grammar.document->mraw;
+
+    if (lexbor_str_init(&value, mraw, 4096) == NULL) {
+        status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        goto failed;
+    }
+
+    for (size_t i = 0; i < 512; i++) {
+        if (lexbor_str_append(&value, mraw, (const lxb_char_t *) pair,
+                              sizeof(pair) - 1) == NULL)
+        {
+            status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+            goto failed;
+        }
+    }
+
+    /* Without the last ", ". */
+    value.length -= 2;
+
+    vm = lxb_grammar_vm_create();
+    status = lxb_grammar_vm_init(vm, grammar.bc);
+    if (status != LXB_STATUS_OK) {
+        goto failed_vm;
+    }
+
+    status = lxb_grammar_vm_match(vm, (const lxb_char_t *) "test", 4,
+                                  value.data, value.length, &result);
+    if (status != LXB_STATUS_OK) {
+        goto failed_vm;
+    }
+
+    /* The entry and <test>, all <pair> frames are gone. */
+    if (!result.accepted || vm->frames.length > 2) {
+        TEST_PRINTLN("Frames are not dropped: "LEXBOR_FORMAT_Z,
+                     vm->frames.length);
+        status = LXB_STATUS_ERROR;
+    }
+
+failed_vm:
+
+    lxb_grammar_vm_destroy(vm, true);
+
+failed:
+
+    grammar_destroy(&grammar);
+
+    return status;
+}
+
+/*
+ * The index of declarations and the bounds are freed by the compiler, the
+ * peak keeps them above the total of the arenas.
+ */
+static lxb_status_t
+peak(void)
+{
+    size_t held;
+    lxb_status_t status;
+    grammar_t grammar = {0};
+    lxb_grammar_memory_t memory;
+
+    TEST_PRINTLN("Peak");
+
+    status = grammar_make(&grammar, "<test> = <pair>#\n"
+                                    "<pair> = <ident> <number>");
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    lxb_grammar_memory_count(&memory, grammar.document, grammar.tree,
+                             grammar.bc);
+
+    held = grammar.tree->nodes->length * (sizeof(uint32_t)
+                                          + sizeof(size_t) * 2);
+
+    if (memory.peak < memory.total + held
+        || grammar.document->memory_held != 0)
+    {
+        TEST_PRINTLN("Peak without held blocks: "LEXBOR_FORMAT_Z
+                     " of "LEXBOR_FORMAT_Z, memory.peak, memory.total);
+        status = LXB_STATUS_ERROR;
+    }
+
+    grammar_destroy(&grammar);
+
+    return status;
+}
+
+/*
+ * Every fed token goes on with the run of the previous ones: a long value
+ * takes the time of one match, not of a match per token.
+ */
+static lxb_status_t
+stream_long(void)
+{
+    bool viable;
+    long decl;
+    clock_t begin;
+    lxb_status_t status;
+    lxb_grammar_vm_t *vm;
+    lxb_grammar_match_result_t result;
+    lexbor_array_obj_t tokens = {0};
+    grammar_t grammar = {0};
+    lexbor_str_t value = {0};
+    lexbor_mraw_t *mraw;
+
+    static const char item[] = "1, ";
+
+    TEST_PRINTLN("Stream of a long value");
+
+    status = grammar_make(&grammar, "<test> = <integer>#");
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    mraw = grammar.document->mraw;
+
+    vm = lxb_grammar_vm_create();
+    status = lxb_grammar_vm_init(vm, grammar.bc);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    if (lexbor_str_init(&value, mraw, 4096) == NULL) {
+        status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        goto failed;
+    }
+
+    for (size_t i = 0; i < 20000; i++) {
+        if (lexbor_str_append(&value, mraw, (const lxb_char_t *) item,
+                              sizeof(item) - 1) == NULL)
+        {
+            status = LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+            goto failed;
+        }
+    }
+
+    /* Without the last ", ". */
+    value.length -= 2;
+
+    status = lexbor_array_obj_init(&tokens, 4096,
+                                   sizeof(lxb_grammar_value_token_t));
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    status = lxb_grammar_value_tokenize(&tokens, value.data, value.length);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    begin = clock();
+
+    decl = lxb_grammar_bytecode_declaration(grammar.bc,
+                                            (const lxb_char_t *) "test", 4);
+
+    status = lxb_grammar_vm_begin(vm, (size_t) decl);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    for (size_t i = 0; i < tokens.length; i++) {
+        status = lxb_grammar_vm_feed(vm, lexbor_array_obj_get(&tokens, i),
+                                     &viable);
+        if (status != LXB_STATUS_OK) {
+            goto failed;
+        }
+
+        if (!viable) {
+            TEST_PRINTLN("Stream: rejected at token "LEXBOR_FORMAT_Z, i);
+            status = LXB_STATUS_ERROR;
+            goto failed;
+        }
+    }
+
+    status = lxb_grammar_vm_finish(vm, &result);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    if (!result.accepted) {
+        TEST_PRINTLN("Stream: the value is rejected");
+        status = LXB_STATUS_ERROR;
+        goto failed;
+    }
+
+    /* Restarted for every token, it takes minutes. */
+    if (clock() - begin > CLOCKS_PER_SEC) {
+        TEST_PRINTLN("Stream: the feeds are too slow");
+        status = LXB_STATUS_ERROR;
+    }
+
+failed:
+
+    lexbor_array_obj_destroy(&tokens, false);
+    lxb_grammar_vm_destroy(vm, true);
+    grammar_destroy(&grammar);
+
+    return status;
+}
+
+/* Images with broken declarations must be refused, not executed. */
+static lxb_status_t
+tampered(void)
+{
+    uint32_t code, value;
+    lxb_status_t status;
+    image_t image = {0};
+    grammar_t grammar = {0};
+    const lxb_grammar_artifact_header_t *hdr;
+
+    static const lxb_status_t bad = LXB_STATUS_ERROR_UNEXPECTED_DATA;
+
+    /* Out of range entry and body, not contiguous code, huge registers. */
+    static const tampered_t cases[] = {
+        {1, tampered_field(entry), 16, true},
+        {1, tampered_field(entry), UINT32_MAX, false},
+        {0, tampered_field(entry), 1, false},
+        {0, tampered_field(body), 1, true},
+        {0, tampered_field(body), 0, false},
+        {1, tampered_field(body), 0, true},
+        {0, tampered_field(registers), UINT32_MAX, false},
+        {1, tampered_field(registers), UINT16_MAX + 2, false},
+        {0, tampered_field(entry_registers), UINT32_MAX, false}
+    };
+
+    TEST_PRINTLN("Tampered artifact");
+
+    status = grammar_make(&grammar, "<test> = <item>+ | auto\n"
+                                    "<item> = a | <length>{1,2}");
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    status = lxb_grammar_artifact_serialize(grammar.bc, image_cb, &image);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    hdr = (const lxb_grammar_artifact_header_t *) image.data;
+    code = (uint32_t) hdr->sections[LXB_GRAMMAR_ARTIFACT_SECTION_CODE].count;
+
+    /* The image itself is fine. */
+    status = tampered_load(&image, 0, tampered_field(entry), 0,
+                           LXB_STATUS_OK);
+    if (status != LXB_STATUS_OK) {
+        goto done;
+    }
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        value = cases[i].value;
+
+        if (cases[i].after_code) {
+            value += code;
+        }
+
+        status = tampered_load(&image, cases[i].decl, cases[i].field,
+                               value, bad);
+        if (status != LXB_STATUS_OK) {
+            TEST_PRINTLN("Tampered image #"LEXBOR_FORMAT_Z" is loaded", i + 1);
+            goto done;
+        }
+    }
+
+done:
+
+    lexbor_free(image.data);
+    grammar_destroy(&grammar);
+
+    return status;
+}
+
+static lxb_status_t
+tampered_load(const image_t *image, size_t decl_idx, size_t field,
+              uint32_t value, lxb_status_t need)
+{
+    lxb_status_t status;
+    lxb_char_t *data;
+    uint32_t *decl;
+    lxb_grammar_bytecode_t *bc;
+    const lxb_grammar_artifact_header_t *hdr;
+    const lxb_grammar_artifact_section_t *section;
+
+    data = lexbor_malloc(image->length);
+    if (data == NULL) {
+        return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+    }
+
+    memcpy(data, image->data, image->length);
+
+    hdr = (const lxb_grammar_artifact_header_t *) data;
+    section = &hdr->sections[LXB_GRAMMAR_ARTIFACT_SECTION_DECLS];
+
+    decl = (uint32_t *) (data + section->offset
+                         + decl_idx * sizeof(lxb_grammar_bytecode_decl_t));
+
+    if (need != LXB_STATUS_OK) {
+        decl[field] = value;
+    }
+
+    bc = lxb_grammar_bytecode_create();
+    status = lxb_grammar_artifact_load(bc, data, image->length,
+                                       LXB_GRAMMAR_ARTIFACT_OPT_NO_CHECKSUM);
+
+    lxb_grammar_bytecode_destroy(bc, true);
+    lexbor_free(data);
+
+    return (status == need) ? LXB_STATUS_OK : LXB_STATUS_ERROR;
+}
+
+static lxb_status_t
+grammar_make(grammar_t *grammar, const char *data)
+{
+    lxb_status_t status;
+    lxb_grammar_node_t *root;
+    lxb_grammar_parser_t *parser;
+    lxb_grammar_tokenizer_t *tkz;
+
+    tkz = lxb_grammar_tokenizer_create();
+    status = lxb_grammar_tokenizer_init(tkz);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    parser = lxb_grammar_parser_create();
+    status = lxb_grammar_parser_init(parser);
+    if (status != LXB_STATUS_OK) {
+        goto failed_parser;
+    }
+
+    grammar->document = lxb_grammar_tokenizer_process(tkz,
+                                                      (const lxb_char_t *) data,
+                                                      strlen(data));
+    if (grammar->document == NULL) {
+        status = LXB_STATUS_ERROR;
+        goto failed_parser;
+    }
+
+    root = lxb_grammar_parser_process(parser, grammar->document);
+    if (root == NULL) {
+        lxb_grammar_parser_print_last_error(parser);
+
+        status = LXB_STATUS_ERROR;
+        goto failed_parser;
+    }
+
+    grammar->tree = lxb_grammar_tree_create();
+    status = lxb_grammar_tree_init(grammar->tree, grammar->document);
+    if (status != LXB_STATUS_OK) {
+        goto failed_parser;
+    }
+
+    status = lxb_grammar_tree_make(grammar->tree, root);
+    if (status != LXB_STATUS_OK) {
+        TEST_PRINTLN("Failed to make tree: %s", grammar->tree->last_error);
+        goto failed_parser;
+    }
+
+    grammar->bc = lxb_grammar_bytecode_create();
+    status = lxb_grammar_bytecode_init(grammar->bc);
+    if (status != LXB_STATUS_OK) {
+        goto failed_parser;
+    }
+
+    status = lxb_grammar_bytecode_make(grammar->bc, grammar->tree);
+    if (status != LXB_STATUS_OK) {
+        TEST_PRINTLN("Failed to make bytecode: %s", grammar->bc->last_error);
+    }
+
+failed_parser:
+
+    lxb_grammar_parser_destroy(parser, true);
+
+failed:
+
+    lxb_grammar_tokenizer_destroy(tkz, true);
+
+    if (status != LXB_STATUS_OK) {
+        grammar_destroy(grammar);
+    }
+
+    return status;
+}
+
+static void
+grammar_destroy(grammar_t *grammar)
+{
+    grammar->bc = lxb_grammar_bytecode_destroy(grammar->bc, true);
+    grammar->tree = lxb_grammar_tree_destroy(grammar->tree, true);
+
+    if (grammar->document != NULL) {
+        lxb_grammar_document_destroy(grammar->document);
+        grammar->document = NULL;
+    }
+}
+
+static lxb_status_t
+image_cb(const lxb_char_t *data, size_t len, void *ctx)
+{
+    lxb_char_t *tmp;
+    image_t *image = ctx;
+
+    if (image->length + len > image->size) {
+        image->size = (image->length + len) * 2;
+
+        tmp = lexbor_realloc(image->data, image->size);
+        if (tmp == NULL) {
+            return LXB_STATUS_ERROR_MEMORY_ALLOCATION;
+        }
+
+        image->data = tmp;
+    }
+
+    memcpy(image->data + image->length, data, len);
+    image->length += len;
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+print_error(helper_t *helper, unit_kv_value_t *value)
+{
+    lexbor_str_t str;
+
+    str = unit_kv_value_position_as_string(helper->kv, value);
+    TEST_PRINTLN("%s", str.data);
+    unit_kv_string_destroy(helper->kv, &str, false);
+
+    str = unit_kv_value_fragment_as_string(helper->kv, value);
+    TEST_PRINTLN("%s", str.data);
+    unit_kv_string_destroy(helper->kv, &str, false);
+
+    return LXB_STATUS_ERROR;
+}
@@ -13,15 +13,27 @@
 #include <lexbor/grammar/tokenizer.h>
 #include <lexbor/grammar/token.h>
 #include <lexbor/grammar/parser.h>
+#include <lexbor/grammar/snapshot.h>
+#include <lexbor/grammar/memory.h>
+#include <lexbor/grammar/synth.h>
+#include <lexbor/grammar/stats.h>
 
 
 typedef struct {
     unit_kv_t                  *kv;
     lexbor_str_t               str;
+    lexbor_str_t               snapshot;
     lexbor_mraw_t              *mraw;
 }
 helper_t;
 
+typedef struct {
+    int64_t                    start;
+    int64_t                    stop;
+    lxb_status_t               status;
+}
+multiplier_t;
+
 
 static lxb_status_t
 parse(helper_t *helper, const char *dir_path);
@@ -37,9 +49,27 @@ static lxb_status_t
 check_entry(helper_t *helper, unit_kv_value_t *entry,
             lxb_grammar_tokenizer_t *tkz, lxb_grammar_parser_t *parser);
 
+static lxb_status_t
+check_stats(const lxb_grammar_stats_t *stats, size_t count);
+
+static lxb_status_t
+synth(helper_t *helper);
+
+static lxb_status_t
+multipliers(helper_t *helper);
+
+static lxb_status_t
+allocators(void);
+
+static lxb_status_t
+allocators_parse(bool tokens, bool first, bool second);
+
 static lxb_status_t
 serializer_callback(const lxb_char_t *data, size_t len, void *ctx);
 
+static lxb_status_t
+snapshot_callback(const lxb_char_t *data, size_t len, void *ctx);
+
 static lxb_status_t
 print_error(helper_t *helper, unit_kv_value_t *value);
 
@@ -77,11 +107,30 @@ main(int argc, const char * argv[])
         goto done;
     }
 
+    if(lexbor_str_init(&helper.snapshot, helper.mraw, 4096) == NULL) {
+        goto done;
+    }
+
     status = parse(&helper, dir_path);
     if (status != LXB_STATUS_OK) {
         return EXIT_FAILURE;
     }
 
+    status = synth(&helper);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    status = multipliers(&helper);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    status = allocators();
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
     TEST_RUN("lexbor/css/grammar/parser");
     TEST_RELEASE();
 
@@ -139,13 +188,13 @@ file_callback(const lxb_char_t *fullpath, size_t fullpath_len,
 
         unit_kv_string_destroy(helper->kv, &str, false);
 
-        return EXIT_FAILURE;
+        exit(EXIT_FAILURE);
     }
 
     value = unit_kv_value(helper->kv);
     if (value == NULL) {
         TEST_PRINTLN("Failed to get root value");
-        return EXIT_FAILURE;
+        exit(EXIT_FAILURE);
     }
 
     TEST_PRINTLN("Check file: %s", fullpath);
@@ -163,6 +212,7 @@ check(helper_t *helper, unit_kv_value_t *value)
 {
     lxb_status_t status;
     unit_kv_array_t *entries;
+    lxb_grammar_stats_t stats;
     lxb_grammar_parser_t *parser;
     lxb_grammar_tokenizer_t *tkz;
 
@@ -186,6 +236,11 @@ check(helper_t *helper, unit_kv_value_t *value)
         goto failed;
     }
 
+    lxb_grammar_stats_clean(&stats);
+
+    tkz->stats = &stats;
+    parser->stats = &stats;
+
     for (size_t i = 0; i < entries->length; i++) {
         if (unit_kv_is_hash(entries->list[i]) == false) {
             return print_error(helper, entries->list[i]);
@@ -201,6 +256,11 @@ check(helper_t *helper, unit_kv_value_t *value)
         lxb_grammar_tokenizer_clean(tkz);
     }
 
+    status = check_stats(&stats, entries->length);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
     lxb_grammar_tokenizer_destroy(tkz, true);
     lxb_grammar_parser_destroy(parser, true);
 
@@ -214,14 +274,49 @@ failed:
     return LXB_STATUS_ERROR;
 }
 
+/* All zero without LXB_GRAMMAR_STATS, an end of file per entry with it. */
+static lxb_status_t
+check_stats(const lxb_grammar_stats_t *stats, size_t count)
+{
+    lxb_grammar_stats_t zero;
+
+    if (lxb_grammar_stats_enabled() == false) {
+        memset(&zero, 0, sizeof(lxb_grammar_stats_t));
+
+        if (memcmp(stats, &zero, sizeof(lxb_grammar_stats_t)) != 0) {
+            TEST_PRINTLN("Stats are counted without LXB_GRAMMAR_STATS");
+
+            return LXB_STATUS_ERROR;
+        }
+
+        return LXB_STATUS_OK;
+    }
+
+    if (stats->tokens[LXB_GRAMMAR_TOKEN_END_OF_FILE] != count
+        || stats->bytes == 0 || stats->nodes == 0)
+    {
+        TEST_PRINTLN("Wrong stats");
+
+        return LXB_STATUS_ERROR;
+    }
+
+    return LXB_STATUS_OK;
+}
+
 static lxb_status_t
 check_entry(helper_t *helper, unit_kv_value_t *entry,
             lxb_grammar_tokenizer_t *tkz, lxb_grammar_parser_t *parser)
 {
+    bool same;
+    size_t length;
+    lxb_char_t *exact;
+    lxb_status_t status;
     lxb_grammar_document_t *document;
     lexbor_str_t *str_data, *str_result;
+    lexbor_str_t str = {0};
     unit_kv_value_t *data, *result;
-    lxb_grammar_node_t *root;
+    lxb_grammar_node_t *root, *loaded;
+    lxb_grammar_memory_t memory;
 
     /* Validate */
     data = unit_kv_hash_value_nolen_c(entry, "data");
@@ -268,12 +363,68 @@ check_entry(helper_t *helper, unit_kv_value_t *entry,
         return LXB_STATUS_ERROR;
     }
 
+    /* Memory: the parts are in the total, the peak is not below it. */
+    lxb_grammar_memory_count(&memory, document, NULL, NULL);
+
+    if (memory.nodes == 0 || memory.tables != 0
+        || memory.total != memory.tokens + memory.nodes + memory.strings
+                           + memory.tree
+        || memory.peak < memory.total)
+    {
+        TEST_PRINTLN("Wrong memory accounting");
+        lxb_grammar_document_destroy(document);
+
+        return print_error(helper, entry);
+    }
+
     lexbor_str_clean(&helper->str);
 
     lxb_grammar_node_serialize_deep(root, serializer_callback, helper);
 
+    /* Straight to the string: the same text. */
+    status = lxb_grammar_node_serialize_deep_str(root, &str, helper->mraw);
+
+    same = status == LXB_STATUS_OK && str.length == helper->str.length
+           && lexbor_str_data_ncmp(str.data, helper->str.data, str.length);
+
+    lexbor_str_destroy(&str, helper->mraw, false);
+
+    /* Exact size: the length, then the data. */
+    exact = lxb_grammar_node_serialize_deep_dup(root, &length);
+
+    same = same && exact != NULL && length == helper->str.length
+           && lexbor_str_data_ncmp(exact, helper->str.data, length);
+
+    lexbor_free(exact);
+
+    /* Snapshot: the loaded tree is serialized to the same text. */
+    status = lxb_grammar_snapshot_serialize(root, snapshot_callback, helper);
+    if (status == LXB_STATUS_OK) {
+        status = lxb_grammar_snapshot_load(helper->snapshot.data,
+                                           helper->snapshot.length, &loaded);
+    }
+
+    lexbor_str_clean(&helper->snapshot);
+
+    exact = NULL;
+
+    if (status == LXB_STATUS_OK) {
+        exact = lxb_grammar_node_serialize_deep_dup(loaded, &length);
+        lxb_grammar_document_destroy(loaded->document);
+    }
+
+    same = same && exact != NULL && length == helper->str.length
+           && lexbor_str_data_ncmp(exact, helper->str.data, length);
+
+    lexbor_free(exact);
     lxb_grammar_document_destroy(document);
 
+    if (!same) {
+        TEST_PRINTLN("Serialization to the string differs");
+
+        return print_error(helper, result);
+    }
+
     if (str_result->length != helper->str.length
         || lexbor_str_data_ncmp(str_result->data, helper->str.data,
                                 str_result->length) == false)
@@ -288,6 +439,294 @@ check_entry(helper_t *helper, unit_kv_value_t *entry,
     return LXB_STATUS_OK;
 }
 
+/* Generated grammars: the same text for the same seed, all are parsed. */
+static lxb_status_t
+synth(helper_t *helper)
+{
+    lxb_status_t status;
+    lxb_grammar_node_t *root;
+    lxb_grammar_synth_t settings;
+    lxb_grammar_parser_t *parser;
+    lxb_grammar_tokenizer_t *tkz;
+    lxb_grammar_document_t *document;
+
+    tkz = lxb_grammar_tokenizer_create();
+    status = lxb_grammar_tokenizer_init(tkz);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    parser = lxb_grammar_parser_create();
+    status = lxb_grammar_parser_init(parser);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    lxb_grammar_synth_init(&settings);
+
+    settings.declarations = 32;
+
+    for (settings.seed = 1; settings.seed <= 16; settings.seed++) {
+        TEST_PRINTLN("Generated grammar #"LEXBOR_FORMAT_Z,
+                     (size_t) settings.seed);
+
+        lexbor_str_clean(&helper->str);
+        lexbor_str_clean(&helper->snapshot);
+
+        status = lxb_grammar_synth_serialize(&settings, serializer_callback,
+                                             helper);
+        if (status == LXB_STATUS_OK) {
+            status = lxb_grammar_synth_serialize(&settings, snapshot_callback,
+                                                 helper);
+        }
+
+        if (status != LXB_STATUS_OK) {
+            goto failed;
+        }
+
+        if (helper->str.length != helper->snapshot.length
+            || lexbor_str_data_ncmp(helper->str.data, helper->snapshot.data,
+                                    helper->str.length) == false)
+        {
+            TEST_PRINTLN("Generated grammar differs for the same seed");
+
+            goto failed;
+        }
+
+        document = lxb_grammar_tokenizer_process(tkz, helper->str.data,
+                                                 helper->str.length);
+        if (document == NULL) {
+            goto failed;
+        }
+
+        root = lxb_grammar_parser_process(parser, document);
+        if (root == NULL) {
+            lxb_grammar_parser_print_last_error(parser);
+            TEST_PRINTLN("%s", (const char *) helper->str.data);
+
+            lxb_grammar_document_destroy(document);
+
+            goto failed;
+        }
+
+        lxb_grammar_document_destroy(document);
+        lxb_grammar_tokenizer_clean(tkz);
+    }
+
+    lxb_grammar_tokenizer_destroy(tkz, true);
+    lxb_grammar_parser_destroy(parser, true);
+
+    return LXB_STATUS_OK;
+
+failed:
+
+    lxb_grammar_tokenizer_destroy(tkz, true);
+    lxb_grammar_parser_destroy(parser, true);
+
+    return LXB_STATUS_ERROR;
+}
+
+/* A snapshot with a multiplier the parser can not give is refused. */
+static lxb_status_t
+multipliers(helper_t *helper)
+{
+    lxb_status_t status;
+    lxb_char_t *data;
+    lxb_grammar_node_t *root, *loaded;
+    lxb_grammar_parser_t *parser;
+    lxb_grammar_tokenizer_t *tkz;
+    lxb_grammar_document_t *document;
+    lxb_grammar_snapshot_node_t *rec;
+
+    static const char grammar[] = "<test> = a{1,2} b";
+
+    static const multiplier_t list[] = {
+        {0, 0, LXB_STATUS_OK},
+        {1, 0, LXB_STATUS_OK},
+        {3, -1, LXB_STATUS_OK},
+        {-1, 0, LXB_STATUS_OK},
+        {2, 1, LXB_STATUS_ERROR_UNEXPECTED_DATA},
+        {5, 0, LXB_STATUS_ERROR_UNEXPECTED_DATA},
+        {0, -2, LXB_STATUS_ERROR_UNEXPECTED_DATA},
+        {-1, 3, LXB_STATUS_ERROR_UNEXPECTED_DATA},
+        {-2, 0, LXB_STATUS_ERROR_UNEXPECTED_DATA},
+        {1, INT64_MAX, LXB_STATUS_ERROR_UNEXPECTED_DATA},
+        {INT64_MAX, -1, LXB_STATUS_ERROR_UNEXPECTED_DATA}
+    };
+
+    TEST_PRINTLN("Snapshot multipliers");
+
+    tkz = lxb_grammar_tokenizer_create();
+    status = lxb_grammar_tokenizer_init(tkz);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    document = lxb_grammar_tokenizer_process(tkz, (const lxb_char_t *) grammar,
+                                             sizeof(grammar) - 1);
+
+    lxb_grammar_tokenizer_destroy(tkz, true);
+
+    if (document == NULL) {
+        return LXB_STATUS_ERROR;
+    }
+
+    parser = lxb_grammar_parser_create();
+    status = lxb_grammar_parser_init(parser);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    root = lxb_grammar_parser_process(parser, document);
+    if (root == NULL) {
+        status = LXB_STATUS_ERROR;
+        goto failed;
+    }
+
+    lexbor_str_clean(&helper->snapshot);
+
+    status = lxb_grammar_snapshot_serialize(root, snapshot_callback, helper);
+    if (status != LXB_STATUS_OK) {
+        goto failed;
+    }
+
+    data = helper->snapshot.data;
+
+    /* Pre-order: root, <test>, a. */
+    rec = (lxb_grammar_snapshot_node_t *)
+          (data + sizeof(lxb_grammar_snapshot_header_t)
+           + 2 * sizeof(lxb_grammar_snapshot_node_t));
+
+    for (size_t i = 0; i < sizeof(list) / sizeof(multiplier_t); i++) {
+        rec->start = list[i].start;
+        rec->stop = list[i].stop;
+
+        status = lxb_grammar_snapshot_load(data, helper->snapshot.length,
+                                           &loaded);
+        if (status == LXB_STATUS_OK) {
+            lxb_grammar_document_destroy(loaded->document);
+        }
+
+        if (status != list[i].status) {
+            TEST_PRINTLN("Multiplier {%lld, %lld} must be %s",
+                         (long long) list[i].start, (long long) list[i].stop,
+                         (list[i].status == LXB_STATUS_OK) ? "loaded"
+                                                           : "refused");
+            status = LXB_STATUS_ERROR;
+            goto failed;
+        }
+    }
+
+    status = LXB_STATUS_OK;
+
+failed:
+
+    lxb_grammar_parser_destroy(parser, true);
+    lxb_grammar_document_destroy(document);
+
+    return status;
+}
+
+/* Tokens and nodes of a document stay in the allocator chosen first. */
+static lxb_status_t
+allocators(void)
+{
+    lxb_status_t status;
+
+    TEST_PRINTLN("Allocators");
+
+    for (size_t i = 0; i < 8; i++) {
+        status = allocators_parse((i & 4) != 0, (i & 2) != 0, (i & 1) != 0);
+        if (status != LXB_STATUS_OK) {
+            TEST_PRINTLN("Allocators: tokens slab %d, nodes slab %d then %d",
+                         (i & 4) != 0, (i & 2) != 0, (i & 1) != 0);
+            return status;
+        }
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static lxb_status_t
+allocators_parse(bool tokens, bool first, bool second)
+{
+    lxb_status_t status, need;
+    lxb_grammar_node_t *root;
+    lxb_grammar_parser_t *parser;
+    lxb_grammar_tokenizer_t *tkz;
+    lxb_grammar_document_t *document;
+
+    static const char grammar[] = "<test> = a b | c";
+
+    tkz = lxb_grammar_tokenizer_create();
+    status = lxb_grammar_tokenizer_init(tkz);
+    if (status != LXB_STATUS_OK) {
+        return status;
+    }
+
+    tkz->slab = tokens;
+
+    document = lxb_grammar_tokenizer_process(tkz, (const lxb_char_t *) grammar,
+                                             sizeof(grammar) - 1);
+
+    lxb_grammar_tokenizer_destroy(tkz, true);
+
+    if (document == NULL) {
+        return LXB_STATUS_ERROR;
+    }
+
+    status = LXB_STATUS_ERROR;
+
+    if (tokens) {
+        if (lxb_grammar_document_token_mraw(document)
+            != LXB_STATUS_ERROR_WRONG_STAGE)
+        {
+            goto failed;
+        }
+    }
+    else if (lxb_grammar_document_token_slab(document)
+             != LXB_STATUS_ERROR_WRONG_STAGE)
+    {
+        goto failed;
+    }
+
+    parser = lxb_grammar_parser_create();
+    status = lxb_grammar_parser_init(parser);
+    if (status != LXB_STATUS_OK) {
+        goto failed_parser;
+    }
+
+    parser->slab = first;
+
+    root = lxb_grammar_parser_process(parser, document);
+    if (root == NULL || parser->status != LXB_STATUS_OK) {
+        status = LXB_STATUS_ERROR;
+        goto failed_parser;
+    }
+
+    /* The second parse goes to the same document. */
+    parser->slab = second;
+    need = (first == second) ? LXB_STATUS_OK : LXB_STATUS_ERROR_WRONG_STAGE;
+
+    root = lxb_grammar_parser_process(parser, document);
+    if ((root != NULL) != (need == LXB_STATUS_OK) || parser->status != need) {
+        status = LXB_STATUS_ERROR;
+        goto failed_parser;
+    }
+
+    status = LXB_STATUS_OK;
+
+failed_parser:
+
+    lxb_grammar_parser_destroy(parser, true);
+
+failed:
+
+    lxb_grammar_document_destroy(document);
+
+    return status;
+}
+
 static lxb_status_t
 serializer_callback(const lxb_char_t *data, size_t len, void *ctx)
 {
@@ -300,6 +739,18 @@ serializer_callback(const lxb_char_t *data, size_t len, void *ctx)
     return LXB_STATUS_OK;
 }
 
+static lxb_status_t
+snapshot_callback(const lxb_char_t *data, size_t len, void *ctx)
+{
+    helper_t *helper = ctx;
+
+    if(lexbor_str_append(&helper->snapshot, helper->mraw, data, len) == NULL) {
+        return LXB_STATUS_ERROR;
+    }
+
+    return LXB_STATUS_OK;
+}
+
 static lxb_status_t
 print_error(helper_t *helper, unit_kv_value_t *value)
 {
@@ -138,13 +138,13 @@ file_callback(const lxb_char_t *fullpath, size_t fullpath_len,
 
         unit_kv_string_destroy(helper->kv, &str, false);
 
-        return EXIT_FAILURE;
+        exit(EXIT_FAILURE);
     }
 
     value = unit_kv_value(helper->kv);
     if (value == NULL) {
         TEST_PRINTLN("Failed to get root value");
-        return EXIT_FAILURE;
+        exit(EXIT_FAILURE);
     }
 
     TEST_PRINTLN("Check file: %s", fullpath);
@@ -534,6 +534,14 @@ unit_kv_state_data_body(unit_kv_t *kv,
                 
             /* U+0024 DOLLAR SIGN ($) */
             case 0x24:
+                /*
+                 * Only an empty body ends here, other lines are checked
+                 * for the end in unit_kv_state_data_body_before_end().
+                 */
+                if (data != begin || kv->token->value.str.length != 0) {
+                    break;
+                }
+
                 kv->state = unit_kv_state_data_body_end;
                 
                 return (data + 1);
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+/*
+ * Usage: codegen <grammar file> <prefix> [output file]
+ *
+ * Writes C matchers of all declarations of the grammar, see
+ * lexbor/grammar/codegen.h.  The output must be built with lexbor.
+ */
+
+#include "lexbor/grammar/tokenizer.h"
+#include "lexbor/grammar/parser.h"
+#include "lexbor/grammar/tree.h"
+#include "lexbor/grammar/codegen.h"
+
+#include "lexbor/core/fs.h"
+
+
+static lxb_status_t
+file_callback(const lxb_char_t *data, size_t length, void *ctx)
+{
+    if (fwrite(data, 1, length, ctx) != length) {
+        return LXB_STATUS_ERROR;
+    }
+
+    return LXB_STATUS_OK;
+}
+
+int
+main(int argc, const char * argv[])
+{
+    FILE *fh;
+    size_t size;
+    lxb_char_t *grammar;
+    lxb_status_t status;
+    lxb_grammar_tree_t *tree;
+    lxb_grammar_node_t *root;
+    lxb_grammar_parser_t *parser;
+    lxb_grammar_codegen_t *cg;
+    lxb_grammar_document_t *doc;
+    lxb_grammar_tokenizer_t *tkz;
+
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "Usage: codegen <grammar file> <prefix> "
+                "[output file]\n");
+        return EXIT_FAILURE;
+    }
+
+    grammar = lexbor_fs_file_easy_read((const lxb_char_t *) argv[1], &size);
+    if (grammar == NULL) {
+        fprintf(stderr, "Failed to read file: %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    /* Tokenize and parse. */
+    tkz = lxb_grammar_tokenizer_create();
+    status = lxb_grammar_tokenizer_init(tkz);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    doc = lxb_grammar_tokenizer_process(tkz, grammar, size);
+    if (doc == NULL) {
+        return EXIT_FAILURE;
+    }
+
+    lxb_grammar_tokenizer_destroy(tkz, true);
+
+    parser = lxb_grammar_parser_create();
+    status = lxb_grammar_parser_init(parser);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    root = lxb_grammar_parser_process(parser, doc);
+    if (root == NULL) {
+        lxb_grammar_parser_print_last_error(parser);
+        return EXIT_FAILURE;
+    }
+
+    lxb_grammar_parser_destroy(parser, true);
+
+    tree = lxb_grammar_tree_create();
+    status = lxb_grammar_tree_init(tree, doc);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    status = lxb_grammar_tree_make(tree, root);
+    if (status != LXB_STATUS_OK) {
+        fprintf(stderr, "Failed to make tree: %s\n",
+                (tree->last_error != NULL) ? tree->last_error : "unknown");
+        return EXIT_FAILURE;
+    }
+
+    /* Generate. */
+    cg = lxb_grammar_codegen_create();
+    status = lxb_grammar_codegen_init(cg, tree);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    if (argc == 4) {
+        fh = fopen(argv[3], "wb");
+        if (fh == NULL) {
+            fprintf(stderr, "Failed to open file: %s\n", argv[3]);
+            return EXIT_FAILURE;
+        }
+    }
+    else {
+        fh = stdout;
+    }
+
+    status = lxb_grammar_codegen_serialize(cg, (const lxb_char_t *) argv[2],
+                                           strlen(argv[2]), file_callback, fh);
+    if (status != LXB_STATUS_OK) {
+        fprintf(stderr, "Failed to generate: %s\n",
+                (cg->last_error != NULL) ? cg->last_error : "unknown");
+    }
+
+    if (fh != stdout) {
+        fclose(fh);
+    }
+
+    lxb_grammar_codegen_destroy(cg, true);
+    lxb_grammar_tree_destroy(tree, true);
+    lxb_grammar_document_destroy(doc);
+    lexbor_free(grammar);
+
+    return (status == LXB_STATUS_OK) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
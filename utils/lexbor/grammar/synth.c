@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2020 Alexander Borisov
+ *
+ * Author: Alexander Borisov <borisov@lexbor.com>
+ */
+
+/*
+ * Usage: synth [name=value ...]
+ *
+ * Writes a generated grammar to stdout, see lexbor/grammar/synth.h.
+ * Names: seed, declarations, width, depth, all, any, multiplied,
+ * multipliers, references.  Example:
+ *
+ *     synth seed=7 declarations=1000 depth=6 multipliers="**+{"
+ */
+
+#include "lexbor/grammar/synth.h"
+
+
+static lxb_status_t
+file_callback(const lxb_char_t *data, size_t length, void *ctx)
+{
+    if (fwrite(data, 1, length, ctx) != length) {
+        return LXB_STATUS_ERROR;
+    }
+
+    return LXB_STATUS_OK;
+}
+
+static bool
+setting(lxb_grammar_synth_t *synth, const char *arg)
+{
+    size_t len;
+    unsigned long num;
+    const char *value;
+
+    value = strchr(arg, '=');
+    if (value == NULL) {
+        return false;
+    }
+
+    len = value - arg;
+    value++;
+
+    if (len == 11 && strncmp(arg, "multipliers", len) == 0) {
+        synth->multipliers = value;
+        return true;
+    }
+
+    num = strtoul(value, NULL, 10);
+
+    if (len == 4 && strncmp(arg, "seed", len) == 0) {
+        synth->seed = strtoull(value, NULL, 10);
+    }
+    else if (len == 12 && strncmp(arg, "declarations", len) == 0) {
+        synth->declarations = num;
+    }
+    else if (len == 5 && strncmp(arg, "width", len) == 0) {
+        synth->width = num;
+    }
+    else if (len == 5 && strncmp(arg, "depth", len) == 0) {
+        synth->depth = num;
+    }
+    else if (len == 3 && strncmp(arg, "all", len) == 0) {
+        synth->all_size = num;
+    }
+    else if (len == 3 && strncmp(arg, "any", len) == 0) {
+        synth->any_size = num;
+    }
+    else if (len == 10 && strncmp(arg, "multiplied", len) == 0) {
+        synth->multiplied = (unsigned) num;
+    }
+    else if (len == 10 && strncmp(arg, "references", len) == 0) {
+        synth->references = (unsigned) num;
+    }
+    else {
+        return false;
+    }
+
+    return true;
+}
+
+int
+main(int argc, const char * argv[])
+{
+    lxb_status_t status;
+    lxb_grammar_synth_t synth;
+
+    lxb_grammar_synth_init(&synth);
+
+    for (int i = 1; i < argc; i++) {
+        if (!setting(&synth, argv[i])) {
+            fprintf(stderr, "Usage:\n\tsynth [name=value ...]\n"
+                    "Names: seed, declarations, width, depth, all, any, "
+                    "multiplied, multipliers, references\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    status = lxb_grammar_synth_serialize(&synth, file_callback, stdout);
+    if (status != LXB_STATUS_OK) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}